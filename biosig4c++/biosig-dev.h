@@ -521,6 +521,75 @@ int month_string2int(const char *s);
 
 int u32cmp(const void *a, const void *b); 
 
+size_t reallocEventTable(HDRTYPE *hdr, size_t EventN);
+/*
+	re-allocates the event table of HDR for EVENTN entries, the entries
+	from hdr->EVENT.N on are cleared; hdr->EVENT.N is not changed.
+	returns EVENTN.
+*/
+
+int double2str(char *buf, double val);
+/*
+	converts VAL into a text representation that is read back by
+	strtod as the identical value (round-trip exact), and is usually,
+	but not always, the shortest one. BUF must have room for at least
+	26 characters; the length of the string is returned.
+*/
+
+typedef struct {
+	FILE	*fid;
+	HDRTYPE	*hdr;		// if not NULL, output goes through ifwrite
+	size_t	pos;		// number of bytes in buf
+	size_t	count;		// number of bytes flushed
+	char	buf[0x10000];
+} TEXTBUF_TYPE;
+
+void	textbuf_init(TEXTBUF_TYPE *tb, FILE *fid, HDRTYPE *hdr);
+void	textbuf_puts(TEXTBUF_TYPE *tb, const char *s);
+void	textbuf_putc(TEXTBUF_TYPE *tb, char c);
+void	textbuf_double(TEXTBUF_TYPE *tb, double val);
+size_t	textbuf_flush(TEXTBUF_TYPE *tb);
+/*
+	buffered output of text, used by the text based writers (ATF, ASCII,
+	CSV, JSON). textbuf_flush must be called before FID or HDR is closed,
+	it returns the total number of bytes written.
+*/
+
+double	str2double(const char *s, char **endptr);
+/*
+	fast replacement of strtod for decimal numbers; the result is
+	identical to strtod, uncommon cases are passed to strtod.
+*/
+
+REREF_TYPE* reref_from_triplets(uint32_t nrow, uint32_t ncol, size_t nnz, const uint32_t *row, const uint32_t *col, const double *val);
+void	reref_free(REREF_TYPE *R);
+/*
+	reref_from_triplets returns a re-referencing matrix (see RerefCHANNEL)
+	with the nnz elements (row[k], col[k], val[k]), indices start with 0.
+	Duplicate elements are summed up, zeros are removed. NULL is returned
+	if an index is out of range or not enough memory is available.
+*/
+
+typedef struct {
+	HDRTYPE	*hdr;		// data is read with ifread
+	char	*buf;
+	size_t	size;		// allocated memory
+	size_t	pos;		// start of the next line
+	size_t	len;		// number of bytes in buf
+	char	eof;
+} LINEBUF_TYPE;
+
+void	linebuf_init(LINEBUF_TYPE *lb, HDRTYPE *hdr);
+char*	linebuf_next(LINEBUF_TYPE *lb, size_t *len);
+void	linebuf_free(LINEBUF_TYPE *lb);
+/*
+	reads a text file in chunks from the current position of HDR.
+	linebuf_next returns the next line without the line break (<LF>,
+	<CR><LF> or <CR>), or NULL at the end of the file. The line is
+	terminated by \0, can be modified, and is valid until the next call.
+	On allocation failure, NULL is returned and the error is set in HDR.
+*/
+
 void biosigERROR(HDRTYPE *hdr, enum B4C_ERROR errnum, const char *errmsg);
 /*
 	sets the local and the (deprecated) global error variables B4C_ERRNUM and B4C_ERRMSG
@@ -584,6 +653,26 @@ size_t bpb8_collapsed_rawdata(HDRTYPE *hdr);
 	computes the bits per block when rawdata is collapsed
 --------------------------------------------------------------- */
 
+#ifdef WITH_TRACE
+extern int biosig_trace_on;
+void	biosig_trace_init(void);
+double	biosig_trace_begin(void);
+void	biosig_trace_end(double t0, const char *name, const char *arg, size_t n);
+int	biosig_trace_flush(void);
+#define TRACE_BEGIN(t)		double t = biosig_trace_on ? biosig_trace_begin() : 0.0
+#define TRACE_END(t,name,arg,n)	do { if (biosig_trace_on) biosig_trace_end(t,name,arg,n); } while (0)
+#else
+#define TRACE_BEGIN(t)
+#define TRACE_END(t,name,arg,n)
+#endif
+/* tracing of SOPEN, SREAD, SWRITE and SCLOSE (compile with WITH_TRACE,
+	and set the environment variable BIOSIG_TRACE=<output file>).
+	TRACE_BEGIN(t) declares the start time t of a span, TRACE_END records
+	the span NAME with the optional static string ARG and the count N.
+	NAME and ARG must be static strings. biosig_trace_flush writes the
+	recorded spans in Chrome trace format, it is also called at exit.
+--------------------------------------------------------------- */
+
 #ifdef __cplusplus
 }
 #endif 
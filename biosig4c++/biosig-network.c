@@ -24,9 +24,15 @@
 #include <errno.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <stdlib.h>
 
 #include "biosig-network.h"
 
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#endif
+
 #ifdef _WIN32
 #define TC (char*)	// WINSOCK's send and recv require (char*)buf 
 
@@ -68,6 +74,57 @@ ssize_t read(int fildes, const void *buf, size_t nbyte) {
 uint64_t B4C_ID=0;	// ID of currently open file 
 const char *B4C_HOSTNAME = NULL; 
 uint32_t SERVER_STATE; // state of server, useful for preliminary error checking 
+uint32_t SERVER_VERSION = 1; // highest protocol version supported by the server
+
+static size_t BSCS_WINDOW = 1;		// number of outstanding data requests
+static size_t BSCS_WINDOW_BLOCKS = 0;	// number of blocks per data request, 0: automatic
+static int BSCS_ZLEVEL = 0;		// compression level of data transfers, 0: off
+static BSCS_LAYOUT_T BSCS_LAYOUT;	// layout of data blocks of the currently open file
+static int BSCS_ABORTED = 0;		// reply stream is out of sync, see bscs_abort
+BSCS_STATS_T BSCS_STATS;		// transfer statistics
+
+/*
+	receive exactly len bytes, returns 0 on success
+*/
+static int bscs_recv(int sd, void *buf, size_t len) {
+	size_t count = 0;
+	while (count < len) {
+		ssize_t n = recv(sd, TC (uint8_t*)buf+count, len-count, 0);
+		if (n <= 0) {
+			if ((n < 0) && (errno == EINTR)) continue;
+			return(-1);
+		}
+		count += n;
+	}
+	return(0);
+}
+
+/*
+	discard len bytes, returns 0 on success
+*/
+static int bscs_skip(int sd, size_t len) {
+	char buf[1024];
+	while (len > 0) {
+		size_t n = min(len, sizeof(buf));
+		if (bscs_recv(sd, buf, n)) return(-1);
+		len -= n;
+	}
+	return(0);
+}
+
+/*
+	the reply stream cannot be resynchronized: the connection is shut down
+	and all further requests fail, the socket is closed by bscs_disconnect
+*/
+static void bscs_abort(int sd) {
+	BSCS_ABORTED  = 1;
+	SERVER_STATE  = STATE_INIT;
+#ifdef _WIN32
+	shutdown(sd, SD_BOTH);
+#else
+	shutdown(sd, SHUT_RDWR);
+#endif
+}
 
 /*
 	converts 64bit integer into hex string
@@ -121,6 +178,147 @@ void *get_in_addr(struct sockaddr *sa)
 }
 
 
+/****************************************************************************************
+	COMPRESSION OF DATA BLOCKS
+ ****************************************************************************************/
+/*
+	layout of a data block as known to the peer: byte offset, samples per
+	block and sample size of all channels with integer data types.
+
+	flagCollapsed: only channels with OnOff!=0 are contained in the data
+	block (as in the header generated by struct2gdfbin), otherwise the
+	positions CHANNEL[].bi of all channels are used.
+
+	returns 0 if the data can be delta coded, and -1 otherwise
+*/
+int bscs_layout(BSCS_LAYOUT_T *L, HDRTYPE *hdr, char flagCollapsed) {
+	L->bpb = 0;
+	L->N   = 0;
+	L->bi   = (uint32_t*)realloc(L->bi,   hdr->NS*sizeof(uint32_t));
+	L->SPR  = (uint32_t*)realloc(L->SPR,  hdr->NS*sizeof(uint32_t));
+	L->size = (uint8_t*) realloc(L->size, hdr->NS);
+
+	size_t bpb8 = 0;
+	for (size_t k = 0; k < hdr->NS; k++) {
+		CHANNEL_TYPE *hc = hdr->CHANNEL+k;
+		if (flagCollapsed && !hc->OnOff) continue;
+		size_t pos8 = flagCollapsed ? bpb8 : hc->bi8;
+		bpb8 += GDFTYP_BITS[hc->GDFTYP] * (size_t)hc->SPR;
+		if ((hc->GDFTYP < 1) || (hc->GDFTYP > 8) || (hc->SPR == 0)) continue;	// not an integer type
+		if (pos8 & 7) return(-1);
+		L->bi[L->N]   = pos8 >> 3;
+		L->SPR[L->N]  = hc->SPR;
+		L->size[L->N] = GDFTYP_BITS[hc->GDFTYP] >> 3;
+		L->N++;
+	}
+	L->bpb = flagCollapsed ? (bpb8 >> 3) : (size_t)hdr->AS.bpb;
+	if ((bpb8 & 7) || (L->bpb == 0)) {
+		L->bpb = 0;
+		return(-1);
+	}
+	return(0);
+}
+
+void bscs_layout_free(BSCS_LAYOUT_T *L) {
+	free(L->bi);
+	free(L->SPR);
+	free(L->size);
+	memset(L, 0, sizeof(*L));
+}
+
+#ifdef ZLIB_H
+/*
+	in-place delta coding (inverse=0) or decoding (inverse=1) of the integer
+	channels of nblocks consecutive data blocks; samples are little endian,
+	differences are taken modulo 2^n, and continue across block boundaries.
+*/
+static void bscs_delta(const BSCS_LAYOUT_T *L, uint8_t *buf, size_t nblocks, char inverse) {
+	for (size_t k = 0; k < L->N; k++) {
+		const size_t sz = L->size[k];
+		const uint64_t mask = (sz == 8) ? ~(uint64_t)0 : (((uint64_t)1 << (8*sz)) - 1);
+		uint64_t prev = 0;
+		for (size_t b = 0; b < nblocks; b++) {
+			uint8_t *p = buf + b*L->bpb + L->bi[k];
+			for (size_t n = 0; n < L->SPR[k]; n++, p += sz) {
+				uint64_t x;
+				switch (sz) {
+				case 1:  x = *p; break;
+				case 2:  x = leu16p(p); break;
+				case 4:  x = leu32p(p); break;
+				default: x = leu64p(p);
+				}
+				if (inverse) {
+					x = (x + prev) & mask;
+					prev = x;
+				} else {
+					uint64_t d = (x - prev) & mask;
+					prev = x;
+					x = d;
+				}
+				switch (sz) {
+				case 1:  *p = (uint8_t)x; break;
+				case 2:  leu16a((uint16_t)x, p); break;
+				case 4:  leu32a((uint32_t)x, p); break;
+				default: leu64a(x, p);
+				}
+			}
+		}
+	}
+}
+#endif
+
+/*
+	compress len bytes of data blocks, the result is stored in *buf
+	(reallocated as needed). returns the length of the compressed payload,
+	or 0 if the data can not be compressed, or compression does not pay off.
+
+	payload format:
+	  byte 0:	method, 1: delta coding of integer channels + deflate
+	  byte 1-3:	reserved
+	  byte 4-7:	uncompressed length (little endian)
+	  byte 8- :	zlib stream
+*/
+size_t bscs_compress(const BSCS_LAYOUT_T *L, const uint8_t *raw, size_t len, uint8_t **buf, int level) {
+#ifdef ZLIB_H
+	if ((L->bpb == 0) || (len % L->bpb) || (len == 0) || (len > 0xffffffff)) return(0);
+
+	uLongf zlen = compressBound(len);
+	uint8_t *tmp = (uint8_t*)malloc(len);
+	*buf = (uint8_t*)realloc(*buf, 8 + zlen);
+	memcpy(tmp, raw, len);
+	bscs_delta(L, tmp, len / L->bpb, 0);
+	int r = compress2(*buf + 8, &zlen, tmp, len, level);
+	free(tmp);
+	if ((r != Z_OK) || (8 + zlen >= len)) return(0);
+
+	(*buf)[0] = 1;
+	(*buf)[1] = (*buf)[2] = (*buf)[3] = 0;
+	leu32a(len, *buf + 4);
+	return(8 + zlen);
+#else
+	return(0);
+#endif
+}
+
+/*
+	decompress payload into raw of size rawlen
+	returns the number of bytes, or -1 in case of an error
+*/
+ssize_t bscs_decompress(const BSCS_LAYOUT_T *L, const uint8_t *load, size_t len, uint8_t *raw, size_t rawlen) {
+#ifdef ZLIB_H
+	if ((len < 8) || (load[0] != 1) || (L->bpb == 0)) return(-1);
+	uLongf n = leu32p(load + 4);
+	if ((n > rawlen) || (n % L->bpb)) return(-1);
+	if ((uncompress(raw, &n, load + 8, len - 8) != Z_OK) || (n != leu32p(load + 4)))
+		return(-1);
+	bscs_delta(L, raw, n / L->bpb, 1);
+	return(n);
+#else
+	return(-1);
+#endif
+}
+
+
 /****************************************************************************************
 	OPEN CONNECTION TO SERVER
  ****************************************************************************************/
@@ -198,12 +396,23 @@ int bscs_connect(const char* hostname) {
     	struct sockaddr_in sain;
 
 	
-   	h = gethostbyname(hostname);
+	// hostname[:port]
+	uint16_t port = SERVER_PORT;
+	char host[256];
+	strncpy(host, hostname, 255);
+	host[255] = 0;
+	char *p = strrchr(host, ':');
+	if (p != NULL) {
+		*p = 0;
+		port = atoi(p+1);
+	}
+
+   	h = gethostbyname(host);
    	if(h==NULL) return(BSCS_UNKNOWN_HOST);
 
    	sain.sin_family = h->h_addrtype;
    	memcpy((char *) &sain.sin_addr.s_addr, h->h_addr_list[0],h->h_length);
-   	sain.sin_port = htons(SERVER_PORT);
+   	sain.sin_port = htons(port);
 
    	/* create socket */
    	sd = socket(AF_INET, SOCK_STREAM, 0);
@@ -218,20 +427,27 @@ int bscs_connect(const char* hostname) {
    	int rc = connect(sd, (struct sockaddr *) &sain, sizeof(sain));
    	if(rc<0) return(BSCS_CANNOT_CONNECT);
 
+	// requests are small, do not wait for coalescing
+	int yes = 1;
+	setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, TC &yes, sizeof(yes));
+	BSCS_ABORTED = 0;
+
 #endif 
    
 	/* identification */	
 	mesg_t msg; 
-	recv(sd,TC&msg,8,0);
+	bscs_recv(sd,&msg,8);
 	int len = b_endian_u32(msg.LEN); 	
-	if ((msg.STATE & (VER_MASK|CMD_MASK)) != (BSCS_VERSION_01 | BSCS_SEND_MSG))	// currently only V0.1 is supported 
+	if ((msg.STATE & (VER_MASK|CMD_MASK)) != (BSCS_VERSION_01 | BSCS_SEND_MSG))	// greeting is always V0.1
 	{
 		close(sd);
 		return(BSCS_SERVER_NOT_SUPPORTED);
 	}
+	// the ERR byte of the greeting contains the highest supported version
+	SERVER_VERSION = max(1, b_endian_u32(msg.STATE & ERR_MASK));
 	
 	char *greeting = (char*)malloc(len+1); 
-	recv(sd,greeting,len,0);
+	bscs_recv(sd,greeting,len);
 	greeting[len]=0; 
 	//fprintf(stdout,"%s",greeting);
 	free(greeting);
@@ -318,6 +534,7 @@ int bscs_open(int sd, uint64_t* ID) {
 
 	size_t LEN;
 	mesg_t msg; 
+	BSCS_LAYOUT.bpb = 0;
 	
 	if (*ID==0) {
 		msg.STATE = BSCS_VERSION_01 | BSCS_OPEN_W | STATE_INIT | BSCS_NO_ERROR;
@@ -378,6 +595,12 @@ int bscs_close(int sd) {
 	size_t LEN;
 	mesg_t msg; 
 	
+	if (BSCS_ABORTED) {
+		bscs_cache_free();
+		return(BSCS_ERROR);
+	}
+	bscs_cache_sync(sd);
+	bscs_cache_free();
 	msg.STATE = BSCS_VERSION_01 | BSCS_CLOSE | BSCS_NO_ERROR | SERVER_STATE;
 if (VERBOSE_LEVEL>8) fprintf(stdout,"close1: %08x \n",msg.STATE);
 	msg.LEN   = b_endian_u32(0);
@@ -390,6 +613,18 @@ if (VERBOSE_LEVEL>8) fprintf(stdout,"close3: %08x %i\n",msg.STATE,s);
 	// wait for reply 
 	s = recv(sd, TC &msg, 8, 0);
 	LEN = b_endian_u32(msg.LEN);
+	while ((SERVER_STATE == STATE_SUBSCRIBED) && (s == 8)
+	    && ((msg.STATE & ~ERR_MASK) == (BSCS_VERSION_01 | BSCS_SUBSCRIBE | BSCS_REPLY | STATE_SUBSCRIBED))) {
+		// skip data of subscription sent before the close request
+		char buf[1024];
+		while (LEN > 0) {
+			ssize_t n = recv(sd, TC buf, min(LEN, sizeof(buf)), 0);
+			if (n <= 0) return(BSCS_ERROR);
+			LEN -= n;
+		}
+		s = recv(sd, TC &msg, 8, 0);
+		LEN = b_endian_u32(msg.LEN);
+	}
 	SERVER_STATE = msg.STATE & STATE_MASK;
 
 if (VERBOSE_LEVEL>8) fprintf(stdout,"s=%i state= %08x len=%i %i  %08x\n",s,msg.STATE& ~STATE_MASK,LEN,s,(BSCS_VERSION_01 | BSCS_CLOSE | BSCS_REPLY));
@@ -423,6 +658,7 @@ int bscs_send_hdr(int sd, HDRTYPE *hdr) {
 	hdr->TYPE = GDF;
 	hdr->FLAG.ANONYMOUS = 1; 	// do not store name 
 	struct2gdfbin(hdr); 
+	bscs_layout(&BSCS_LAYOUT, hdr, 1);	// header contains only channels with OnOff
 
 	msg.STATE = BSCS_VERSION_01 | BSCS_SEND_HDR | STATE_OPEN_WRITE_HDR | BSCS_NO_ERROR;
 	msg.LEN   = b_endian_u32(hdr->HeadLen);
@@ -454,10 +690,61 @@ if (VERBOSE_LEVEL>8) fprintf(stdout,"SND HDR %i %i %i %08x\n",hdr->HeadLen,s,cou
 /****************************************************************************************
 	SEND DATA
  ****************************************************************************************/
+int bscs_set_compression(int level) {
+	BSCS_ZLEVEL = max(0, min(level, 9));
+	return(0);
+}
+
+/*
+	send data with protocol version 0.3: the data is split into batches
+	of about 1 MB, each batch is compressed and sent as a separate
+	message (or uncompressed, if compression does not pay off), and the
+	replies are collected afterwards.
+*/
+static int bscs_send_dat_z(int sd, uint8_t *buf, size_t len) {
+	const size_t bpb = BSCS_LAYOUT.bpb;
+	const size_t batch = max(1, (1<<20) / bpb) * bpb;
+	uint8_t *zbuf = NULL;
+	size_t NREQ = 0;
+	mesg_t msg;
+
+	for (size_t pos = 0; pos < len; pos += batch, NREQ++) {
+		size_t n = min(batch, len - pos);
+		size_t zlen = bscs_compress(&BSCS_LAYOUT, buf + pos, n, &zbuf, BSCS_ZLEVEL);
+		msg.STATE = BSCS_VERSION_01 | BSCS_SEND_DAT | STATE_OPEN_WRITE | BSCS_NO_ERROR | (zlen ? BSCS_COMPRESSED : 0);
+		msg.LEN   = b_endian_u32(zlen ? zlen : n);
+		send(sd, TC &msg, 8, 0);
+		send(sd, TC (zlen ? zbuf : buf + pos), zlen ? zlen : n, 0);
+		BSCS_STATS.rawbytes += n;
+		BSCS_STATS.netbytes += zlen ? zlen : n;
+if (VERBOSE_LEVEL>8) fprintf(stdout,"SND DAT(z) %i %i\n",(int)n,(int)zlen);
+	}
+	free(zbuf);
+
+	// wait for replies
+	uint32_t state = 0;
+	for (size_t k = 0; k < NREQ; k++) {
+		if (bscs_recv(sd, &msg, 8)) return(BSCS_ERROR);
+		SERVER_STATE = msg.STATE & STATE_MASK;
+		if (state) continue;
+		if (b_endian_u32(msg.LEN) > 0)
+			state = BSCS_VERSION_01 | BSCS_SEND_DAT | BSCS_REPLY | STATE_OPEN_WRITE | BSCS_INCORRECT_REPLY_PACKET_LENGTH;
+		else if ((msg.STATE & ~ERR_MASK)==(BSCS_VERSION_01 | BSCS_SEND_DAT | BSCS_REPLY | STATE_OPEN_WRITE)) {
+			if (msg.STATE & ERR_MASK) state = (msg.STATE & ~ERR_MASK) | BSCS_ERROR_COULD_NOT_WRITE_DAT;
+		}
+		else
+			state = msg.STATE;
+	}
+	return(state);
+}
+
 int bscs_send_dat(int sd, void* buf, size_t len ) {
 
 	if (SERVER_STATE != STATE_OPEN_WRITE) return(BSCS_ERROR);
 
+	if (BSCS_ZLEVEL && (SERVER_VERSION >= 3) && (BSCS_LAYOUT.bpb > 0) && (len > 0) && !(len % BSCS_LAYOUT.bpb))
+		return(bscs_send_dat_z(sd, (uint8_t*)buf, len));
+
 	size_t LEN;
 	mesg_t msg; 
 	msg.STATE = BSCS_VERSION_01 | BSCS_SEND_DAT | STATE_OPEN_WRITE | BSCS_NO_ERROR;
@@ -468,6 +755,8 @@ if (VERBOSE_LEVEL>8) fprintf(stdout,"SND DAT %i %08x\n",len,msg.STATE);
 	ssize_t s;
 	s = send(sd, TC &msg, 8, 0);	
 	s = send(sd, TC buf, len, 0);	
+	BSCS_STATS.rawbytes += len;
+	BSCS_STATS.netbytes += len;
 	if (errno) fprintf(stdout,"SND DAT ERR=%i %s\n",errno,strerror(errno));
 
 if (VERBOSE_LEVEL>8) fprintf(stdout,"SND DAT %i %08x %i \n",len,msg.STATE,s); 
@@ -557,6 +846,7 @@ int bscs_requ_hdr(int sd, HDRTYPE *hdr) {
 	
 
 	if (SERVER_STATE != STATE_OPEN_READ) return(BSCS_ERROR);
+	if (bscs_cache_sync(sd)) return(BSCS_ERROR);
 	
 	msg.STATE = BSCS_VERSION_01 | BSCS_REQU_HDR | BSCS_NO_ERROR | (SERVER_STATE & STATE_MASK);
 	msg.LEN   = 0;
@@ -575,6 +865,7 @@ if (VERBOSE_LEVEL>8) fprintf(stdout,"REQ HDR: %i %s\n",count,GetFileTypeString(h
 	
 	hdr->FLAG.ANONYMOUS = 1; 	// do not store name 
 	gdfbin2struct(hdr); 
+	bscs_layout(&BSCS_LAYOUT, hdr, 0);
 	
 	
    	return(count-hdr->HeadLen); 
@@ -583,6 +874,146 @@ if (VERBOSE_LEVEL>8) fprintf(stdout,"REQ HDR: %i %s\n",count,GetFileTypeString(h
 /****************************************************************************************
 	REQUEST DATA
  ****************************************************************************************/
+int bscs_set_window(size_t nreq, size_t nblocks) {
+	BSCS_WINDOW = max(nreq, 1);
+	BSCS_WINDOW_BLOCKS = nblocks;
+	return(0);
+}
+
+/*
+	request data with protocol version 0.2: the range is split into requests
+	of nb blocks, up to BSCS_WINDOW requests are outstanding, and the replies
+	are placed into hdr->AS.rawdata according to their request id.
+	After an error, no new requests are sent and the replies of the
+	outstanding ones are discarded, so that the next command finds the
+	stream in sync; if that is not possible, the connection is aborted.
+*/
+static ssize_t bscs_requ_dat_window(int sd, size_t start, size_t length, HDRTYPE *hdr, size_t nb) {
+
+	const size_t bpb  = hdr->AS.bpb;
+	const size_t NREQ = (length + nb - 1) / nb;
+	const size_t PKTLEN = 8 + BSCS_RID_LEN + 8;
+
+	uint8_t *rawdata = (uint8_t*) realloc(hdr->AS.rawdata, length*bpb);
+	size_t *count   = (size_t*) calloc(NREQ, sizeof(size_t));	// bytes received for each request
+	uint8_t *pkt    = (uint8_t*) malloc(BSCS_WINDOW*PKTLEN);
+	uint8_t *zbuf   = NULL;
+	const uint32_t zflag = (BSCS_ZLEVEL && (SERVER_VERSION >= 3) && (BSCS_LAYOUT.bpb == bpb)) ? BSCS_COMPRESSED : 0;
+	int err = 0;	// 1: failed request, the stream is still in sync; 2: stream is out of sync
+
+	if (rawdata != NULL) hdr->AS.rawdata = rawdata;
+	if ((rawdata == NULL) || (count == NULL) || (pkt == NULL)) {
+		// nothing has been sent yet
+		free(count);
+		free(pkt);
+		hdr->AS.first  = start;
+		hdr->AS.length = 0;
+		return(BSCS_ERROR);
+	}
+
+	size_t sent = 0, done = 0;
+	while (done < NREQ) {
+		/* fill window, all new requests are sent at once */
+		size_t k = 0;
+		for (; (sent < NREQ) && (sent - done < BSCS_WINDOW); sent++, k++) {
+			uint8_t *p = pkt + k*PKTLEN;
+			size_t n = min(nb, length - sent*nb);
+			*(uint32_t*)(p)    = BSCS_VERSION_02 | BSCS_REQU_DAT | BSCS_NO_ERROR | zflag | (SERVER_STATE & STATE_MASK);
+			*(uint32_t*)(p+4)  = b_endian_u32(BSCS_RID_LEN + 8);
+			leu32a(sent, p+8);
+			leu32a(n, p+12);
+			leu32a(start + sent*nb, p+16);
+		}
+		if ((k > 0) && (send(sd, TC pkt, k*PKTLEN, 0) < (ssize_t)(k*PKTLEN))) {
+			err = 2;
+			break;
+		}
+
+		/* receive one reply */
+		mesg_t msg;
+		if (bscs_recv(sd, &msg, 8 + BSCS_RID_LEN)) {
+			err = 2;
+			break;
+		}
+		size_t LEN   = b_endian_u32(msg.LEN) - BSCS_RID_LEN;
+		uint32_t rid = leu32p(msg.LOAD);
+		size_t siz   = (rid < NREQ) ? min(nb, length - rid*nb)*bpb : 0;
+		if (((msg.STATE & ~STATE_MASK & ~zflag) != (BSCS_VERSION_02 | BSCS_REQU_DAT | BSCS_REPLY | BSCS_NO_ERROR))
+		 || (rid >= NREQ) || (LEN > siz)) {
+			done++;
+			// a data reply with an error code can be skipped, anything else is out of sync
+			if (((msg.STATE & ~STATE_MASK & ~zflag & ~ERR_MASK) != (BSCS_VERSION_02 | BSCS_REQU_DAT | BSCS_REPLY))
+			 || (LEN > nb*bpb) || bscs_skip(sd, LEN))
+				err = 2;
+			else
+				err = 1;
+			break;
+		}
+		if (msg.STATE & BSCS_COMPRESSED) {
+			ssize_t n = -1;
+			uint8_t *z = (uint8_t*) realloc(zbuf, LEN);
+			if (z == NULL) {
+				err = bscs_skip(sd, LEN) ? 2 : 1;
+				done++;
+				break;
+			}
+			zbuf = z;
+			if (bscs_recv(sd, zbuf, LEN)) {
+				err = 2;
+				break;
+			}
+			done++;
+			n = bscs_decompress(&BSCS_LAYOUT, zbuf, LEN, hdr->AS.rawdata + rid*nb*bpb, siz);
+			if (n < 0) {
+				err = 1;
+				break;
+			}
+			count[rid] = n;
+		}
+		else {
+			if (bscs_recv(sd, hdr->AS.rawdata + rid*nb*bpb, LEN)) {
+				err = 2;
+				break;
+			}
+			done++;
+			count[rid] = LEN;
+		}
+		BSCS_STATS.rawbytes += count[rid];
+		BSCS_STATS.netbytes += LEN;
+	}
+
+	/* discard the replies of the requests that are still outstanding */
+	while ((err == 1) && (done < sent)) {
+		mesg_t msg;
+		if (bscs_recv(sd, &msg, 8 + BSCS_RID_LEN)) {
+			err = 2;
+			break;
+		}
+		size_t LEN = b_endian_u32(msg.LEN) - BSCS_RID_LEN;
+		if (((msg.STATE & ~STATE_MASK & ~zflag & ~ERR_MASK) != (BSCS_VERSION_02 | BSCS_REQU_DAT | BSCS_REPLY))
+		 || (LEN > nb*bpb) || bscs_skip(sd, LEN))
+			err = 2;
+		done++;
+	}
+	if (err == 2) bscs_abort(sd);
+
+	/* data is valid up to the first incomplete reply */
+	size_t k = 0, total = 0;
+	for (; k < NREQ; k++) {
+		total += count[k];
+		if (count[k] < min(nb, length - k*nb)*bpb) break;
+	}
+	free(count);
+	free(pkt);
+	free(zbuf);
+
+	hdr->AS.first  = start;
+	hdr->AS.length = total / bpb;
+	if (VERBOSE_LEVEL>8) fprintf(stdout,"REQ DAT(window=%i): %i %i\n",(int)BSCS_WINDOW,(int)hdr->AS.first,(int)hdr->AS.length);
+
+	return(err ? BSCS_ERROR : 0);
+}
+
 ssize_t bscs_requ_dat(int sd, size_t start, size_t length, HDRTYPE *hdr) {
 /*
 	bufsiz should be equal to hdr->AS.bpb*length	
@@ -591,8 +1022,16 @@ ssize_t bscs_requ_dat(int sd, size_t start, size_t length, HDRTYPE *hdr) {
 	size_t LEN;
 	
 	if (SERVER_STATE != STATE_OPEN_READ) return(BSCS_ERROR);
+	if (bscs_cache_sync(sd)) return(BSCS_ERROR);
+
+	if (((BSCS_WINDOW > 1) || BSCS_WINDOW_BLOCKS) && (SERVER_VERSION >= 2) && (hdr->AS.bpb > 0)) {
+		size_t nb = BSCS_WINDOW_BLOCKS ? BSCS_WINDOW_BLOCKS : max(1, (1<<16) / hdr->AS.bpb);
+		if (length > nb)
+			return(bscs_requ_dat_window(sd, start, length, hdr, nb));
+	}
 	
-	msg.STATE = BSCS_VERSION_01 | BSCS_REQU_DAT | BSCS_NO_ERROR | (SERVER_STATE & STATE_MASK);
+	const uint32_t zflag = (BSCS_ZLEVEL && (SERVER_VERSION >= 3) && (BSCS_LAYOUT.bpb > 0) && (BSCS_LAYOUT.bpb == hdr->AS.bpb)) ? BSCS_COMPRESSED : 0;
+	msg.STATE = BSCS_VERSION_01 | BSCS_REQU_DAT | BSCS_NO_ERROR | zflag | (SERVER_STATE & STATE_MASK);
 	msg.LEN   = b_endian_u32(8);
 
 
@@ -603,11 +1042,24 @@ ssize_t bscs_requ_dat(int sd, size_t start, size_t length, HDRTYPE *hdr) {
 	ssize_t count = recv(sd, TC &msg, 8, 0);
 	LEN = b_endian_u32(msg.LEN);
 	
-	hdr->AS.rawdata = (uint8_t*) realloc(hdr->AS.rawdata,LEN);
-	count = 0; 
-	while (LEN > (size_t)count) {
-		count += recv(sd, TC hdr->AS.rawdata+count, LEN-count, 0);
-	}	
+	if (msg.STATE & zflag) {
+		uint8_t *zbuf = (uint8_t*) malloc(LEN);
+		hdr->AS.rawdata = (uint8_t*) realloc(hdr->AS.rawdata, length*hdr->AS.bpb);
+		count = -1;
+		if (!bscs_recv(sd, zbuf, LEN))
+			count = bscs_decompress(&BSCS_LAYOUT, zbuf, LEN, hdr->AS.rawdata, length*hdr->AS.bpb);
+		free(zbuf);
+		if (count < 0) return(BSCS_ERROR);
+	}
+	else {
+		hdr->AS.rawdata = (uint8_t*) realloc(hdr->AS.rawdata,LEN);
+		count = 0; 
+		while (LEN > (size_t)count) {
+			count += recv(sd, TC hdr->AS.rawdata+count, LEN-count, 0);
+		}	
+	}
+	BSCS_STATS.rawbytes += count;
+	BSCS_STATS.netbytes += LEN;
 	
 	hdr->AS.first = start;
 if (VERBOSE_LEVEL>8) fprintf(stdout,"REQ DAT: %i %i\n",count,hdr->AS.bpb);
@@ -617,6 +1069,257 @@ if (VERBOSE_LEVEL>8) fprintf(stdout,"REQ DAT: %i %i\n",hdr->AS.first,hdr->AS.len
 	return(0);
 }
 
+/****************************************************************************************
+	CLIENT-SIDE BLOCK CACHE AND READAHEAD
+
+	Data blocks are cached in chunks of about 64 kB (the same chunks as in
+	the cache of biosig_server). A miss requests the missing chunks, and
+	in addition readahead chunks in the direction of the last move. The
+	readahead is not waited for; its replies are collected when a later
+	call needs them, or before the next other command (bscs_cache_sync).
+	Requests use the request ids of protocol version 0.2.
+ ****************************************************************************************/
+typedef struct {
+	size_t   chunk;		// chunk number
+	size_t   len;		// number of valid bytes
+	uint32_t rid;		// request id while pending
+	char     state;		// 0: free, 1: pending, 2: valid
+	uint64_t used;		// time of last use, for LRU
+	uint8_t  *buf;
+} BSCS_CHUNK_T;
+
+static size_t BSCS_CACHE_SIZE = 16<<20;	// size of client-side cache, 0: off
+static size_t BSCS_READAHEAD  = 4;	// minimum number of readahead chunks
+static struct {
+	size_t   bpb;		// bytes per block
+	size_t   nb;		// blocks per chunk
+	size_t   N;		// number of chunks
+	BSCS_CHUNK_T *C;
+	size_t   pending;	// number of outstanding replies
+	uint32_t rid;		// next request id
+	uint64_t clock;
+	size_t   last;		// first chunk of previous request
+	size_t   eof;		// first chunk beyond the end of data
+	uint8_t  *zbuf;
+} BSCS_CACHE;
+
+int bscs_set_cache(size_t size, size_t readahead) {
+	bscs_cache_free();
+	BSCS_CACHE_SIZE = size;
+	BSCS_READAHEAD  = readahead;
+	return(0);
+}
+
+void bscs_cache_free(void) {
+	size_t k;
+	for (k = 0; k < BSCS_CACHE.N; k++)
+		free(BSCS_CACHE.C[k].buf);
+	free(BSCS_CACHE.C);
+	free(BSCS_CACHE.zbuf);
+	memset(&BSCS_CACHE, 0, sizeof(BSCS_CACHE));
+}
+
+/*
+	initialize cache for blocks of size bpb, returns -1 if caching is not possible
+*/
+static int bscs_cache_init(size_t bpb) {
+	if (BSCS_CACHE.bpb == bpb) return(0);
+	bscs_cache_free();
+	size_t nb = max(1, (1<<16) / bpb);
+	size_t N  = BSCS_CACHE_SIZE / (nb*bpb);
+	if (N < 2*BSCS_READAHEAD + 2) return(-1);
+	BSCS_CACHE.C = (BSCS_CHUNK_T*) calloc(N, sizeof(BSCS_CHUNK_T));
+	if (BSCS_CACHE.C == NULL) return(-1);
+	BSCS_CACHE.bpb = bpb;
+	BSCS_CACHE.nb  = nb;
+	BSCS_CACHE.N   = N;
+	BSCS_CACHE.eof = (size_t)-1;
+	return(0);
+}
+
+static BSCS_CHUNK_T *bscs_cache_find(size_t chunk) {
+	size_t k;
+	for (k = 0; k < BSCS_CACHE.N; k++)
+		if (BSCS_CACHE.C[k].state && (BSCS_CACHE.C[k].chunk == chunk))
+			return(BSCS_CACHE.C + k);
+	return(NULL);
+}
+
+/*
+	receive one reply of an outstanding request
+*/
+static int bscs_cache_recv(int sd) {
+	mesg_t msg;
+	if (bscs_recv(sd, &msg, 8 + BSCS_RID_LEN)) return(-1);
+	size_t LEN   = b_endian_u32(msg.LEN) - BSCS_RID_LEN;
+	uint32_t rid = leu32p(msg.LOAD);
+	const size_t siz = BSCS_CACHE.nb*BSCS_CACHE.bpb;
+
+	BSCS_CHUNK_T *C = NULL;
+	size_t k;
+	for (k = 0; k < BSCS_CACHE.N; k++)
+		if ((BSCS_CACHE.C[k].state == 1) && (BSCS_CACHE.C[k].rid == rid))
+			C = BSCS_CACHE.C + k;
+	if ((C == NULL) || (LEN > siz) ||
+	    ((msg.STATE & ~STATE_MASK & ~BSCS_COMPRESSED & ~ERR_MASK) != (BSCS_VERSION_02 | BSCS_REQU_DAT | BSCS_REPLY)))
+		return(-1);
+	BSCS_CACHE.pending--;
+
+	if (C->buf == NULL) C->buf = (uint8_t*) malloc(siz);
+	ssize_t n = LEN;
+	if (msg.STATE & BSCS_COMPRESSED) {
+		BSCS_CACHE.zbuf = (uint8_t*) realloc(BSCS_CACHE.zbuf, siz);
+		n = -1;
+		if (!bscs_recv(sd, BSCS_CACHE.zbuf, LEN))
+			n = bscs_decompress(&BSCS_LAYOUT, BSCS_CACHE.zbuf, LEN, C->buf, siz);
+	}
+	else if (bscs_recv(sd, C->buf, LEN))
+		n = -1;
+	if (n < 0) {
+		C->state = 0;
+		return(-1);
+	}
+	BSCS_STATS.rawbytes += n;
+	BSCS_STATS.netbytes += LEN;
+
+	if (msg.STATE & ERR_MASK) {
+		C->state = 0;	// not cached, is requested again
+		return(0);
+	}
+	C->len   = n - n % BSCS_CACHE.bpb;
+	C->state = 2;
+	if (C->len < siz)
+		BSCS_CACHE.eof = min(BSCS_CACHE.eof, C->chunk + 1);
+	return(0);
+}
+
+/*
+	receive all outstanding replies; must be called before any other command
+*/
+int bscs_cache_sync(int sd) {
+	while (BSCS_CACHE.pending > 0)
+		if (bscs_cache_recv(sd)) {
+			bscs_cache_free();
+			return(BSCS_ERROR);
+		}
+	return(0);
+}
+
+/*
+	request chunk, the least recently used chunk older than t is replaced
+*/
+static BSCS_CHUNK_T *bscs_cache_requ(int sd, size_t chunk, uint64_t t) {
+	BSCS_CHUNK_T *C = NULL;
+	size_t k;
+	for (k = 0; k < BSCS_CACHE.N; k++) {
+		BSCS_CHUNK_T *c = BSCS_CACHE.C + k;
+		if (c->state == 1) continue;
+		if (c->state == 0) {
+			C = c;
+			break;
+		}
+		if ((c->used < t) && ((C == NULL) || (c->used < C->used)))
+			C = c;
+	}
+	if (C == NULL) return(NULL);
+
+	const uint32_t zflag = (BSCS_ZLEVEL && (SERVER_VERSION >= 3) && (BSCS_LAYOUT.bpb == BSCS_CACHE.bpb)) ? BSCS_COMPRESSED : 0;
+	uint8_t pkt[8 + BSCS_RID_LEN + 8];
+	*(uint32_t*)(pkt) = BSCS_VERSION_02 | BSCS_REQU_DAT | BSCS_NO_ERROR | zflag | (SERVER_STATE & STATE_MASK);
+	*(uint32_t*)(pkt+4) = b_endian_u32(BSCS_RID_LEN + 8);
+	leu32a(BSCS_CACHE.rid, pkt+8);
+	leu32a(BSCS_CACHE.nb, pkt+12);
+	leu32a(chunk*BSCS_CACHE.nb, pkt+16);
+	if (send(sd, TC pkt, sizeof(pkt), 0) < (ssize_t)sizeof(pkt)) return(NULL);
+
+	C->chunk = chunk;
+	C->rid   = BSCS_CACHE.rid++;
+	C->state = 1;
+	C->len   = 0;
+	C->used  = t;
+	BSCS_CACHE.pending++;
+	return(C);
+}
+
+ssize_t bscs_requ_dat_cached(int sd, size_t start, size_t length, HDRTYPE *hdr) {
+
+	if (SERVER_STATE != STATE_OPEN_READ) return(BSCS_ERROR);
+
+	const size_t bpb = hdr->AS.bpb;
+	if ((BSCS_CACHE.bpb != bpb) && bscs_cache_sync(sd)) return(BSCS_ERROR);
+	if ((SERVER_VERSION < 2) || (BSCS_CACHE_SIZE == 0) || (bpb == 0) || bscs_cache_init(bpb))
+		return(bscs_requ_dat(sd, start, length, hdr));
+
+	const size_t nb = BSCS_CACHE.nb;
+	if (hdr->NRec >= 0)
+		length = (start >= (size_t)hdr->NRec) ? 0 : min(length, hdr->NRec - start);
+	size_t c0 = start / nb;
+	size_t c1 = length ? (start + length + nb - 1) / nb : c0;	// first chunk after the request
+	if (hdr->NRec >= 0)
+		BSCS_CACHE.eof = min(BSCS_CACHE.eof, (hdr->NRec + nb - 1) / nb);
+	c1 = min(c1, max(c0, BSCS_CACHE.eof));
+	if (c1 - c0 > BSCS_CACHE.N / 2) {
+		// too large for the cache
+		if (bscs_cache_sync(sd)) return(BSCS_ERROR);
+		return(bscs_requ_dat(sd, start, length, hdr));
+	}
+
+	/* request missing chunks, and readahead in the direction of the last move */
+	const uint64_t t = ++BSCS_CACHE.clock;
+	size_t k;
+	for (k = c0; k < c1; k++) {
+		BSCS_CHUNK_T *C = bscs_cache_find(k);
+		if ((C == NULL) && ((C = bscs_cache_requ(sd, k, t)) == NULL) && (BSCS_CACHE.pending > 0)) {
+			// all free chunks are pending readahead
+			if (bscs_cache_sync(sd)) return(BSCS_ERROR);
+			C = bscs_cache_requ(sd, k, t);
+		}
+		if (C == NULL) {
+			bscs_cache_sync(sd);
+			bscs_cache_free();
+			return(BSCS_ERROR);
+		}
+		C->used = t;
+	}
+	size_t ra = max(BSCS_READAHEAD, c1 - c0);
+	ra = min(ra, BSCS_CACHE.N - (c1 - c0));
+	if (c0 >= BSCS_CACHE.last) {
+		for (k = c1; (k < c1 + ra) && (k < BSCS_CACHE.eof); k++)
+			if (!bscs_cache_find(k) && !bscs_cache_requ(sd, k, t)) break;
+	}
+	else {
+		for (k = c0; (k > 0) && (k + ra > c0); k--)
+			if (!bscs_cache_find(k-1) && !bscs_cache_requ(sd, k-1, t)) break;
+	}
+	BSCS_CACHE.last = c0;
+
+	/* assemble requested blocks */
+	hdr->AS.rawdata = (uint8_t*) realloc(hdr->AS.rawdata, length*bpb);
+	size_t count = 0;
+	for (k = c0; k < c1; k++) {
+		BSCS_CHUNK_T *C = bscs_cache_find(k);
+		while ((C != NULL) && (C->state == 1)) {
+			if (bscs_cache_recv(sd)) {
+				bscs_cache_free();
+				return(BSCS_ERROR);
+			}
+			C = bscs_cache_find(k);
+		}
+		if (C == NULL) break;	// error reply
+		size_t off = (k == c0) ? (start - k*nb)*bpb : 0;
+		if (C->len <= off) break;
+		size_t n = min(C->len - off, length*bpb - count);
+		memcpy(hdr->AS.rawdata + count, C->buf + off, n);
+		count += n;
+		if (C->len < nb*bpb) break;
+	}
+	hdr->AS.first  = start;
+	hdr->AS.length = count / bpb;
+if (VERBOSE_LEVEL>8) fprintf(stdout,"REQ DAT(cached): %i %i pending=%i\n",(int)hdr->AS.first,(int)hdr->AS.length,(int)BSCS_CACHE.pending);
+
+	return(0);
+}
+
 
 /****************************************************************************************
 	REQUEST EVENT TABLE 
@@ -628,6 +1331,7 @@ int bscs_requ_evt(int sd, HDRTYPE *hdr) {
 if (VERBOSE_LEVEL>8) fprintf(stdout,"REQ EVT %08x %08x\n",SERVER_STATE, STATE_OPEN_READ);
 
 	if (SERVER_STATE != STATE_OPEN_READ) return(BSCS_ERROR);
+	if (bscs_cache_sync(sd)) return(BSCS_ERROR);
 
 	msg.STATE = BSCS_VERSION_01 | BSCS_REQU_EVT | BSCS_NO_ERROR | (SERVER_STATE & STATE_MASK);
 	msg.LEN   = b_endian_u32(0);
@@ -788,6 +1492,106 @@ int bscs_get_file(int sd, uint64_t ID, char *filename) {
 
 }
 
+/****************************************************************************************
+	SUBSCRIBE TO DATA OF A RECORDING
+ ****************************************************************************************/
+int bscs_subscribe(int sd, uint64_t ID, size_t start, HDRTYPE *hdr) {
+
+	if (SERVER_STATE != STATE_INIT) return(BSCS_ERROR);
+
+	mesg_t msg;
+	uint8_t buf[12];
+	msg.STATE = BSCS_VERSION_01 | BSCS_SUBSCRIBE | STATE_INIT | BSCS_NO_ERROR;
+	msg.LEN   = b_endian_u32(12);
+	leu64a(ID, buf);
+	leu32a(start, buf+8);
+	send(sd, TC &msg, 8, 0);
+	send(sd, TC buf, 12, 0);
+
+	if (bscs_recv(sd, &msg, 8)) return(BSCS_ERROR);
+	size_t LEN = b_endian_u32(msg.LEN);
+	SERVER_STATE = msg.STATE & STATE_MASK;
+
+	hdr->AS.Header = (uint8_t*)realloc(hdr->AS.Header, LEN);
+	if (bscs_recv(sd, hdr->AS.Header, LEN)) return(BSCS_ERROR);
+	if ((LEN == 0) || (msg.STATE != (BSCS_VERSION_01 | BSCS_SUBSCRIBE | BSCS_REPLY | STATE_SUBSCRIBED | BSCS_NO_ERROR)))
+		return(msg.STATE ? msg.STATE : BSCS_ERROR);
+
+	hdr->HeadLen = LEN;
+	hdr->TYPE    = GDF;
+	hdr->FLAG.ANONYMOUS = 1; 	// do not store name
+	gdfbin2struct(hdr);
+	hdr->AS.first  = 0;
+	hdr->AS.length = 0;
+	return(0);
+}
+
+ssize_t bscs_recv_dat(int sd, HDRTYPE *hdr, int timeout) {
+
+	if (SERVER_STATE != STATE_SUBSCRIBED) return(-2);
+
+	if (timeout >= 0) {
+		fd_set fds;
+		struct timeval tv;
+		FD_ZERO(&fds);
+		FD_SET(sd, &fds);
+		tv.tv_sec  = timeout / 1000;
+		tv.tv_usec = (timeout % 1000) * 1000;
+		int r = select(sd+1, &fds, NULL, NULL, &tv);
+		if (r == 0) return(0);
+		if (r < 0) return(-2);
+	}
+
+	mesg_t msg;
+	if (bscs_recv(sd, &msg, 8)) return(-2);
+	size_t LEN = b_endian_u32(msg.LEN);
+	if (((msg.STATE & ~ERR_MASK) != (BSCS_VERSION_01 | BSCS_SUBSCRIBE | BSCS_REPLY | STATE_SUBSCRIBED))
+	 || (LEN < 4) || (hdr->AS.bpb <= 0) || ((LEN-4) % hdr->AS.bpb))
+		return(-2);
+
+	uint8_t buf[4];
+	if (bscs_recv(sd, buf, 4)) return(-2);
+	LEN -= 4;
+	hdr->AS.first  = leu32p(buf);
+	hdr->AS.length = LEN / hdr->AS.bpb;
+	if (LEN == 0) return(-1);	// end of recording
+
+	hdr->AS.rawdata = (uint8_t*)realloc(hdr->AS.rawdata, LEN);
+	if (bscs_recv(sd, hdr->AS.rawdata, LEN)) return(-2);
+	BSCS_STATS.rawbytes += LEN;
+	BSCS_STATS.netbytes += LEN;
+	return(hdr->AS.length);
+}
+
+/****************************************************************************************
+	REQUEST STATUS OF SERVER
+ ****************************************************************************************/
+int bscs_requ_status(int sd, char **status) {
+
+	*status = NULL;
+	if ((SERVER_VERSION < 4) || (SERVER_STATE == STATE_SUBSCRIBED)) return(BSCS_ERROR);
+	if (bscs_cache_sync(sd)) return(BSCS_ERROR);
+
+	mesg_t msg;
+	msg.STATE = BSCS_VERSION_01 | BSCS_SEND_MSG | BSCS_NO_ERROR | SERVER_STATE;
+	msg.LEN   = b_endian_u32(6);
+	memcpy(msg.LOAD, "status", 6);
+	send(sd, TC &msg, 8+6, 0);
+
+	if (bscs_recv(sd, &msg, 8)) return(BSCS_ERROR);
+	size_t LEN = b_endian_u32(msg.LEN);
+	*status = (char*)malloc(LEN+1);
+	if (bscs_recv(sd, *status, LEN)) {
+		free(*status);
+		*status = NULL;
+		return(BSCS_ERROR);
+	}
+	(*status)[LEN] = 0;
+	if ((msg.STATE & ~STATE_MASK) != (BSCS_VERSION_01 | BSCS_SEND_MSG | BSCS_REPLY | BSCS_NO_ERROR))
+		return(msg.STATE);
+	return(0);
+}
+
 /****************************************************************************************
 	NO OPERATION 
  ****************************************************************************************/
@@ -796,6 +1600,7 @@ int bscs_nop(int sd) {
 	size_t LEN;
 	mesg_t msg;
 	
+	bscs_cache_sync(sd);
 	msg.STATE = BSCS_NOP | SERVER_STATE;
 	msg.LEN = b_endian_u32(0); 
 	int s = send(sd, TC &msg, 8, 0);	
@@ -101,6 +101,38 @@
 #define	BSCS_VERSION_01 (b_endian_u32(0x01000000)) 		// Version 0.1		  
 #define	BSCS_VERSION_02 (b_endian_u32(0x02000000)) 		// Version 0.2  
 
+/*
+	Version 0.2 has the same commands as version 0.1, but the payload of each
+	request starts with a 32 bit request id (little endian, included in LEN).
+	The reply repeats the id in front of its payload. A client can send
+	several requests without waiting, and must match replies by their id,
+	because the server may answer in any order.
+	The server announces the highest supported version in the ERR byte of
+	its greeting message.
+*/
+#define BSCS_RID_LEN		4
+
+/*
+	Version 0.3 is version 0.2, and the BSCS_COMPRESSED flag is understood.
+	In a REQU_DAT request the flag indicates that a compressed reply is
+	accepted, in SEND_DAT and in the reply to REQU_DAT it indicates that the
+	payload is compressed (see bscs_compress). Messages keep the version
+	byte of 0.1 or 0.2; the flag is only set if the server announced
+	version 0.3 or higher, and the server compresses a reply only if the
+	request carries the flag, so older peers always get raw data.
+*/
+#define	BSCS_VERSION_03 (b_endian_u32(0x03000000)) 		// Version 0.3
+
+/*
+	Version 0.4: the server answers BSCS_SEND_MSG with the text "status"
+	by a BSCS_SEND_MSG reply with statistics (e.g. hit rate of the cache).
+*/
+#ifdef ZLIB_H
+#define BSCS_MAX_VERSION	4
+#else
+#define BSCS_MAX_VERSION	2
+#endif
+
 #define	BSCS_NOP       (b_endian_u32(0x00000000))	// no operation 
 #define	BSCS_OPEN      (b_endian_u32(0x00010000))	// open 
 #define	BSCS_OPEN_R    (b_endian_u32(0x00010000))	// open read
@@ -115,12 +147,30 @@
 #define	BSCS_REQU_EVT  (b_endian_u32(0x00090000))	// request event table 
 #define	BSCS_PUT_FILE  (b_endian_u32(0x000a0000))	// request event table 
 #define	BSCS_GET_FILE  (b_endian_u32(0x000b0000))	// request event table 
+#define	BSCS_SUBSCRIBE (b_endian_u32(0x000c0000))	// subscribe to data of a file that is being recorded
 #define	BSCS_REPLY     (b_endian_u32(0x00800000))	// replay flag: can be combined with any of the above codes   
+#define	BSCS_COMPRESSED (b_endian_u32(0x00400000))	// compression flag: used with SEND_DAT and REQU_DAT (version 0.3)
 
 #define	STATE_INIT    	      (b_endian_u32(0x00000000)) 		// initial state 
 #define	STATE_OPEN_READ       (b_endian_u32(0x00000a00)) 	// connection opened for reading 
 #define	STATE_OPEN_WRITE_HDR  (b_endian_u32(0x00000b00)) 	// connection opened for writing header 
 #define	STATE_OPEN_WRITE      (b_endian_u32(0x00000c00)) 	// connection opened for writing data and events #define	
+#define	STATE_SUBSCRIBED      (b_endian_u32(0x00000d00)) 	// connection receives new data blocks of a file
+
+/*
+	BSCS_SUBSCRIBE: payload is the file ID (8 bytes) and the first record
+	(32 bit, little endian; BSCS_SUBSCRIBE_LIVE: start with new records).
+	The reply carries the GDF header. Then the server pushes messages
+	BSCS_SUBSCRIBE|BSCS_REPLY|STATE_SUBSCRIBED whenever new records are
+	available; their payload is the number of the first record (32 bit)
+	followed by the data blocks. A payload of only the record number marks
+	the end of the recording. BSCS_CLOSE ends the subscription.
+	Each subscriber has a bounded queue: while it is full, no records are
+	read for this subscriber. With BSCS_SUBSCRIBE_LIVE, records are skipped
+	if the subscriber lags behind by more than a full queue; the gap is
+	visible in the record numbers.
+*/
+#define	BSCS_SUBSCRIBE_LIVE	0xffffffff
 
 #define	BSCS_NO_ERROR    			 (b_endian_u32(0x00000000))	// no error  
 #define	BSCS_ERROR_CANNOT_OPEN_FILE 		 (b_endian_u32(0x00000001))	// writing error 
@@ -148,6 +198,23 @@ typedef struct {
 } mesg_t  __attribute__ ((aligned (8)));
 
 extern uint32_t SERVER_STATE; 
+extern uint32_t SERVER_VERSION;	// highest protocol version supported by the server
+
+/* layout of the integer channels within a data block, used for delta coding */
+typedef struct {
+	size_t   bpb;		// bytes per block
+	size_t   N;		// number of integer channels
+	uint32_t *bi;		// byte offset of channel within block
+	uint32_t *SPR;		// samples per block
+	uint8_t  *size;		// bytes per sample
+} BSCS_LAYOUT_T;
+
+/* transfer statistics of bscs_send_dat and bscs_requ_dat */
+typedef struct {
+	uint64_t rawbytes;	// size of data blocks
+	uint64_t netbytes;	// size of payload on the wire
+} BSCS_STATS_T;
+extern BSCS_STATS_T BSCS_STATS;
 
 /****************************************************************************/
 /**                                                                        **/
@@ -221,6 +288,54 @@ int bscs_requ_hdr(int sd, HDRTYPE *hdr);
 ssize_t bscs_requ_dat(int sd, size_t start, size_t nblocks, HDRTYPE *hdr);
 /* request data blocks 
 	bufsiz is maximum number of bytes, typically it must be nblocks*hdr->AS.bpb
+	if the server supports version 0.2, large requests are split, and
+	several of them are kept in flight (see bscs_set_window)
+   -------------------------------------------------------------- */
+
+int bscs_set_window(size_t nreq, size_t nblocks);
+/* number of outstanding data requests, and number of blocks per request
+	nreq=1, nblocks=0 (default): each call of bscs_requ_dat is a single request
+	nblocks=0: about 64 kB per request
+   -------------------------------------------------------------- */
+
+ssize_t bscs_requ_dat_cached(int sd, size_t start, size_t nblocks, HDRTYPE *hdr);
+/* request data blocks through the client-side cache (used by sread_raw)
+	data is cached in chunks of about 64 kB; missing chunks, and readahead
+	in the direction of the last request, are requested at once, and only
+	the requested chunks are waited for. Requires version 0.2, otherwise
+	bscs_requ_dat is used.
+   -------------------------------------------------------------- */
+
+int bscs_set_cache(size_t size, size_t readahead);
+/* size of the client-side cache in bytes (default 16 MB, 0: off), and
+	minimum number of readahead chunks (default 4). A request of more than
+	half of the cache bypasses it. Must not be called while data is pending.
+   -------------------------------------------------------------- */
+
+int bscs_cache_sync(int sd);
+void bscs_cache_free(void);
+/* receive all outstanding readahead replies; is done by all other requests.
+	bscs_cache_free empties the cache, bscs_close does both.
+   -------------------------------------------------------------- */
+
+int bscs_set_compression(int level);
+/* compression of data blocks (0: off [default], 1..9: zlib level)
+	is only used if the server supports version 0.3, otherwise data is
+	transfered uncompressed. The level applies to bscs_send_dat, replies
+	to bscs_requ_dat are compressed with the level of the server.
+	BSCS_STATS counts the transfered bytes.
+   -------------------------------------------------------------- */
+
+int bscs_layout(BSCS_LAYOUT_T *L, HDRTYPE *hdr, char flagCollapsed);
+void bscs_layout_free(BSCS_LAYOUT_T *L);
+/* determine layout of data blocks; flagCollapsed: only channels with OnOff
+	are contained in a block. returns -1 if no delta coding is possible
+   -------------------------------------------------------------- */
+
+size_t bscs_compress(const BSCS_LAYOUT_T *L, const uint8_t *raw, size_t len, uint8_t **buf, int level);
+ssize_t bscs_decompress(const BSCS_LAYOUT_T *L, const uint8_t *load, size_t len, uint8_t *raw, size_t rawlen);
+/* compress and decompress data blocks (delta coding + deflate)
+	bscs_compress returns 0 if the data is not compressed.
    -------------------------------------------------------------- */
 
 int bscs_requ_evt(int sd, HDRTYPE *hdr);
@@ -235,6 +350,25 @@ int bscs_get_file(int sd, uint64_t ID, char *filename);
 /* put raw data file on server 
    -------------------------------------------------------------- */
 
+int bscs_subscribe(int sd, uint64_t ID, size_t start, HDRTYPE *hdr);
+/* subscribe to data of file ID, which can be still open for writing
+	start: first record, or BSCS_SUBSCRIBE_LIVE
+	the header is returned in hdr, data is received with bscs_recv_dat,
+	and bscs_close ends the subscription.
+   -------------------------------------------------------------- */
+
+ssize_t bscs_recv_dat(int sd, HDRTYPE *hdr, int timeout);
+/* wait at most timeout ms (-1: infinite) for data of a subscription
+	the records are stored in hdr->AS.rawdata, hdr->AS.first and hdr->AS.length
+	returns the number of records, 0 on timeout,
+	-1 at the end of the recording, and -2 in case of an error
+   -------------------------------------------------------------- */
+
+int bscs_requ_status(int sd, char **status);
+/* request statistics of server (version 0.4), *status is a text that
+	must be freed by the caller
+   -------------------------------------------------------------- */
+
 int bscs_nop(int sd);
 /* no operation 
    -------------------------------------------------------------- */
@@ -699,6 +699,617 @@ int u32cmp(const void *a,const void *b)
 }
 
 
+/*
+	Conversion of floating point numbers into text
+	double2str returns a text representation of VAL that is converted
+	by strtod back into the identical value. It is based on the Grisu2
+	algorithm [F. Loitsch, Printing Floating-Point Numbers Quickly and
+	Accurately with Integers, PLDI 2010], which is round-trip exact and
+	yields the shortest digit string for about 99.9% of all doubles; in
+	the remaining cases, the result may be longer than necessary.
+	Integer values are converted directly. BUF must have room for at
+	least 26 chars, the length of the string is returned.
+*/
+typedef struct {
+	uint64_t f;
+	int	 e;
+} diyfp_t;
+
+// normalized 10^k, k = -348, -340, ..., 340
+static const uint64_t grisu_cached_f[] = {
+	0xfa8fd5a0081c0288ull, 0xbaaee17fa23ebf76ull, 0x8b16fb203055ac76ull, 0xcf42894a5dce35eaull,
+	0x9a6bb0aa55653b2dull, 0xe61acf033d1a45dfull, 0xab70fe17c79ac6caull, 0xff77b1fcbebcdc4full,
+	0xbe5691ef416bd60cull, 0x8dd01fad907ffc3cull, 0xd3515c2831559a83ull, 0x9d71ac8fada6c9b5ull,
+	0xea9c227723ee8bcbull, 0xaecc49914078536dull, 0x823c12795db6ce57ull, 0xc21094364dfb5637ull,
+	0x9096ea6f3848984full, 0xd77485cb25823ac7ull, 0xa086cfcd97bf97f4ull, 0xef340a98172aace5ull,
+	0xb23867fb2a35b28eull, 0x84c8d4dfd2c63f3bull, 0xc5dd44271ad3cdbaull, 0x936b9fcebb25c996ull,
+	0xdbac6c247d62a584ull, 0xa3ab66580d5fdaf6ull, 0xf3e2f893dec3f126ull, 0xb5b5ada8aaff80b8ull,
+	0x87625f056c7c4a8bull, 0xc9bcff6034c13053ull, 0x964e858c91ba2655ull, 0xdff9772470297ebdull,
+	0xa6dfbd9fb8e5b88full, 0xf8a95fcf88747d94ull, 0xb94470938fa89bcfull, 0x8a08f0f8bf0f156bull,
+	0xcdb02555653131b6ull, 0x993fe2c6d07b7facull, 0xe45c10c42a2b3b06ull, 0xaa242499697392d3ull,
+	0xfd87b5f28300ca0eull, 0xbce5086492111aebull, 0x8cbccc096f5088ccull, 0xd1b71758e219652cull,
+	0x9c40000000000000ull, 0xe8d4a51000000000ull, 0xad78ebc5ac620000ull, 0x813f3978f8940984ull,
+	0xc097ce7bc90715b3ull, 0x8f7e32ce7bea5c70ull, 0xd5d238a4abe98068ull, 0x9f4f2726179a2245ull,
+	0xed63a231d4c4fb27ull, 0xb0de65388cc8ada8ull, 0x83c7088e1aab65dbull, 0xc45d1df942711d9aull,
+	0x924d692ca61be758ull, 0xda01ee641a708deaull, 0xa26da3999aef774aull, 0xf209787bb47d6b85ull,
+	0xb454e4a179dd1877ull, 0x865b86925b9bc5c2ull, 0xc83553c5c8965d3dull, 0x952ab45cfa97a0b3ull,
+	0xde469fbd99a05fe3ull, 0xa59bc234db398c25ull, 0xf6c69a72a3989f5cull, 0xb7dcbf5354e9beceull,
+	0x88fcf317f22241e2ull, 0xcc20ce9bd35c78a5ull, 0x98165af37b2153dfull, 0xe2a0b5dc971f303aull,
+	0xa8d9d1535ce3b396ull, 0xfb9b7cd9a4a7443cull, 0xbb764c4ca7a44410ull, 0x8bab8eefb6409c1aull,
+	0xd01fef10a657842cull, 0x9b10a4e5e9913129ull, 0xe7109bfba19c0c9dull, 0xac2820d9623bf429ull,
+	0x80444b5e7aa7cf85ull, 0xbf21e44003acdd2dull, 0x8e679c2f5e44ff8full, 0xd433179d9c8cb841ull,
+	0x9e19db92b4e31ba9ull, 0xeb96bf6ebadf77d9ull, 0xaf87023b9bf0ee6bull,
+};
+static const int16_t grisu_cached_e[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954,
+	-927, -901, -874, -847, -821, -794, -768, -741, -715, -688, -661,
+	-635, -608, -582, -555, -529, -502, -475, -449, -422, -396, -369,
+	-343, -316, -289, -263, -236, -210, -183, -157, -130, -103, -77,
+	-50, -24, 3, 30, 56, 83, 109, 136, 162, 189, 216,
+	242, 269, 295, 322, 348, 375, 402, 428, 455, 481, 508,
+	534, 561, 588, 614, 641, 667, 694, 720, 747, 774, 800,
+	827, 853, 880, 907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static const uint64_t grisu_pow10[] = {
+	1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+	100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull,
+	10000000000000ull, 100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+	100000000000000000ull, 1000000000000000000ull, 10000000000000000000ull,
+};
+
+static diyfp_t diyfp_mul(diyfp_t x, diyfp_t y) {
+	const uint64_t M32 = 0xffffffffull;
+	uint64_t a = x.f >> 32, b = x.f & M32;
+	uint64_t c = y.f >> 32, d = y.f & M32;
+	uint64_t ac = a*c, bc = b*c, ad = a*d, bd = b*d;
+	uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32) + (1ull << 31);	// rounding
+	diyfp_t r;
+	r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+	r.e = x.e + y.e + 64;
+	return r;
+}
+
+static diyfp_t diyfp_normalize(diyfp_t x) {
+	while (!(x.f & 0x8000000000000000ull)) {
+		x.f <<= 1;
+		x.e--;
+	}
+	return x;
+}
+
+static void grisu_round(char *buf, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+	while ((rest < wp_w) && (delta - rest >= ten_kappa)
+	  && ((rest + ten_kappa < wp_w) || (wp_w - rest > rest + ten_kappa - wp_w))) {
+		buf[len-1]--;
+		rest += ten_kappa;
+	}
+}
+
+/*
+	generates a round-trip exact, usually the shortest, digit string of
+	a positive, finite VAL, VAL = digits * 10^K; returns the number of
+	digits.
+*/
+static int grisu2(double val, char *buf, int *K) {
+	union { double d; uint64_t u; } u;
+	u.d = val;
+	int bexp = (int)((u.u >> 52) & 0x7ff);
+	diyfp_t v;
+	v.f = u.u & 0x000fffffffffffffull;
+	if (bexp) {
+		v.f += 0x0010000000000000ull;
+		v.e  = bexp - 1075;
+	}
+	else
+		v.e  = -1074;
+
+	// boundaries m- and m+
+	diyfp_t mp, mm;
+	mp.f = (v.f << 1) + 1;
+	mp.e = v.e - 1;
+	while (!(mp.f & (0x0010000000000000ull << 1))) {
+		mp.f <<= 1;
+		mp.e--;
+	}
+	mp.f <<= 10;
+	mp.e -= 10;
+	if (v.f == 0x0010000000000000ull) {
+		mm.f = (v.f << 2) - 1;
+		mm.e = v.e - 2;
+	}
+	else {
+		mm.f = (v.f << 1) - 1;
+		mm.e = v.e - 1;
+	}
+	mm.f <<= mm.e - mp.e;
+	mm.e = mp.e;
+
+	// cached power c = 10^-K with exponent such that W is in [2^-60, 2^-32]
+	double dk = (-61 - mp.e) * 0.30102999566398114 + 347;
+	int k = (int)dk;
+	if (dk - k > 0.0) k++;
+	unsigned idx = (unsigned)((k >> 3) + 1);
+	*K = -(-348 + (int)(idx << 3));
+	diyfp_t c;
+	c.f = grisu_cached_f[idx];
+	c.e = grisu_cached_e[idx];
+
+	diyfp_t W  = diyfp_mul(diyfp_normalize(v), c);
+	diyfp_t Wp = diyfp_mul(mp, c);
+	diyfp_t Wm = diyfp_mul(mm, c);
+	Wm.f++;
+	Wp.f--;
+
+	// digit generation
+	uint64_t delta = Wp.f - Wm.f;
+	uint64_t one_f = 1ull << -Wp.e;
+	uint64_t wp_w  = Wp.f - W.f;
+	uint32_t p1 = (uint32_t)(Wp.f >> -Wp.e);
+	uint64_t p2 = Wp.f & (one_f - 1);
+	int kappa = 10;
+	while (kappa > 1 && p1 < grisu_pow10[kappa-1]) kappa--;
+
+	int len = 0;
+	while (kappa > 0) {
+		uint32_t d = p1 / (uint32_t)grisu_pow10[kappa-1];
+		p1 %= (uint32_t)grisu_pow10[kappa-1];
+		if (d || len) buf[len++] = '0' + d;
+		kappa--;
+		uint64_t rest = ((uint64_t)p1 << -Wp.e) + p2;
+		if (rest <= delta) {
+			*K += kappa;
+			grisu_round(buf, len, delta, rest, grisu_pow10[kappa] << -Wp.e, wp_w);
+			return len;
+		}
+	}
+	for (;;) {
+		p2    *= 10;
+		delta *= 10;
+		char d = (char)(p2 >> -Wp.e);
+		if (d || len) buf[len++] = '0' + d;
+		p2 &= one_f - 1;
+		kappa--;
+		if (p2 < delta) {
+			*K += kappa;
+			int index = -kappa;
+			grisu_round(buf, len, delta, p2, one_f, wp_w * (index < 20 ? grisu_pow10[index] : 0));
+			return len;
+		}
+	}
+}
+
+static int uint2str(char *buf, uint64_t val) {
+	char tmp[20];
+	int k = 0, n = 0;
+	do {
+		tmp[k++] = '0' + (char)(val % 10);
+		val /= 10;
+	} while (val);
+	while (k > 0) buf[n++] = tmp[--k];
+	buf[n] = 0;
+	return n;
+}
+
+int double2str(char *buf, double val) {
+	char *p = buf;
+	if (isnan(val)) {
+		strcpy(buf,"nan");
+		return 3;
+	}
+	if (signbit(val)) {
+		*p++ = '-';
+		val = -val;
+	}
+	if (isinf(val)) {
+		strcpy(p,"inf");
+		return p-buf+3;
+	}
+	if (val < 9007199254740992.0 && val == (double)(uint64_t)val)
+		// integer values, including 0
+		return p-buf + uint2str(p, (uint64_t)val);
+
+	char digits[20];
+	int K, len = grisu2(val, digits, &K);
+	int kk = len + K;		// position of the decimal point
+
+	if ((len <= kk) && (kk <= 21)) {
+		// 1234e7 -> 12340000000
+		memcpy(p, digits, len);
+		memset(p+len, '0', kk-len);
+		p += kk;
+	}
+	else if ((0 < kk) && (kk <= 21)) {
+		// 1234e-2 -> 12.34
+		memcpy(p, digits, kk);
+		p[kk] = '.';
+		memcpy(p+kk+1, digits+kk, len-kk);
+		p += len+1;
+	}
+	else if ((-6 < kk) && (kk <= 0)) {
+		// 1234e-6 -> 0.001234
+		*p++ = '0';
+		*p++ = '.';
+		memset(p, '0', -kk);
+		memcpy(p-kk, digits, len);
+		p += len-kk;
+	}
+	else {
+		// 1234e-30 -> 1.234e-27
+		*p++ = digits[0];
+		if (len > 1) {
+			*p++ = '.';
+			memcpy(p, digits+1, len-1);
+			p += len-1;
+		}
+		int e = kk - 1;
+		*p++ = 'e';
+		*p++ = e < 0 ? '-' : '+';
+		if (e < 0) e = -e;
+		if (e < 10) *p++ = '0';
+		p += uint2str(p, e);
+	}
+	*p = 0;
+	return p-buf;
+}
+
+
+/*
+	buffered output of text, used by the text based writers
+*/
+void textbuf_init(TEXTBUF_TYPE *tb, FILE *fid, HDRTYPE *hdr) {
+	tb->fid   = fid;
+	tb->hdr   = hdr;
+	tb->pos   = 0;
+	tb->count = 0;
+}
+
+size_t textbuf_flush(TEXTBUF_TYPE *tb) {
+	if (tb->pos > 0) {
+		if (tb->hdr != NULL)
+			ifwrite(tb->buf, 1, tb->pos, tb->hdr);
+		else
+			fwrite(tb->buf, 1, tb->pos, tb->fid);
+		tb->count += tb->pos;
+		tb->pos = 0;
+	}
+	return tb->count;
+}
+
+void textbuf_puts(TEXTBUF_TYPE *tb, const char *s) {
+	size_t len = strlen(s);
+	while (tb->pos + len > sizeof(tb->buf)) {
+		size_t n = sizeof(tb->buf) - tb->pos;
+		memcpy(tb->buf + tb->pos, s, n);
+		tb->pos += n;
+		s   += n;
+		len -= n;
+		textbuf_flush(tb);
+	}
+	memcpy(tb->buf + tb->pos, s, len);
+	tb->pos += len;
+}
+
+void textbuf_putc(TEXTBUF_TYPE *tb, char c) {
+	if (tb->pos >= sizeof(tb->buf)) textbuf_flush(tb);
+	tb->buf[tb->pos++] = c;
+}
+
+void textbuf_double(TEXTBUF_TYPE *tb, double val) {
+	if (tb->pos + 32 > sizeof(tb->buf)) textbuf_flush(tb);
+	tb->pos += double2str(tb->buf + tb->pos, val);
+}
+
+
+/*
+	fast conversion of decimal numbers, replacement for strtod.
+	If the number has at most 19 significant digits, the mantissa is at
+	most 2^53 and the decimal exponent is within [-22, 22], the result is
+	obtained with a single (correctly rounded) multiplication or division
+	and is identical to the result of strtod. All other cases, including
+	nan, inf and hexadecimal numbers, are handled by strtod.
+*/
+double str2double(const char *s, char **endptr) {
+#if defined(FLT_EVAL_METHOD) && (FLT_EVAL_METHOD == 0)
+	static const double pow10[] = {
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const char *p = s;
+	while (isspace((unsigned char)*p)) p++;
+
+	char neg = (*p=='-');
+	if ((*p=='-') || (*p=='+')) p++;
+
+	uint64_t m = 0;
+	int nd = 0, exp10 = 0, ndigits = 0;
+	char trunc = 0;
+	for (; isdigit((unsigned char)*p); p++, ndigits++) {
+		if (nd < 19) {
+			m = m*10 + (*p - '0');
+			nd += (m > 0);
+		}
+		else {
+			exp10++;
+			trunc |= (*p != '0');
+		}
+	}
+	if (*p=='.') {
+		for (p++; isdigit((unsigned char)*p); p++, ndigits++) {
+			if (nd < 19) {
+				m = m*10 + (*p - '0');
+				nd += (m > 0);
+				exp10--;
+			}
+			else
+				trunc |= (*p != '0');
+		}
+	}
+	if ((ndigits == 0) || (*p=='x') || (*p=='X'))
+		return strtod(s, endptr);
+
+	if ((*p=='e') || (*p=='E')) {
+		const char *q = p+1;
+		char eneg = (*q=='-');
+		if ((*q=='-') || (*q=='+')) q++;
+		if (isdigit((unsigned char)*q)) {
+			int e = 0;
+			for (; isdigit((unsigned char)*q); q++)
+				if (e < 10000) e = e*10 + (*q - '0');
+			exp10 += eneg ? -e : e;
+			p = q;
+		}
+	}
+
+	if (trunc || (m > 9007199254740992ull) || (exp10 < -22) || (exp10 > 22))
+		return strtod(s, endptr);
+
+	if (endptr != NULL) *endptr = (char*)p;
+	double d = (double)m;
+	d = (exp10 < 0) ? d / pow10[-exp10] : d * pow10[exp10];
+	return neg ? -d : d;
+#else
+	return strtod(s, endptr);
+#endif
+}
+
+
+/*
+	reading text files line by line
+*/
+#define LINEBUF_CHUNK	0x10000
+
+void linebuf_init(LINEBUF_TYPE *lb, HDRTYPE *hdr) {
+	lb->hdr  = hdr;
+	lb->size = LINEBUF_CHUNK;
+	lb->buf  = (char*)malloc(lb->size);
+	lb->pos  = 0;
+	lb->len  = 0;
+	lb->eof  = 0;
+	if (lb->buf == NULL) {
+		lb->size = 0;
+		biosigERROR(hdr, B4C_MEMORY_ALLOCATION_FAILED, "linebuf: memory allocation failed");
+	}
+}
+
+void linebuf_free(LINEBUF_TYPE *lb) {
+	free(lb->buf);
+	lb->buf  = NULL;
+	lb->size = 0;
+}
+
+char* linebuf_next(LINEBUF_TYPE *lb, size_t *len) {
+	if (lb->buf == NULL) return NULL;
+	for (;;) {
+		char *s = lb->buf + lb->pos;
+		size_t n = lb->len - lb->pos;
+		char *e = (char*)memchr(s, '\n', n);
+		char *r = (char*)memchr(s, '\r', e ? (size_t)(e-s) : n);
+		if (r != NULL) {
+			// <CR> or <CR><LF>; <LF> might not be read yet
+			if ((r+1 < lb->buf + lb->len) || lb->eof) {
+				e = r + ((r+1 < lb->buf + lb->len) && (r[1]=='\n'));
+				n = r - s;
+			}
+			else
+				e = NULL;
+		}
+		else if (e != NULL)
+			n = e - s;
+		else if (lb->eof) {
+			// last line without line break
+			if (n == 0) return NULL;
+			lb->buf[lb->len] = 0;
+			lb->pos = lb->len;
+			if (len != NULL) *len = n;
+			return s;
+		}
+
+		if (e != NULL) {
+			s[n] = 0;
+			lb->pos = e + 1 - lb->buf;
+			if (len != NULL) *len = n;
+			return s;
+		}
+
+		// move incomplete line to the beginning of the buffer and read more data
+		memmove(lb->buf, s, lb->len - lb->pos);
+		lb->len -= lb->pos;
+		lb->pos  = 0;
+		if (lb->len + LINEBUF_CHUNK + 1 > lb->size) {
+			size_t size = 2*lb->size + LINEBUF_CHUNK;
+			char *buf = (char*)realloc(lb->buf, size);
+			if (buf == NULL) {
+				biosigERROR(lb->hdr, B4C_MEMORY_ALLOCATION_FAILED, "linebuf: memory allocation failed");
+				return NULL;
+			}
+			lb->buf  = buf;
+			lb->size = size;
+		}
+		size_t count = ifread(lb->buf + lb->len, 1, lb->size - lb->len - 1, lb->hdr);
+		lb->len += count;
+		if (count == 0) lb->eof = 1;
+	}
+}
+
+
+/*
+	monotonic wall clock [s], used for the statistics in HDR.STATS.
+	clock() is not used because it measures CPU time, and misses
+	the time spent waiting for I/O.
+ */
+#if defined(__APPLE__) && !defined(CLOCK_MONOTONIC)
+#include <mach/mach_time.h>	// clock_gettime is available since macOS 10.12 only
+#endif
+static double biosig_clock(void) {
+#if defined(_WIN32)
+	static double f = 0.0;
+	LARGE_INTEGER t;
+	if (f == 0.0) {
+		QueryPerformanceFrequency(&t);
+		f = 1.0/t.QuadPart;
+	}
+	QueryPerformanceCounter(&t);
+	return(t.QuadPart * f);
+#elif defined(__APPLE__) && !defined(CLOCK_MONOTONIC)
+	static double f = 0.0;
+	if (f == 0.0) {
+		mach_timebase_info_data_t tb;
+		mach_timebase_info(&tb);
+		f = 1e-9*tb.numer/tb.denom;
+	}
+	return(mach_absolute_time() * f);
+#else
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return(t.tv_sec + t.tv_nsec*1e-9);
+#endif
+}
+
+#ifdef WITH_TRACE
+/*
+	Tracing of the phases of SOPEN, SREAD, SWRITE and SCLOSE.
+	Tracing is enabled when the environment variable BIOSIG_TRACE contains
+	the name of the output file. The spans are kept in a ring buffer of
+	BIOSIG_TRACE_SIZE entries (default 65536, the oldest spans are
+	overwritten), and are written in Chrome trace format (JSON, can be
+	viewed with chrome://tracing or ui.perfetto.dev) at exit, or when
+	biosig_trace_flush is called.
+	Without WITH_TRACE, the TRACE_* macros are empty.
+ */
+#ifdef WITH_PTHREAD
+#include <pthread.h>
+#endif
+
+struct trace_span {
+	const char	*name;		// static strings only
+	const char	*arg;
+	double		t0;		// [s] since start of tracing
+	double		dt;		// [s]
+	uint64_t	n;
+	unsigned long	tid;
+};
+
+int biosig_trace_on = 0;
+static struct {
+	char		*file;
+	struct trace_span *buf;
+	size_t		size;
+	size_t		N;		// number of spans, the next one is buf[N % size]
+	double		tstart;
+} TRACE;
+#ifdef _PTHREAD_H
+static pthread_mutex_t mutexTrace = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t  onceTrace  = PTHREAD_ONCE_INIT;
+#endif
+
+static void biosig_trace_atexit(void) {
+	biosig_trace_flush();
+}
+
+static void biosig_trace_init_once(void) {
+	const char *f = getenv("BIOSIG_TRACE");
+	if (f==NULL || f[0]==0) return;
+	const char *s = getenv("BIOSIG_TRACE_SIZE");
+	TRACE.size = (s != NULL && atol(s) > 0) ? (size_t)atol(s) : 65536;
+	TRACE.buf  = (struct trace_span*)calloc(TRACE.size, sizeof(struct trace_span));
+	TRACE.file = strdup(f);
+	if (TRACE.buf==NULL || TRACE.file==NULL) {
+		fprintf(stderr,"Warning BIOSIG_TRACE: memory allocation failed, tracing is disabled\n");
+		return;
+	}
+	TRACE.tstart = biosig_clock();
+	atexit(biosig_trace_atexit);
+	biosig_trace_on = 1;
+}
+
+void biosig_trace_init(void) {
+#ifdef _PTHREAD_H
+	pthread_once(&onceTrace, biosig_trace_init_once);
+#else
+	static char init = 0;
+	if (!init) {
+		init = 1;
+		biosig_trace_init_once();
+	}
+#endif
+}
+
+double biosig_trace_begin(void) {
+	return(biosig_clock());
+}
+
+void biosig_trace_end(double t0, const char *name, const char *arg, size_t n) {
+	double t = biosig_clock();
+#ifdef _PTHREAD_H
+	pthread_mutex_lock(&mutexTrace);
+#endif
+	struct trace_span *S = TRACE.buf + (TRACE.N++ % TRACE.size);
+	S->name = name;
+	S->arg  = arg;
+	S->t0   = t0 - TRACE.tstart;
+	S->dt   = t - t0;
+	S->n    = n;
+#ifdef _PTHREAD_H
+	S->tid  = (unsigned long)pthread_self();
+	pthread_mutex_unlock(&mutexTrace);
+#else
+	S->tid  = 0;
+#endif
+}
+
+int biosig_trace_flush(void) {
+	if (!biosig_trace_on) return(0);
+#ifdef _PTHREAD_H
+	pthread_mutex_lock(&mutexTrace);
+#endif
+	FILE *fid = fopen(TRACE.file, "w");
+	if (fid != NULL) {
+#if defined(_WIN32)
+		int pid = 1;
+#else
+		int pid = getpid();
+#endif
+		const char *sep = "";
+		size_t k = (TRACE.N > TRACE.size) ? TRACE.N - TRACE.size : 0;
+		fprintf(fid,"{\"traceEvents\":[");
+		for (; k < TRACE.N; k++, sep = ",") {
+			struct trace_span *S = TRACE.buf + (k % TRACE.size);
+			fprintf(fid,"%s\n{\"name\":\"%s\",\"cat\":\"biosig\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%i,\"tid\":%lu,\"args\":{",
+				sep, S->name, S->t0*1e6, S->dt*1e6, pid, S->tid);
+			if (S->arg != NULL) fprintf(fid,"\"arg\":\"%s\",", S->arg);
+			fprintf(fid,"\"n\":%llu}}", (unsigned long long)S->n);
+		}
+		fprintf(fid,"\n],\"displayTimeUnit\":\"ms\"}\n");
+		fclose(fid);
+	}
+#ifdef _PTHREAD_H
+	pthread_mutex_unlock(&mutexTrace);
+#endif
+	return(fid==NULL ? -1 : 0);
+}
+#endif
+
 /*
 	Interface for mixed use of ZLIB and STDIO
 	If ZLIB is not available, STDIO is used.
@@ -741,12 +1352,16 @@ int ifflush(HDRTYPE* hdr) {
 }
 
 size_t ifread(void* ptr, size_t size, size_t nmemb, HDRTYPE* hdr) {
+	size_t count;
+	hdr->STATS.read_calls++;
 #ifdef ZLIB_H
 	if (hdr->FILE.COMPRESSION>0)
-		return(gzread(hdr->FILE.gzFID, ptr, size * nmemb)/size);
+		count = gzread(hdr->FILE.gzFID, ptr, size * nmemb)/size;
 	else
 #endif
-	return(fread(ptr, size, nmemb, hdr->FILE.FID));
+	count = fread(ptr, size, nmemb, hdr->FILE.FID);
+	hdr->STATS.bytes_read += count*size;
+	return(count);
 }
 
 size_t ifwrite(void* ptr, size_t size, size_t nmemb, HDRTYPE* hdr) {
@@ -795,6 +1410,7 @@ char* ifgets(char *str, int n, HDRTYPE* hdr) {
 }
 
 int ifseek(HDRTYPE* hdr, long offset, int whence) {
+	hdr->STATS.seek_calls++;
 #ifdef ZLIB_H
 	if (hdr->FILE.COMPRESSION) {
 	if (whence==SEEK_END)
@@ -826,6 +1442,7 @@ int ifsetpos(HDRTYPE* hdr, size_t *pos) {
 	p.__pos = *pos;
 #endif
 
+	hdr->STATS.seek_calls++;
 #ifdef ZLIB_H
 	if (hdr->FILE.COMPRESSION) {
 		gzseek(hdr->FILE.gzFID,*pos,SEEK_SET);
@@ -917,6 +1534,7 @@ int compare_eventpos(struct event *e1, struct event *e2) {
 
 void sort_eventtable(HDRTYPE *hdr) {
 	size_t k;
+	double t0 = biosig_clock();
 	struct event *entry = (struct event*) calloc(hdr->EVENT.N, sizeof(struct event));
 	if ((hdr->EVENT.DUR != NULL) && (hdr->EVENT.CHN != NULL))
 	for (k=0; k < hdr->EVENT.N; k++) {
@@ -960,6 +1578,8 @@ void sort_eventtable(HDRTYPE *hdr) {
 #endif
 
 	free(entry);
+	hdr->STATS.t_events += biosig_clock() - t0;
+	TRACE_END(t0, "sort_eventtable", NULL, hdr->EVENT.N);
 }
 
 /*------------------------------------------------------------------------
@@ -1343,8 +1963,13 @@ HDRTYPE* constructHDR(const unsigned NS, const unsigned N_EVENT)
 	hdr->AS.first = 0;
 	hdr->AS.length  = 0;  			// no data loaded
 	memset(hdr->AS.SegSel,0,sizeof(hdr->AS.SegSel)); 
+	memset(&hdr->STATS,0,sizeof(hdr->STATS));
+#ifdef WITH_TRACE
+	biosig_trace_init();
+#endif
 	hdr->Calib = NULL;
 	hdr->rerefCHANNEL = NULL;
+	hdr->REREF = NULL;
 
 	hdr->NRec = 0;
 	hdr->SPR  = 0;
@@ -1617,14 +2242,11 @@ void destructHDR(HDRTYPE* hdr) {
 
 	if (VERBOSE_LEVEL>7)  fprintf(stdout,"destructHDR: free HDR.rerefCHANNEL\n");
 
-#ifdef CHOLMOD_H
-        //if (hdr->Calib) cholmod_print_sparse(hdr->Calib,"destructHDR hdr->Calib",&CHOLMOD_COMMON_VAR);
-	if (VERBOSE_LEVEL>7)  fprintf(stdout,"destructHDR: free hdr->Calib\n");
-	if (hdr->Calib) cholmod_free_sparse(&hdr->Calib, &CHOLMOD_COMMON_VAR);
+	if (VERBOSE_LEVEL>7)  fprintf(stdout,"destructHDR: free hdr->REREF\n");
+	reref_free(hdr->REREF);
 
 	if (VERBOSE_LEVEL>7)  fprintf(stdout,"destructHDR: free hdr->rerefCHANNEL %p\n",hdr->rerefCHANNEL);
 	if (hdr->rerefCHANNEL) free(hdr->rerefCHANNEL);
-#endif
 
 	if (VERBOSE_LEVEL>7)  fprintf(stdout,"destructHDR: free HDR\n");
 
@@ -2531,6 +3153,8 @@ void struct2gdfbin(HDRTYPE *hdr)
 	    		biosigERROR(hdr, B4C_MEMORY_ALLOCATION_FAILED, "Memory allocation failed");
 			return; 
 	    	}
+		// reserved and unused fields must be zero, not left-over heap content
+		memset(hdr->AS.Header, 0, hdr->HeadLen);
 	     	sprintf((char*)hdr->AS.Header,"GDF %4.2f",hdr->VERSION);
 	    	uint8_t* Header2 = hdr->AS.Header+256;
 
@@ -3439,174 +4063,478 @@ void rawEVT2hdrEVT(HDRTYPE *hdr) {
 #endif
 }
 
+/****************************************************************************
+ *                     sparse re-referencing matrix
+ *
+ *	REREF_TYPE is a matrix in compressed sparse row format with one row
+ *	for each output channel. reref_compile splits it into a shared row w
+ *	and a remainder D, so that a common average reference costs about two
+ *	operations per channel and sample instead of NS.
+ ****************************************************************************/
+
+void reref_free(REREF_TYPE *R) {
+	if (R == NULL) return;
+	free(R->p);
+	free(R->i);
+	free(R->x);
+	free(R->wi);
+	free(R->wx);
+	free(R->common);
+	free(R->dp);
+	free(R->di);
+	free(R->dx);
+	free(R);
+}
+
+struct reref_entry {
+	uint32_t	col;
+	double		val;
+};
+
+int compare_reref_entry(const void *e1, const void *e2) {
+	uint32_t c1 = ((const struct reref_entry*)e1)->col;
+	uint32_t c2 = ((const struct reref_entry*)e2)->col;
+	return((c1 > c2) - (c1 < c2));
+}
+
+REREF_TYPE* reref_from_triplets(uint32_t nrow, uint32_t ncol, size_t nnz, const uint32_t *row, const uint32_t *col, const double *val) {
+	size_t k, r, n;
+
+	REREF_TYPE *R = (REREF_TYPE*)calloc(1, sizeof(REREF_TYPE));
+	if (R == NULL) return(NULL);
+	R->nrow = nrow;
+	R->ncol = ncol;
+	R->p = (uint32_t*)calloc(nrow+1, sizeof(uint32_t));
+	R->i = (uint32_t*)malloc(max(nnz,1)*sizeof(uint32_t));
+	R->x = (double*)malloc(max(nnz,1)*sizeof(double));
+	struct reref_entry *e = (struct reref_entry*)malloc(max(nnz,1)*sizeof(struct reref_entry));
+	uint32_t *pos = (uint32_t*)malloc((nrow+1)*sizeof(uint32_t));
+
+	char flag = (R->p==NULL) || (R->i==NULL) || (R->x==NULL) || (e==NULL) || (pos==NULL) || (nnz >= UINT32_MAX);
+	for (k = 0; !flag && (k < nnz); k++) {
+		if ((row[k] >= nrow) || (col[k] >= ncol))
+			flag = 1;
+		else
+			R->p[row[k]+1]++;
+	}
+	if (flag) {
+		free(e);
+		free(pos);
+		reref_free(R);
+		return(NULL);
+	}
+
+	// sort by row (counting sort), and within each row by column
+	for (r = 0; r < nrow; r++)
+		R->p[r+1] += R->p[r];
+	memcpy(pos, R->p, (nrow+1)*sizeof(uint32_t));
+	for (k = 0; k < nnz; k++) {
+		e[pos[row[k]]].col = col[k];
+		e[pos[row[k]]].val = val[k];
+		pos[row[k]]++;
+	}
+	free(pos);
+
+	// sum up duplicate elements and remove zeros
+	for (r = 0, n = 0; r < nrow; r++) {
+		size_t k0 = R->p[r], k1 = R->p[r+1], n0 = n, n1;
+		qsort(e+k0, k1-k0, sizeof(struct reref_entry), &compare_reref_entry);
+		for (k = k0; k < k1; k++) {
+			if ((n > n0) && (R->i[n-1] == e[k].col))
+				R->x[n-1] += e[k].val;
+			else {
+				R->i[n] = e[k].col;
+				R->x[n] = e[k].val;
+				n++;
+			}
+		}
+		for (k = n0, n1 = n, n = n0; k < n1; k++) {
+			if (R->x[k] == 0.0) continue;
+			R->i[n] = R->i[k];
+			R->x[n] = R->x[k];
+			n++;
+		}
+		R->p[r] = n0;
+	}
+	R->p[nrow] = n;
+	free(e);
+	return(R);
+}
+
+/*
+	reref_compile sets w, common and D of R. Column c of w is the value
+	that is used by more than half of the output channels, e.g. -1/NS
+	for a common average reference. A row uses w only if it contains all
+	columns of w, so that a NaN in an input channel affects exactly the
+	same output channels as without w.
+ */
+static int reref_compile(REREF_TYPE *R) {
+	size_t r, k, n;
+	const uint32_t NS = R->ncol;
+	const size_t nnz = R->p[R->nrow];
+
+	uint32_t *cnt = (uint32_t*)calloc(max(NS,1), sizeof(uint32_t));
+	double *w = (double*)calloc(max(NS,1), sizeof(double));
+	R->common = (uint8_t*)calloc(max(R->nrow,1), sizeof(uint8_t));
+	R->dp = (uint32_t*)calloc(R->nrow+1, sizeof(uint32_t));
+	R->di = (uint32_t*)malloc(max(nnz,1)*sizeof(uint32_t));
+	R->dx = (double*)malloc(max(nnz,1)*sizeof(double));
+	if ((cnt==NULL) || (w==NULL) || (R->common==NULL) || (R->dp==NULL) || (R->di==NULL) || (R->dx==NULL)) {
+		free(cnt);
+		free(w);
+		return(-1);
+	}
+
+	// majority vote for each column
+	for (k = 0; k < nnz; k++) {
+		uint32_t c = R->i[k];
+		if (cnt[c] == 0) {
+			w[c]   = R->x[k];
+			cnt[c] = 1;
+		}
+		else if (w[c] == R->x[k])
+			cnt[c]++;
+		else
+			cnt[c]--;
+	}
+	memset(cnt, 0, NS*sizeof(uint32_t));
+	for (k = 0; k < nnz; k++)
+		if (w[R->i[k]] == R->x[k]) cnt[R->i[k]]++;
+	for (k = 0, R->nw = 0; k < NS; k++) {
+		if ((cnt[k] < 2) || (2*(size_t)cnt[k] <= R->nrow))
+			w[k] = 0.0;
+		else
+			R->nw++;
+	}
+	free(cnt);
+
+	R->wi = (uint32_t*)malloc(max(R->nw,1)*sizeof(uint32_t));
+	R->wx = (double*)malloc(max(R->nw,1)*sizeof(double));
+	if ((R->wi==NULL) || (R->wx==NULL)) {
+		free(w);
+		return(-1);
+	}
+	for (k = 0, n = 0; k < NS; k++) {
+		if (w[k] == 0.0) continue;
+		R->wi[n] = k;
+		R->wx[n] = w[k];
+		n++;
+	}
+
+	for (r = 0, n = 0; r < R->nrow; r++) {
+		size_t m = 0, eq = 0;
+		for (k = R->p[r]; k < R->p[r+1]; k++) {
+			if (w[R->i[k]] == 0.0) continue;
+			m++;
+			eq += (w[R->i[k]] == R->x[k]);
+		}
+		R->common[r] = (R->nw > 0) && (m == R->nw) && (eq > 0);
+
+		R->dp[r] = n;
+		for (k = R->p[r]; k < R->p[r+1]; k++) {
+			double v = R->x[k];
+			if (R->common[r]) {
+				if (v == w[R->i[k]]) continue;
+				v -= w[R->i[k]];
+			}
+			R->di[n] = R->i[k];
+			R->dx[n] = v;
+			n++;
+		}
+	}
+	R->dp[R->nrow] = n;
+	free(w);
+	return(0);
+}
+
+/*
+	reref_apply re-references n samples of the row-based block X (R->ncol
+	values for each sample). Output channel r of sample s is written to
+	Y[r*rs + s*ss]. g is a buffer of n elements.
+ */
+static void reref_apply(const REREF_TYPE *R, const biosig_data_type *X, size_t n, biosig_data_type *Y, size_t rs, size_t ss, biosig_data_type *g) {
+	const size_t NS = R->ncol;
+	size_t s, r, k;
+
+	// shared part w*x
+	if (R->nw > 0)
+	for (s = 0; s < n; s++) {
+		const biosig_data_type *x = X + s*NS;
+		biosig_data_type a = 0.0;
+		for (k = 0; k < R->nw; k++)
+			a += R->wx[k] * x[R->wi[k]];
+		g[s] = a;
+	}
+
+	if (ss == 1) {
+		// column-based output: one output channel after the other
+		for (r = 0; r < R->nrow; r++) {
+			const uint32_t k0 = R->dp[r], k1 = R->dp[r+1];
+			const char common = R->common[r];
+			biosig_data_type *y = Y + r*rs;
+			for (s = 0; s < n; s++) {
+				const biosig_data_type *x = X + s*NS;
+				biosig_data_type a = common ? g[s] : 0.0;
+				for (k = k0; k < k1; k++)
+					a += R->dx[k] * x[R->di[k]];
+				y[s] = a;
+			}
+		}
+	}
+	else {
+		// row-based output: one sample after the other
+		for (s = 0; s < n; s++) {
+			const biosig_data_type *x = X + s*NS;
+			biosig_data_type *y = Y + s*ss;
+			for (r = 0; r < R->nrow; r++) {
+				biosig_data_type a = R->common[r] ? g[s] : 0.0;
+				for (k = R->dp[r]; k < R->dp[r+1]; k++)
+					a += R->dx[k] * x[R->di[k]];
+				y[r*rs] = a;
+			}
+		}
+	}
+}
+
+#ifdef CHOLMOD_H
+/* converts a cholmod matrix (one column for each output channel) into REREF_TYPE */
+static REREF_TYPE* reref_from_cholmod(const cholmod_sparse *A) {
+	size_t j, k, nnz = 0;
+	if ((A->xtype != CHOLMOD_REAL) && (A->xtype != CHOLMOD_PATTERN)) return(NULL);
+	if ((A->dtype != CHOLMOD_DOUBLE) || (A->nrow >= UINT32_MAX) || (A->ncol >= UINT32_MAX)) return(NULL);
+
+#define CHOLMOD_IDX(a,k) ((size_t)(A->itype==CHOLMOD_LONG ? ((int64_t*)(a))[k] : ((int*)(a))[k]))
+	for (j = 0; j < A->ncol; j++)
+		nnz += A->packed ? CHOLMOD_IDX(A->p,j+1) - CHOLMOD_IDX(A->p,j) : CHOLMOD_IDX(A->nz,j);
+	nnz *= 1 + (A->stype != 0);
+
+	uint32_t *row = (uint32_t*)malloc(max(nnz,1)*sizeof(uint32_t));
+	uint32_t *col = (uint32_t*)malloc(max(nnz,1)*sizeof(uint32_t));
+	double   *val = (double*)malloc(max(nnz,1)*sizeof(double));
+	REREF_TYPE *R = NULL;
+	if ((row != NULL) && (col != NULL) && (val != NULL)) {
+		size_t n = 0;
+		for (j = 0; j < A->ncol; j++) {
+			size_t k0 = CHOLMOD_IDX(A->p,j);
+			size_t k1 = A->packed ? CHOLMOD_IDX(A->p,j+1) : k0 + CHOLMOD_IDX(A->nz,j);
+			for (k = k0; k < k1; k++) {
+				size_t i = CHOLMOD_IDX(A->i,k);
+				double v = (A->xtype == CHOLMOD_PATTERN) ? 1.0 : ((double*)A->x)[k];
+				// symmetric matrices store only the upper (stype>0) or lower (stype<0) part
+				if (((A->stype > 0) && (i > j)) || ((A->stype < 0) && (i < j))) continue;
+				row[n] = j; col[n] = i; val[n] = v; n++;
+				if (A->stype && (i != j)) {
+					row[n] = i; col[n] = j; val[n] = v; n++;
+				}
+			}
+		}
+		R = reref_from_triplets(A->ncol, A->nrow, n, row, col, val);
+	}
+#undef CHOLMOD_IDX
+	free(row);
+	free(col);
+	free(val);
+	return(R);
+}
+#endif
+
 int NumberOfChannels(HDRTYPE *hdr)
 {
         unsigned int k,NS;
         for (k=0, NS=0; k<hdr->NS; k++)
                 if (hdr->CHANNEL[k].OnOff==1) NS++;
 
-#ifdef CHOLMOD_H
-        if (hdr->Calib == NULL)
+        if (hdr->REREF == NULL)
                 return (NS);
 
-        if (NS == hdr->Calib->nrow)
-                return (hdr->Calib->ncol);
-#endif
+        if (NS == hdr->REREF->ncol)
+                return (hdr->REREF->nrow);
+
         return(hdr->NS);
 }
 
 int RerefCHANNEL(HDRTYPE *hdr, void *arg2, char Mode)
 {
-#ifndef CHOLMOD_H
-                if (!arg2 || !Mode) return(0); // do nothing
+		REREF_TYPE *ReRef = NULL;
+		CHANNEL_TYPE *LABELS = NULL;	// labels from the MatrixMarket file
+		uint16_t NS, *ChanList;
+		size_t i, j, k;
 
-                biosigERROR(hdr, B4C_REREF_FAILED, "Error RerefCHANNEL: cholmod library is missing");
-                return(1);
-#else
                 if (arg2==NULL) Mode = 0; // do nothing
 
-                cholmod_sparse *ReRef=NULL;
-		uint16_t flag,NS;
-                size_t i,j,k;
-                long r;
-		char flagLabelIsSet = 0; 
-
                 switch (Mode) {
                 case 1: {
                         HDRTYPE *RR = sopen((char*)arg2,"r",NULL);
-                        ReRef       = RR->Calib;
-                        if (RR->rerefCHANNEL != NULL) {
-                                flagLabelIsSet = 1; 
-                        	if (hdr->rerefCHANNEL) free(hdr->rerefCHANNEL); 
-                        	hdr->rerefCHANNEL = RR->rerefCHANNEL;
-                        	RR->rerefCHANNEL  = NULL; 
+                        if ((RR->TYPE == MM) && (RR->REREF != NULL)) {
+	                        ReRef           = RR->REREF;
+	                        LABELS          = RR->rerefCHANNEL;
+	                        RR->REREF       = NULL;
+	                        RR->rerefCHANNEL = NULL;
                         }
-                        RR->Calib   = NULL; // do not destroy ReRef
                         destructHDR(RR);
                         RR = NULL;
+                        if (ReRef == NULL) {
+                                biosigERROR(hdr, B4C_REREF_FAILED, "Error RerefCHANNEL: can not read MatrixMarket file");
+                                return(1);
+                        }
                         break;
                         }
-                case 2: ReRef = (cholmod_sparse*) arg2;
-                        CSstart();
+                case 2:
+#ifdef CHOLMOD_H
+                        ReRef = reref_from_cholmod((cholmod_sparse*)arg2);
+                        if (ReRef == NULL) {
+                                biosigERROR(hdr, B4C_REREF_FAILED, "Error RerefCHANNEL: cholmod matrix not supported");
+                                return(1);
+                        }
+                        break;
+#else
+                        biosigERROR(hdr, B4C_REREF_FAILED, "Error RerefCHANNEL: cholmod library is missing");
+                        return(1);
+#endif
+                case 3: {
+                        const REREF_TYPE *A = (const REREF_TYPE*)arg2;
+                        uint32_t *row = (uint32_t*)malloc(max(A->p[A->nrow],1)*sizeof(uint32_t));
+                        if (row != NULL) {
+                                for (i=0; i<A->nrow; i++)
+                                        for (k=A->p[i]; k<A->p[i+1]; k++) row[k] = i;
+                                ReRef = reref_from_triplets(A->nrow, A->ncol, A->p[A->nrow], row, A->i, A->x);
+                                free(row);
+                        }
+                        if (ReRef == NULL) {
+                                biosigERROR(hdr, B4C_REREF_FAILED, "Error RerefCHANNEL: invalid ReRef-matrix");
+                                return(1);
+                        }
                         break;
+                        }
                 }
 
                 if ((ReRef==NULL) || !Mode) {
                         // reset rereferencing
-
-        		if (hdr->Calib != NULL)
-				 cholmod_free_sparse(&hdr->Calib, &CHOLMOD_COMMON_VAR);
-                        hdr->Calib = ReRef;
+                        reref_free(hdr->REREF);
+                        hdr->REREF = NULL;
         		if (hdr->rerefCHANNEL) free(hdr->rerefCHANNEL);
         		hdr->rerefCHANNEL = NULL;
-
         	        return(0);
                 }
-                cholmod_sparse *A = ReRef;
 
                 // check dimensions
                 for (k=0, NS=0; k<hdr->NS; k++)
                         if (hdr->CHANNEL[k].OnOff) NS++;
-                if (NS - A->nrow) {
+                ChanList = (uint16_t*)malloc(max(NS,1)*sizeof(uint16_t));
+                if ((NS != ReRef->ncol) || (ChanList == NULL) || reref_compile(ReRef)) {
+                        reref_free(ReRef);
+                        free(LABELS);
+                        free(ChanList);
                         biosigERROR(hdr, B4C_REREF_FAILED, "Error REREF_CHAN: size of data does not fit ReRef-matrix");
                         return(1);
                 }
+                for (k=0, NS=0; k<hdr->NS; k++)
+                        if (hdr->CHANNEL[k].OnOff) ChanList[NS++] = k;
 
-                // allocate memory
-		if (hdr->Calib != NULL)
-                        cholmod_free_sparse(&hdr->Calib, &CHOLMOD_COMMON_VAR);
-
-		if (VERBOSE_LEVEL>8) {
-			CHOLMOD_COMMON_VAR.print = 5;
-			cholmod_print_sparse(ReRef,"HDR.Calib", &CHOLMOD_COMMON_VAR);
-		}
-
-                hdr->Calib = ReRef;
-                if (hdr->rerefCHANNEL==NULL)
-			hdr->rerefCHANNEL = (CHANNEL_TYPE*) realloc(hdr->rerefCHANNEL, A->ncol*sizeof(CHANNEL_TYPE));
+		if (VERBOSE_LEVEL>8)
+			fprintf(stdout,"RerefCHANNEL: %i x %i, %i elements, shared row with %i elements\n",ReRef->nrow,ReRef->ncol,ReRef->p[ReRef->nrow],ReRef->nw);
 
-		CHANNEL_TYPE *NEWCHANNEL = hdr->rerefCHANNEL; 
-                hdr->FLAG.ROW_BASED_CHANNELS = 1;
+                reref_free(hdr->REREF);
+                hdr->REREF = ReRef;
+                if (hdr->rerefCHANNEL) free(hdr->rerefCHANNEL);
+                hdr->rerefCHANNEL = (CHANNEL_TYPE*) calloc(max(ReRef->nrow,1), sizeof(CHANNEL_TYPE));
+		CHANNEL_TYPE *NEWCHANNEL = hdr->rerefCHANNEL;
 
                 // check each component
-       		for (i=0; i<A->ncol; i++)         // i .. column index
+       		for (i=0; i<ReRef->nrow; i++)         // i .. row index, output channel
        		{
-			flag = 0;
-			int mix = -1, oix = -1, pix = -1;
+			int mix = -1, oix = -1;
 			double m  = 0.0;
-			double v;
-			for (j = *((unsigned*)(A->p)+i); j < *((unsigned*)(A->p)+i+1); j++) {
+			double v, PhysMax = 0.0;
+			CHANNEL_TYPE *cp;
+
+			NEWCHANNEL[i].OnOff      = 1;
+			NEWCHANNEL[i].LeadIdCode = 0;
+			NEWCHANNEL[i].Cal        = 1.0;
+			NEWCHANNEL[i].Off        = 0.0;
+			NEWCHANNEL[i].SPR        = hdr->SPR;
+			NEWCHANNEL[i].GDFTYP     = 16;
+			for (j = ReRef->p[i]; j < ReRef->p[i+1]; j++) {
 
-				v = *(((double*)A->x)+j);
-				r = *(((int*)A->i)+j);        // r .. row index
+				v  = ReRef->x[j];
+				cp = hdr->CHANNEL + ChanList[ReRef->i[j]];
+				PhysMax += fabs(v) * max(fabs(cp->PhysMax), fabs(cp->PhysMin));
 
 				if (v>m) {
 					m = v;
-					mix = r;
+					mix = ChanList[ReRef->i[j]];
 				}
 				if (v==1.0) {
 					if (oix<0)
-						oix = r;
+						oix = ChanList[ReRef->i[j]];
 					else
 						fprintf(stderr,"Warning: ambiguous channel information (in new #%i,%i more than one scaling factor of 1.0 is used.) \n",(int)i,(int)j);
 				}
-				if (v) {
-					if (pix == -1) {
-                				//memcpy(NEWCHANNEL+i, hdr->CHANNEL+r, sizeof(CHANNEL_TYPE));
-					        NEWCHANNEL[i].PhysDimCode = hdr->CHANNEL[r].PhysDimCode;
-					        NEWCHANNEL[i].LowPass 	  = hdr->CHANNEL[r].LowPass;
-					        NEWCHANNEL[i].HighPass    = hdr->CHANNEL[r].HighPass;
-					        NEWCHANNEL[i].Notch 	  = hdr->CHANNEL[r].Notch;
-					        NEWCHANNEL[i].SPR 	  = hdr->CHANNEL[r].SPR;
-					        NEWCHANNEL[i].GDFTYP      = hdr->CHANNEL[r].GDFTYP;
-				                NEWCHANNEL[i].Impedance   = fabs(v)*hdr->CHANNEL[r].Impedance;
-						NEWCHANNEL[i].OnOff       = 1;
-						NEWCHANNEL[i].LeadIdCode  = 0;
-						if (!flagLabelIsSet) memcpy(NEWCHANNEL[i].Label, hdr->CHANNEL[r].Label, MAX_LENGTH_LABEL);
-				                pix = 0;
-					}
-					else {
-					        if (NEWCHANNEL[i].PhysDimCode != hdr->CHANNEL[r].PhysDimCode)
-					                NEWCHANNEL[i].PhysDimCode = 0;
-					        if (NEWCHANNEL[i].LowPass != hdr->CHANNEL[r].LowPass)
-					                NEWCHANNEL[i].LowPass = NAN;
-					        if (NEWCHANNEL[i].HighPass != hdr->CHANNEL[r].HighPass)
-					                NEWCHANNEL[i].HighPass = NAN;
-					        if (NEWCHANNEL[i].Notch != hdr->CHANNEL[r].Notch)
-					                NEWCHANNEL[i].Notch = NAN;
-
-					        if (NEWCHANNEL[i].SPR != hdr->CHANNEL[r].SPR)
-					                NEWCHANNEL[i].SPR = lcm(NEWCHANNEL[i].SPR, hdr->CHANNEL[r].SPR);
-					        if (NEWCHANNEL[i].GDFTYP != hdr->CHANNEL[r].GDFTYP)
-					                NEWCHANNEL[i].GDFTYP = max(NEWCHANNEL[i].GDFTYP, hdr->CHANNEL[r].GDFTYP);
-
-				                NEWCHANNEL[i].Impedance += fabs(v)*NEWCHANNEL[r].Impedance;
-				                NEWCHANNEL[i].GDFTYP = 16;
-					}
-				}
-				if (r >= hdr->NS) {
-					flag = 1;
-					fprintf(stderr,"Error: index (%i) in channel (%i) exceeds number of channels (%i)\n",(int)r,(int)i,hdr->NS);
+				if (j == ReRef->p[i]) {
+				        NEWCHANNEL[i].PhysDimCode = cp->PhysDimCode;
+				        NEWCHANNEL[i].LowPass 	  = cp->LowPass;
+				        NEWCHANNEL[i].HighPass    = cp->HighPass;
+				        NEWCHANNEL[i].Notch 	  = cp->Notch;
+				        NEWCHANNEL[i].SPR 	  = cp->SPR;
+				        NEWCHANNEL[i].GDFTYP      = cp->GDFTYP;
+			                NEWCHANNEL[i].Impedance   = fabs(v)*cp->Impedance;
 				}
+				else {
+				        if (NEWCHANNEL[i].PhysDimCode != cp->PhysDimCode)
+				                NEWCHANNEL[i].PhysDimCode = 0;
+				        if (NEWCHANNEL[i].LowPass != cp->LowPass)
+				                NEWCHANNEL[i].LowPass = NAN;
+				        if (NEWCHANNEL[i].HighPass != cp->HighPass)
+				                NEWCHANNEL[i].HighPass = NAN;
+				        if (NEWCHANNEL[i].Notch != cp->Notch)
+				                NEWCHANNEL[i].Notch = NAN;
+
+				        if (NEWCHANNEL[i].SPR != cp->SPR)
+				                NEWCHANNEL[i].SPR = lcm(NEWCHANNEL[i].SPR, cp->SPR);
+
+			                NEWCHANNEL[i].Impedance += fabs(v)*cp->Impedance;
+				}
+			}
+
+			/* ranges of the output channel: a positively scaled copy of a
+			   single channel keeps its scaling, all other combinations are
+			   stored as float with Cal=1, Off=0 */
+			j = ReRef->p[i];
+			if ((ReRef->p[i+1] == j+1) && (ReRef->x[j] > 0)) {
+				v  = ReRef->x[j];
+				cp = hdr->CHANNEL + ChanList[ReRef->i[j]];
+				NEWCHANNEL[i].Cal     = v * cp->Cal;
+				NEWCHANNEL[i].Off     = v * cp->Off;
+				NEWCHANNEL[i].PhysMax = v * cp->PhysMax;
+				NEWCHANNEL[i].PhysMin = v * cp->PhysMin;
+				NEWCHANNEL[i].DigMax  = cp->DigMax;
+				NEWCHANNEL[i].DigMin  = cp->DigMin;
+			}
+			else {
+				if (!(PhysMax > 0.0)) PhysMax = 1.0;	// empty row, or no range of the input channels
+				NEWCHANNEL[i].GDFTYP  = 16;
+				NEWCHANNEL[i].PhysMax = PhysMax;
+				NEWCHANNEL[i].PhysMin = -PhysMax;
+				NEWCHANNEL[i].DigMax  = PhysMax;
+				NEWCHANNEL[i].DigMin  = -PhysMax;
 			}
 
 			// heuristic to determine hdr->CHANNEL[k].Label;
+			int r;
 			if (oix>-1) r=oix;        // use the info from channel with a scaling of 1.0 ;
 			else if (mix>-1) r=mix;   // use the info from channel with the largest scale;
 			else r = -1;
 
-			if (flagLabelIsSet)
-                               ; 
-			else if (!flag && (r<hdr->NS) && (r>=0)) {
-			        // if successful
-			        memcpy(NEWCHANNEL[i].Label, hdr->CHANNEL[r].Label, MAX_LENGTH_LABEL);
-                        }
-			else {
+			if ((LABELS != NULL) && LABELS[i].Label[0])
+				memcpy(NEWCHANNEL[i].Label, LABELS[i].Label, MAX_LENGTH_LABEL+1);
+			else if (r>=0)
+			        memcpy(NEWCHANNEL[i].Label, hdr->CHANNEL[r].Label, MAX_LENGTH_LABEL+1);
+			else
 			        sprintf(NEWCHANNEL[i].Label,"component #%i",(int)i);
-			}
                 }
+		free(LABELS);
+		free(ChanList);
 		return(0);
-#endif
 }
 
 
@@ -3694,6 +4622,7 @@ int read_header(HDRTYPE *hdr) {
 	}
 	else if (hdr->FILE.size > hdr->HeadLen + hdr->AS.bpb*(size_t)hdr->NRec + 8)
 	{
+			double t0 = biosig_clock();
 			if (VERBOSE_LEVEL > 7) 
 				fprintf(stdout,"GDF EVENT: %i,%i %i,%i,%i\n",(int)hdr->FILE.size, (int)(hdr->HeadLen + hdr->AS.bpb*hdr->NRec + 8), hdr->HeadLen, hdr->AS.bpb, (int)hdr->NRec); 
 
@@ -3733,6 +4662,8 @@ int read_header(HDRTYPE *hdr) {
                                 return(-3);
 			}
 			rawEVT2hdrEVT(hdr);
+			hdr->STATS.t_events += biosig_clock() - t0;
+			TRACE_END(t0, "events", "GDF", hdr->EVENT.N);
 		}
 		else
 			hdr->EVENT.N = 0;
@@ -3746,6 +4677,8 @@ int read_header(HDRTYPE *hdr) {
 /****************************************************************************/
 /**                     SOPEN                                              **/
 /****************************************************************************/
+static HDRTYPE* sopen_intern(const char* FileName, const char* MODE, HDRTYPE* hdr);
+
 HDRTYPE* sopen(const char* FileName, const char* MODE, HDRTYPE* hdr)
 /*
 	MODE="r"
@@ -3753,6 +4686,17 @@ HDRTYPE* sopen(const char* FileName, const char* MODE, HDRTYPE* hdr)
 	MODE="w"
 		writes HDR into file
  */
+{
+	double t0  = biosig_clock();
+	double tev = (hdr != NULL) ? hdr->STATS.t_events : 0.0;
+	hdr = sopen_intern(FileName, MODE, hdr);
+	if (hdr != NULL)
+		hdr->STATS.t_header += biosig_clock() - t0 - (hdr->STATS.t_events - tev);
+	TRACE_END(t0, (MODE[0]=='r') ? "sopen(r)" : "sopen(w)", hdr ? GetFileTypeString(hdr->TYPE) : NULL, hdr ? hdr->NS : 0);
+	return(hdr);
+}
+
+static HDRTYPE* sopen_intern(const char* FileName, const char* MODE, HDRTYPE* hdr)
 {
 
 //    	unsigned int 	k2;
@@ -3807,7 +4751,7 @@ if (!strncmp(MODE,"a",1)) {
 
 	if (hdr->FILE.size==0) {
 		if (hdr->FILE.OPEN) ifclose(hdr);
-		return( sopen(FileName, "w", hdr) );
+		return( sopen_intern(FileName, "w", hdr) );
 	} 
 	else if (hdr->FILE.size < 256) {
 		biosigERROR(hdr, B4C_FORMAT_UNSUPPORTED, "Error SOPEN(APPEND);  file format not supported.");
@@ -3997,7 +4941,9 @@ else if (!strncmp(MODE,"r",1)) {
 
 	if (VERBOSE_LEVEL>7) fprintf(stdout,"[222] %i\n",(int)count);
 	hdr->HeadLen = count;
+	TRACE_BEGIN(trft);
 	getfiletype(hdr);
+	TRACE_END(trft, "getfiletype", GetFileTypeString(hdr->TYPE), count);
 	if (VERBOSE_LEVEL>7) fprintf(stdout,"[201] FMT=%s Ver=%4.2f\n",GetFileTypeString(hdr->TYPE),hdr->VERSION);
 
 #ifndef  ONLYGDF
@@ -4342,6 +5288,7 @@ else if (!strncmp(MODE,"r",1)) {
 			hdr->NRec = (FileBuf.st_size - hdr->HeadLen)/hdr->AS.bpb;
 		}
 
+		double tev = biosig_clock();
 		if (AnnotationChannel) {
 			/* read Annotation and Status channel and extract event information */
 			CHANNEL_TYPE *hc = hdr->CHANNEL+AnnotationChannel-1;
@@ -4489,6 +5436,8 @@ if (VERBOSE_LEVEL>7) fprintf(stdout,"EDF+ event\n\ts1:\t<%s>\n\ts2:\t<%s>\n\ts3:
 				free(Marker);
 
 		}	/* End reading BDF Status channel */
+		hdr->STATS.t_events += biosig_clock() - tev;
+		TRACE_END(tev, "events", GetFileTypeString(hdr->TYPE), hdr->EVENT.N);
 
 		ifseek(hdr, hdr->HeadLen, SEEK_SET);
 	}
@@ -4543,6 +5492,7 @@ if (VERBOSE_LEVEL>7) fprintf(stdout,"EDF+ event\n\ts1:\t<%s>\n\ts2:\t<%s>\n\ts3:
 
 		typeof(hdr->NS) TIMECHANNEL = 0;
 
+		hdr->AS.bpb = 0;
 		str = strtok(line,"\t\n\r");
 		for (k = 0; k < hdr->NS; k++) {
 			CHANNEL_TYPE *hc = hdr->CHANNEL+k;
@@ -5236,7 +6186,7 @@ fprintf(stdout,"ACQ EVENT: %i POS: %i\n",k,POS);
 							char *bufbak  = buf; 	// backup copy
 							char **endptr = &bufbak;
 							for (k = 0; k < cp->SPR; k++) {
-								double d = strtod(*endptr,endptr);
+								double d = str2double(*endptr,endptr);
 								*(double*)(hdr->AS.rawdata+lengthRawData+sz*k) = d;
 							}
 							lengthRawData += bufsiz;
@@ -6185,40 +7135,46 @@ if (VERBOSE_LEVEL>8)
 		}
 		hdr->HeadLen  = 0;
 	    	if (FLAG_ASCII) {
-	    		count = 0;
-			size_t bufsiz  = hdr->NS*hdr->SPR*hdr->NRec*16;
-			while (!ifeof(hdr)) {
-			    	hdr->AS.Header = (uint8_t*)realloc(hdr->AS.Header,count+bufsiz+1);
-		    		count += ifread(hdr->AS.Header+count,1,bufsiz,hdr);
-			}
-			ifclose(hdr);
-			hdr->AS.Header[count]=0;	// terminating null character
-
-			size_t pos=0;
-			if (DECIMALSYMBOL != '.')
-				do {
-					if (hdr->AS.Header[pos]==DECIMALSYMBOL)
-						hdr->AS.Header[pos] = '.';
-				} while (hdr->AS.Header[++pos]);
-
-			pos = 0;
-	    		while (SKIPLINES>0) {
-				while (!iscntrl(hdr->AS.Header[pos])) pos++; 	// skip line
-				while ( iscntrl(hdr->AS.Header[pos])) pos++;	// skip line feed and carriage return
+			LINEBUF_TYPE lb;
+			linebuf_init(&lb, hdr);
+			while ((SKIPLINES > 0) && (linebuf_next(&lb, NULL) != NULL))
 				SKIPLINES--;
-	    		}
 
-			hdr->AS.rawdata = (uint8_t*)malloc(hdr->NS*npts*sizeof(double));
-			char* POS=(char*)(hdr->AS.Header+pos);
-			for (k=0; k < hdr->NS*npts; k++) {
-		    		if (((orientation==MUL) && !(k%hdr->NS)) ||
-		    		    ((orientation==VEC) && !(k%npts))) {
-		    		    	double d;
-			    		int sc = SKIPCOLUMNS;
-					while (sc--) d=strtod(POS,&POS);	// skip value, return value is ignored
-	    			}
-		    		*(double*)(hdr->AS.rawdata+k*sizeof(double)) = strtod(POS,&POS);
+			size_t N = hdr->NS*npts;
+			hdr->AS.rawdata = (uint8_t*)calloc(N, sizeof(double));
+			double *data = (double*)hdr->AS.rawdata;
+			char *line, *POS, *end;
+			char flagSkip = 1;
+			k = 0;
+			while ((k < N) && ((line = linebuf_next(&lb, NULL)) != NULL)) {
+				if (DECIMALSYMBOL != '.')
+					for (POS = line; (POS = strchr(POS, DECIMALSYMBOL)) != NULL; ) *POS = '.';
+
+				POS = line;
+				while (k < N) {
+			    		if (flagSkip && (((orientation==MUL) && !(k%hdr->NS)) ||
+			    		    ((orientation==VEC) && !(k%npts)))) {
+				    		int sc = SKIPCOLUMNS;
+						// skip leading columns, these can contain labels
+						while (sc > 0) {
+							POS += strspn(POS, " \t");
+							if (*POS == 0) break;
+							POS += strcspn(POS, " \t");
+							sc--;
+						}
+						if (sc > 0) break;	// continue in next line
+						flagSkip = 0;
+		    			}
+					double d = str2double(POS, &end);
+					if (end == POS) break;	// end of line
+					data[k++] = d;
+					POS = end;
+					flagSkip = 1;
+				}
 	    		}
+			linebuf_free(&lb);
+			ifclose(hdr);
+			if (hdr->AS.B4C_ERRNUM) return(hdr);
 	    		hdr->TYPE = native;
 			hdr->AS.length  = hdr->NRec;
 	    	}
@@ -9400,73 +10356,145 @@ if (VERBOSE_LEVEL>2)
 
 	} /* END OF MIT FORMAT */
 
-#ifdef CHOLMOD_H
-	else if ((hdr->TYPE==MM) && (!hdr->FILE.COMPRESSION)) {
+	else if (hdr->TYPE==MM) {
+		/* MatrixMarket file with a re-referencing matrix, see RerefCHANNEL;
+		   the matrix has one row for each input channel and one column for
+		   each output channel, and is stored transposed in hdr->REREF */
+		LINEBUF_TYPE lb;
+		char *line, *s;
+		size_t len, nnz = 0, nmax = 0, k = 0, ns = 0;
+		unsigned long M = 0, N = 0, L = 0;
+		char flagArray = 0, flagPattern = 0, status = 0;
+		int  symm = 0;		// 1: symmetric, -1: skew-symmetric
+		uint32_t *row = NULL, *col = NULL;
+		double *val = NULL;
 
 		if (VERBOSE_LEVEL>7) fprintf(stdout,"[MM 001] %i,%i\n",hdr->HeadLen,hdr->FILE.COMPRESSION);
 
-		while (!ifeof(hdr)) {
-			count = max(5000, hdr->HeadLen*2);
-			hdr->AS.Header = (uint8_t*)realloc(hdr->AS.Header, count);
-			hdr->HeadLen  += ifread(hdr->AS.Header + hdr->HeadLen, 1, count - hdr->HeadLen - 1, hdr);
-		}
-
-		if (VERBOSE_LEVEL>7) fprintf(stdout,"[MM 003] %i,%i\n",hdr->HeadLen,hdr->FILE.COMPRESSION);
-
-		char *line = strtok((char*)hdr->AS.Header, "\x0a\x0d");
-		char status = 0; 
-		unsigned long ns = 0; 
-		while (line != NULL) {
+		ifseek(hdr, 0, SEEK_SET);
+		linebuf_init(&lb, hdr);
+		line = linebuf_next(&lb, &len);
+		if (line != NULL) {
+			for (s = line; *s; s++) *s = tolower(*s);
+			flagArray   = (strstr(line," array") != NULL);
+			flagPattern = (strstr(line," pattern") != NULL);
+			symm = (strstr(line," skew-symmetric") != NULL) ? -1 : (strstr(line," symmetric") != NULL);
+			if (!strstr(line," matrix") || strstr(line," complex") || strstr(line," hermitian") || (flagArray && symm))
+				biosigERROR(hdr, B4C_FORMAT_UNSUPPORTED, "MatrixMarket: only real and general or symmetric matrices are supported");
+		}
+
+		while (!hdr->AS.B4C_ERRNUM && ((line = linebuf_next(&lb, &len)) != NULL)) {
+
+			if (line[0]=='%') {
+				if ((line[1]=='%') && isspace(line[2])) {
+					if (!strncmp(line+3,"LABELS",6))
+						status = 1;
+					else if (!strncmp(line+3,"ENDLABEL",8))
+						status = 0;
+					else if (status) {
+						unsigned long ch = strtoul(line+3, &s, 10);
+						while (isspace(*s)) s++;
+						// labels might precede the size line, the number of channels is limited by HDR.NS
+						if (ch > (N ? N : 0xffff)) {
+							biosigERROR(hdr, B4C_FORMAT_UNSUPPORTED, "MatrixMarket: invalid channel number in LABELS");
+							break;
+						}
+						if (ch > ns) {
+							CHANNEL_TYPE *c = (CHANNEL_TYPE*)realloc(hdr->rerefCHANNEL, ch*sizeof(CHANNEL_TYPE));
+							if (c == NULL) {
+								biosigERROR(hdr, B4C_MEMORY_ALLOCATION_FAILED, "MatrixMarket: not enough memory");
+								break;
+							}
+							hdr->rerefCHANNEL = c;
+							memset(hdr->rerefCHANNEL+ns, 0, (ch-ns)*sizeof(CHANNEL_TYPE));
+							ns = ch;
+						}
+						if (ch > 0) {
+							strncpy(hdr->rerefCHANNEL[ch-1].Label, s, MAX_LENGTH_LABEL);
+							hdr->rerefCHANNEL[ch-1].Label[MAX_LENGTH_LABEL] = 0;
+							hdr->rerefCHANNEL[ch-1].OnOff = 1;
+						}
+		if (VERBOSE_LEVEL>7) fprintf(stdout,"[MM 027] %i <%s>\n",(int)ch,s);
+					}
+				}
+				continue;
+			}
 
-		if (VERBOSE_LEVEL>7) fprintf(stdout,"[MM 013] <%s>\n",line);
+			for (s = line; isspace(*s); s++);
+			if (*s == 0) continue;	// empty line
 
-			if ((line[0]=='%') && (line[1]=='%') && isspace(line[2])) {
-				if (!strncmp(line+3,"LABELS",6)) 
-					status = 1;
-				else if (!strncmp(line+3,"ENDLABEL",8)) {
-					status = 0;
+			if (M == 0) {
+				// size line
+				M = strtoul(s, &s, 10);
+				N = strtoul(s, &s, 10);
+				L = flagArray ? M*N : strtoul(s, &s, 10);
+				nmax = symm ? 2*L : L;
+				if ((M == 0) || (N == 0) || (M >= UINT32_MAX) || (N >= UINT32_MAX) || (L > M*N)) {
+					biosigERROR(hdr, B4C_FORMAT_UNSUPPORTED, "MatrixMarket: invalid size");
 					break;
 				}
-				if (status) {
-					int k = 3;
-					while (isspace(line[k])) k++; 
-					unsigned long ch = strtoul(line+k, &line, 10);
-					while (isspace(line[0])) line++;
-					if (ch >= ns) {	
-						hdr->rerefCHANNEL = (CHANNEL_TYPE*)realloc(hdr->rerefCHANNEL, ch*sizeof(CHANNEL_TYPE));
-
-						while (ns < ch) {
-							hdr->rerefCHANNEL[ns].Label[0] = 0;
-							ns++;
-						}
-					}	 
-					strncpy(hdr->rerefCHANNEL[ch-1].Label, line, MAX_LENGTH_LABEL);
-					hdr->rerefCHANNEL[ch-1].OnOff = 1;
-					hdr->rerefCHANNEL[ch-1].Label[MAX_LENGTH_LABEL] = 0;
-					hdr->rerefCHANNEL[ch-1].LeadIdCode = 0;
-					
-		if (VERBOSE_LEVEL>7) fprintf(stdout,"[MM 027] %i <%s>\n",(int)ch,line);
-				}
+				row = (uint32_t*)malloc(max(nmax,1)*sizeof(uint32_t));
+				col = (uint32_t*)malloc(max(nmax,1)*sizeof(uint32_t));
+				val = (double*)malloc(max(nmax,1)*sizeof(double));
+				if ((row == NULL) || (col == NULL) || (val == NULL))
+					biosigERROR(hdr, B4C_MEMORY_ALLOCATION_FAILED, "MatrixMarket: not enough memory");
+				continue;
 			}
-			line = strtok(NULL,"\x0a\x0d");
-		}
 
-		if (VERBOSE_LEVEL>7) fprintf(stdout,"[MM 033]\n");
+			unsigned long r, c;
+			double v = 1.0;
+			if (flagArray) {
+				// column-major order
+				r = k % M + 1;
+				c = k / M + 1;
+				v = str2double(s, &s);
+			}
+			else {
+				r = strtoul(s, &s, 10);
+				c = strtoul(s, &s, 10);
+				if (!flagPattern) v = str2double(s, &s);
+			}
+			k++;
+			if ((r < 1) || (r > M) || (c < 1) || (c > N) || (k > L)) {
+				biosigERROR(hdr, B4C_FORMAT_UNSUPPORTED, "MatrixMarket: invalid element");
+				break;
+			}
+			row[nnz] = c-1; col[nnz] = r-1; val[nnz] = v; nnz++;
+			if (symm && (r != c)) {
+				row[nnz] = r-1; col[nnz] = c-1; val[nnz] = symm*v; nnz++;
+			}
+		}
+		linebuf_free(&lb);
 
-		ifseek(hdr,0,SEEK_SET);
+		if (VERBOSE_LEVEL>7) fprintf(stdout,"[MM 033] %lu x %lu, %i elements\n",M,N,(int)nnz);
 
-		CSstart();	// init cholmod library
-                CHOLMOD_COMMON_VAR.print = 5;
-                hdr->Calib = cholmod_read_sparse (hdr->FILE.FID, &CHOLMOD_COMMON_VAR); /* read in a matrix */
+		if (!hdr->AS.B4C_ERRNUM) {
+			hdr->REREF = reref_from_triplets(N, M, nnz, row, col, val);
+			if (hdr->REREF == NULL)
+				biosigERROR(hdr, B4C_FORMAT_UNSUPPORTED, "MatrixMarket: invalid matrix");
+		}
+		free(row);
+		free(col);
+		free(val);
 
-                if (VERBOSE_LEVEL>7)
-                        cholmod_print_sparse (hdr->Calib, "Calib", &CHOLMOD_COMMON_VAR); /* print the matrix */
+		// one (possibly empty) label for each output channel
+		if (hdr->REREF && (ns != N)) {
+			CHANNEL_TYPE *c = (CHANNEL_TYPE*)realloc(hdr->rerefCHANNEL, N*sizeof(CHANNEL_TYPE));
+			if (c == NULL) {
+				biosigERROR(hdr, B4C_MEMORY_ALLOCATION_FAILED, "MatrixMarket: not enough memory");
+				reref_free(hdr->REREF);
+				hdr->REREF = NULL;
+			}
+			else {
+				hdr->rerefCHANNEL = c;
+				if (ns < N) memset(hdr->rerefCHANNEL+ns, 0, (N-ns)*sizeof(CHANNEL_TYPE));
+			}
+		}
 
 		ifclose(hdr);
 		if (VERBOSE_LEVEL>7) fprintf(stdout,"[MM 999]\n");
 		return(hdr);
 	} /* END OF MatrixMarket */
-#endif
 
 	else if (hdr->TYPE==NEURON) {
 		hdr->HeadLen = count;
@@ -10908,18 +11936,27 @@ if (VERBOSE_LEVEL>2)
 		hdr->SPR  = 1;
 		hdr->AS.bpb = 0;
 		ifseek(hdr,0,SEEK_SET);
-		char line[81];
-		ifgets(line,80,hdr);
+		/* FreeTextEvent does not copy the annotation: the descriptions are
+		   kept in auxBUF, in one slot of 64 bytes for each CodeDesc entry */
+		hdr->AS.auxBUF = (uint8_t*)realloc(hdr->AS.auxBUF, 257*64);
+		if (hdr->AS.auxBUF == NULL) {
+			biosigERROR(hdr, B4C_MEMORY_ALLOCATION_FAILED, "IBI: memory allocation failed");
+			return(hdr);
+		}
+		LINEBUF_TYPE lb;
+		linebuf_init(&lb, hdr);
+		char *line;
 		size_t N = 0;
 		hdr->EVENT.N = 0;
-		while (!ifeof(hdr) && strlen(line)) {
+		while (!hdr->AS.B4C_ERRNUM && ((line = linebuf_next(&lb, NULL)) != NULL) && line[0]) {
 
 			if (isdigit(line[0])) {
 				struct tm t;
 				int ms,rri;
-				char *desc = NULL;
+				char desc[64];
+				desc[0] = 0;
 
-				sscanf(line,"%02u-%02u-%02u %02u:%02u:%02u %03u %as %u", &t.tm_mday, &t.tm_mon, &t.tm_year, &t.tm_hour, &t.tm_min, &t.tm_sec, &ms, &desc, &rri);
+				sscanf(line,"%02u-%02u-%02u %02u:%02u:%02u %03u %63s %u", &t.tm_mday, &t.tm_mon, &t.tm_year, &t.tm_hour, &t.tm_min, &t.tm_sec, &ms, desc, &rri);
 				if (t.tm_year < 1970) t.tm_year += 100;
 				t.tm_mon--;
 				t.tm_isdst = -1;
@@ -10943,11 +11980,20 @@ if (VERBOSE_LEVEL>2)
 
 				if (!strcmp(desc,"IBI"))
 					hdr->EVENT.TYP[N] = 0x0501;
-				else
+				else {
+					// desc lives on the stack, new descriptions are copied into auxBUF
+					size_t len0 = hdr->EVENT.LenCodeDesc;
 					FreeTextEvent(hdr,N,desc);
+					if (hdr->EVENT.LenCodeDesc > len0) {
+						// the new description is the last entry (entry 0 might have been added, too)
+						size_t k1 = hdr->EVENT.LenCodeDesc - 1;
+						char *d = (char*)hdr->AS.auxBUF + 64*k1;
+						strcpy(d, desc);
+						hdr->EVENT.CodeDesc[k1] = d;
+					}
+				}
 
 				++N;
-				if (desc) free(desc); 
 			}
 			else {
 				strtok(line,":");
@@ -10957,10 +12003,11 @@ if (VERBOSE_LEVEL>2)
 				else if (!hdr->FLAG.ANONYMOUS && !strncmp(line,"File version",12))
 					strncpy(hdr->Patient.Id,v,MAX_LENGTH_PID);
 			}
-			ifgets(line,80,hdr);
 		}
+		linebuf_free(&lb);
 	    	ifclose(hdr);
 	    	hdr->EVENT.N = N;
+		if (hdr->AS.B4C_ERRNUM) return(hdr);
 	    	hdr->SampleRate = 1000.0;
 	    	hdr->EVENT.SampleRate = 1000.0;
 	    	hdr->TYPE = EVENT;
@@ -11282,11 +12329,12 @@ else if (!strncmp(MODE,"w",1))	 /* --- WRITE --- */
 		hdr->FILE.POS = 0;
 		hdr->FILE.FID = fopen(hdr->FileName, "w");
 
-		typeof(hdr->NS) k, NS = 1;
+		// number of columns, including the time axis
+		typeof(hdr->NS) k, NS = (getTimeChannelNumber(hdr) == 0);
 		for (k = 0; k < hdr->NS; k++) {
 			NS += (hdr->CHANNEL[k].OnOff > 0);
 		}
-		hdr->HeadLen += fprintf(hdr->FILE.FID, "ATF\t1.0\n%lu\t%u", max(0,hdr->NRec * hdr->SPR), NS + 1);
+		hdr->HeadLen += fprintf(hdr->FILE.FID, "ATF\t1.0\n%lu\t%u", max(0,hdr->NRec * hdr->SPR), NS);
 
 		char *sep = "\n";
 		if (getTimeChannelNumber(hdr) == 0) {
@@ -11592,7 +12640,7 @@ else if (!strncmp(MODE,"w",1))	 /* --- WRITE --- */
 	     	memcpy(Header1+184, tmp, len);
 	     	memcpy(Header1+192, "EDF+C  ", 5);
 
-		len = sprintf(tmp,"%u",(int)hdr->NRec);
+		len = sprintf(tmp,"%i",(int)hdr->NRec);
 		if (len>8) fprintf(stderr,"Warning: NRec is (%s) too long (%i>8).\n",tmp,(int)len);
 	     	memcpy(Header1+236, tmp, len);
 
@@ -11642,6 +12690,13 @@ else if (!strncmp(MODE,"w",1))	 /* --- WRITE --- */
 			if (ftoa8(tmp,hdr->CHANNEL[k].DigMax))
 				fprintf(stderr,"Warning: DigMax (%f)(%s) of channel %i does not fit into 8 bytes of EDF header.\n",hdr->CHANNEL[k].DigMax,tmp,k);
 		     	memcpy(Header2 + 8*k2 + 128*NS, tmp, strlen(tmp));
+			/* swrite scales with Cal and Off, these must match the header */
+			if ((hdr->CHANNEL[k].DigMax != hdr->CHANNEL[k].DigMin) && (hdr->CHANNEL[k].PhysMax != hdr->CHANNEL[k].PhysMin)) {
+				hdr->CHANNEL[k].Cal = (hdr->CHANNEL[k].PhysMax-hdr->CHANNEL[k].PhysMin)/(hdr->CHANNEL[k].DigMax-hdr->CHANNEL[k].DigMin);
+				hdr->CHANNEL[k].Off =  hdr->CHANNEL[k].PhysMin-hdr->CHANNEL[k].Cal*hdr->CHANNEL[k].DigMin;
+			}
+			else
+				fprintf(stderr,"Warning: channel %i has an empty physical or digital range [%g,%g]/[%g,%g], scaling is not defined.\n",k,hdr->CHANNEL[k].PhysMin,hdr->CHANNEL[k].PhysMax,hdr->CHANNEL[k].DigMin,hdr->CHANNEL[k].DigMax);
 
 			if (hdr->CHANNEL[k].Notch>0)
 				len = sprintf(tmp,"HP:%fHz LP:%fHz Notch:%fHz",hdr->CHANNEL[k].HighPass,hdr->CHANNEL[k].LowPass,hdr->CHANNEL[k].Notch);
@@ -12178,6 +13233,7 @@ size_t sread_raw(size_t start, size_t length, HDRTYPE* hdr, char flag) {
 		// Caching, no file-IO, data is already loaded into hdr->AS.rawdata
 		hdr->FILE.POS = start;
 		count = nelem;
+		hdr->STATS.cache_hits += nelem;
 
 		if (VERBOSE_LEVEL>7)
 			fprintf(stdout,"sread-raw: 222\n");
@@ -12186,8 +13242,12 @@ size_t sread_raw(size_t start, size_t length, HDRTYPE* hdr, char flag) {
 #ifndef WITHOUT_NETWORK
 	else if (hdr->FILE.Des > 0) {
 		// network connection
-		int s = bscs_requ_dat(hdr->FILE.Des, start, length,hdr);
+		double t0 = biosig_clock();
+		int s = bscs_requ_dat_cached(hdr->FILE.Des, start, length, hdr);
 		count = hdr->AS.length;
+		hdr->STATS.cache_misses += nelem;
+		hdr->STATS.t_io += biosig_clock() - t0;
+		TRACE_END(t0, "sread_raw", NULL, count);
 
 		if (VERBOSE_LEVEL>7) fprintf(stdout,"sread-raw from network: 222 count=%i\n",(int)count);
 	}
@@ -12225,7 +13285,11 @@ size_t sread_raw(size_t start, size_t length, HDRTYPE* hdr, char flag) {
 			fprintf(stdout,"#sread(%i %li)\n",(int)(hdr->HeadLen + hdr->FILE.POS*hdr->AS.bpb), iftell(hdr));
 
 		// read data
+		double t0 = biosig_clock();
 		count = ifread(hdr->AS.rawdata, hdr->AS.bpb, nelem, hdr);
+		hdr->STATS.cache_misses += nelem;
+		hdr->STATS.t_io += biosig_clock() - t0;
+		TRACE_END(t0, "sread_raw", NULL, count);
 		hdr->AS.flag_collapsed_rawdata = 0;	// is rawdata not collapsed
 //		if ((count<nelem) && ((hdr->NRec < 0) || (hdr->NRec > start+count))) hdr->NRec = start+count; // get NRec if NRec undefined, not tested yet.
 		if (count < nelem) {
@@ -12259,6 +13323,19 @@ int cachingWholeFile(HDRTYPE* hdr) {
 
 
 
+/* sparse samples of the event table, see sread */
+struct sparse_event_t {
+	uint32_t	pos;
+	size_t		k;	// index in event table
+};
+
+static int compare_sparse_event(const void *e1, const void *e2) {
+	const struct sparse_event_t *s1 = (const struct sparse_event_t*)e1;
+	const struct sparse_event_t *s2 = (const struct sparse_event_t*)e2;
+	if (s1->pos != s2->pos) return((s1->pos > s2->pos) - (s1->pos < s2->pos));
+	return((s1->k > s2->k) - (s1->k < s2->k));
+}
+
 /****************************************************************************/
 /**	SREAD : segment-based                                              **/
 /****************************************************************************/
@@ -12292,9 +13369,11 @@ size_t sread(biosig_data_type* data, size_t start, size_t length, HDRTYPE* hdr)
  *
  */
 
-	size_t			count,k1,k2,k4,k5=0,NS;//bi,bi8;
+	size_t			count,k1,k2,k4,k5=0,NS,NSout;//bi,bi8;
 	size_t			toffset;	// time offset for rawdata
 	biosig_data_type	*data1=NULL;
+	REREF_TYPE		*RR = hdr->REREF;
+	double			t0 = biosig_clock(), tio = hdr->STATS.t_io;
 
 
 	if (VERBOSE_LEVEL>6)
@@ -12330,21 +13409,31 @@ size_t sread(biosig_data_type* data, size_t start, size_t length, HDRTYPE* hdr)
 	for (k1=0,NS=0; k1<hdr->NS; ++k1)
 		if (hdr->CHANNEL[k1].OnOff) ++NS;
 
+	// number of output channels
+	NSout = NS;
+	if (RR != NULL) {
+		if (RR->ncol != NS) {
+			biosigERROR(hdr, B4C_REREF_FAILED, "Error SREAD: number of selected channels does not fit ReRef-matrix");
+			return(0);
+		}
+		NSout = RR->nrow;
+	}
+
 	if (VERBOSE_LEVEL>7)
 		fprintf(stdout,"SREAD: count=%i pos=[%i,%i,%i,%i], size of data = %ix%ix%ix%i = %i\n",(int)count,(int)start,(int)length,(int)POS,(int)hdr->FILE.POS,(int)hdr->SPR, (int)count, (int)NS, (int)sizeof(biosig_data_type), (int)(hdr->SPR * count * NS * sizeof(biosig_data_type)));
 
 #ifndef ANDROID 
 //Stoyan: Arm has some problem with log2 - or I dont know how to fix it - it exists but do not work.
-        if (log2(hdr->SPR) + log2(count) + log2(NS) + log2(sizeof(biosig_data_type)) + 1 >= sizeof(size_t)*8) {
+        if (log2(hdr->SPR) + log2(count) + log2(max(NS,NSout)) + log2(sizeof(biosig_data_type)) + 1 >= sizeof(size_t)*8) {
                 // used to check the 2GByte limit on 32bit systems
                 biosigERROR(hdr, B4C_MEMORY_ALLOCATION_FAILED, "Size of required data buffer too large (exceeds size_t addressable space)");
                 return(0);
         }
 #endif
 	// transfer RAW into BIOSIG data format
-	if ((data==NULL) || hdr->Calib) {
+	if (data==NULL) {
 		// local data memory required
-		size_t sz = hdr->SPR * count * NS * sizeof(biosig_data_type);
+		size_t sz = hdr->SPR * count * NSout * sizeof(biosig_data_type);
 		void *tmpptr = realloc(hdr->data.block, sz);
 		if (tmpptr!=NULL || !sz) 
 			data1 = (biosig_data_type*) tmpptr;
@@ -12383,6 +13472,69 @@ size_t sread(biosig_data_type* data, size_t start, size_t length, HDRTYPE* hdr)
 	if (VERBOSE_LEVEL>7)
 		fprintf(stdout,"sread 223 alpha12bit=%i SWAP=%i spr=%i   %p\n", ALPHA12BIT, SWAP, hdr->SPR, hdr->AS.rawdata);
 
+	/* Samples are decoded into buf, channel k2 of sample k5 is buf[k2*chs+k5*sps].
+	   Without re-referencing, buf is the output data1 and all records are
+	   converted at once. Otherwise, buf is a row-based block of nrt records
+	   (about 256 kB), which is re-referenced into data1 right after decoding.
+	 */
+	biosig_data_type *buf = data1, *gbuf = NULL;
+	size_t nrt = count, chs = 1, sps = NS, r0, r1;
+	if (RR != NULL) {
+		nrt = (1<<15) / (hdr->SPR*NS + 1) + 1;
+		if (nrt > count) nrt = count;
+		buf = (biosig_data_type*) malloc(hdr->SPR * nrt * (NS+1) * sizeof(biosig_data_type));
+		if (buf == NULL) {
+			biosigERROR(hdr, B4C_MEMORY_ALLOCATION_FAILED, "memory allocation failed - not enough memory");
+			return(0);
+		}
+		gbuf = buf + hdr->SPR * nrt * NS;
+	}
+	else if (!hdr->FLAG.ROW_BASED_CHANNELS) {
+		chs = hdr->SPR * count;
+		sps = 1;
+	}
+
+	/* Sparse samples (GDF v2+, PDP) are stored in the event table. The selected
+	   ones within records POS ... POS+count-1 are collected once, sorted by
+	   position, and each block r0 ... r1-1 consumes them with the cursor kse.
+	 */
+	char SPARSE = ((hdr->TYPE==GDF) && (hdr->VERSION > 1.9)) || (hdr->TYPE==PDP);
+	double c = hdr->SPR / hdr->SampleRate * hdr->EVENT.SampleRate;
+	size_t *ChanList = NULL;
+	struct sparse_event_t *SE = NULL;
+	size_t nse = 0, kse = 0;
+	if (SPARSE) {
+		TRACE_BEGIN(trsp);
+		ChanList = (size_t*)calloc(hdr->NS+1,sizeof(size_t));
+		SE = (struct sparse_event_t*)malloc((hdr->EVENT.N+1)*sizeof(struct sparse_event_t));
+		if (ChanList == NULL || SE == NULL) {
+			free(ChanList);
+			free(SE);
+			if (buf != data1) free(buf);
+			biosigERROR(hdr, B4C_MEMORY_ALLOCATION_FAILED, "memory allocation failed - not enough memory");
+			return(0);
+		}
+
+		// Note: ChanList and EVENT.CHN start with index=1 (not 0)
+		size_t ch = 0;
+		for (k1=0; k1<hdr->NS; k1++) // list of selected channels
+			ChanList[k1+1]= (hdr->CHANNEL[k1].OnOff ? ++ch : 0);
+
+		for (k1=0; k1<hdr->EVENT.N; k1++)
+		if (hdr->EVENT.TYP[k1] == 0x7fff) 	// select non-equidistant sampled value
+		if (ChanList[hdr->EVENT.CHN[k1]] > 0)	// if channel is selected
+		if ((hdr->EVENT.POS[k1] >= POS*c) && (hdr->EVENT.POS[k1] < (POS+count)*c)) {
+			SE[nse].pos = hdr->EVENT.POS[k1];
+			SE[nse].k   = k1;
+			nse++;
+		}
+		qsort(SE, nse, sizeof(*SE), compare_sparse_event);
+		TRACE_END(trsp, "sparse samples", NULL, hdr->EVENT.N);
+	}
+
+	for (r0 = 0; r0 < count; r0 = r1) {
+	r1 = min(r0 + nrt, count);
+
 	for (k1=0,k2=0; k1<hdr->NS; k1++) {
 		CHANNEL_TYPE *CHptr = hdr->CHANNEL+k1;
 
@@ -12400,7 +13552,7 @@ size_t sread(biosig_data_type* data, size_t start, size_t length, HDRTYPE* hdr)
 		union {int16_t i16; uint16_t u16; uint32_t i32; float f32; uint64_t i64; double f64;} u;
 
 		// TODO:  MIT data types
-		for (k4 = 0; k4 < count; k4++)
+		for (k4 = r0; k4 < r1; k4++)
 		{  	uint8_t *ptr1;
 
 #ifndef  ONLYGDF
@@ -12601,6 +13753,9 @@ size_t sread(biosig_data_type* data, size_t start, size_t length, HDRTYPE* hdr)
 
 			if (VERBOSE_LEVEL > 7) fprintf(stdout,"%s (line %i) GDFTYP=%i %i %i \n", __FILE__, __LINE__, GDFTYP,k1,k2);
 			biosigERROR(hdr, B4C_DATATYPE_UNSUPPORTED, "Error SREAD: datatype not supported");
+			free(ChanList);
+			free(SE);
+			if (buf != data1) free(buf);
 			return(-1);
 
 		}	// end switch
@@ -12616,14 +13771,11 @@ size_t sread(biosig_data_type* data, size_t start, size_t length, HDRTYPE* hdr)
 			fprintf(stdout,"%g\n",sample_value);
 
 		// resampling 1->DIV samples
-		if (hdr->FLAG.ROW_BASED_CHANNELS) {
-			size_t k3;
-			for (k3=0; k3 < DIV; k3++)
-				data1[k2 + (k4*hdr->SPR + k5*DIV + k3)*NS] = sample_value; // row-based channels
-		} else {
+		{
 			size_t k3;
+			biosig_data_type *dst = buf + k2*chs + ((k4-r0)*hdr->SPR + k5*DIV)*sps;
 			for (k3=0; k3 < DIV; k3++)
-				data1[k2*count*hdr->SPR + k4*hdr->SPR + k5*DIV + k3] = sample_value; // column-based channels
+				dst[k3*sps] = sample_value;
 		}
 
 		}	// end for (k5 ....
@@ -12633,16 +13785,9 @@ size_t sread(biosig_data_type* data, size_t start, size_t length, HDRTYPE* hdr)
 	k2++;
 	}}
 
-	if (hdr->FLAG.ROW_BASED_CHANNELS) {
-		hdr->data.size[0] = k2;			// rows
-		hdr->data.size[1] = hdr->SPR*count;	// columns
-	} else {
-		hdr->data.size[0] = hdr->SPR*count;	// rows
-		hdr->data.size[1] = k2;			// columns
-	}
-
 	/* read sparse samples */
-	if (((hdr->TYPE==GDF) && (hdr->VERSION > 1.9)) || (hdr->TYPE==PDP)) {
+	if (SPARSE) {
+		TRACE_BEGIN(trsp);
 
 		for (k1=0,k2=0; k1<hdr->NS; k1++) {
 			CHANNEL_TYPE *CHptr = hdr->CHANNEL+k1;
@@ -12650,30 +13795,15 @@ size_t sread(biosig_data_type* data, size_t start, size_t length, HDRTYPE* hdr)
 			if (CHptr->OnOff) {	/* read selected channels only */
 				if (CHptr->SPR==0) {
 					// sparsely sampled channels are stored in event table
-					if (hdr->FLAG.ROW_BASED_CHANNELS) {
-						for (k5 = 0; k5 < hdr->SPR*count; k5++)
-							data1[k2 + k5*NS] = CHptr->DigMin;		// row-based channels
-					} else {
-						for (k5 = 0; k5 < hdr->SPR*count; k5++)
-							data1[k2*count*hdr->SPR + k5] = CHptr->DigMin; 	// column-based channels
-					}
+					for (k5 = 0; k5 < hdr->SPR*(r1-r0); k5++)
+						buf[k2*chs + k5*sps] = CHptr->DigMin;
 				}
 				k2++;
 			}
 		}
 
-		double c = hdr->SPR / hdr->SampleRate * hdr->EVENT.SampleRate;
-		size_t *ChanList = (size_t*)calloc(hdr->NS+1,sizeof(size_t));
-
-		// Note: ChanList and EVENT.CHN start with index=1 (not 0)
-		size_t ch = 0;
-		for (k1=0; k1<hdr->NS; k1++) // list of selected channels
-			ChanList[k1+1]= (hdr->CHANNEL[k1].OnOff ? ++ch : 0);
-
-		for (k1=0; k1<hdr->EVENT.N; k1++)
-		if (hdr->EVENT.TYP[k1] == 0x7fff) 	// select non-equidistant sampled value
-		if (ChanList[hdr->EVENT.CHN[k1]] > 0)	// if channel is selected
-		if ((hdr->EVENT.POS[k1] >= POS*c) && (hdr->EVENT.POS[k1] < hdr->FILE.POS*c)) {
+		for (; (kse < nse) && (SE[kse].pos < (POS+r1)*c); kse++) {
+			k1 = SE[kse].k;
 			biosig_data_type sample_value;
 			uint8_t *ptr = (uint8_t*)(hdr->EVENT.DUR + k1);
 
@@ -12720,6 +13850,9 @@ size_t sread(biosig_data_type* data, size_t start, size_t length, HDRTYPE* hdr)
 			else {
 				if (VERBOSE_LEVEL > 7) fprintf(stdout,"%s (line %i) GDFTYP=%i %i %i \n", __FILE__, __LINE__, GDFTYP,k1,k2);
 				biosigERROR(hdr, B4C_DATATYPE_UNSUPPORTED, "Error SREAD: datatype not supported");
+				free(ChanList);
+				free(SE);
+				if (buf != data1) free(buf);
 				return(0);
 			}
 
@@ -12731,84 +13864,58 @@ size_t sread(biosig_data_type* data, size_t start, size_t length, HDRTYPE* hdr)
 				sample_value = sample_value * CHptr->Cal + CHptr->Off;
 
 			// resampling 1->DIV samples
-			k5  = (hdr->EVENT.POS[k1]/c - POS)*hdr->SPR;
-			if (hdr->FLAG.ROW_BASED_CHANNELS) {
-				size_t k3;
-				for (k3=0; k3 < DIV; k3++)
-					data1[k2 + (k5 + k3)*NS] = sample_value;
-			} else {
+			k5  = (hdr->EVENT.POS[k1]/c - POS - r0)*hdr->SPR;
+			{
 				size_t k3;
-				for (k3=0; k3 < DIV; k3++)
-					data1[k2 * count * hdr->SPR + k5 + k3] = sample_value;
+				for (k3=0; (k3 < DIV) && (k5 + k3 < hdr->SPR*(r1-r0)); k3++)
+					buf[k2*chs + (k5 + k3)*sps] = sample_value;
 			}
 
 		if (VERBOSE_LEVEL>7)
 			fprintf(stdout,"E%02i: s(%d,%d)= %d %e %e %e\n",(int)k1,(int)k2,hdr->EVENT.CHN[k1],leu32p(ptr),sample_value,(*(double*)(ptr)),(*(float*)(ptr)));
 
 		}
-		free(ChanList);
+		TRACE_END(trsp, "sparse samples", NULL, kse);
 	}
 	else if (hdr->TYPE==TMS32) {
 		// post-processing TMS32 files: last block can contain undefined samples
 		size_t spr = lei32p(hdr->AS.Header+121);
-		if (hdr->FILE.POS*hdr->SPR > spr) 
+		if ((POS+r1)*hdr->SPR > spr)
 		for (k2=0; k2<NS; k2++) 
-		for (k5 = spr - POS*hdr->SPR; k5 < hdr->SPR*count; k5++) {
-			if (hdr->FLAG.ROW_BASED_CHANNELS)
-				data1[k2 + k5*NS] = NAN;		// row-based channels
-			else
-				data1[k2*count*hdr->SPR + k5] = NAN; 	// column-based channels
-		}
+		for (k5 = max(spr, (POS+r0)*hdr->SPR) - (POS+r0)*hdr->SPR; k5 < hdr->SPR*(r1-r0); k5++)
+			buf[k2*chs + k5*sps] = NAN;
 	}
 
-#ifdef CHOLMOD_H
-	if (hdr->Calib) {
-        if (!hdr->FLAG.ROW_BASED_CHANNELS)
-                fprintf(stderr,"Error SREAD: Re-Referencing on column-based data not supported.");
-        else {
-			cholmod_dense X,Y;
-			X.nrow = hdr->data.size[0];
-			X.ncol = hdr->data.size[1];
-			X.d    = hdr->data.size[0];
-			X.nzmax= hdr->data.size[1]*hdr->data.size[0];
-			X.x    = data1;
-                        X.xtype = CHOLMOD_REAL;
-                        X.dtype = CHOLMOD_DOUBLE;
-
-			Y.nrow = hdr->Calib->ncol;
-			Y.ncol = hdr->data.size[1];
-			Y.d    = Y.nrow;
-			Y.nzmax= Y.nrow * Y.ncol;
-			if (data)
-				Y.x    = data;
-			else
-				Y.x    = malloc(Y.nzmax*sizeof(double));
-
-                        Y.xtype = CHOLMOD_REAL;
-                        Y.dtype = CHOLMOD_DOUBLE;
-
-			double alpha[]={1,0},beta[]={0,0};
-
-			cholmod_sdmult(hdr->Calib,1,alpha,beta,&X,&Y,&CHOLMOD_COMMON_VAR);
-
-			if (VERBOSE_LEVEL>8) fprintf(stdout,"%f -> %f\n",*(double*)X.x,*(double*)Y.x);
-			free(X.x);
-			if (data==NULL)
-				hdr->data.block = (biosig_data_type*)Y.x;
-			else
-				hdr->data.block = NULL;
+	if (RR != NULL) {
+		// re-referencing of records r0 ... r1-1
+		if (hdr->FLAG.ROW_BASED_CHANNELS)
+			reref_apply(RR, buf, hdr->SPR*(r1-r0), data1 + r0*hdr->SPR*NSout, 1, NSout, gbuf);
+		else
+			reref_apply(RR, buf, hdr->SPR*(r1-r0), data1 + r0*hdr->SPR, hdr->SPR*count, 1, gbuf);
+	}
+	}	// end for (r0 ....
+	free(ChanList);
+	free(SE);
 
-        		hdr->data.size[0] = Y.nrow;
+	if (buf != data1) free(buf);
 
+	if (hdr->FLAG.ROW_BASED_CHANNELS) {
+		hdr->data.size[0] = NSout;		// rows
+		hdr->data.size[1] = hdr->SPR*count;	// columns
+	} else {
+		hdr->data.size[0] = hdr->SPR*count;	// rows
+		hdr->data.size[1] = NSout;		// columns
 	}
-	}
-#endif
+
 
 	if (VERBOSE_LEVEL>7)
 		fprintf(stdout,"sread - end \n");
 
 //VERBOSE_LEVEL = V;
 
+	hdr->STATS.records_decoded += count;
+	hdr->STATS.t_decode += biosig_clock() - t0 - (hdr->STATS.t_io - tio);
+	TRACE_END(t0, "sread", GetFileTypeString(hdr->TYPE), count);
 	return(count);
 
 }  // end of SREAD
@@ -12842,12 +13949,243 @@ size_t gsl_sread(gsl_matrix* m, size_t start, size_t length, HDRTYPE* hdr) {
 #endif
 
 
+/* limits used for saturation of the target data type in SWRITE */
+#define MAX_INT8   ((int8_t)0x7f)
+#define MIN_INT8   ((int8_t)0x80)
+#define MAX_UINT8  ((uint8_t)0xff)
+#define MIN_UINT8  ((uint8_t)0)
+#define MAX_INT16  ((int16_t)0x7fff)
+#define MIN_INT16  ((int16_t)0x8000)
+#define MAX_UINT16 ((uint16_t)0xffff)
+#define MIN_UINT16 ((uint16_t)0)
+#define MAX_INT24  ((int32_t)0x007fffff)
+#define MIN_INT24  ((int32_t)0xff800000)
+#define MAX_UINT24 ((uint32_t)0x00ffffff)
+#define MIN_UINT24 ((uint32_t)0)
+#define MAX_INT32  ((int32_t)0x7fffffff)
+#define MIN_INT32  ((int32_t)0x80000000)
+#define MAX_UINT32 ((uint32_t)0xffffffff)
+#define MIN_UINT32 ((uint32_t)0)
+#define MAX_INT64  ((((uint64_t)1)<<63)-1)
+#define MIN_INT64  ((int64_t)((uint64_t)1)<<63)
+#define MAX_UINT64 ((uint64_t)0xffffffffffffffffl)
+#define MIN_UINT64 ((uint64_t)0)
+
+
+/****************************************************************************/
+/**                     SWRITE ENCODING KERNELS                            **/
+/****************************************************************************/
+/*
+	Fast paths used by SWRITE for channels without decimation (DIV==1) and
+	with GDFTYP int16, int24, int32 or float32. Each kernel converts N samples
+	(SRC has a stride of STRIDE elements) into little-endian raw data at DST.
+
+	The conversion is identical to the generic per-sample code in swrite():
+	values are scaled with iCal and iOff (unless UCAL is set), converted by
+	truncation towards zero, and saturated at the limits of the target type;
+	NaN is mapped to the smallest value. The files written are therefore
+	bit-identical, regardless which kernel is used.
+
+	On x86_64, AVX2 versions are selected at runtime if the CPU supports it.
+	Fused multiply-add is not enabled on purpose, because it would change
+	the rounding of sample*iCal+iOff.
+*/
+#if defined(__x86_64__) && (defined(__clang__) || (defined(__GNUC__) && (GCC_VERSION >= 40900)))
+#define WITH_SWRITE_AVX2
+#include <immintrin.h>
+#endif
+
+typedef void (*swrite_encode_t)(uint8_t *dst, const biosig_data_type *src, size_t stride, size_t n, double iCal, double iOff, char ucal);
+
+#define SWRITE_SCALE(v)	(ucal ? (0.0 + (v)) : (0.0 + (v)) * iCal + iOff)
+
+static void swrite_encode_i16(uint8_t *dst, const biosig_data_type *src, size_t stride, size_t n, double iCal, double iOff, char ucal) {
+	size_t k;
+	for (k = 0; k < n; k++, dst += 2) {
+		double v = SWRITE_SCALE(src[k*stride]);
+		int16_t i;
+		if      (v > MAX_INT16) i = MAX_INT16;
+		else if (v > MIN_INT16) i = (int16_t)v;
+		else     i = MIN_INT16;
+		lei16a(i, dst);
+	}
+}
+
+static void swrite_encode_i24(uint8_t *dst, const biosig_data_type *src, size_t stride, size_t n, double iCal, double iOff, char ucal) {
+	size_t k;
+	for (k = 0; k < n; k++, dst += 3) {
+		double v = SWRITE_SCALE(src[k*stride]);
+		int32_t i;
+		if      (v > MAX_INT24) i = MAX_INT24;
+		else if (v > MIN_INT24) i = (int32_t)v;
+		else     i = MIN_INT24;
+		dst[0] = (uint8_t)(i & 0x000000ff);
+		dst[1] = (uint8_t)((i>>8) & 0x000000ff);
+		dst[2] = (uint8_t)((i>>16) & 0x000000ff);
+	}
+}
+
+static void swrite_encode_i32(uint8_t *dst, const biosig_data_type *src, size_t stride, size_t n, double iCal, double iOff, char ucal) {
+	size_t k;
+	for (k = 0; k < n; k++, dst += 4) {
+		double v = SWRITE_SCALE(src[k*stride]);
+		int32_t i;
+		if      (v > ldexp(1.0,31)-1) i = MAX_INT32;
+		else if (v > ldexp(-1.0,31)) i = (int32_t)v;
+		else     i = MIN_INT32;
+		lei32a(i, dst);
+	}
+}
+
+static void swrite_encode_f32(uint8_t *dst, const biosig_data_type *src, size_t stride, size_t n, double iCal, double iOff, char ucal) {
+	size_t k;
+	for (k = 0; k < n; k++, dst += 4) {
+		double v = SWRITE_SCALE(src[k*stride]);
+		lef32a((float)v, dst);
+	}
+}
+
+#ifdef WITH_SWRITE_AVX2
+/*
+	AVX2 kernels: 8 samples per iteration for contiguous input (stride==1),
+	the remainder is handled by the scalar kernels above.
+	_mm256_max_pd(x,lo) returns lo if x is NaN, this gives the same
+	saturation as the comparisons in the scalar code.
+	The upper halves of the YMM registers are cleared before the scalar
+	tail, otherwise all subsequent SSE code in the caller (e.g. libm) is
+	slowed down by the AVX-SSE transition penalty.
+*/
+#define SWRITE_AVX2_LOAD(a,b) \
+		__m256d a = _mm256_add_pd(zero, _mm256_loadu_pd(src+k)); \
+		__m256d b = _mm256_add_pd(zero, _mm256_loadu_pd(src+k+4)); \
+		if (!ucal) { \
+			a = _mm256_add_pd(_mm256_mul_pd(a, cal), off); \
+			b = _mm256_add_pd(_mm256_mul_pd(b, cal), off); \
+		}
+
+__attribute__((target("avx2")))
+static void swrite_encode_i16_avx2(uint8_t *dst, const biosig_data_type *src, size_t stride, size_t n, double iCal, double iOff, char ucal) {
+	size_t k = 0;
+	if (stride == 1) {
+		const __m256d zero = _mm256_setzero_pd();
+		const __m256d cal  = _mm256_set1_pd(iCal);
+		const __m256d off  = _mm256_set1_pd(iOff);
+		const __m256d hi   = _mm256_set1_pd(MAX_INT16);
+		const __m256d lo   = _mm256_set1_pd(MIN_INT16);
+		for (; k + 8 <= n; k += 8) {
+			SWRITE_AVX2_LOAD(a, b);
+			__m128i ia = _mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(a, lo), hi));
+			__m128i ib = _mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(b, lo), hi));
+			_mm_storeu_si128((__m128i*)(dst + 2*k), _mm_packs_epi32(ia, ib));
+		}
+	}
+	_mm256_zeroupper();
+	swrite_encode_i16(dst + 2*k, src + k*stride, stride, n - k, iCal, iOff, ucal);
+}
+
+__attribute__((target("avx2")))
+static void swrite_encode_i24_avx2(uint8_t *dst, const biosig_data_type *src, size_t stride, size_t n, double iCal, double iOff, char ucal) {
+	size_t k = 0;
+	if (stride == 1) {
+		const __m256d zero = _mm256_setzero_pd();
+		const __m256d cal  = _mm256_set1_pd(iCal);
+		const __m256d off  = _mm256_set1_pd(iOff);
+		const __m256d hi   = _mm256_set1_pd(MAX_INT24);
+		const __m256d lo   = _mm256_set1_pd(MIN_INT24);
+		// drop the most significant byte of each int32
+		const __m128i pack = _mm_setr_epi8(0,1,2, 4,5,6, 8,9,10, 12,13,14, -1,-1,-1,-1);
+		uint8_t tmp[16];
+		for (; k + 8 <= n; k += 8) {
+			SWRITE_AVX2_LOAD(a, b);
+			__m128i ia = _mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(a, lo), hi));
+			__m128i ib = _mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(b, lo), hi));
+			_mm_storeu_si128((__m128i*)tmp, _mm_shuffle_epi8(ia, pack));
+			memcpy(dst + 3*k, tmp, 12);
+			_mm_storeu_si128((__m128i*)tmp, _mm_shuffle_epi8(ib, pack));
+			memcpy(dst + 3*k + 12, tmp, 12);
+		}
+	}
+	_mm256_zeroupper();
+	swrite_encode_i24(dst + 3*k, src + k*stride, stride, n - k, iCal, iOff, ucal);
+}
+
+__attribute__((target("avx2")))
+static void swrite_encode_i32_avx2(uint8_t *dst, const biosig_data_type *src, size_t stride, size_t n, double iCal, double iOff, char ucal) {
+	size_t k = 0;
+	if (stride == 1) {
+		const __m256d zero = _mm256_setzero_pd();
+		const __m256d cal  = _mm256_set1_pd(iCal);
+		const __m256d off  = _mm256_set1_pd(iOff);
+		const __m256d hi   = _mm256_set1_pd(ldexp(1.0,31)-1);
+		const __m256d lo   = _mm256_set1_pd(ldexp(-1.0,31));
+		for (; k + 8 <= n; k += 8) {
+			SWRITE_AVX2_LOAD(a, b);
+			_mm_storeu_si128((__m128i*)(dst + 4*k),      _mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(a, lo), hi)));
+			_mm_storeu_si128((__m128i*)(dst + 4*k + 16), _mm256_cvttpd_epi32(_mm256_min_pd(_mm256_max_pd(b, lo), hi)));
+		}
+	}
+	_mm256_zeroupper();
+	swrite_encode_i32(dst + 4*k, src + k*stride, stride, n - k, iCal, iOff, ucal);
+}
+
+__attribute__((target("avx2")))
+static void swrite_encode_f32_avx2(uint8_t *dst, const biosig_data_type *src, size_t stride, size_t n, double iCal, double iOff, char ucal) {
+	size_t k = 0;
+	if (stride == 1) {
+		const __m256d zero = _mm256_setzero_pd();
+		const __m256d cal  = _mm256_set1_pd(iCal);
+		const __m256d off  = _mm256_set1_pd(iOff);
+		for (; k + 8 <= n; k += 8) {
+			SWRITE_AVX2_LOAD(a, b);
+			_mm_storeu_ps((float*)(dst + 4*k),      _mm256_cvtpd_ps(a));
+			_mm_storeu_ps((float*)(dst + 4*k + 16), _mm256_cvtpd_ps(b));
+		}
+	}
+	_mm256_zeroupper();
+	swrite_encode_f32(dst + 4*k, src + k*stride, stride, n - k, iCal, iOff, ucal);
+}
+#undef SWRITE_AVX2_LOAD
+#endif // WITH_SWRITE_AVX2
+
+#undef SWRITE_SCALE
+
+/*
+	returns the encoding kernel for GDFTYP, or NULL if the generic
+	code path in swrite() must be used.
+ */
+static swrite_encode_t swrite_encoder(uint16_t gdftyp) {
+#ifdef WITH_SWRITE_AVX2
+	static int flagAVX2 = -1;
+	if (flagAVX2 < 0) {
+		__builtin_cpu_init();
+		flagAVX2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+	}
+	if (flagAVX2) switch (gdftyp) {
+	case 3:		return swrite_encode_i16_avx2;
+	case 5:		return swrite_encode_i32_avx2;
+	case 16:	return swrite_encode_f32_avx2;
+	case 255+24:	return swrite_encode_i24_avx2;
+	}
+#endif
+	switch (gdftyp) {
+	case 3:		return swrite_encode_i16;
+	case 5:		return swrite_encode_i32;
+	case 16:	return swrite_encode_f32;
+	case 255+24:	return swrite_encode_i24;
+	}
+	return NULL;
+}
+
+
 /****************************************************************************/
 /**                     SWRITE                                             **/
 /****************************************************************************/
 size_t swrite(const biosig_data_type *data, size_t nelem, HDRTYPE* hdr) {
 /*
  *	writes NELEM blocks with HDR.AS.bpb BYTES each,
+ *	swrite can be called repeatedly to append blocks to a binary file
+ *	(e.g. GDF, EDF, BDF); DATA contains then only the NELEM new blocks.
+ *	ATF, ASCII, BIN, SCP and HL7aECG must be written with a single call.
  */
 	uint8_t		*ptr;
 	size_t		count=0,k1,k2,k4,k5,DIV,SZ=0;
@@ -12868,34 +14206,14 @@ size_t swrite(const biosig_data_type *data, size_t nelem, HDRTYPE* hdr) {
 	if (VERBOSE_LEVEL>6)
 		fprintf(stdout,"SWRITE( %p, %i, %s ) MODE=%i\n",data, (int)nelem, hdr->FileName, hdr->FILE.OPEN);
 
-		// write data
-
-#define MAX_INT8   ((int8_t)0x7f)
-#define MIN_INT8   ((int8_t)0x80)
-#define MAX_UINT8  ((uint8_t)0xff)
-#define MIN_UINT8  ((uint8_t)0)
-#define MAX_INT16  ((int16_t)0x7fff)
-#define MIN_INT16  ((int16_t)0x8000)
-#define MAX_UINT16 ((uint16_t)0xffff)
-#define MIN_UINT16 ((uint16_t)0)
-#define MAX_INT24  ((int32_t)0x007fffff)
-#define MIN_INT24  ((int32_t)0xff800000)
-#define MAX_UINT24 ((uint32_t)0x00ffffff)
-#define MIN_UINT24 ((uint32_t)0)
-#define MAX_INT32  ((int32_t)0x7fffffff)
-#define MIN_INT32  ((int32_t)0x80000000)
-#define MAX_UINT32 ((uint32_t)0xffffffff)
-#define MIN_UINT32 ((uint32_t)0)
-#define MAX_INT64  ((((uint64_t)1)<<63)-1)
-#define MIN_INT64  ((int64_t)((uint64_t)1)<<63)
-#define MAX_UINT64 ((uint64_t)0xffffffffffffffffl)
-#define MIN_UINT64 ((uint64_t)0)
+	TRACE_BEGIN(tr);
 
+		// write data
 
 	size_t bpb8 = bpb8_collapsed_rawdata(hdr);
 
 	if (VERBOSE_LEVEL>7)
-		fprintf(stdout,"swrite 307 <%s> sz=%i\n",hdr->FileName,(int)(hdr->NRec*bpb8>>3));
+		fprintf(stdout,"swrite 307 <%s> sz=%i\n",hdr->FileName,(int)(nelem*bpb8>>3));
 
 	if (hdr->TYPE==ATF) {
 		if (VERBOSE_LEVEL>7) fprintf(stdout,"ATF swrite\n");
@@ -12906,61 +14224,47 @@ size_t swrite(const biosig_data_type *data, size_t nelem, HDRTYPE* hdr) {
 		typeof(hdr->NS) k,k2;
 		size_t c = 0;
 
-		char tabflag = 0;
+		// the column header "Time (s)" is written in SOPEN
 		unsigned timeChan = getTimeChannelNumber(hdr);
-		if ( timeChan == 0) {
-			hdr->HeadLen += fprintf(hdr->FILE.FID, "\"Time (s)\"");
-			tabflag = 1;
-		}
-
-		if (hdr->data.size[1-hdr->FLAG.ROW_BASED_CHANNELS] < hdr->NS) {
-			// if collapsed data, use k2, otherwise use k1
-			for (c = 0; c < nr; c++) {
-				char *sep = "\n";
-				if (timeChan == 0)
-					fprintf(hdr->FILE.FID,"%s%.16g",sep,(++hdr->FILE.POS)/hdr->SampleRate);
-				for (k = 0, k2=0; k < hdr->NS; k++) {
-					if (hdr->CHANNEL[k].OnOff) {
-						size_t idx;
-						if (hdr->FLAG.ROW_BASED_CHANNELS)
-							idx = k2 + c * hdr->data.size[0];
-						else
-							idx = k2 * hdr->data.size[0] + c;
 
-						fprintf(hdr->FILE.FID,"%s%.16g",sep,data[idx]);
-						sep = "\t";
-						k2++;
-					}
-				}
-			}
-		}
-		else {	// if not collapsed data, use k1
-			for (c = 0; c < nr; c++) {
-				char *sep = "\n";
-				if (timeChan == 0)
-					fprintf(hdr->FILE.FID,"%s%.16g",sep,(++hdr->FILE.POS)/hdr->SampleRate);
-				for (k = 0; k < hdr->NS; k++) {
-					if (hdr->CHANNEL[k].OnOff) {
-						size_t idx;
-						if (hdr->FLAG.ROW_BASED_CHANNELS)
-							idx = k + c * hdr->data.size[0];
-						else
-							idx = k * hdr->data.size[0] + c;
+		TEXTBUF_TYPE tb;
+		textbuf_init(&tb, hdr->FILE.FID, NULL);
+
+		// if collapsed data, use k2, otherwise use k1
+		char collapsed = hdr->data.size[1-hdr->FLAG.ROW_BASED_CHANNELS] < hdr->NS;
+		for (c = 0; c < nr; c++) {
+			textbuf_putc(&tb, '\n');
+			char flag = 0;
+			if (timeChan == 0) {
+				textbuf_double(&tb, (++hdr->FILE.POS)/hdr->SampleRate);
+				flag = 1;
+			}
+			for (k = 0, k2=0; k < hdr->NS; k++) {
+				if (hdr->CHANNEL[k].OnOff) {
+					size_t ch = collapsed ? k2 : k;
+					size_t idx;
+					if (hdr->FLAG.ROW_BASED_CHANNELS)
+						idx = ch + c * hdr->data.size[0];
+					else
+						idx = ch * hdr->data.size[0] + c;
 
-						fprintf(hdr->FILE.FID,"%s%.16g", sep, data[idx]);
-						sep = "\t";
-					}
+					if (flag) textbuf_putc(&tb, '\t');
+					textbuf_double(&tb, data[idx]);
+					flag = 1;
+					k2++;
 				}
 			}
 		}
+		textbuf_flush(&tb);
+		TRACE_END(tr, "swrite", "ATF", nr);
 		return nr;
 		// end write ATF
 	}
 
 
-	if ((hdr->NRec*bpb8>0) && (hdr->TYPE != SCP_ECG)) {
+	if ((nelem*bpb8>0) && (hdr->TYPE != SCP_ECG)) {
 	// memory allocation for SCP is done in SOPEN_SCP_WRITE Section 6
-		ptr = (typeof(ptr))realloc(hdr->AS.rawdata, (hdr->NRec*bpb8>>3)+1);
+		ptr = (typeof(ptr))realloc(hdr->AS.rawdata, (nelem*bpb8>>3)+1);
 		if (ptr==NULL) {
 			biosigERROR(hdr, B4C_INSUFFICIENT_MEMORY, "SWRITE: memory allocation failed.");
 			return(0);
@@ -12992,7 +14296,24 @@ size_t swrite(const biosig_data_type *data, size_t nelem, HDRTYPE* hdr) {
 	if (VERBOSE_LEVEL>7)
 		fprintf(stdout,"swrite 312=#%i gdftyp=%i %i %i %i %f %f %f %f %i\n",(int)k1,GDFTYP,(int)bi8,(int)SZ,(int)CHptr->SPR,CHptr->Cal,CHptr->Off,iCal,iOff,(int)bpb8);
 
-		for (k4 = 0; k4 < (size_t)hdr->NRec; k4++) {
+		swrite_encode_t encode = NULL;
+		/* with less than 8 samples per block (i.e. one AVX2 iteration),
+		   the kernel call per block costs more than the generic loop */
+		if ((DIV==1) && (CHptr->SPR >= 8) && !(bi8 & 7) && !(bpb8 & 7))
+			encode = swrite_encoder(GDFTYP);
+
+		if (encode != NULL) {
+			// fast path: one kernel call per block
+			for (k4 = 0; k4 < nelem; k4++) {
+				ptr = hdr->AS.rawdata + ((k4*bpb8 + bi8)>>3);
+				if (hdr->FLAG.ROW_BASED_CHANNELS)
+					encode(ptr, data + col + k4*hdr->SPR*hdr->data.size[0], hdr->data.size[0], CHptr->SPR, iCal, iOff, hdr->FLAG.UCAL);
+				else
+					encode(ptr, data + col*nelem*hdr->SPR + k4*hdr->SPR, 1, CHptr->SPR, iCal, iOff, hdr->FLAG.UCAL);
+			}
+		}
+		else
+		for (k4 = 0; k4 < nelem; k4++) {
 			if (VERBOSE_LEVEL>8)
 				fprintf(stdout,"swrite 313- #%i: [%i %i] %i %i %i %i %i\n",(int)k1,(int)hdr->data.size[0],(int)hdr->data.size[1],(int)k4,(int)0,(int)hdr->SPR,(int)DIV,(int)nelem);
 
@@ -13172,9 +14493,9 @@ size_t swrite(const biosig_data_type *data, size_t nelem, HDRTYPE* hdr) {
 #ifndef WITHOUT_NETWORK
 	if (hdr->FILE.Des>0) {
 
-	if (VERBOSE_LEVEL>7) fprintf(stdout,"bscs_send_dat sz=%i\n",(int)(hdr->NRec*bpb8>>3));
+	if (VERBOSE_LEVEL>7) fprintf(stdout,"bscs_send_dat sz=%i\n",(int)(nelem*bpb8>>3));
 
-		int s = bscs_send_dat(hdr->FILE.Des,hdr->AS.rawdata,hdr->NRec*bpb8>>3);
+		int s = bscs_send_dat(hdr->FILE.Des,hdr->AS.rawdata,nelem*bpb8>>3);
 
 	if (VERBOSE_LEVEL>7) fprintf(stdout,"bscs_send_dat succeeded %i\n",s);
 
@@ -13230,6 +14551,8 @@ size_t swrite(const biosig_data_type *data, size_t nelem, HDRTYPE* hdr) {
 					SPR = hdr->SPR;
 				}
 				size_t k2;
+				TEXTBUF_TYPE tb;
+				textbuf_init(&tb, NULL, &H1);
 				for (k2=0; k2 < SPR*(size_t)hdr->NRec; k2++) {
 					biosig_data_type i = 0.0;
 					size_t k3;
@@ -13253,17 +14576,14 @@ size_t swrite(const biosig_data_type *data, size_t nelem, HDRTYPE* hdr) {
                         }
 */
 
-#ifdef ZLIB_H
-					if (H1.FILE.COMPRESSION)
-						gzprintf(H1.FILE.gzFID,"%f\n",i/DIV);
-					else
-#endif
-						fprintf(H1.FILE.FID,"%f\n",i/DIV);
+					textbuf_double(&tb, i/DIV);
+					textbuf_putc(&tb, '\n');
 				}
+				textbuf_flush(&tb);
 			}
 			else if (hdr->TYPE == BIN) {
 				size_t nbytes	= ((size_t)hdr->CHANNEL[k1].SPR * GDFTYP_BITS[hdr->CHANNEL[k1].GDFTYP])>>3;
-				ifwrite(hdr->AS.rawdata+hdr->CHANNEL[k1].bi, nbytes, hdr->NRec, &H1);
+				ifwrite(hdr->AS.rawdata+hdr->CHANNEL[k1].bi, nbytes, nelem, &H1);
 			}
 			ifclose(&H1);
 		}
@@ -13277,7 +14597,7 @@ size_t swrite(const biosig_data_type *data, size_t nelem, HDRTYPE* hdr) {
 
 		if (VERBOSE_LEVEL>7) fprintf(stdout,"swrite 317 <%s>\n", hdr->FileName );
 
-		count = ifwrite((uint8_t*)(hdr->AS.rawdata), hdr->AS.bpb, hdr->NRec, hdr);
+		count = ifwrite((uint8_t*)(hdr->AS.rawdata), hdr->AS.bpb, nelem, hdr);
 
 		if (VERBOSE_LEVEL>7) fprintf(stdout,"swrite 319 <%i>\n", (int)count);
 
@@ -13292,6 +14612,7 @@ size_t swrite(const biosig_data_type *data, size_t nelem, HDRTYPE* hdr) {
 	// set position of file handle
 	hdr->FILE.POS += count;
 
+	TRACE_END(tr, "swrite", GetFileTypeString(hdr->TYPE), count);
 	return(count);
 
 }  // end of SWRITE
@@ -13372,6 +14693,7 @@ int sclose(HDRTYPE* hdr)
 
         if (hdr==NULL) return(0);
 
+	TRACE_BEGIN(tr);
 	size_t k;
 	for (k=0; k<hdr->NS; k++) {
 		// replace Nihon-Kohden code with standard code
@@ -13423,6 +14745,8 @@ int sclose(HDRTYPE* hdr)
 			else {
 				len = sprintf(t.tmp,"%d",(int)hdr->NRec);
 				if (len>8) fprintf(stderr,"Warning: NRec is (%s) to long.\n",t.tmp);
+				/* pad with blanks to overwrite the "-1" placeholder written by sopen */
+				for (; len<8; len++) t.tmp[len]=' ';
 			}
 			/* ### FIXME : gzseek supports only forward seek */
 			if (hdr->FILE.COMPRESSION>0)
@@ -13485,6 +14809,7 @@ int sclose(HDRTYPE* hdr)
 		hdr->FILE.OPEN = 0;
     	}
 
+	TRACE_END(tr, "sclose", GetFileTypeString(hdr->TYPE), hdr->NRec);
     	return(0);
 }
 
@@ -13575,8 +14900,18 @@ int sflush_gdf_event_table(HDRTYPE* hdr)
 }
 
 
+/*
+	text representation of a number in JSON; returns BUF, which must
+	have room for at least 26 characters
+*/
+static const char* json_number(char *buf, double val) {
+	double2str(buf, val);
+	return buf;
+}
+
 void fprintf_json_double(FILE *fid, const char* Name, double val) {
-	fprintf(fid,"\t\t\"%s\"\t: %g", Name, val);
+	char num[32];
+	fprintf(fid,"\t\t\"%s\"\t: %s", Name, json_number(num, val));
 }
 
 /****************************************************************************/
@@ -13587,6 +14922,7 @@ int asprintf_hdr2json(char **str, HDRTYPE *hdr)
 {
         size_t k;
 	char tmp[41];
+	char num[32];
 	char flag_comma = 0; 
 
 	size_t sz = 25*50 + hdr->NS * 16 * 50 + hdr->EVENT.N * 6 * 50;	// rough estimate of memory needed
@@ -13614,7 +14950,7 @@ if (VERBOSE_LEVEL>7) fprintf(stdout, "asprintf_hdr2json: sz=%i\n", (int)sz);
 	c += sprintf(STR, "\t\"NumberOfRecords\"\t: %i,\n",(int)hdr->NRec);
 	c += sprintf(STR, "\t\"SamplesPerRecords\"\t: %i,\n",(int)hdr->SPR);
 	c += sprintf(STR, "\t\"NumberOfSamples\"\t: %i,\n",(int)(hdr->NRec*hdr->SPR));
-	if (!isnan(hdr->SampleRate)) c += sprintf(STR, "\t\"Samplingrate\"\t: %f,\n",hdr->SampleRate);
+	if (!isnan(hdr->SampleRate)) c += sprintf(STR, "\t\"Samplingrate\"\t: %s,\n", json_number(num,hdr->SampleRate));
 	strftime(tmp,40,"%Y-%m-%d %H:%M:%S",gdf_time2tm_time(hdr->T0));
 	c += sprintf(STR, "\t\"StartOfRecording\"\t: \"%s\",\n",tmp);
 	c += sprintf(STR, "\t\"TimezoneMinutesEastOfUTC\"\t: %i,\n", hdr->tzmin);
@@ -13674,31 +15010,31 @@ if (VERBOSE_LEVEL>7) fprintf(stdout, "asprintf_hdr2json: count=%i\n", (int)c);
 		c += sprintf(STR,"\t\t\"Label\"\t: \"%s\",\n", hc->Label);
 		if ( hc->Transducer && strlen(hc->Transducer) ) c += sprintf(STR,"\t\t\"Transducer\"\t: \"%s\",\n", hc->Transducer);
 		c += sprintf(STR,"\t\t\"PhysicalUnit\"\t: \"%s\",\n", PhysDim3(hc->PhysDimCode));
-		if (!isnan(hc->PhysMax)) c += sprintf(STR,"\t\t\"PhysicalMaximum\"\t: %g,\n", hc->PhysMax);
-		if (!isnan(hc->PhysMin)) c += sprintf(STR,"\t\t\"PhysicalMinimum\"\t: %g,\n", hc->PhysMin);
-		if (!isnan(hc->DigMax))  c += sprintf(STR,"\t\t\"DigitalMaximum\"\t: %f,\n", hc->DigMax);
-		if (!isnan(hc->DigMin))  c += sprintf(STR,"\t\t\"DigitalMinimum\"\t: %f,\n", hc->DigMin);
-		if (!isnan(hc->Cal))     c += sprintf(STR,"\t\t\"scaling\"\t: %g,\n", hc->Cal);
-		if (!isnan(hc->Off))     c += sprintf(STR,"\t\t\"offset\"\t: %g,\n", hc->Off);
-		if (!isnan(hc->TOffset)) c += sprintf(STR,"\t\t\"TimeDelay\"\t: %g,\n", hc->TOffset);
+		if (!isnan(hc->PhysMax)) c += sprintf(STR,"\t\t\"PhysicalMaximum\"\t: %s,\n", json_number(num,hc->PhysMax));
+		if (!isnan(hc->PhysMin)) c += sprintf(STR,"\t\t\"PhysicalMinimum\"\t: %s,\n", json_number(num,hc->PhysMin));
+		if (!isnan(hc->DigMax))  c += sprintf(STR,"\t\t\"DigitalMaximum\"\t: %s,\n", json_number(num,hc->DigMax));
+		if (!isnan(hc->DigMin))  c += sprintf(STR,"\t\t\"DigitalMinimum\"\t: %s,\n", json_number(num,hc->DigMin));
+		if (!isnan(hc->Cal))     c += sprintf(STR,"\t\t\"scaling\"\t: %s,\n", json_number(num,hc->Cal));
+		if (!isnan(hc->Off))     c += sprintf(STR,"\t\t\"offset\"\t: %s,\n", json_number(num,hc->Off));
+		if (!isnan(hc->TOffset)) c += sprintf(STR,"\t\t\"TimeDelay\"\t: %s,\n", json_number(num,hc->TOffset));
 		uint8_t flag = (0 < hc->LowPass && hc->LowPass<INFINITY) | ((0 < hc->HighPass && hc->HighPass<INFINITY)<<1) | ((0 < hc->Notch && hc->Notch<INFINITY)<<2); 
 		if (flag) {
 			c += sprintf(STR, "\t\t\"Filter\" : {\n");
-			if (flag & 0x01) c += sprintf(STR, "\t\t\t\"Lowpass\"\t: %g%c\n", hc->LowPass, flag & 0x06 ? ',' : ' '); 
-			if (flag & 0x02) c += sprintf(STR, "\t\t\t\"Highpass\"\t: %g%c\n", hc->HighPass, flag & 0x04 ? ',' : ' ' ); 
-			if (flag & 0x04) c += sprintf(STR, "\t\t\t\"Notch\"\t: %g\n", hc->Notch); 
+			if (flag & 0x01) c += sprintf(STR, "\t\t\t\"Lowpass\"\t: %s%c\n", json_number(num,hc->LowPass), flag & 0x06 ? ',' : ' '); 
+			if (flag & 0x02) c += sprintf(STR, "\t\t\t\"Highpass\"\t: %s%c\n", json_number(num,hc->HighPass), flag & 0x04 ? ',' : ' ' ); 
+			if (flag & 0x04) c += sprintf(STR, "\t\t\t\"Notch\"\t: %s\n", json_number(num,hc->Notch)); 
 			c += sprintf(STR, "\n\t\t},\n");
 		}
 		switch (hc->PhysDimCode & 0xffe0) {
 		case 4256: // Volt       
-			if (!isnan(hc->Impedance)) c += sprintf(STR, "\t\t\"Impedance\"\t: %g,\n", hc->Impedance);
+			if (!isnan(hc->Impedance)) c += sprintf(STR, "\t\t\"Impedance\"\t: %s,\n", json_number(num,hc->Impedance));
 			break;
 		case 4288: // Ohm
-			if (!isnan(hc->fZ)) c += sprintf(STR, "\t\t\"fZ\"\t: %g,\n", hc->fZ);
+			if (!isnan(hc->fZ)) c += sprintf(STR, "\t\t\"fZ\"\t: %s,\n", json_number(num,hc->fZ));
 			break;
 		}
                 double fs = hdr->SampleRate * hc->SPR/hdr->SPR;
-		if (!isnan(fs)) c += sprintf(STR, "\t\t\"Samplingrate\"\t: %f", fs);
+		if (!isnan(fs)) c += sprintf(STR, "\t\t\"Samplingrate\"\t: %s", json_number(num,fs));
 		c += sprintf(STR, "\n\t\t}");   // end-of-CHANNEL
 	}
         c += sprintf(STR, "\n\t]");   // end-of-CHANNELS
@@ -13720,12 +15056,12 @@ if (VERBOSE_LEVEL>7) fprintf(stdout, "asprintf_hdr2json: count=%i\n", (int)c);
                 if ( flag_comma ) c += sprintf(STR,",");
                 c += sprintf(STR, "\n\t\t{\n");
                 c += sprintf(STR, "\t\t\"TYP\"\t: \"0x%04x\",\n", hdr->EVENT.TYP[k]);
-                c += sprintf(STR, "\t\t\"POS\"\t: %f", hdr->EVENT.POS[k]/hdr->EVENT.SampleRate);
+                c += sprintf(STR, "\t\t\"POS\"\t: %s", json_number(num,hdr->EVENT.POS[k]/hdr->EVENT.SampleRate));
                 if (hdr->EVENT.CHN && hdr->EVENT.DUR) {
 			if (hdr->EVENT.CHN[k])
 	                        c += sprintf(STR, ",\n\t\t\"CHN\"\t: %d", hdr->EVENT.CHN[k]);
 			if (hdr->EVENT.TYP[k] != 0x7fff)
-	                        c += sprintf(STR, ",\n\t\t\"DUR\"\t: %f", hdr->EVENT.DUR[k]/hdr->EVENT.SampleRate);
+	                        c += sprintf(STR, ",\n\t\t\"DUR\"\t: %s", json_number(num,hdr->EVENT.DUR[k]/hdr->EVENT.SampleRate));
                 }
 #if (BIOSIG_VERSION >= 10500)
 		if (hdr->EVENT.TimeStamp != NULL && hdr->EVENT.TimeStamp[k] != 0) {
@@ -13746,7 +15082,7 @@ if (VERBOSE_LEVEL>7) fprintf(stdout, "asprintf_hdr2json: count=%i\n", (int)c);
 			val += hdr->CHANNEL[chan].Off; 
 
 			if (isfinite(val))
-				c += sprintf(STR, ",\n\t\t\"Value\"\t: %g", val);        // no comma at the end because its the last element
+				c += sprintf(STR, ",\n\t\t\"Value\"\t: %s", json_number(num,val));        // no comma at the end because its the last element
 		}
 		else {
 			const char *tmpstr = GetEventDescription(hdr,k); 
@@ -13783,6 +15119,7 @@ int fprintf_hdr2json(FILE *fid, HDRTYPE* hdr)
 {
         size_t k;
 	char tmp[41];
+	char num[32];
 	char flag_comma = 0; 
 
 	size_t NumberOfSweeps = (hdr->SPR*hdr->NRec > 0); 
@@ -13803,7 +15140,7 @@ int fprintf_hdr2json(FILE *fid, HDRTYPE* hdr)
 	fprintf(fid,"\t\"NumberOfRecords\"\t: %i,\n",(int)hdr->NRec);
 	fprintf(fid,"\t\"SamplesPerRecords\"\t: %i,\n",(int)hdr->SPR);
 	fprintf(fid,"\t\"NumberOfSamples\"\t: %i,\n",(int)(hdr->NRec*hdr->SPR));
-	if (!isnan(hdr->SampleRate)) fprintf(fid,"\t\"Samplingrate\"\t: %f,\n",hdr->SampleRate);
+	if (!isnan(hdr->SampleRate)) fprintf(fid,"\t\"Samplingrate\"\t: %s,\n", json_number(num,hdr->SampleRate));
 	strftime(tmp,40,"%Y-%m-%d %H:%M:%S",gdf_time2tm_time(hdr->T0));
 	fprintf(fid,"\t\"StartOfRecording\"\t: \"%s\",\n",tmp);
 	fprintf(fid,"\t\"TimezoneMinutesEastOfUTC\"\t: %i,\n", hdr->tzmin);
@@ -13852,31 +15189,31 @@ int fprintf_hdr2json(FILE *fid, HDRTYPE* hdr)
 		fprintf(fid,"\t\t\"Label\"\t: \"%s\",\n", hc->Label);
 		if ( hc->Transducer && strlen(hc->Transducer) ) fprintf(fid,"\t\t\"Transducer\"\t: \"%s\",\n", hc->Transducer);
 		fprintf(fid,"\t\t\"PhysicalUnit\"\t: \"%s\",\n", PhysDim3(hc->PhysDimCode));
-		if (!isnan(hc->PhysMax)) fprintf(fid,"\t\t\"PhysicalMaximum\"\t: %g,\n", hc->PhysMax);
-		if (!isnan(hc->PhysMin)) fprintf(fid,"\t\t\"PhysicalMinimum\"\t: %g,\n", hc->PhysMin);
-		if (!isnan(hc->DigMax))  fprintf(fid,"\t\t\"DigitalMaximum\"\t: %f,\n", hc->DigMax);
-		if (!isnan(hc->DigMin))  fprintf(fid,"\t\t\"DigitalMinimum\"\t: %f,\n", hc->DigMin);
-		if (!isnan(hc->Cal))     fprintf(fid,"\t\t\"scaling\"\t: %g,\n", hc->Cal);
-		if (!isnan(hc->Off))     fprintf(fid,"\t\t\"offset\"\t: %g,\n", hc->Off);
-		if (!isnan(hc->TOffset)) fprintf(fid,"\t\t\"TimeDelay\"\t: %g,\n", hc->TOffset);
+		if (!isnan(hc->PhysMax)) fprintf(fid,"\t\t\"PhysicalMaximum\"\t: %s,\n", json_number(num,hc->PhysMax));
+		if (!isnan(hc->PhysMin)) fprintf(fid,"\t\t\"PhysicalMinimum\"\t: %s,\n", json_number(num,hc->PhysMin));
+		if (!isnan(hc->DigMax))  fprintf(fid,"\t\t\"DigitalMaximum\"\t: %s,\n", json_number(num,hc->DigMax));
+		if (!isnan(hc->DigMin))  fprintf(fid,"\t\t\"DigitalMinimum\"\t: %s,\n", json_number(num,hc->DigMin));
+		if (!isnan(hc->Cal))     fprintf(fid,"\t\t\"scaling\"\t: %s,\n", json_number(num,hc->Cal));
+		if (!isnan(hc->Off))     fprintf(fid,"\t\t\"offset\"\t: %s,\n", json_number(num,hc->Off));
+		if (!isnan(hc->TOffset)) fprintf(fid,"\t\t\"TimeDelay\"\t: %s,\n", json_number(num,hc->TOffset));
 		uint8_t flag = (0 < hc->LowPass && hc->LowPass<INFINITY) | ((0 < hc->HighPass && hc->HighPass<INFINITY)<<1) | ((0 < hc->Notch && hc->Notch<INFINITY)<<2); 
 		if (flag) {
 			fprintf(fid,"\t\t\"Filter\" : {\n");
-			if (flag & 0x01) fprintf(fid,"\t\t\t\"Lowpass\"\t: %g%c\n",hc->LowPass, flag & 0x06 ? ',' : ' '); 
-			if (flag & 0x02) fprintf(fid,"\t\t\t\"Highpass\"\t: %g%c\n",hc->HighPass, flag & 0x04 ? ',' : ' ' ); 
-			if (flag & 0x04) fprintf(fid,"\t\t\t\"Notch\"\t: %g\n",hc->Notch); 
+			if (flag & 0x01) fprintf(fid,"\t\t\t\"Lowpass\"\t: %s%c\n", json_number(num,hc->LowPass), flag & 0x06 ? ',' : ' '); 
+			if (flag & 0x02) fprintf(fid,"\t\t\t\"Highpass\"\t: %s%c\n", json_number(num,hc->HighPass), flag & 0x04 ? ',' : ' ' ); 
+			if (flag & 0x04) fprintf(fid,"\t\t\t\"Notch\"\t: %s\n", json_number(num,hc->Notch)); 
 			fprintf(fid,"\n\t\t},\n");
 		}
 		switch (hc->PhysDimCode & 0xffe0) {
 		case 4256: // Volt       
-			if (!isnan(hc->Impedance)) fprintf(fid,"\t\t\"Impedance\"\t: %g,\n", hc->Impedance);
+			if (!isnan(hc->Impedance)) fprintf(fid,"\t\t\"Impedance\"\t: %s,\n", json_number(num,hc->Impedance));
 			break;
 		case 4288: // Ohm
-			if (!isnan(hc->fZ)) fprintf(fid,"\t\t\"fZ\"\t: %g,\n", hc->fZ);
+			if (!isnan(hc->fZ)) fprintf(fid,"\t\t\"fZ\"\t: %s,\n", json_number(num,hc->fZ));
 			break;
 		}
                 double fs = hdr->SampleRate * hc->SPR/hdr->SPR;
-		if (!isnan(fs)) fprintf(fid,"\t\t\"Samplingrate\"\t: %f", fs);        // no comma at the end because its the last element
+		if (!isnan(fs)) fprintf(fid,"\t\t\"Samplingrate\"\t: %s", json_number(num,fs));        // no comma at the end because its the last element
 		fprintf(fid,"\n\t\t}");   // end-of-CHANNEL
 	}
         fprintf(fid,"\n\t]");   // end-of-CHANNELS
@@ -13889,12 +15226,12 @@ int fprintf_hdr2json(FILE *fid, HDRTYPE* hdr)
                 if ( flag_comma ) fprintf(fid,",");
                 fprintf(fid,"\n\t\t{\n");
                 fprintf(fid,"\t\t\"TYP\"\t: \"0x%04x\",\n", hdr->EVENT.TYP[k]);
-                fprintf(fid,"\t\t\"POS\"\t: %f", hdr->EVENT.POS[k]/hdr->EVENT.SampleRate);
+                fprintf(fid,"\t\t\"POS\"\t: %s", json_number(num,hdr->EVENT.POS[k]/hdr->EVENT.SampleRate));
                 if (hdr->EVENT.CHN && hdr->EVENT.DUR) {
 			if (hdr->EVENT.CHN[k])
 	                        fprintf(fid,",\n\t\t\"CHN\"\t: %d", hdr->EVENT.CHN[k]);
 			if (hdr->EVENT.TYP[k] != 0x7fff)
-	                        fprintf(fid,",\n\t\t\"DUR\"\t: %f", hdr->EVENT.DUR[k]/hdr->EVENT.SampleRate);
+	                        fprintf(fid,",\n\t\t\"DUR\"\t: %s", json_number(num,hdr->EVENT.DUR[k]/hdr->EVENT.SampleRate));
                 }
 #if (BIOSIG_VERSION >= 10500)
 		if (hdr->EVENT.TimeStamp != NULL && hdr->EVENT.TimeStamp[k] != 0) {
@@ -13917,7 +15254,7 @@ int fprintf_hdr2json(FILE *fid, HDRTYPE* hdr)
 			val += hdr->CHANNEL[chan].Off; 
 
 			if (isfinite(val))
-				fprintf(fid,",\n\t\t\"Value\"\t: %g", val);        // no comma at the end because its the last element
+				fprintf(fid,",\n\t\t\"Value\"\t: %s", json_number(num,val));        // no comma at the end because its the last element
 		}
 		else {	
 			const char *str = GetEventDescription(hdr,k); 
@@ -14040,18 +15377,13 @@ int hdr2ascii(HDRTYPE* hdr, FILE *fid, int VERBOSE)
 		fprintf(fid,"\n[CHANNEL HEADER] %p",hdr->CHANNEL);
 		fprintf(fid,"\nNo  LeadId Label\tFs[Hz]\tSPR\tGDFTYP\tCal\tOff\tPhysDim\tPhysMax \tPhysMin \tDigMax  \tDigMin  \tHighPass\tLowPass \tNotch   \tdelay [s]\tX\tY\tZ");
 		size_t k;
-#ifdef CHOLMOD_H
-                typeof(hdr->NS) NS = hdr->NS;
-                if (hdr->Calib) NS += hdr->Calib->ncol;
+                size_t NS = hdr->NS;
+                if (hdr->REREF && hdr->rerefCHANNEL) NS += hdr->REREF->nrow;
 		for (k=0; k<NS; k++) {
 		        if (k<hdr->NS)
         			cp = hdr->CHANNEL+k;
         		else
         			cp = hdr->rerefCHANNEL + k - hdr->NS;
-#else
-		for (k=0; k<hdr->NS; k++) {
-       			cp = hdr->CHANNEL+k;
-#endif
 
 			const char *tmpstr = cp->Label;
 			if (tmpstr==NULL || strlen(tmpstr)==0) tmpstr = LEAD_ID_TABLE[cp->LeadIdCode];
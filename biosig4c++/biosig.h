@@ -263,6 +263,47 @@ typedef struct CHANNEL_STRUCT {
 } CHANNEL_TYPE	ATT_ALI ATT_MSSTRUCT;
 
 
+/*
+	I/O and decoding statistics of a HDR, accumulated since SOPEN
+	(or the last reset). Times are wall clock times in seconds.
+*/
+typedef struct {
+	uint64_t	bytes_read;	/* number of bytes read with ifread */
+	uint64_t	read_calls;	/* number of calls of ifread */
+	uint64_t	seek_calls;	/* number of calls of ifseek and ifsetpos */
+	uint64_t	cache_hits;	/* SREAD_RAW: blocks found in hdr->AS.rawdata */
+	uint64_t	cache_misses;	/* SREAD_RAW: blocks loaded from file or network */
+	uint64_t	records_decoded; /* SREAD: blocks converted into hdr->data.block */
+	double		t_io;		/* SREAD_RAW: loading of data blocks */
+	double		t_decode;	/* SREAD: conversion, without t_io */
+	double		t_events;	/* reading and conversion of event table */
+	double		t_header;	/* SOPEN: without t_events */
+} HDRSTATS_TYPE;
+
+/*
+	Sparse re-referencing matrix in compressed sparse row (CSR) format.
+	Output channel r is the sum of x[k] * (selected input channel i[k])
+	for k = p[r] ... p[r+1]-1. This is the same memory layout as the
+	transposed HDR.Calib matrix of SLOAD, or of a Matlab sparse matrix
+	with one column for each output channel.
+*/
+typedef struct {
+	uint32_t	nrow;		/* number of output channels */
+	uint32_t	ncol;		/* number of selected input channels */
+	uint32_t	*p;		/* row pointers, nrow+1 elements */
+	uint32_t	*i;		/* column indices, p[nrow] elements */
+	double		*x;		/* values, p[nrow] elements */
+
+	/* this part is set by RerefCHANNEL and should not be used by application programs */
+	uint32_t	nw;		/* number of elements of the shared row w (e.g. common average) */
+	uint32_t	*wi;		/* column indices of w */
+	double		*wx;		/* values of w */
+	uint8_t		*common;	/* output r = w*x + D(r,:)*x if common[r], D(r,:)*x otherwise */
+	uint32_t	*dp;		/* row pointers of D */
+	uint32_t	*di;		/* column indices of D */
+	double		*dx;		/* values of D */
+} REREF_TYPE;
+
 /*
 	This structure defines the general (fixed) header
 */
@@ -302,11 +343,11 @@ typedef struct HDR_STRUCT {
 	int16_t 	tzmin 	ATT_ALI;	/* time zone : minutes east of UTC */
 
 #ifdef CHOLMOD_H
-	cholmod_sparse  *Calib ATT_ALI;                  /* re-referencing matrix */
+	cholmod_sparse  *Calib ATT_ALI;                  /* obsolete, not used anymore - see REREF */
 #else
-        void        *Calib ATT_ALI;                  /* re-referencing matrix */
+        void        *Calib ATT_ALI;                  /* obsolete, not used anymore - see REREF */
 #endif
-	CHANNEL_TYPE 	*rerefCHANNEL ATT_ALI;
+	CHANNEL_TYPE 	*rerefCHANNEL ATT_ALI;		/* header of the re-referenced channels, REREF->nrow elements */
 
 	/* Patient specific information */
 	struct {
@@ -464,6 +505,9 @@ typedef struct HDR_STRUCT {
 	} SCP;
 #endif
 
+	HDRSTATS_TYPE	STATS ATT_ALI;	/* I/O and decoding statistics */
+	REREF_TYPE	*REREF ATT_ALI;	/* re-referencing matrix, applied by SREAD; NULL: no re-referencing */
+
 } HDRTYPE ATT_MSSTRUCT;
 
 /*
@@ -545,6 +589,10 @@ HDRTYPE* sopen(const char* FileName, const char* MODE, HDRTYPE* hdr);
 	Mode: "w" is writing mode, hdr contains the header information
 		If the number of records is not known, set hdr->NRec=-1 and
 		sclose will fill in the correct number.
+		EDF and BDF store only the physical and digital ranges, for these
+		formats CHANNEL[].Cal and .Off are set from PhysMax, PhysMin,
+		DigMax and DigMin; Cal and Off provided by the caller are used
+		only if one of these ranges is empty (a warning is shown).
 	Mode: "a" is append mode,
 		if file exists, header and eventtable is read, 
 		position pointer is set to end of data in order to add 
@@ -691,22 +739,34 @@ int 	cachingWholeFile(HDRTYPE* hdr);
 int RerefCHANNEL(HDRTYPE *hdr, void *ReRef, char rrtype);
 /* rerefCHAN
         defines rereferencing of channels,
-        hdr->Calib defines the rereferencing matrix
+        hdr->REREF defines the rereferencing matrix (a copy of ReRef),
         hdr->rerefCHANNEL is defined.
         hdr->rerefCHANNEL[.].Label is  by some heuristics from hdr->CHANNEL
                 either the maximum scaling factor
-        if ReRef is NULL, rereferencing is turned off (hdr->Calib and
+        hdr->rerefCHANNEL[.].PhysMax/PhysMin is the sum of |ReRef| times the
+                ranges of the input channels; these channels are float
+                (Cal=1, Off=0), unless they are a positively scaled copy
+                of a single channel, which keeps its scaling.
+        if ReRef is NULL, rereferencing is turned off (hdr->REREF and
         hdr->rerefCHANNEL are reset to NULL).
         if rrtype==1, Reref is a filename pointing to a MatrixMarket file
         if rrtype==2, Reref must be a pointer to a cholmod sparse matrix (cholmod_sparse*)
+        if rrtype==3, Reref must be a pointer to a REREF_TYPE matrix
         In case of an error (mismatch of dimensions), a non-zero is returned,
         and serror() is set.
+        The number of columns of ReRef (rows of a MatrixMarket or cholmod
+        matrix) must be the number of selected channels (CHANNEL[k].OnOff);
+        SREAD returns then hdr->REREF->nrow channels in either layout
+        (ROW_BASED_CHANNELS). The matrix is applied to each block of
+        records right after decoding.
 
         rr is a pointer to a rereferencing matrix
         rrtype determines the type of pointer
         rrtype=0: no rereferencing, RR is ignored (NULL)
                1: pointer to MarketMatrix file (char*)
-               2: pointer to a sparse cholmod matrix  (cholmod_sparse*)
+               2: pointer to a sparse cholmod matrix  (cholmod_sparse*),
+                  requires CHOLMOD
+               3: pointer to a sparse matrix in CSR format (REREF_TYPE*)
  ------------------------------------------------------------------------*/
 
 const char* GetFileTypeString(enum FileFormat FMT);
@@ -28,6 +28,10 @@
 #include "biosig.h"
 #include "biosig2.h"
 
+#ifdef WITH_PTHREAD
+#include <pthread.h>
+#endif
+
 
 /* =============================================================
 	setter and getter functions for accessing fields of HDRTYPE
@@ -90,6 +94,17 @@ int biosig_get_targetsegment(HDRTYPE *hdr) {
 	return hdr->FLAG.TARGETSEGMENT;
 };
 
+const HDRSTATS_TYPE* biosig_get_stats(HDRTYPE *hdr) {
+	if (hdr==NULL) return NULL;
+	return &hdr->STATS;
+};
+
+int biosig_reset_stats(HDRTYPE *hdr) {
+	if (hdr==NULL) return -1;
+	memset(&hdr->STATS, 0, sizeof(hdr->STATS));
+	return 0;
+};
+
 const char* biosig_get_filename(HDRTYPE *hdr) {
 	if (hdr==NULL) return NULL;
 	return hdr->FileName;
@@ -636,15 +651,116 @@ int biosig_channel_set_transducer(CHANNEL_TYPE *hc, const char *transducer) {
         DO NOT USE         DO NOT USE         DO NOT USE         DO NOT USE
 */
 
-#define hdrlistlen 64
+/*
+	Table of open files: the entries are allocated in segments of
+	HDRLIST_SEGLEN entries, segments are never moved or freed, therefore
+	the table can grow (up to HDRLIST_MAXLEN entries) while other threads
+	use their entries. Free entries are kept in a list, allocation and
+	release are O(1).
+	A handle consists of the index of the entry and its generation, which
+	is incremented when the file is closed. Handles of closed files are
+	therefore rejected, unless the entry has been reused 2^HDRLIST_GEN_BITS
+	times in between.
+*/
+#define HDRLIST_SEGLEN_LOG2	8
+#define HDRLIST_SEGLEN		(1<<HDRLIST_SEGLEN_LOG2)
+#define HDRLIST_INDEX_BITS	20
+#define HDRLIST_MAXLEN		(1<<HDRLIST_INDEX_BITS)
+#define HDRLIST_GEN_BITS	11	// handle is a positive int
+#define HDRLIST_GEN_MASK	((1<<HDRLIST_GEN_BITS)-1)
+
 struct hdrlist_t {
 	HDRTYPE *hdr;		// header information as defined in level 1 interface
 	//const char *filename; // name of file, is always hdr->FileName
 	uint16_t NS; 	        // number of effective channels, only CHANNEL[].OnOff==1 are considered
 	size_t *chanpos; 	// position of file handle for each channel
+	uint32_t gen;		// generation of entry
+	int32_t next;		// next free entry, -1: none
 } ; 
 
-struct hdrlist_t hdrlist[hdrlistlen];
+static struct hdrlist_t *hdrlist[HDRLIST_MAXLEN/HDRLIST_SEGLEN];
+static size_t hdrlistlen = 0;		// number of allocated entries
+static int32_t hdrlistfree = -1;	// first free entry
+
+#ifdef _PTHREAD_H
+static pthread_mutex_t mutexHdrList = PTHREAD_MUTEX_INITIALIZER;
+#endif
+static void hdrlist_lock() {
+#ifdef _PTHREAD_H
+	pthread_mutex_lock(&mutexHdrList);
+#endif
+}
+static void hdrlist_unlock() {
+#ifdef _PTHREAD_H
+	pthread_mutex_unlock(&mutexHdrList);
+#endif
+}
+
+#define HDRLIST_ENTRY(k)	(hdrlist[(k)>>HDRLIST_SEGLEN_LOG2] + ((k) & (HDRLIST_SEGLEN-1)))
+
+/* returns handle of new entry for hdr, or -1 if the table is full */
+static int hdrlist_alloc(HDRTYPE *hdr) {
+	hdrlist_lock();
+	if ((hdrlistfree < 0) && (hdrlistlen < HDRLIST_MAXLEN)) {
+		// add segment
+		struct hdrlist_t *seg = (struct hdrlist_t*) calloc(HDRLIST_SEGLEN, sizeof(struct hdrlist_t));
+		if (seg != NULL) {
+			int32_t k;
+			for (k = 0; k < HDRLIST_SEGLEN; k++)
+				seg[k].next = (k+1 < HDRLIST_SEGLEN) ? (int32_t)hdrlistlen + k + 1 : -1;
+			hdrlist[hdrlistlen>>HDRLIST_SEGLEN_LOG2] = seg;
+			hdrlistfree = hdrlistlen;
+			hdrlistlen += HDRLIST_SEGLEN;
+		}
+	}
+	int handle = -1;
+	if (hdrlistfree >= 0) {
+		int32_t k = hdrlistfree;
+		struct hdrlist_t *hl = HDRLIST_ENTRY(k);
+		hdrlistfree = hl->next;
+		hl->hdr     = hdr;
+		hl->NS      = 0;
+		hl->chanpos = NULL;
+		hl->next    = -1;
+		handle = (hl->gen << HDRLIST_INDEX_BITS) | k;
+	}
+	hdrlist_unlock();
+	return(handle);
+}
+
+/* returns entry of handle, or NULL if handle is invalid or the file has been closed */
+static struct hdrlist_t *hdrlist_get(int handle) {
+	if (handle < 0) return(NULL);
+	size_t k = handle & (HDRLIST_MAXLEN-1);
+	struct hdrlist_t *hl = NULL;
+	hdrlist_lock();
+	if ((k < hdrlistlen) && (HDRLIST_ENTRY(k)->hdr != NULL)
+	 && (HDRLIST_ENTRY(k)->gen == ((uint32_t)handle >> HDRLIST_INDEX_BITS)))
+		hl = HDRLIST_ENTRY(k);
+	hdrlist_unlock();
+	return(hl);
+}
+
+/* releases entry of handle, returns its HDR (NULL if handle is invalid) */
+static HDRTYPE *hdrlist_release(int handle) {
+	if (handle < 0) return(NULL);
+	size_t k = handle & (HDRLIST_MAXLEN-1);
+	HDRTYPE *hdr = NULL;
+	hdrlist_lock();
+	struct hdrlist_t *hl = (k < hdrlistlen) ? HDRLIST_ENTRY(k) : NULL;
+	if ((hl != NULL) && (hl->hdr != NULL) && (hl->gen == ((uint32_t)handle >> HDRLIST_INDEX_BITS))) {
+		hdr = hl->hdr;
+		if (hl->chanpos) free(hl->chanpos);
+		hl->hdr     = NULL;
+		hl->chanpos = NULL;
+		hl->NS      = 0;
+		hl->gen     = (hl->gen + 1) & HDRLIST_GEN_MASK;
+		hl->next    = hdrlistfree;
+		hdrlistfree = k;
+	}
+	hdrlist_unlock();
+	return(hdr);
+}
 
 CHANNEL_TYPE *getChannelHeader(HDRTYPE *hdr, uint16_t channel) {
 	// returns channel header - skip Off-channels
@@ -685,19 +801,17 @@ int biosig_open_file_readonly(const char *path, int read_annotations) {
 
 	on success returns handle. 
 */
-	int k = 0;
-	while (k < hdrlistlen && hdrlist[k].hdr != NULL) k++;
-	if (k >= hdrlistlen) return(-1);
 	HDRTYPE *hdr = sopen(path,"r",NULL);
-	hdrlist[k].hdr = hdr;
-	//hdrlist[k].filename = hdr->FileName;
-	hdrlist[k].NS  = 0; 
-	hdrlist[k].chanpos  = calloc(hdrlist[k].NS,sizeof(size_t)); 
+	int handle = hdrlist_alloc(hdr);
+	if (handle < 0) {
+		destructHDR(hdr);
+		return(-1);
+	}
 
         if (read_annotations)
-                sort_eventtable(hdrlist[k].hdr);
+                sort_eventtable(hdr);
 
-	return(k);
+	return(handle);
 }
 
 int biosig2_close_file(biosig_handle_t hdr) {
@@ -706,31 +820,23 @@ int biosig2_close_file(biosig_handle_t hdr) {
 }
 
 int biosig_close_file(int handle) {
-	destructHDR(hdrlist[handle].hdr);
-	hdrlist[handle].hdr = NULL;
-	if (hdrlist[handle].chanpos) free(hdrlist[handle].chanpos);
-	hdrlist[handle].NS  = 0; 
-	//hdrlist[handle].filename = NULL;
-	
-#if 0
-	int k;
-	for (k=0; k<hdrlistlen; k++)
-		if (hdrlist[k].hdr!=NULL) return(0); 
-	free(hdrlist);
-#endif 
+	HDRTYPE *hdr = hdrlist_release(handle);
+	if (hdr == NULL) return(-1);
+	destructHDR(hdr);
 	return(0);
 }
 
 int biosig_read_samples(int handle, size_t channel, size_t n, double *buf, unsigned char UCAL) {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL || hdrlist[handle].NS<=channel ) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL || hl->NS<=channel) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 
 	CHANNEL_TYPE *hc = getChannelHeader(hdr,channel);
 
 	size_t stride = 1; // stride between consecutive samples of same channel, depends on data orientation hdr->FLAG.ROW_BASED_CHANNELS
 	size_t div = hdr->SPR/hc->SPR; 	// stride if sample rate of channel is smaller than the overall sampling rate
 
-	size_t POS = hdrlist[handle].chanpos[channel]*div;	// 
+	size_t POS = hl->chanpos[channel]*div;	// 
 	size_t LEN = n*div;
 	size_t startpos = POS/hdr->SPR;  // round towards 0
 	size_t endpos = (POS+LEN)/hdr->SPR + ((POS+LEN)%hdr->SPR != 0);  // round towards infinity
@@ -757,7 +863,7 @@ int biosig_read_samples(int handle, size_t channel, size_t n, double *buf, unsig
 	for (k = 0; k < n; k++) {
 		buf[k] = data[k*div*stride];	// copy data into output buffer
 	}
-	hdrlist[handle].chanpos[channel] += n; // update position pointer of channel chan
+	hl->chanpos[channel] += n; // update position pointer of channel chan
 	return (0);
 }
 
@@ -772,27 +878,31 @@ int biosig_read_digital_samples(int handle, size_t biosig_signal, size_t n, doub
 */
 
 size_t biosig_seek(int handle, long long offset, int whence) {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	sseek(hdr, offset, whence);
 	return (hdr->FILE.POS);
 }
 
 size_t biosig_tell(int handle) {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	return(stell(hdrlist[handle].hdr));
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	return(stell(hl->hdr));
 }
 
 void biosig_rewind(int handle, int biosig_signal) {
 /* It is equivalent to: (void) biosig_seek(int handle, int biosig_signal, 0LL, biosig_SEEK_SET) */
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return;
-	srewind(hdrlist[handle].hdr);
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return;
+	srewind(hl->hdr);
 }
 
 int biosig_get_annotation(int handle, size_t n, struct biosig_annotation_struct *annot) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	if (n>=hdr->EVENT.N) return (-1); 
 
 	annot->onset = hdr->EVENT.POS[n];
@@ -816,53 +926,38 @@ biosig_handle_t biosig2_open_file_writeonly(const char *path, enum FileFormat fi
 int biosig_open_file_writeonly(const char *path, enum FileFormat filetype, int number_of_signals) {
 
         /* TODO: does not open file and write to file */
-#if 1
-	int k = 0;
-	while (k < hdrlistlen && hdrlist[k].hdr != NULL) k++;
-	if (k>=hdrlistlen) return -1;
-
-	HDRTYPE *hdr = constructHDR(number_of_signals,0);
-#else
 	HDRTYPE *hdr = constructHDR(number_of_signals,0);
 	if (hdr==NULL) return (-1); 
-
-	hdr->FileName = strdup(path);
-	hdr->TYPE = filetype;
-	int k = 0;
-	while (k < hdrlistlen && hdrlist[k].hdr != NULL) k++;
-	if (k>=hdrlistlen) {
-		void *ptr = realloc(hdrlist, (k+1)*sizeof(*hdrlist));
-		if (ptr==NULL) return (-1); 
-		hdrlist = (struct hdrlist_t*) ptr;
-		hdrlistlen = k+1;
-	}
-#endif
         hdr->FLAG.UCAL = 0;
         hdr->FLAG.OVERFLOWDETECTION = 0;
         hdr->FILE.COMPRESSION = 0;
 
-	hdrlist[k].hdr  = hdr;
-	return(0); 
+	int handle = hdrlist_alloc(hdr);
+	if (handle < 0) destructHDR(hdr);
+	return(handle); 
 }
 
 double biosig_get_global_samplefrequency(int handle) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(NAN);
-	return (hdrlist[handle].hdr->SampleRate);
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(NAN);
+	return (hl->hdr->SampleRate);
 }
 
 int biosig_set_global_samplefrequency(int handle, double samplefrequency) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	hdrlist[handle].hdr->SampleRate = samplefrequency;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	hl->hdr->SampleRate = samplefrequency;
 
 	return 0;
 }
 
 double biosig_get_samplefrequency(int handle, int biosig_signal) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(NAN);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(NAN);
+	HDRTYPE *hdr = hl->hdr;
 	typeof(hdr->NS) ns = hdr->NS;
 	if (biosig_signal >= ns) return(NAN);
 
@@ -871,8 +966,9 @@ double biosig_get_samplefrequency(int handle, int biosig_signal) {
 
 int biosig_set_samplefrequency(int handle, int biosig_signal, double samplefrequency) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	typeof(hdr->NS) ns = 0;
 	int ch;
         for (ch = 0; ch < hdr->NS; ch++) {
@@ -896,8 +992,9 @@ int biosig_set_samplefrequency(int handle, int biosig_signal, double samplefrequ
 
 double biosig_get_physical_maximum(int handle, int biosig_signal) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(NAN);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(NAN);
+	HDRTYPE *hdr = hl->hdr;
 	typeof(hdr->NS) ns = hdr->NS;
 	if (biosig_signal >= ns) return(NAN);
 
@@ -906,8 +1003,9 @@ double biosig_get_physical_maximum(int handle, int biosig_signal) {
 
 int biosig_set_physical_maximum(int handle, int biosig_signal, double phys_max) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	typeof(hdr->NS) ns = hdr->NS;
 	if (biosig_signal >= ns) return(-1);
 
@@ -917,8 +1015,9 @@ int biosig_set_physical_maximum(int handle, int biosig_signal, double phys_max)
 
 double biosig_get_physical_minimum(int handle, int biosig_signal) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(NAN);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(NAN);
+	HDRTYPE *hdr = hl->hdr;
 	typeof(hdr->NS) ns = hdr->NS;
 	if (biosig_signal >= ns) return(NAN);
 
@@ -927,8 +1026,9 @@ double biosig_get_physical_minimum(int handle, int biosig_signal) {
 
 int biosig_set_physical_minimum(int handle, int biosig_signal, double phys_min) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	typeof(hdr->NS) ns = hdr->NS;
 	if (biosig_signal >= ns) return(-1);
 
@@ -938,8 +1038,9 @@ int biosig_set_physical_minimum(int handle, int biosig_signal, double phys_min)
 
 double biosig_get_digital_maximum(int handle, int biosig_signal) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(NAN);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(NAN);
+	HDRTYPE *hdr = hl->hdr;
 	typeof(hdr->NS) ns = hdr->NS;
 	if (biosig_signal >= ns) return(NAN);
 
@@ -948,8 +1049,9 @@ double biosig_get_digital_maximum(int handle, int biosig_signal) {
 
 int biosig_set_digital_maximum(int handle, int biosig_signal, double dig_max) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	typeof(hdr->NS) ns = hdr->NS;
 	if (biosig_signal >= ns) return(-1);
 
@@ -959,8 +1061,9 @@ int biosig_set_digital_maximum(int handle, int biosig_signal, double dig_max) {
 
 double biosig_get_digital_minimum(int handle, int biosig_signal) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(NAN);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(NAN);
+	HDRTYPE *hdr = hl->hdr;
 	typeof(hdr->NS) ns = hdr->NS;
 	if (biosig_signal >= ns) return(NAN);
 
@@ -969,8 +1072,9 @@ double biosig_get_digital_minimum(int handle, int biosig_signal) {
 
 int biosig_set_digital_minimum(int handle, int biosig_signal, double dig_min) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	typeof(hdr->NS) ns = hdr->NS;
 	if (biosig_signal >= ns) return(-1);
 
@@ -980,8 +1084,9 @@ int biosig_set_digital_minimum(int handle, int biosig_signal, double dig_min) {
 
 const char *biosig_get_label(int handle, int biosig_signal) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(NULL);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(NULL);
+	HDRTYPE *hdr = hl->hdr;
 	typeof(hdr->NS) ns = hdr->NS;
 	if (biosig_signal >= ns) return(NULL);
 
@@ -990,8 +1095,9 @@ const char *biosig_get_label(int handle, int biosig_signal) {
 
 int biosig_set_label(int handle, int biosig_signal, const char *label) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(NULL);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(NULL);
+	HDRTYPE *hdr = hl->hdr;
 	typeof(hdr->NS) ns = hdr->NS;
 	if (biosig_signal >= ns) return(NULL);
 
@@ -1007,8 +1113,9 @@ int biosig_set_prefilter(int handle, int biosig_signal, const char *prefilter) {
         
 int biosig_set_highpassfilter(int handle, int biosig_signal, double frequency) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	typeof(hdr->NS) ns = hdr->NS;
 	if (biosig_signal >= ns) return(-1);
 
@@ -1019,8 +1126,9 @@ int biosig_set_highpassfilter(int handle, int biosig_signal, double frequency) {
 
 int biosig_set_lowpassfilter(int handle, int biosig_signal, double frequency) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	typeof(hdr->NS) ns = hdr->NS;
 	if (biosig_signal >= ns) return(-1);
 
@@ -1031,8 +1139,9 @@ int biosig_set_lowpassfilter(int handle, int biosig_signal, double frequency) {
 
 int biosig_set_notchfilter(int handle, int biosig_signal, double frequency) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	typeof(hdr->NS) ns = hdr->NS;
 	if (biosig_signal >= ns) return(-1);
 
@@ -1044,8 +1153,9 @@ int biosig_set_notchfilter(int handle, int biosig_signal, double frequency) {
 
 const char *biosig_get_transducer(int handle, int biosig_signal) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(NULL);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(NULL);
+	HDRTYPE *hdr = hl->hdr;
 	typeof(hdr->NS) ns = hdr->NS;
 	if (biosig_signal >= ns) return(NULL);
 
@@ -1054,8 +1164,9 @@ const char *biosig_get_transducer(int handle, int biosig_signal) {
 
 int biosig_set_transducer(int handle, int biosig_signal, const char *transducer) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	typeof(hdr->NS) ns = hdr->NS;
 	if (biosig_signal >= ns) return(-1);
 
@@ -1067,8 +1178,9 @@ int biosig_set_transducer(int handle, int biosig_signal, const char *transducer)
 
 const char *biosig_physical_dimension(int handle, int biosig_signal) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(NULL);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(NULL);
+	HDRTYPE *hdr = hl->hdr;
 	typeof(hdr->NS) ns = hdr->NS;
 	if (biosig_signal >= ns) return(NULL);
 
@@ -1077,8 +1189,9 @@ const char *biosig_physical_dimension(int handle, int biosig_signal) {
 
 int biosig_set_physical_dimension(int handle, int biosig_signal, const char *phys_dim) {
 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	typeof(hdr->NS) ns = hdr->NS;
 	if (biosig_signal >= ns) return(-1);
 
@@ -1089,23 +1202,26 @@ int biosig_set_physical_dimension(int handle, int biosig_signal, const char *phy
 
 /*
 int biosig_get_startdatetime(int handle, struct tm *T) {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	gdf_time2tm_time_r(hdr->T0, T);
 	return (0);
 }
 
 int biosig_set_startdatetime(int handle, const struct tm *T) {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	hdr->T0   = tm_time2gdf_time(T);
 	return (0);
 }
 */
 
 int edf_set_startdatetime(int handle, int startdate_year, int startdate_month, int startdate_day, int starttime_hour, int starttime_minute, int starttime_second) {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	struct tm T;
 	T.tm_year = startdate_year;
 	T.tm_mon  = startdate_month;
@@ -1118,43 +1234,49 @@ int edf_set_startdatetime(int handle, int startdate_year, int startdate_month, i
 }
 
 const char *biosig_get_patientname(int handle)  {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(NULL);
-	return(hdrlist[handle].hdr->Patient.Name);
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(NULL);
+	return(hl->hdr->Patient.Name);
 }
 int biosig_set_patientname(int handle, const char *patientname) {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	strncpy(hdrlist[handle].hdr->Patient.Name, patientname, MAX_LENGTH_NAME+1);
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	strncpy(hl->hdr->Patient.Name, patientname, MAX_LENGTH_NAME+1);
 	return (0);
 }
 
 const char *biosig_get_patientcode(int handle)  {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(NULL);
-	return(hdrlist[handle].hdr->Patient.Id);
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(NULL);
+	return(hl->hdr->Patient.Id);
 }
 int biosig_set_patientcode(int handle, const char *patientcode) {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	strncpy(hdrlist[handle].hdr->Patient.Id, patientcode, MAX_LENGTH_PID+1);
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	strncpy(hl->hdr->Patient.Id, patientcode, MAX_LENGTH_PID+1);
 	return(0);
 }
 
 int biosig_get_gender(int handle) {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(0);
-	return(hdrlist[handle].hdr->Patient.Sex);
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(0);
+	return(hl->hdr->Patient.Sex);
 }
 
 int biosig_set_gender(int handle, int gender) {
 	if (gender<0 || gender>9) return (-1); 
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
 	switch (gender) {
 	case  1 :
 	case 'm':
 	case 'M':
-		hdrlist[handle].hdr->Patient.Sex = 1;
+		hl->hdr->Patient.Sex = 1;
 		return(0);
 	case  2 :
 	case 'f':
 	case 'F':
-		hdrlist[handle].hdr->Patient.Sex = 2;
+		hl->hdr->Patient.Sex = 2;
 		return(0);
 	default:
 		return(0); 
@@ -1163,23 +1285,26 @@ int biosig_set_gender(int handle, int gender) {
 
 /*
 int biosig_get_birthdate(int handle, struct tm *T) {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	gdf_time2tm_time_r(hdr->Patient.Birthday, T);
 	return (0);
 }
 
 int biosig_set_birthdate(int handle, const struct tm *T) {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	hdr->Patient.Birthday = tm_time2gdf_time(T);
 	return (0);
 }
 */
 
 int edf_set_birthdate(int handle, int birthdate_year, int birthdate_month, int birthdate_day) {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	struct tm T;
 	T.tm_year = birthdate_year;
 	T.tm_mon  = birthdate_month;
@@ -1203,13 +1328,15 @@ int biosig_set_admincode(int handle, const char *admincode) {
 
 /*
 const char *biosig_get_technician(int handle)  {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(NULL);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(NULL);
+	HDRTYPE *hdr = hl->hdr;
 	return(hdr->ID.Technician);
 }
 int biosig_set_technician(int handle, const char *technician) {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	hdr->ID.Technician = realloc(hdr->ID.Technician, strlen(technician)+1);
 	strcpy(hdr->ID.Technician, technician);
 	return(0);
@@ -1238,8 +1365,9 @@ int biosig_blockwrite_digital_samples(int handle, int *buf) {
 
 int biosig_write_annotation(int handle, size_t onset, size_t duration, const char *description) {
 	/* onset and duration are in samples */
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 
 	size_t N = hdr->EVENT.N++;
 	hdr->EVENT.POS = (uint32_t*) realloc(hdr->EVENT.POS, hdr->EVENT.N*sizeof(*(hdr->EVENT.POS)) );
@@ -1264,8 +1392,9 @@ int biosig_write_annotation_latin1(int handle, size_t onset, size_t duration, co
 }
 
 int biosig_set_datarecord_duration(int handle, double duration) {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	double spr   = hdr->SampleRate * duration;
 	size_t rspr  = round(spr);
 	if (fabs(spr - rspr) > 1e-8*spr) {
@@ -1296,8 +1425,9 @@ int edfopen_file_writeonly(const char *path, int filetype, int number_of_signals
 }
 
 int edf_set_gender(int handle, int gender) {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	hdr->Patient.Sex = (gender==1) + (gender==0)*2 ;
 }
 
@@ -1312,40 +1442,44 @@ int edfread_digital_samples(int handle, int edfsignal, int n, int *buf) {
 }
 
 long long edfseek(int handle, int channel, long long offset, int whence) {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL || hdrlist[handle].NS<=channel ) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL || hl->NS<=channel) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 
 	switch (whence) {
 	case SEEK_SET:
-		hdrlist[handle].chanpos[channel] = offset; // update position pointer of channel chan
+		hl->chanpos[channel] = offset; // update position pointer of channel chan
 		break;
 	case SEEK_CUR:
-		hdrlist[handle].chanpos[channel] += offset; // update position pointer of channel chan
+		hl->chanpos[channel] += offset; // update position pointer of channel chan
 		break;
 	case SEEK_END: {
 		CHANNEL_TYPE *hc = getChannelHeader(hdr,channel);
-		hdrlist[handle].chanpos[channel] = hdr->NRec*hc->SPR + offset; // update position pointer of channel chan
+		hl->chanpos[channel] = hdr->NRec*hc->SPR + offset; // update position pointer of channel chan
 		break;
 		}
 	}	
-	return (hdrlist[handle].chanpos[channel]);
+	return (hl->chanpos[channel]);
 }
 
 long long edftell(int handle, int channel) {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL || hdrlist[handle].NS<=channel ) return(-1);
-	return ( hdrlist[handle].chanpos[channel] );
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL || hl->NS<=channel) return(-1);
+	return ( hl->chanpos[channel] );
 }
 
 int edfrewind(int handle, int channel) {
 /* It is equivalent to: (void) edf_seek(int handle, int biosig_signal, 0LL, SEEK_SET) */
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL || hdrlist[handle].NS<=channel ) return(-1);
-	hdrlist[handle].chanpos[channel] = 0;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL || hl->NS<=channel) return(-1);
+	hl->chanpos[channel] = 0;
 	return(0);
 }
 
 int edf_get_annotation(int handle, int n, struct edf_annotation_struct *annot) {
-	if (handle<0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 
 	annot->onset = hdr->EVENT.POS[n]*1e4/hdr->EVENT.SampleRate;
 	annot->duration = hdr->EVENT.DUR[n]*1e4/hdr->EVENT.SampleRate;
@@ -1356,8 +1490,9 @@ int edf_get_annotation(int handle, int n, struct edf_annotation_struct *annot) {
 
 int edfwrite_annotation(int handle, size_t onset, size_t duration, const char *description) {
 	/* onset and duration are multiples of 100 microseconds */
-	if (handle < 0 || handle >= hdrlistlen || hdrlist[handle].hdr==NULL) return(-1);
-	HDRTYPE *hdr = hdrlist[handle].hdr;
+	struct hdrlist_t *hl = hdrlist_get(handle);
+	if (hl==NULL) return(-1);
+	HDRTYPE *hdr = hl->hdr;
 	return (biosig_write_annotation(handle, onset*1e-4*hdr->EVENT.SampleRate, duration*1e-4*hdr->EVENT.SampleRate, description));
 }
 
@@ -62,6 +62,11 @@ int biosig_reset_flag(HDRTYPE *hdr, unsigned flags);
 int biosig_set_targetsegment(HDRTYPE *hdr, unsigned targetsegment);
 int biosig_get_targetsegment(HDRTYPE *hdr);
 
+/* I/O and decoding statistics collected while reading the file,
+   reset_stats clears all counters and timers */
+const HDRSTATS_TYPE* biosig_get_stats(HDRTYPE *hdr);
+int biosig_reset_stats(HDRTYPE *hdr);
+
 const char* biosig_get_filename(HDRTYPE *hdr);
 float biosig_get_version(HDRTYPE *hdr);
 
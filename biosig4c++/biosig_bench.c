@@ -0,0 +1,743 @@
+/*
+
+    This file is part of the "BioSig for C/C++" repository
+    (biosig4c++) at http://biosig.sf.net/
+
+    BioSig is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+	Benchmark of the read and write engine of libbiosig
+
+	Synthetic GDF, EDF and BDF files are generated with SWRITE; the number
+	of channels, samples per record, records, the mix of data types (GDFTYP)
+	and the density of events can be chosen. Then the following is measured:
+
+	swrite		throughput of SOPEN(w), SWRITE and SCLOSE for each format
+	sopen		latency of SOPEN(r) and SCLOSE
+	sread		throughput of sequential SREAD for each format, and for
+			GDF files with a single data type for each GDFTYP
+	select		throughput of SREAD when only a fraction of the channels is selected
+	reref		throughput of SREAD with a common average and a bipolar montage
+			(RerefCHANNEL), in both layouts (ROW_BASED_CHANNELS)
+	window		latency of SREAD of random windows
+	events		SORT_EVENTTABLE, CONVERT2TO4_EVENTTABLE and reading the event table
+
+	With -x, the conversion matrix is measured instead: the synthetic GDF
+	file is converted with save2gdf into each writable format, and back
+	into GDF. For each conversion, the throughput (relative to the size of
+	the GDF source), the peak RSS of save2gdf, and the maximum absolute
+	error (in physical units) between the data of the source and the
+	converted file are recorded. Each conversion and each comparison runs
+	in a separate process, so that a crash affects only one entry.
+
+	The results are written in JSON format, in order to track regressions
+	across versions.
+
+	usage: biosig_bench [OPTIONS]
+	with -g, the files are only generated (and kept), no benchmark is run.
+ */
+
+#include "biosig-dev.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static size_t	NS     = 32;		// number of channels
+static size_t	SPR    = 256;		// samples per record
+static size_t	NREC   = 600;		// number of records
+static double	FS     = 256.0;		// sampling rate [Hz]
+static double	EVENTS = 1.0;		// events per second
+static size_t	REPS   = 20;		// repetitions for latency measurements
+static size_t	WINDOW = 4;		// records per random window
+static size_t	CHUNK  = 16;		// records per SREAD call of the sequential read
+static const char *DataDir = "/tmp";
+static const char *TYPES = "3,5,16,17";	// GDFTYP mix of GDF files
+static uint64_t	SEED   = 0x2545F4914F6CDD1DULL;
+
+static FILE	*OUT;
+static int	FirstResult = 1;
+
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return(tv.tv_sec + tv.tv_usec*1e-6);
+}
+
+/* xorshift64*, results are reproducible across platforms */
+static uint64_t rnd() {
+	SEED ^= SEED >> 12;
+	SEED ^= SEED << 25;
+	SEED ^= SEED >> 27;
+	return(SEED * 0x2545F4914F6CDD1DULL);
+}
+
+static int cmp_double(const void *a, const void *b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return((x > y) - (x < y));
+}
+
+/* p-th percentile of T[0..n-1], T is sorted */
+static double percentile(double *T, size_t n, double p) {
+	if (n == 0) return(NAN);
+	size_t k = (size_t)floor(p * (n-1) + 0.5);
+	return(T[k]);
+}
+
+static size_t parse_list(const char *s, int *list, size_t max) {
+	size_t n = 0;
+	while (*s && n < max) {
+		char *e;
+		long v = strtol(s, &e, 0);
+		if (e == s) break;
+		list[n++] = (int)v;
+		s = (*e == ',') ? e+1 : e;
+	}
+	return(n);
+}
+
+static void result_begin(const char *bench) {
+	fprintf(OUT, "%s\n\t\t{\"bench\": \"%s\"", FirstResult ? "" : ",", bench);
+	FirstResult = 0;
+}
+static void result_end() {
+	fprintf(OUT, "}");
+}
+
+/* range of digital values of GDFTYP */
+static void digrange(uint16_t gdftyp, double *DigMin, double *DigMax) {
+	switch (gdftyp) {
+	case 1:  *DigMin = -128;        *DigMax = 127;        break;
+	case 2:  *DigMin = 0;           *DigMax = 255;        break;
+	case 3:  *DigMin = -32768;      *DigMax = 32767;      break;
+	case 4:  *DigMin = 0;           *DigMax = 65535;      break;
+	case 5:  *DigMin = -2147483648.0; *DigMax = 2147483647.0; break;
+	case 6:  *DigMin = 0;           *DigMax = 4294967295.0; break;
+	case 255+24: *DigMin = -8388608; *DigMax = 8388607;   break;
+	case 511+24: *DigMin = 0;       *DigMax = 16777215;   break;
+	default: *DigMin = -1e6;        *DigMax = 1e6;        // float and double
+	}
+}
+
+/*
+	generates a synthetic file with SWRITE, GDFTYP[k % NT] is the data type
+	of channel k. Returns the time spent in SOPEN, SWRITE and SCLOSE [s],
+	or a negative value in case of an error.
+ */
+static double generate(const char *fn, enum FileFormat TYPE, const int *GDFTYP, size_t NT) {
+
+	size_t NEV = (size_t)(EVENTS * NREC * SPR / FS);
+	HDRTYPE *hdr = constructHDR(NS, NEV);
+	size_t k, k1, k2;
+
+	hdr->TYPE       = TYPE;
+	hdr->VERSION    = (TYPE == GDF) ? 3.0 : 0.0;
+	hdr->NRec       = NREC;
+	hdr->SPR        = SPR;
+	hdr->SampleRate = FS;
+	hdr->FLAG.UCAL  = 0;
+	hdr->FLAG.OVERFLOWDETECTION = 0;
+	hdr->FLAG.ROW_BASED_CHANNELS = 0;
+
+	for (k = 0; k < NS; k++) {
+		CHANNEL_TYPE *hc = hdr->CHANNEL+k;
+		uint16_t gdftyp  = (TYPE == EDF) ? 3 : (TYPE == BDF) ? 255+24 : GDFTYP[k % NT];
+		sprintf(hc->Label, "ch%i", (int)k+1);
+		hc->OnOff   = 1;
+		hc->SPR     = SPR;
+		hc->GDFTYP  = gdftyp;
+		digrange(gdftyp, &hc->DigMin, &hc->DigMax);
+		hc->PhysMin = -1000.0;
+		hc->PhysMax = +1000.0;
+		hc->Cal     = (hc->PhysMax - hc->PhysMin) / (hc->DigMax - hc->DigMin);
+		hc->Off     = hc->PhysMin - hc->Cal * hc->DigMin;
+		if ((gdftyp == 16) || (gdftyp == 17)) {
+			// floating point types are stored without scaling
+			hc->DigMin = hc->PhysMin;
+			hc->DigMax = hc->PhysMax;
+			hc->Cal = 1.0;
+			hc->Off = 0.0;
+		}
+	}
+
+	// events with random positions and types, sorted by position
+	hdr->EVENT.SampleRate = FS;
+	for (k = 0; k < NEV; k++) {
+		hdr->EVENT.POS[k] = (uint32_t)(rnd() % (NREC*SPR));
+		hdr->EVENT.TYP[k] = 0x0300 + (uint16_t)(rnd() % 8);
+		hdr->EVENT.DUR[k] = (uint32_t)(rnd() % (size_t)FS);
+		hdr->EVENT.CHN[k] = 0;
+	}
+	sort_eventtable(hdr);
+
+	// data is written in chunks of CHUNK records
+	size_t chunk = min(CHUNK, NREC);
+	biosig_data_type *data = (biosig_data_type*)malloc(NS * chunk * SPR * sizeof(biosig_data_type));
+	if (data == NULL) {
+		destructHDR(hdr);
+		return(-1);
+	}
+	hdr->data.block   = data;
+	hdr->data.size[1] = NS;
+
+	// only the library calls are timed, not the generation of the samples
+	double t0 = now();
+	sopen(fn, "w", hdr);
+	double dt = now() - t0;
+	if (serror2(hdr)) {
+		hdr->data.block = NULL;
+		destructHDR(hdr);
+		free(data);
+		return(-1);
+	}
+
+	size_t pos, count;
+	for (pos = 0; pos < NREC; pos += count) {
+		count = min(chunk, NREC - pos);
+		hdr->data.size[0] = count * SPR;
+		for (k = 0; k < NS; k++) {
+			double f = 1.0 + k;
+			biosig_data_type *d = data + k * count * SPR;
+			for (k1 = 0; k1 < count * SPR; k1++) {
+				k2 = pos * SPR + k1;
+				d[k1] = 800.0 * sin(2 * M_PI * f * k2 / FS) + (double)(rnd() % 2001) * 0.1 - 100.0;
+			}
+		}
+		t0 = now();
+		size_t c = swrite(data, count, hdr);
+		dt += now() - t0;
+		if (c != count) break;
+	}
+	t0 = now();
+	sclose(hdr);
+	dt += now() - t0;
+
+	int err = serror2(hdr);
+	hdr->data.block = NULL;
+	destructHDR(hdr);
+	free(data);
+	return(err ? -1 : dt);
+}
+
+static size_t filesize(const char *fn) {
+	FILE *fid = fopen(fn, "rb");
+	if (fid == NULL) return(0);
+	fseek(fid, 0, SEEK_END);
+	size_t s = ftell(fid);
+	fclose(fid);
+	return(s);
+}
+
+static HDRTYPE *open_read(const char *fn) {
+	HDRTYPE *hdr = sopen(fn, "r", NULL);
+	if (serror2(hdr)) {
+		destructHDR(hdr);
+		return(NULL);
+	}
+	hdr->FLAG.UCAL = 0;
+	hdr->FLAG.OVERFLOWDETECTION = 1;
+	hdr->FLAG.ROW_BASED_CHANNELS = 0;
+	return(hdr);
+}
+
+static void bench_swrite(const char *fn, const char *label, double dt) {
+	size_t sz = filesize(fn);
+	result_begin("swrite");
+	fprintf(OUT, ", \"format\": \"%s\", \"bytes\": %lu, \"seconds\": %.6f, \"MBps\": %.2f",
+		label, (unsigned long)sz, dt, dt > 0 ? sz*1e-6/dt : 0.0);
+	result_end();
+}
+
+static void bench_sopen(const char *fn, const char *label) {
+	double *T = (double*)malloc(REPS * sizeof(double));
+	size_t k, n = 0;
+	for (k = 0; k < REPS; k++) {
+		double t0 = now();
+		HDRTYPE *hdr = sopen(fn, "r", NULL);
+		int err = serror2(hdr);
+		sclose(hdr);
+		T[n] = now() - t0;
+		destructHDR(hdr);
+		if (!err) n++;
+	}
+	qsort(T, n, sizeof(double), cmp_double);
+	result_begin("sopen");
+	fprintf(OUT, ", \"format\": \"%s\", \"reps\": %lu, \"p50_us\": %.1f, \"p99_us\": %.1f, \"min_us\": %.1f",
+		label, (unsigned long)n, percentile(T,n,0.5)*1e6, percentile(T,n,0.99)*1e6, n ? T[0]*1e6 : NAN);
+	result_end();
+	free(T);
+}
+
+/* sequential read with SREAD of all records; every STEP-th channel is selected */
+static void bench_sread(const char *fn, const char *bench, const char *label, size_t step) {
+	HDRTYPE *hdr = open_read(fn);
+	if (hdr == NULL) return;
+	size_t k, nsel = 0;
+	for (k = 0; k < hdr->NS; k++) {
+		hdr->CHANNEL[k].OnOff = (k % step) == 0;
+		nsel += hdr->CHANNEL[k].OnOff;
+	}
+	size_t bytes = (size_t)hdr->NRec * hdr->AS.bpb;
+	size_t pos, count, samples = 0;
+	double t0 = now();
+	for (pos = 0; pos < (size_t)hdr->NRec; pos += count) {
+		count = sread(NULL, pos, CHUNK, hdr);
+		if (count == 0) break;
+		samples += hdr->data.size[0] * hdr->data.size[1];
+	}
+	double dt = now() - t0;
+	result_begin(bench);
+	fprintf(OUT, ", \"format\": \"%s\", \"selected\": %.3f, \"bytes\": %lu, \"seconds\": %.6f, \"MBps\": %.2f, \"Msamples_per_s\": %.2f"
+		", \"t_io\": %.6f, \"t_decode\": %.6f",
+		label, (double)nsel / hdr->NS, (unsigned long)bytes, dt, dt > 0 ? bytes*1e-6/dt : 0.0,
+		dt > 0 ? samples*1e-6/dt : 0.0, hdr->STATS.t_io, hdr->STATS.t_decode);
+	result_end();
+	sclose(hdr);
+	destructHDR(hdr);
+}
+
+/* sequential read with SREAD and re-referencing: car = common average reference, bip = bipolar chain */
+static void bench_reref(const char *fn, const char *montage, char row_based) {
+	HDRTYPE *hdr = open_read(fn);
+	if (hdr == NULL) return;
+	size_t k, j, n = 0, NS = hdr->NS;
+	char car = !strcmp(montage, "car");
+	REREF_TYPE R;
+	memset(&R, 0, sizeof(R));
+	R.ncol = NS;
+	R.nrow = car ? NS : NS - 1;
+	R.p = (uint32_t*)malloc((NS+1) * sizeof(uint32_t));
+	R.i = (uint32_t*)malloc(NS*NS * sizeof(uint32_t));
+	R.x = (double*)malloc(NS*NS * sizeof(double));
+	for (k = 0; k < R.nrow; k++) {
+		R.p[k] = n;
+		if (car) {
+			for (j = 0; j < NS; j++, n++) {
+				R.i[n] = j;
+				R.x[n] = (j == k) - 1.0/NS;
+			}
+		}
+		else {
+			R.i[n] = k;   R.x[n++] =  1.0;
+			R.i[n] = k+1; R.x[n++] = -1.0;
+		}
+	}
+	R.p[R.nrow] = n;
+	hdr->FLAG.ROW_BASED_CHANNELS = row_based;
+	int err = RerefCHANNEL(hdr, &R, 3);
+	free(R.p);
+	free(R.i);
+	free(R.x);
+	if (err) {
+		sclose(hdr);
+		destructHDR(hdr);
+		return;
+	}
+
+	size_t bytes = (size_t)hdr->NRec * hdr->AS.bpb;
+	size_t pos, count, samples = 0;
+	double t0 = now();
+	for (pos = 0; pos < (size_t)hdr->NRec; pos += count) {
+		count = sread(NULL, pos, CHUNK, hdr);
+		if (count == 0) break;
+		samples += hdr->data.size[0] * hdr->data.size[1];
+	}
+	double dt = now() - t0;
+	result_begin("reref");
+	fprintf(OUT, ", \"format\": \"GDF\", \"montage\": \"%s\", \"row_based\": %i, \"bytes\": %lu, \"seconds\": %.6f, \"MBps\": %.2f, \"Msamples_per_s\": %.2f"
+		", \"t_io\": %.6f, \"t_decode\": %.6f",
+		montage, row_based, (unsigned long)bytes, dt, dt > 0 ? bytes*1e-6/dt : 0.0,
+		dt > 0 ? samples*1e-6/dt : 0.0, hdr->STATS.t_io, hdr->STATS.t_decode);
+	result_end();
+	sclose(hdr);
+	destructHDR(hdr);
+}
+
+static void bench_window(const char *fn, const char *label) {
+	HDRTYPE *hdr = open_read(fn);
+	if (hdr == NULL) return;
+	size_t w = min(WINDOW, (size_t)hdr->NRec);
+	size_t k, n = REPS * 10;
+	double *T = (double*)malloc(n * sizeof(double));
+	for (k = 0; k < n; k++) {
+		size_t start = rnd() % (hdr->NRec - w + 1);
+		double t0 = now();
+		sread(NULL, start, w, hdr);
+		T[k] = now() - t0;
+	}
+	qsort(T, n, sizeof(double), cmp_double);
+	result_begin("window");
+	fprintf(OUT, ", \"format\": \"%s\", \"records\": %lu, \"reps\": %lu, \"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f",
+		label, (unsigned long)w, (unsigned long)n, percentile(T,n,0.5)*1e6, percentile(T,n,0.99)*1e6, T[n-1]*1e6);
+	result_end();
+	free(T);
+	sclose(hdr);
+	destructHDR(hdr);
+}
+
+static void bench_events(const char *fn, const char *label) {
+	HDRTYPE *hdr = open_read(fn);
+	if (hdr == NULL) return;
+	size_t k, N = hdr->EVENT.N;
+	double t_read = hdr->STATS.t_events;
+
+	// shuffle and sort again
+	for (k = N; k > 1; k--) {
+		size_t j = rnd() % k;
+		uint32_t p = hdr->EVENT.POS[k-1]; hdr->EVENT.POS[k-1] = hdr->EVENT.POS[j]; hdr->EVENT.POS[j] = p;
+		uint16_t t = hdr->EVENT.TYP[k-1]; hdr->EVENT.TYP[k-1] = hdr->EVENT.TYP[j]; hdr->EVENT.TYP[j] = t;
+	}
+	double t0 = now();
+	sort_eventtable(hdr);
+	double t_sort = now() - t0;
+
+	t0 = now();
+	convert2to4_eventtable(hdr);
+	double t_convert = now() - t0;
+
+	result_begin("events");
+	fprintf(OUT, ", \"format\": \"%s\", \"N\": %lu, \"read_us\": %.1f, \"sort_us\": %.1f, \"convert2to4_us\": %.1f",
+		label, (unsigned long)N, t_read*1e6, t_sort*1e6, t_convert*1e6);
+	result_end();
+	sclose(hdr);
+	destructHDR(hdr);
+}
+
+/*
+	runs "save2gdf -f=FMT src dst" with stdout and stderr discarded.
+	Returns the exit status (or 128+signal), the elapsed time [s] and
+	the peak RSS [kB] of the child.
+ */
+static int run_save2gdf(const char *save2gdf, const char *fmt, const char *src, const char *dst, double *dt, long *maxrss) {
+	char opt[32];
+	snprintf(opt, sizeof(opt), "-f=%s", fmt);
+	double t0 = now();
+	pid_t pid = fork();
+	if (pid == 0) {
+		int fd = open("/dev/null", O_WRONLY);
+		if (fd >= 0) {
+			dup2(fd, 1);
+			dup2(fd, 2);
+		}
+		execl(save2gdf, save2gdf, opt, src, dst, (char*)NULL);
+		_exit(127);
+	}
+	int status = 0;
+	struct rusage ru;
+	memset(&ru, 0, sizeof(ru));
+	if ((pid < 0) || (wait4(pid, &status, 0, &ru) < 0))
+		return(-1);
+	*dt     = now() - t0;
+	*maxrss = ru.ru_maxrss;
+	if (WIFSIGNALED(status)) return(128 + WTERMSIG(status));
+	return(WEXITSTATUS(status));
+}
+
+typedef struct {
+	int	status;		// 0: ok, 1: cannot read, 2: number of channels differs
+	double	maxerr;		// maximum absolute difference of common samples
+	size_t	ns[2];		// number of channels
+	size_t	n[2];		// number of samples per channel
+} COMPARE_T;
+
+static void compare(const char *fn0, const char *fn1, COMPARE_T *C) {
+	HDRTYPE *hdr[2];
+	const char *fn[2] = {fn0, fn1};
+	int k;
+	memset(C, 0, sizeof(*C));
+	for (k = 0; k < 2; k++) {
+		hdr[k] = open_read(fn[k]);
+		if (hdr[k] == NULL) {
+			C->status = 1;
+			if (k) destructHDR(hdr[0]);
+			return;
+		}
+		hdr[k]->FLAG.OVERFLOWDETECTION = 0;
+		sread(NULL, 0, hdr[k]->NRec, hdr[k]);
+		C->n[k]  = hdr[k]->data.size[0];
+		C->ns[k] = hdr[k]->data.size[1];
+	}
+	if (C->ns[0] != C->ns[1]) C->status = 2;
+
+	size_t ch, i, N = min(C->n[0], C->n[1]);
+	for (ch = 0; ch < min(C->ns[0], C->ns[1]); ch++) {
+		const biosig_data_type *d0 = hdr[0]->data.block + ch*C->n[0];
+		const biosig_data_type *d1 = hdr[1]->data.block + ch*C->n[1];
+		for (i = 0; i < N; i++) {
+			double e = fabs(d0[i] - d1[i]);
+			if (isnan(d0[i]) && isnan(d1[i])) continue;
+			if (!(e <= C->maxerr)) C->maxerr = e;	// NaN in one of them is an infinite error
+			if (isnan(e)) C->maxerr = INFINITY;
+		}
+	}
+	for (k = 0; k < 2; k++) {
+		sclose(hdr[k]);
+		destructHDR(hdr[k]);
+	}
+}
+
+/* compare in a child process, because some readers might crash */
+static void compare_child(const char *fn0, const char *fn1, COMPARE_T *C) {
+	int fd[2];
+	memset(C, 0, sizeof(*C));
+	C->status = 1;
+	if (pipe(fd)) return;
+	pid_t pid = fork();
+	if (pid == 0) {
+		COMPARE_T R;
+		int null = open("/dev/null", O_WRONLY);
+		if (null >= 0) {
+			dup2(null, 1);
+			dup2(null, 2);
+		}
+		close(fd[0]);
+		compare(fn0, fn1, &R);
+		if (write(fd[1], &R, sizeof(R)) != sizeof(R)) _exit(1);
+		_exit(0);
+	}
+	close(fd[1]);
+	if ((pid > 0) && (read(fd[0], C, sizeof(*C)) != sizeof(*C)))
+		C->status = 1;
+	close(fd[0]);
+	if (pid > 0) waitpid(pid, NULL, 0);
+}
+
+static void result_convert(const char *direction, const char *from, const char *to, int status, double dt, long maxrss, size_t bytes, const char *fn0, const char *fn1) {
+	COMPARE_T C;
+	if (status == 0)
+		compare_child(fn0, fn1, &C);
+	result_begin("convert");
+	fprintf(OUT, ", \"direction\": \"%s\", \"from\": \"%s\", \"to\": \"%s\", \"exit\": %i", direction, from, to, status);
+	if (status == 0) {
+		fprintf(OUT, ", \"bytes\": %lu, \"seconds\": %.6f, \"MBps\": %.2f, \"maxrss_kB\": %li",
+			(unsigned long)filesize(fn1), dt, dt > 0 ? bytes*1e-6/dt : 0.0, maxrss);
+		fprintf(OUT, ", \"readback\": %s", C.status == 1 ? "false" : "true");
+		if (C.status != 1) {
+			fprintf(OUT, ", \"channels\": [%lu, %lu], \"samples\": [%lu, %lu], \"max_abs_error\": ",
+				(unsigned long)C.ns[0], (unsigned long)C.ns[1], (unsigned long)C.n[0], (unsigned long)C.n[1]);
+			if (isfinite(C.maxerr))
+				fprintf(OUT, "%g", C.maxerr);
+			else
+				fprintf(OUT, "null");
+		}
+	}
+	result_end();
+	fflush(OUT);
+}
+
+/*
+	conversion matrix: SRC (GDF) -> each target format -> GDF
+ */
+static void bench_convert(const char *save2gdf, const char *src) {
+	struct {
+		const char *fmt;
+		const char *ext;	// extension of the target file
+		const char *readext;	// extension of the file that is read back
+	} TARGET[] = {
+		{"GDF","gdf","gdf"}, {"GDF1","gd1","gd1"}, {"EDF","edf","edf"}, {"BDF","bdf","bdf"},
+		{"ATF","atf","atf"}, {"BIN","bin","bin"}, {"BVA","eeg","vhdr"}, {"CFWB","cfw","cfw"},
+		{"HL7","hl7","hl7"}, {"MFER","mwf","mwf"}, {"SCP","scp","scp"}, {"ASCII","asc","asc"} };
+	size_t k, bytes = filesize(src);
+	for (k = 0; k < sizeof(TARGET)/sizeof(TARGET[0]); k++) {
+		char dst[1024], rd[1024], back[1024];
+		double dt = 0;
+		long maxrss = 0;
+		snprintf(dst,  sizeof(dst),  "%s/roundtrip_%s.%s", DataDir, TARGET[k].fmt, TARGET[k].ext);
+		snprintf(rd,   sizeof(rd),   "%s/roundtrip_%s.%s", DataDir, TARGET[k].fmt, TARGET[k].readext);
+		snprintf(back, sizeof(back), "%s/roundtrip_%s_back.gdf", DataDir, TARGET[k].fmt);
+
+		int status = run_save2gdf(save2gdf, TARGET[k].fmt, src, dst, &dt, &maxrss);
+		result_convert("forward", "GDF", TARGET[k].fmt, status, dt, maxrss, bytes, src, rd);
+		if (status) continue;
+
+		status = run_save2gdf(save2gdf, "GDF", rd, back, &dt, &maxrss);
+		result_convert("back", TARGET[k].fmt, "GDF", status, dt, maxrss, bytes, src, back);
+	}
+
+	// remove all files roundtrip_* in DataDir
+	DIR *dir = opendir(DataDir);
+	struct dirent *e;
+	while ((dir != NULL) && ((e = readdir(dir)) != NULL)) {
+		if (strncmp(e->d_name, "roundtrip_", 10)) continue;
+		char fn[1024];
+		snprintf(fn, sizeof(fn), "%s/%s", DataDir, e->d_name);
+		remove(fn);
+	}
+	if (dir != NULL) closedir(dir);
+}
+
+int main(int argc, char *argv[]) {
+
+	const char *outfile = NULL;
+	const char *save2gdf = "./save2gdf";
+	int generate_only = 0;
+	int matrix = 0;
+
+	for (int k = 1; k < argc; k++)
+		if (!strcmp(argv[k],"-x")) {
+			// defaults of conversion matrix
+			matrix = 1;
+			NS   = 8;
+			SPR  = 500;
+			NREC = 10;
+			FS   = 500.0;
+		}
+
+	for (int k = 1; k < argc; k++) {
+		if (!strcmp(argv[k],"-n") && (k+1 < argc))
+			NS = atol(argv[++k]);
+		else if (!strcmp(argv[k],"-s") && (k+1 < argc))
+			SPR = atol(argv[++k]);
+		else if (!strcmp(argv[k],"-r") && (k+1 < argc))
+			NREC = atol(argv[++k]);
+		else if (!strcmp(argv[k],"-f") && (k+1 < argc))
+			FS = atof(argv[++k]);
+		else if (!strcmp(argv[k],"-t") && (k+1 < argc))
+			TYPES = argv[++k];
+		else if (!strcmp(argv[k],"-e") && (k+1 < argc))
+			EVENTS = atof(argv[++k]);
+		else if (!strcmp(argv[k],"-R") && (k+1 < argc))
+			REPS = atol(argv[++k]);
+		else if (!strcmp(argv[k],"-w") && (k+1 < argc))
+			WINDOW = atol(argv[++k]);
+		else if (!strcmp(argv[k],"-c") && (k+1 < argc))
+			CHUNK = atol(argv[++k]);
+		else if (!strcmp(argv[k],"-d") && (k+1 < argc))
+			DataDir = argv[++k];
+		else if (!strcmp(argv[k],"-o") && (k+1 < argc))
+			outfile = argv[++k];
+		else if (!strcmp(argv[k],"-S") && (k+1 < argc))
+			save2gdf = argv[++k];
+		else if (!strcmp(argv[k],"-g"))
+			generate_only = 1;
+		else if (!strcmp(argv[k],"-x"))
+			;
+		else {
+			NS = 0;
+			break;
+		}
+	}
+
+	int GDFTYP[32];
+	size_t NT = parse_list(TYPES, GDFTYP, 32);
+	for (size_t k = 0; k < NT; k++)
+		if ((GDFTYP[k] < 1) || (GDFTYP[k] > 17 && GDFTYP[k] != 255+24 && GDFTYP[k] != 511+24) || GDFTYP[k] == 7 || GDFTYP[k] == 8)
+			NT = 0;
+
+	if ((NS < 1) || (SPR < 1) || (NREC < 1) || !(FS > 0) || (NT < 1) || (REPS < 1) || (WINDOW < 1) || (CHUNK < 1)) {
+		fprintf(stdout,"usage: biosig_bench [-n NS] [-s SPR] [-r NREC] [-f FS] [-t GDFTYP,...] [-e EVENTS] [-R REPS] [-w WINDOW] [-c CHUNK] [-d DIR] [-o FILE] [-g] [-x] [-S save2gdf]\n"
+			"  -n NS\n\tnumber of channels [default: 32]\n"
+			"  -s SPR\n\tsamples per record [default: 256]\n"
+			"  -r NREC\n\tnumber of records [default: 600]\n"
+			"  -f FS\n\tsampling rate in Hz [default: 256]\n"
+			"  -t GDFTYP,...\n\tdata types of the channels of GDF files, used cyclically [default: 3,5,16,17]\n"
+			"\tEDF uses always int16 (3), BDF int24 (279)\n"
+			"  -e EVENTS\n\tnumber of events per second [default: 1]\n"
+			"  -R REPS\n\tnumber of repetitions of latency measurements [default: 20]\n"
+			"  -w WINDOW\n\tnumber of records of random windows [default: 4]\n"
+			"  -c CHUNK\n\tnumber of records per SREAD and SWRITE call [default: 16]\n"
+			"  -d DIR\n\tdirectory of the generated files [default: /tmp]\n"
+			"  -o FILE\n\tJSON output [default: stdout]\n"
+			"  -g\n\tonly generate the files bench.gdf, bench.edf and bench.bdf in DIR, and keep them\n"
+			"  -x\n\tconversion matrix: converts bench.gdf with save2gdf into each writable format and back into GDF\n"
+			"\tthe defaults are then -n 8 -s 500 -r 10 -f 500, because some formats (SCP, HL7) are limited\n"
+			"  -S save2gdf\n\tpath to save2gdf [default: ./save2gdf]\n");
+		return(-1);
+	}
+
+	struct {
+		enum FileFormat TYPE;
+		const char *label;
+		const char *ext;
+	} FMT[] = { {GDF,"GDF","gdf"}, {EDF,"EDF","edf"}, {BDF,"BDF","bdf"} };
+	const size_t NF = sizeof(FMT)/sizeof(FMT[0]);
+	char fn[sizeof(FMT)/sizeof(FMT[0])][1024];
+	double tw[sizeof(FMT)/sizeof(FMT[0])];
+	size_t k;
+
+	for (k = 0; k < NF; k++) {
+		snprintf(fn[k], sizeof(fn[k]), "%s/bench.%s", DataDir, FMT[k].ext);
+		tw[k] = generate(fn[k], FMT[k].TYPE, GDFTYP, NT);
+		if (tw[k] < 0) {
+			fprintf(stderr, "biosig_bench: cannot generate %s\n", fn[k]);
+			return(-1);
+		}
+	}
+	if (generate_only) {
+		for (k = 0; k < NF; k++)
+			fprintf(stdout, "%s\t%lu bytes\n", fn[k], (unsigned long)filesize(fn[k]));
+		return(0);
+	}
+
+	OUT = stdout;
+	if (outfile != NULL && (OUT = fopen(outfile, "w")) == NULL) {
+		fprintf(stderr, "biosig_bench: cannot open %s\n", outfile);
+		return(-1);
+	}
+
+	time_t t = time(NULL);
+	char date[32];
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&t));
+	fprintf(OUT, "{\n\t\"program\": \"biosig_bench\",\n\t\"version\": \"%i.%i.%i\",\n\t\"date\": \"%s\",\n",
+		BIOSIG_VERSION_MAJOR, BIOSIG_VERSION_MINOR, BIOSIG_PATCHLEVEL, date);
+	fprintf(OUT, "\t\"params\": {\"NS\": %lu, \"SPR\": %lu, \"NRec\": %lu, \"fs\": %g, \"gdftyp\": \"%s\", \"events_per_s\": %g, \"reps\": %lu, \"window\": %lu, \"chunk\": %lu},\n",
+		(unsigned long)NS, (unsigned long)SPR, (unsigned long)NREC, FS, TYPES, EVENTS, (unsigned long)REPS, (unsigned long)WINDOW, (unsigned long)CHUNK);
+	fprintf(OUT, "\t\"results\": [");
+
+	if (matrix)
+		bench_convert(save2gdf, fn[0]);
+	else {
+		for (k = 0; k < NF; k++) {
+			bench_swrite(fn[k], FMT[k].label, tw[k]);
+			bench_sopen(fn[k], FMT[k].label);
+			bench_sread(fn[k], "sread", FMT[k].label, 1);
+			bench_window(fn[k], FMT[k].label);
+		}
+
+		// sread for each data type, and channel selection
+		char fn1[1024];
+		snprintf(fn1, sizeof(fn1), "%s/bench_gdftyp.gdf", DataDir);
+		for (k = 0; k < NT; k++) {
+			char label[32];
+			snprintf(label, sizeof(label), "GDF/gdftyp=%i", GDFTYP[k]);
+			if (generate(fn1, GDF, GDFTYP+k, 1) < 0) continue;
+			bench_sread(fn1, "sread", label, 1);
+		}
+		remove(fn1);
+		bench_sread(fn[0], "select", "GDF", 2);
+		bench_sread(fn[0], "select", "GDF", 10);
+		for (k = 0; k < 2; k++) {
+			bench_reref(fn[0], "car", k);
+			bench_reref(fn[0], "bip", k);
+		}
+		bench_events(fn[0], "GDF");
+	}
+
+	fprintf(OUT, "\n\t]\n}\n");
+	if (OUT != stdout) fclose(OUT);
+
+	for (k = 0; k < NF; k++)
+		remove(fn[k]);
+	return(0);
+}
@@ -34,6 +34,29 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/time.h>
+
+static double t0;
+static BSCS_STATS_T stats0;
+
+/* start measurement of transfer rate */
+static void transfer_start(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	t0 = tv.tv_sec + 1e-6*tv.tv_usec;
+	stats0 = BSCS_STATS;
+}
+
+/* report compression ratio and transfer rate */
+static void transfer_report(const char *what) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	double dt = tv.tv_sec + 1e-6*tv.tv_usec - t0;
+	double raw = BSCS_STATS.rawbytes - stats0.rawbytes;
+	double net = BSCS_STATS.netbytes - stats0.netbytes;
+	fprintf(stdout,"%s: %.0f bytes, %.0f on wire (ratio %.2f), %.3f s, %.1f MB/s\n",
+		what, raw, net, net>0 ? raw/net : 1.0, dt, dt>0 ? raw*1e-6/dt : 0.0);
+}
 
 
 
@@ -57,9 +80,9 @@ int main (int argc, char *argv[]) {
 	
 	char path2keys[1024];
 	char *str;
-#ifdef _WIN32
-	str = strncpy(path2keys,getenv("HOME"),1023);
-#elif 0
+	str = strncpy(path2keys,getenv("HOME") ? getenv("HOME") : ".",1023);
+	path2keys[1023] = 0;
+#if 0
 	// TODO: getpwuid can cause a memory leak in glibc2.15 and earlier 
 	struct passwd *p = getpwuid(geteuid());	
 	str = strncpy(path2keys,p->pw_dir,1023);
@@ -144,8 +167,10 @@ int main (int argc, char *argv[]) {
 			s= bscs_send_hdr(sd, hdr);
 		}
 		else if (!strncasecmp(cmd,"senddat",7)) {
+			transfer_start();
 			s= bscs_send_dat(sd, hdr->AS.rawdata, hdr->AS.bpb*hdr->AS.length);
 			fprintf(stdout,"sent dat %i\n",s);
+			transfer_report("senddat");
 		}
 		else if (!strncasecmp(cmd,"sendevt",7)) {
 			if (hdr->TYPE != GDF) hdrEVT2rawEVT(hdr); 
@@ -168,11 +193,44 @@ int main (int argc, char *argv[]) {
 			hdr2ascii(hdr,stdout,4);
 		}
 		else if (!strncasecmp(cmd,"dat",3)) {
+			transfer_start();
 			bscs_requ_dat(sd,0,hdr->NRec,hdr);
+			transfer_report("dat");
 		}
 		else if (!strncasecmp(cmd,"evt",3)) {
 			bscs_requ_evt(sd,hdr);
 		}
+		else if (!strncasecmp(cmd,"subscribe ",10)) {
+			// subscribe ID [start]: receive data of a recording until it is closed
+			char *fn = cmd+10;
+		     	while (isspace(fn[0])) fn++;
+			char *ix = fn;
+		     	while (ix[0] && !isspace(ix[0])) ix++;
+			unsigned long start = strtoul(ix, NULL, 10);
+			if (!strchr(ix,'0') && !start) start = BSCS_SUBSCRIBE_LIVE;
+		     	ix[0]=0;
+		     	cat64(fn,&ID);
+			s = bscs_subscribe(sd, ID, start, hdr);
+			fprintf(stdout,"subscribe ID=%16Lx s=%08x NS=%i bpb=%i\n",ID,s,hdr->NS,(int)hdr->AS.bpb);
+			transfer_start();
+			ssize_t n;
+			while (!s && ((n = bscs_recv_dat(sd, hdr, 10000)) > 0))
+				fprintf(stdout,"records %i..%i\n",(int)hdr->AS.first,(int)(hdr->AS.first+n-1));
+			if (!s) fprintf(stdout,"%s\n", n<0 ? "end of recording" : "timeout");
+			transfer_report("subscribe");
+			s = bscs_close(sd);
+		}
+		else if (!strncasecmp(cmd,"status",6)) {
+			char *status;
+			s = bscs_requ_status(sd, &status);
+			fprintf(stdout,"status %08x\n%s", s, status ? status : "");
+			free(status);
+		}
+		else if (!strncasecmp(cmd,"compress",8)) {
+			// compress N: compression level 0 (off) .. 9
+			bscs_set_compression(atoi(cmd+8));
+			fprintf(stdout,"compression level %i, server version 0.%i\n",atoi(cmd+8),SERVER_VERSION);
+		}
 		else if (!strncasecmp(cmd,"ow",2)) {
 			ID = 0; 
 			s=bscs_open(sd, &ID);
@@ -199,7 +257,9 @@ fprintf(stdout,"12 %i\n",hdr->EVENT.N);
 fprintf(stdout,"13 %s %i\n",GetFileTypeString(hdr->TYPE),hdr->EVENT.N);
 			bscs_requ_hdr(sd,hdr);
 fprintf(stdout,"14a %i %i %i\n",0,(int)hdr->NRec,hdr->EVENT.N);
+			transfer_start();
 			bscs_requ_dat(sd,0,hdr->NRec,hdr);
+			transfer_report("requ");
 fprintf(stdout,"14b %i\n",hdr->EVENT.N);
 //			bscs_requ_evt(sd,hdr);
 fprintf(stdout,"14c %i\n",hdr->EVENT.N);
@@ -220,7 +280,7 @@ fprintf(stdout,"16 %i\n",hdr->EVENT.N);
 		     	
 		     	hdr = sopen(fn,"r",NULL);
 //			if (hdr->TYPE!=GDF) {
-			if (serror()) {
+			if (serror2(hdr)) {
 				stat(fn, &info);
 		     		FILE *fid = fopen(fn,"r"); 
 		     		if (fid==NULL)
@@ -257,7 +317,7 @@ fprintf(stdout,"16 %i\n",hdr->EVENT.N);
 		     	
 		     		sread_raw(0,hdr->NRec,hdr,1); 	// collapse rawdata (remove obsolete channels) 
 				size_t bpb = bpb8_collapsed_rawdata(hdr)>>3;
-				if (serror()) {
+				if (serror2(hdr)) {
 					sclose(hdr);
 					exit(-1);
 				}	
@@ -281,8 +341,10 @@ fprintf(stdout,"16 %i\n",hdr->EVENT.N);
 				s= bscs_send_hdr(sd, hdr);
 				fprintf(stdout,"sent hdr %i %i\n",s,hdr->AS.bpb);
 
+				transfer_start();
 				s = bscs_send_dat(sd, hdr->AS.rawdata, hdr->AS.length*bpb);
 				fprintf(stdout,"sent dat %i %i\n",s,bpb);
+				transfer_report("send");
 					
 				if (hdr->TYPE != GDF) hdrEVT2rawEVT(hdr); 
 				if (hdr->EVENT.N>0) s= bscs_send_evt(sd, hdr);
@@ -31,8 +31,21 @@
 #include <sys/stat.h>
 #include <time.h>
 #include <syslog.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <signal.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/mman.h>
+
+#ifdef WITH_PTHREAD
+#include <pthread.h>
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#endif
 
 #ifdef WITH_MICROMED 
 void sopen_trc_read(HDRTYPE *hdr);
@@ -43,6 +56,28 @@ void sopen_pdp_read(HDRTYPE *hdr);
 
 const char *LOGFILE = "/tmp/biosig/biosigd.log";
 
+/*
+	the epoll server runs several connections in one process,
+	libbiosig is not thread-safe in sopen, sclose and the header conversion;
+	these are serialized with mutexLibrary.
+ */
+#ifdef _PTHREAD_H
+static pthread_mutex_t mutexLibrary = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t mutexIdTable = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void lock_library() {
+#ifdef _PTHREAD_H
+	pthread_mutex_lock(&mutexLibrary);
+#endif
+}
+
+static void unlock_library() {
+#ifdef _PTHREAD_H
+	pthread_mutex_unlock(&mutexLibrary);
+#endif
+}
+
 /* 
 	Key ID table and related functions 
 */
@@ -75,6 +110,9 @@ uint64_t GetNewId() {
 
 	int k; 
 	uint64_t c;
+#ifdef _PTHREAD_H
+	pthread_mutex_lock(&mutexIdTable);
+#endif
 	FILE *fid = fopen("/dev/urandom","r"); 
 	do {
 		fread(&c,sizeof(c),1,fid); 
@@ -84,13 +122,16 @@ uint64_t GetNewId() {
 	k = IdTableLen; 
 	IdTableLen++; 
 	IdTablePtr = (IDTABLE_T*)realloc(IdTablePtr,IdTableLen*sizeof(IDTABLE_T));
-	while ((c < IdTablePtr[k].id) && (k>0)) {
-		IdTablePtr[k].id = IdTablePtr[k-1].id;
+	while ((k>0) && (u64cmp(&c, &IdTablePtr[k-1].id) < 0)) {
+		IdTablePtr[k] = IdTablePtr[k-1];
 		k--;
 	}	
 	IdTablePtr[k].id = c;
 	IdTablePtr[k].gtime = t_time2gdf_time(time(NULL));
 //	memcpy(&IdTablePtr[k].addr, addr, sizeof(struct sockaddr_in));
+#ifdef _PTHREAD_H
+	pthread_mutex_unlock(&mutexIdTable);
+#endif
 	
 	return(c); 
 }; 
@@ -144,643 +185,1739 @@ void sigchld_handler(int s)
 //#define VERBOSE_LEVEL 8
 
 const char   path[] = "/tmp/biosig/\0                .gdf";
-void DoJob(int ns)
-{
-		char fullfilename[] = "/tmp/biosig/                .gdf";
-		const size_t pathlen = strlen(path); 
-		char *filename = fullfilename+pathlen;  
-
-//    		size_t sizbuf = BSCS_MAX_BUFSIZ+8;
-		uint8_t inbuf[BSCS_MAX_BUFSIZ+8];
-		HDRTYPE *hdr = NULL; 
-		uint64_t ID = 0; 
-		uint32_t STATUS = STATE_INIT;
-		char stopflag = 0; 
-		size_t datalen = 0; 
-		mesg_t msg; 	
-
-		if ((VERBOSE_LEVEL>7) && errno) {
-			errno = 0; 
-			fprintf(stdout,"## errno=%i %s\n",errno,strerror(errno));
-		}	 
 
-		/* Create a new SID for the child process */
-		pid_t sid = setsid();
-		if (sid < 0) {
-			exit(-1);
+/****************************************************************************************
+	SHARED CACHE
+
+	Parsed headers (header and event table of GDF files) and chunks of
+	raw data blocks are kept in a cache that is shared by all connections:
+	it is allocated as shared memory before the first connection is
+	accepted, so it is used by the forked processes as well as by the
+	threads of the epoll server. Entries are identified by the file
+	(device, inode, mtime, size), a rewritten file has a new key, and
+	stale entries are eventually dropped by the LRU policy.
+
+	The memory is divided into blocks of BSCS_CACHE_BLOCK bytes; an entry
+	occupies a chain of blocks. A process-shared robust mutex protects
+	the cache; if a process dies while holding it, the cache is cleared.
+ ****************************************************************************************/
+#define BSCS_CACHE_BLOCK	(1<<16)
+#define BSCS_CACHE_HDR		0	// header and event table
+#define BSCS_CACHE_DAT		1	// chunk of data blocks
+
+typedef struct {
+	uint64_t	dev, ino, mtime, size;	// file identity
+	uint32_t	kind, index;		// entry type, and chunk number
+} CACHE_KEY_T;
+
+typedef struct {
+	CACHE_KEY_T	key;
+	size_t		len;
+	int32_t		block;		// first block, -1: entry is unused
+	int32_t		hnext;		// next entry in hash chain
+	int32_t		prev, next;	// LRU list
+} CACHE_ENTRY_T;
+
+typedef struct {
+#ifdef _PTHREAD_H
+	pthread_mutex_t	mutex;
+#endif
+	size_t		nblocks, nhash;
+	int32_t		head, tail;	// most and least recently used entry
+	int32_t		freeEntry, freeBlock;
+	size_t		used;		// number of used blocks
+	uint64_t	hits[2], misses[2], inserts, evictions;
+	int32_t		*hash;		// nhash chains
+	CACHE_ENTRY_T	*entry;		// nblocks entries
+	int32_t		*blocknext;	// chain of blocks
+	uint8_t		*data;
+} CACHE_T;
+
+static CACHE_T *Cache = NULL;
+
+static void cache_clear(CACHE_T *C) {
+	for (size_t k = 0; k < C->nhash; k++) C->hash[k] = -1;
+	for (size_t k = 0; k < C->nblocks; k++) {
+		C->entry[k].block = -1;
+		C->entry[k].next  = (k+1 < C->nblocks) ? k+1 : -1;
+		C->blocknext[k]   = (k+1 < C->nblocks) ? k+1 : -1;
+	}
+	C->head = C->tail = -1;
+	C->freeEntry = C->freeBlock = 0;
+	C->used = 0;
+}
+
+/* allocate a cache of size bytes in shared memory, returns 0 on success */
+static int cache_init(size_t size) {
+#ifdef _PTHREAD_H
+	size_t nblocks = size / BSCS_CACHE_BLOCK;
+	if (nblocks < 4) return(-1);
+	size_t nhash = 1;
+	while (nhash < nblocks) nhash <<= 1;
+	size_t len = sizeof(CACHE_T) + nhash*sizeof(int32_t) + nblocks*(sizeof(CACHE_ENTRY_T) + sizeof(int32_t)) + 8;
+	len = (len + 4095) & ~(size_t)4095;
+	uint8_t *mem = (uint8_t*)mmap(NULL, len + nblocks*BSCS_CACHE_BLOCK, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) return(-1);
+
+	CACHE_T *C = (CACHE_T*)mem;
+	memset(C, 0, sizeof(CACHE_T));
+	C->nblocks   = nblocks;
+	C->nhash     = nhash;
+	C->entry     = (CACHE_ENTRY_T*)(((uintptr_t)(mem + sizeof(CACHE_T)) + 7) & ~(uintptr_t)7);
+	C->hash      = (int32_t*)(C->entry + nblocks);
+	C->blocknext = C->hash + nhash;
+	C->data      = mem + len;
+	cache_clear(C);
+
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&C->mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+	Cache = C;
+	return(0);
+#else
+	return(-1);
+#endif
+}
+
+static void cache_lock(CACHE_T *C) {
+#ifdef _PTHREAD_H
+	if (pthread_mutex_lock(&C->mutex) == EOWNERDEAD) {
+		/* previous owner died, the content might be inconsistent */
+		cache_clear(C);
+		pthread_mutex_consistent(&C->mutex);
+	}
+#endif
+}
+
+static void cache_unlock(CACHE_T *C) {
+#ifdef _PTHREAD_H
+	pthread_mutex_unlock(&C->mutex);
+#endif
+}
+
+static size_t cache_hash(const CACHE_T *C, const CACHE_KEY_T *key) {
+	uint64_t h = key->ino * 0x9E3779B97F4A7C15ULL;
+	h ^= (key->dev + key->mtime + ((uint64_t)key->kind << 32) + key->index) * 0xC2B2AE3D27D4EB4FULL;
+	h ^= h >> 29;
+	return(h & (C->nhash - 1));
+}
+
+static int cache_keycmp(const CACHE_KEY_T *a, const CACHE_KEY_T *b) {
+	return((a->ino != b->ino) || (a->dev != b->dev) || (a->mtime != b->mtime) || (a->size != b->size)
+		|| (a->kind != b->kind) || (a->index != b->index));
+}
+
+static int32_t cache_find(CACHE_T *C, const CACHE_KEY_T *key) {
+	int32_t e = C->hash[cache_hash(C, key)];
+	while ((e >= 0) && cache_keycmp(&C->entry[e].key, key)) e = C->entry[e].hnext;
+	return(e);
+}
+
+static void cache_lru_unlink(CACHE_T *C, int32_t e) {
+	CACHE_ENTRY_T *E = C->entry + e;
+	if (E->prev >= 0) C->entry[E->prev].next = E->next; else C->head = E->next;
+	if (E->next >= 0) C->entry[E->next].prev = E->prev; else C->tail = E->prev;
+}
+
+static void cache_lru_push(CACHE_T *C, int32_t e) {
+	CACHE_ENTRY_T *E = C->entry + e;
+	E->prev = -1;
+	E->next = C->head;
+	if (C->head >= 0) C->entry[C->head].prev = e; else C->tail = e;
+	C->head = e;
+}
+
+/* remove least recently used entry */
+static void cache_evict(CACHE_T *C) {
+	int32_t e = C->tail;
+	CACHE_ENTRY_T *E = C->entry + e;
+	int32_t *p = C->hash + cache_hash(C, &E->key);
+	while (*p != e) p = &C->entry[*p].hnext;
+	*p = E->hnext;
+	cache_lru_unlink(C, e);
+
+	int32_t b = E->block;
+	while (C->blocknext[b] >= 0) {
+		b = C->blocknext[b];
+		C->used--;
+	}
+	C->used--;
+	C->blocknext[b] = C->freeBlock;
+	C->freeBlock = E->block;
+	E->block = -1;
+	E->next = C->freeEntry;
+	C->freeEntry = e;
+	C->evictions++;
+}
+
+/*
+	copy entry into *buf (reallocated as needed)
+	returns the length, or -1 if the entry is not cached
+ */
+static ssize_t cache_get(const CACHE_KEY_T *key, uint8_t **buf) {
+	CACHE_T *C = Cache;
+	if (C == NULL) return(-1);
+	cache_lock(C);
+	int32_t e = cache_find(C, key);
+	ssize_t len = -1;
+	if (e < 0)
+		C->misses[key->kind]++;
+	else {
+		CACHE_ENTRY_T *E = C->entry + e;
+		C->hits[key->kind]++;
+		cache_lru_unlink(C, e);
+		cache_lru_push(C, e);
+		len = E->len;
+		*buf = (uint8_t*)realloc(*buf, max(len, 1));
+		int32_t b = E->block;
+		for (size_t pos = 0; pos < E->len; pos += BSCS_CACHE_BLOCK, b = C->blocknext[b])
+			memcpy(*buf + pos, C->data + (size_t)b*BSCS_CACHE_BLOCK, min(BSCS_CACHE_BLOCK, E->len - pos));
+	}
+	cache_unlock(C);
+	return(len);
+}
+
+static void cache_put(const CACHE_KEY_T *key, const uint8_t *buf, size_t len) {
+	CACHE_T *C = Cache;
+	size_t nb = max(1, (len + BSCS_CACHE_BLOCK - 1) / BSCS_CACHE_BLOCK);
+	if ((C == NULL) || (nb > C->nblocks/4)) return;
+	cache_lock(C);
+	if (cache_find(C, key) < 0) {		// might have been inserted by another connection
+		while ((C->nblocks - C->used < nb) || (C->freeEntry < 0))
+			cache_evict(C);
+
+		int32_t e = C->freeEntry;
+		CACHE_ENTRY_T *E = C->entry + e;
+		C->freeEntry = E->next;
+		E->key = *key;
+		E->len = len;
+		E->block = C->freeBlock;
+		int32_t b = E->block;
+		for (size_t pos = 0; ; pos += BSCS_CACHE_BLOCK) {
+			memcpy(C->data + (size_t)b*BSCS_CACHE_BLOCK, buf + pos, min(BSCS_CACHE_BLOCK, len - pos));
+			C->used++;
+			if (pos + BSCS_CACHE_BLOCK >= len) break;
+			b = C->blocknext[b];
 		}
+		C->freeBlock = C->blocknext[b];
+		C->blocknext[b] = -1;
+
+		size_t h = cache_hash(C, key);
+		E->hnext = C->hash[h];
+		C->hash[h] = e;
+		cache_lru_push(C, e);
+		C->inserts++;
+	}
+	cache_unlock(C);
+}
 
-		/*server identification */
-		const char *greeting="Hi there,\n this is your experimental BSCS server. \n It is useful for testing the BioSig client-server architecture.\n";
-		msg.STATE = BSCS_VERSION_01 | BSCS_SEND_MSG | STATE_INIT | BSCS_NO_ERROR;
-		msg.LEN = b_endian_u32(strlen(greeting)); 
-		int s;
-		s = send(ns,&msg,8,0);
-		s = send(ns, greeting, strlen(greeting), 0);
-		
-	    	while (!stopflag) // wait for command
-		{
-			fprintf(stdout,":> ");
-	   		ssize_t count = recv(ns, &msg, 8, 0);
-			fprintf(stdout,"STATUS=%08x c=%i MSG=%08x len=%i,errno=%i %s\n",STATUS,count,b_endian_u32(msg.STATE),b_endian_u32(msg.LEN),errno,strerror(errno)); 
-			size_t  LEN = b_endian_u32(msg.LEN);  
-
-			FILE *fid = fopen(LOGFILE,"a");
-			fprintf(stdout,"STATUS=%08x c=%i MSG=%08x len=%i,errno=%i %s\n",STATUS,count,b_endian_u32(msg.STATE),b_endian_u32(msg.LEN),errno,strerror(errno)); 
-			fclose(fid); 
-			errno = 0; 
-
-	   		if (count==0) {
-				fprintf(stdout,"connection lost! %i %i %i %s\n",stopflag,count,errno,strerror(errno)); 
-				LEN = 0;
-				stopflag=1;
-				continue;
-	   		} 
-	   		else if (count<0) {
-				fprintf(stdout,"invalid packet! %i %i %i %s\n",stopflag,count,errno,strerror(errno)); 
-				LEN = 0;
-	   		} 
-			else if ((msg.STATE & CMD_MASK) == BSCS_NOP) 
-			{	// no operation 
-
-				count = 0; 
-				while (count<LEN) {
-			   		count += recv(ns, inbuf, min(BSCS_MAX_BUFSIZ,LEN-count), 0);
-				}
-				msg.STATE = BSCS_VERSION_01 | BSCS_NOP | BSCS_REPLY | (msg.STATE & STATE_MASK) | BSCS_NO_ERROR;
+/* identity of file; returns 0 on success */
+static int cache_key(CACHE_KEY_T *key, const char *fn, uint32_t kind, uint32_t index) {
+	struct stat FileBuf;
+	if ((Cache == NULL) || stat(fn, &FileBuf)) return(-1);
+	memset(key, 0, sizeof(*key));
+	key->dev   = FileBuf.st_dev;
+	key->ino   = FileBuf.st_ino;
+#ifdef __linux__
+	key->mtime = FileBuf.st_mtim.tv_sec*1000000000ULL + FileBuf.st_mtim.tv_nsec;
+#else
+	key->mtime = FileBuf.st_mtime;
+#endif
+	key->size  = FileBuf.st_size;
+	key->kind  = kind;
+	key->index = index;
+	return(0);
+}
 
-				// send reply 
-				msg.LEN = b_endian_u32(0);
-				s = send(ns, &msg, 8, 0);	
-			}
+/* cache statistics as text */
+static int cache_status(char *buf, size_t len) {
+	CACHE_T *C = Cache;
+	if (C == NULL) return(snprintf(buf, len, "cache: disabled\n"));
+	cache_lock(C);
+	uint64_t h = C->hits[0] + C->hits[1], m = C->misses[0] + C->misses[1];
+	int n = snprintf(buf, len,
+		"cache: %.1f of %.1f MB used\n"
+		"header: %llu hits, %llu misses\n"
+		"data: %llu hits, %llu misses\n"
+		"hit rate: %.1f %%\n"
+		"inserts: %llu, evictions: %llu\n",
+		C->used*(double)BSCS_CACHE_BLOCK/(1<<20), C->nblocks*(double)BSCS_CACHE_BLOCK/(1<<20),
+		(unsigned long long)C->hits[0], (unsigned long long)C->misses[0],
+		(unsigned long long)C->hits[1], (unsigned long long)C->misses[1],
+		(h+m) ? 100.0*h/(h+m) : 0.0,
+		(unsigned long long)C->inserts, (unsigned long long)C->evictions);
+	cache_unlock(C);
+	return(n);
+}
 
-			else if ((STATUS == STATE_INIT) && 
-			    	 ((msg.STATE & ~ERR_MASK) == (BSCS_VERSION_01 | BSCS_OPEN | STATE_INIT))) 
-			{
-/****************************************************************************************
-	OPEN FILE with ID 
- ****************************************************************************************/
+/*
+	Connection state
+
+	Each message consists of the 8 byte header of mesg_t and LEN bytes of
+	payload. The payload is handed to bscs_process() in one piece; bulk
+	transfers (BSCS_SEND_DAT, BSCS_PUT_FILE) and oversized messages are
+	passed in chunks of at most BSCS_CHUNK_SIZE bytes, so the memory per
+	connection stays bounded. Replies are collected in the output buffer;
+	bulk data that is stored contiguously in a file (BSCS_GET_FILE, and
+	BSCS_REQU_DAT of uncompressed GDF) is appended as a file segment
+	(sendfd, sendoff, sendlen), and sent with sendfile() without copying it
+	through user space. No further request is processed until the segment
+	is sent.
+
+	The same state machine is used by the fork server (one blocking
+	connection per process) and by the epoll server (non-blocking sockets,
+	messages are processed by a pool of worker threads).
+
+	A subscribed connection (BSCS_SUBSCRIBE) follows the file on disk:
+	whenever its output queue has room for more than BSCS_SUB_QUEUE/2
+	bytes, conn_follow() checks the file size and pushes new records. It
+	runs after data was written by another connection of the epoll
+	server, and every BSCS_SUB_POLL ms, which also covers files written by
+	other processes.
+ */
+#define BSCS_CHUNK_SIZE		(16*BSCS_MAX_BUFSIZ)
+#define BSCS_MAX_MSGLEN		(1<<26)		// larger messages (except bulk transfers) are rejected
+#define BSCS_OUT_HIGHWATER	(1<<22)		// stop reading requests while this much output is pending
+#define BSCS_ZLEVEL		1		// compression level of data replies (version 0.3)
+#define BSCS_SUB_QUEUE		(1<<20)		// output queue of a subscriber [bytes]
+#define BSCS_SUB_POLL		50		// interval of checking subscribed files [ms]
+
+typedef struct CONN_T {
+	int		sd;		// socket
+	HDRTYPE		*hdr;		// currently open file
+	uint64_t	ID;
+	uint32_t	STATUS;
+	size_t		datalen;	// number of bytes received with BSCS_SEND_DAT
+	char		fullfilename[sizeof(path)+24];
+
+	/* message currently processed */
+	mesg_t		msg;
+	uint32_t	rid;		// request id (version 0.2)
+	size_t		LEN;		// payload length
+	size_t		pos;		// number of payload bytes already processed
+	size_t		joblen;		// payload bytes of the next call to bscs_process
+	char		flagMsg;	// header of msg is valid
+	char		flagChunked;	// payload is processed in chunks
+	char		flagOverflow;	// message is too large, payload is discarded
+	uint32_t	errcode;	// error code of bulk transfers
+	int		fd2;		// temporary file of BSCS_PUT_FILE
+	char		*f2;
+	BSCS_LAYOUT_T	layout;		// layout of data blocks, for compressed transfer
+	uint8_t		*zbuf;		// buffer for compression
+	CACHE_KEY_T	key;		// file identity in shared cache
+	char		flagKey;	// key is valid
+	uint8_t		*dbuf;		// buffer for data from the cache
+
+	/* subscription */
+	int		subfd;		// subscribed file
+	size_t		subHeadLen;
+	size_t		subbpb;
+	size_t		subnext;	// next record to be sent
+	char		sublive;	// skip records if subscriber is too slow
+	char		subend;		// end of recording has been sent
+
+	/* input and output buffer */
+	uint8_t		*in;
+	size_t		inpos, inlen, insiz;
+	uint8_t		*out;
+	size_t		outpos, outlen, outsiz;
+	int		sendfd;		// file segment following the output buffer
+	char		sendclose;	// sendfd is closed when the segment is sent
+	off_t		sendoff;
+	size_t		sendlen;
+
+	/* epoll server */
+	char		sublisted;	// connection is in Subscribers
+	char		busy;		// connection is queued or processed by a worker
+	char		closing;	// peer has gone, release connection when idle
+	uint32_t	events;		// registered epoll events
+	struct CONN_T	*next;
+} CONN_T;
+
+static CONN_T *conn_new(int sd) {
+	CONN_T *c = (CONN_T*)calloc(1, sizeof(CONN_T));
+	c->sd     = sd;
+	c->STATUS = STATE_INIT;
+	c->fd2    = -1;
+	c->sendfd = -1;
+	c->subfd  = -1;
+	c->insiz  = 4*BSCS_MAX_BUFSIZ;
+	c->in     = (uint8_t*)malloc(c->insiz);
+	strcpy(c->fullfilename, path);
+	return(c);
+}
 
-				if (VERBOSE_LEVEL>7) fprintf(stdout,"open %i %i %016lx\n",LEN,count,ID);
+/* release file segment */
+static void conn_sendfile_done(CONN_T *c) {
+	if (c->sendclose && (c->sendfd >= 0)) close(c->sendfd);
+	c->sendfd    = -1;
+	c->sendclose = 0;
+	c->sendlen   = 0;
+}
 
-				hdr = constructHDR(0,0);
-				if (LEN==0) //|| ((LEN==8) && (ID==0))) 	// no ID, send back id, open(w) 
-				{
-					ID = GetNewId(); 
-					c64ta(ID, filename); 
-					hdr->FLAG.ANONYMOUS = 1; 	// do not store name 
-					STATUS = STATE_OPEN_WRITE_HDR; 
-					msg.STATE = BSCS_VERSION_01 | BSCS_OPEN_W | BSCS_REPLY | STATE_OPEN_WRITE_HDR;
-					msg.LEN = b_endian_u32(8);
-					*(uint64_t*)&msg.LOAD  = l_endian_u64(ID); 
-					s = send(ns, &msg, 16, 0);
+static void conn_free(CONN_T *c) {
+	conn_sendfile_done(c);
+	if (c->fd2 >= 0) close(c->fd2);
+	if (c->subfd >= 0) close(c->subfd);
+	if (c->f2 != NULL) {
+		unlink(c->f2);
+		free(c->f2);
+	}
+	bscs_layout_free(&c->layout);
+	free(c->zbuf);
+	free(c->dbuf);
+	free(c->in);
+	free(c->out);
+	free(c);
+}
 
-		FILE *fid = fopen(LOGFILE,"a");
-		fprintf(fid,"\t> %s",filename); 
-		fclose(fid); 
+/* set fullfilename according to ID */
+static char* conn_filename(CONN_T *c) {
+	c64ta(c->ID, c->fullfilename+strlen(path));
+	return(c->fullfilename);
+}
 
-				}
-				else if (LEN == 8) 		// open(r)
-				{
-		   			count = recv(ns, &msg.LOAD, 8, 0);
-					ID = leu64p((uint8_t*)&msg.LOAD);
-
-					c64ta(ID, filename); 
-					// ToDo: replace SOPEN with simple function, e.g. access to event table not needed here 
-					hdr->FLAG.ANONYMOUS = 1; 	// do not store name 
-					hdr->FileName = fullfilename;
-					hdr = sopen(fullfilename,"r",hdr);
-					msg.LEN = b_endian_u32(0);
-					if (hdr->FILE.OPEN==0) {
-						msg.STATE = BSCS_VERSION_01 | BSCS_OPEN_R | BSCS_REPLY | STATE_INIT | BSCS_ERROR_CANNOT_OPEN_FILE;
-						STATUS = STATE_INIT; 
-					} else if (serror2(hdr) || (hdr->NRec < 0)) {
-						sclose(hdr);
-						msg.STATE = BSCS_VERSION_01 | BSCS_OPEN_R | BSCS_REPLY | STATE_INIT | BSCS_ERROR_CANNOT_OPEN_FILE;
-						STATUS = STATE_INIT; 
-					} else 	{
-						msg.STATE = BSCS_VERSION_01 | BSCS_OPEN_R | BSCS_REPLY | STATE_OPEN_READ;
-						STATUS = STATE_OPEN_READ; 
-					}
-					s = send(ns, &msg, 8, 0);	
-		FILE *fid = fopen(LOGFILE,"a");
-		fprintf(fid,"\t< %s",filename); 
-		fclose(fid); 
-				}
-				else //if (LEN != 8) 
-				{ 
-					STATUS = STATE_INIT; 
-					msg.STATE = BSCS_VERSION_01 | BSCS_OPEN_W | BSCS_REPLY | STATE_INIT | BSCS_ERROR_INCORRECT_PACKET_LENGTH;
-					msg.LEN = b_endian_u32(0);
-					s = send(ns, &msg, 8, 0);	
-				}
-			}	
+/* make room for len bytes after inpos in the input buffer */
+static void conn_reserve(CONN_T *c, size_t len) {
+	if (c->insiz - c->inpos >= len) return;
+	if (c->inpos > 0) {
+		memmove(c->in, c->in + c->inpos, c->inlen - c->inpos);
+		c->inlen -= c->inpos;
+		c->inpos  = 0;
+	}
+	if (c->insiz < len) {
+		c->insiz = len;
+		c->in = (uint8_t*)realloc(c->in, c->insiz);
+	}
+}
 
-			else if ((STATUS == (msg.STATE & STATE_MASK)) && 
-				 (LEN == 0) && 
-				 ((msg.STATE & (VER_MASK | CMD_MASK)) == (BSCS_VERSION_01 | BSCS_CLOSE))) 
-			{	// close 
-/****************************************************************************************
-	CLOSE FILE 
- ****************************************************************************************/
+/* append to output buffer */
+static uint8_t* conn_outbuf(CONN_T *c, size_t len) {
+	if (c->outpos == c->outlen) c->outpos = c->outlen = 0;
+	if (c->outsiz - c->outlen < len) {
+		if (c->outpos > 0) {
+			memmove(c->out, c->out + c->outpos, c->outlen - c->outpos);
+			c->outlen -= c->outpos;
+			c->outpos  = 0;
+		}
+		if (c->outsiz - c->outlen < len) {
+			c->outsiz = max(2*c->outsiz, c->outlen + len);
+			c->out = (uint8_t*)realloc(c->out, c->outsiz);
+		}
+	}
+	uint8_t *p = c->out + c->outlen;
+	c->outlen += len;
+	return(p);
+}
 
-				if (STATUS != (msg.STATE & STATE_MASK)) fprintf(stdout,"Close: status does not fit\n");
-	
-				msg.STATE = BSCS_VERSION_01 | BSCS_CLOSE | BSCS_REPLY | STATE_INIT;
-				msg.LEN = b_endian_u32(0);
-
-				if (LEN != 0) 
-					msg.STATE = BSCS_VERSION_01 | BSCS_CLOSE | BSCS_REPLY | STATE_INIT | BSCS_ERROR_INCORRECT_PACKET_LENGTH;
-
-				if ((STATUS == STATE_OPEN_WRITE_HDR) || (STATUS == STATE_OPEN_WRITE)) {
-					if (hdr->NRec != datalen/hdr->AS.bpb)
-						hdr->NRec = -1; // this triggers sclose to compute the correct size  
-				} 
-								
-				if ((hdr!=NULL) && ((STATUS != STATE_OPEN_READ) || (STATUS != STATE_OPEN_READ)) ) 
-					sclose(hdr); 
-
-				if (STATUS != STATE_INIT) {
-					destructHDR(hdr); 
-					hdr = NULL;
-				}	
+/*
+	append reply header for len bytes of payload;
+	requests of version 0.2 are answered with version 0.2, and the request id
+	is put in front of the payload.
+ */
+static void conn_reply_head(CONN_T *c, uint32_t state, size_t len) {
+	mesg_t msg;
+	if (c->flagMsg && ((c->msg.STATE & VER_MASK) == BSCS_VERSION_02)) {
+		msg.STATE = (state & ~VER_MASK) | BSCS_VERSION_02;
+		msg.LEN   = b_endian_u32(len + BSCS_RID_LEN);
+		leu32a(c->rid, msg.LOAD);
+		memcpy(conn_outbuf(c, 8 + BSCS_RID_LEN), &msg, 8 + BSCS_RID_LEN);
+	}
+	else {
+		msg.STATE = state;
+		msg.LEN   = b_endian_u32(len);
+		memcpy(conn_outbuf(c, 8), &msg, 8);
+	}
+}
 
-				hdr = NULL; 
-				if (serror2(hdr))
-					msg.STATE = BSCS_VERSION_01 | BSCS_CLOSE | BSCS_REPLY | STATE_INIT | BSCS_ERROR_CLOSE_FILE;
+static void conn_reply(CONN_T *c, uint32_t state, const void *load, size_t len) {
+	conn_reply_head(c, state, len);
+	if (len > 0) memcpy(conn_outbuf(c, len), load, len);
+}
+
+#ifndef __linux__
+/*
+	append len bytes of file fd starting at offset off to the output
+	returns number of bytes
+ */
+static size_t conn_reply_file(CONN_T *c, int fd, off_t off, size_t len) {
+	uint8_t *buf = conn_outbuf(c, len);
+	size_t count = 0;
+	while (count < len) {
+		ssize_t n = pread(fd, buf+count, len-count, off+count);
+		if (n <= 0) break;
+		count += n;
+	}
+	memset(buf+count, 0, len-count);
+	return(count);
+}
+#endif
 
-				STATUS = STATE_INIT; 
+#ifdef __linux__
+/*
+	append len bytes of file fd starting at offset off to the output,
+	the data is sent by conn_flush with sendfile(). If flagClose is set,
+	fd is closed afterwards.
+ */
+static void conn_sendfile(CONN_T *c, int fd, off_t off, size_t len, char flagClose) {
+	c->sendfd    = fd;
+	c->sendclose = flagClose;
+	c->sendoff   = off;
+	c->sendlen   = len;
+	if (len == 0) conn_sendfile_done(c);
+}
+#endif
 
-				s = send(ns, &msg, 8, 0);	
+/* number of bytes waiting to be sent */
+static size_t conn_pending(CONN_T *c) {
+	return(c->outlen - c->outpos + c->sendlen);
+}
 
-			}
+/*
+	send pending output
+	returns 1 when everything is sent, 0 if the socket would block, -1 on error
+ */
+static int conn_flush(CONN_T *c) {
+	while (c->outpos < c->outlen) {
+		ssize_t s = send(c->sd, c->out + c->outpos, c->outlen - c->outpos, 0);
+		if (s < 0) {
+			if (errno == EINTR) continue;
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) return(0);
+			return(-1);
+		}
+		c->outpos += s;
+	}
+	c->outpos = c->outlen = 0;
+
+#ifdef __linux__
+	while (c->sendlen > 0) {
+		ssize_t s = sendfile(c->sd, c->sendfd, &c->sendoff, c->sendlen);
+		if (s < 0) {
+			if (errno == EINTR) continue;
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) return(0);
+			return(-1);
+		}
+		if (s == 0) return(-1);	// file is shorter than announced
+		c->sendlen -= s;
+	}
+	conn_sendfile_done(c);
+#endif
+	return(1);
+}
 
-			else if ((STATUS == STATE_OPEN_WRITE_HDR) && 
-				 ((msg.STATE & ~ERR_MASK) == (BSCS_VERSION_01 | BSCS_SEND_HDR | STATE_OPEN_WRITE_HDR))) 
-			{	
+/* receive input, returns the result of recv */
+static ssize_t conn_fill(CONN_T *c) {
+	if (c->inpos == c->inlen) c->inpos = c->inlen = 0;
+	if (c->insiz - c->inlen < BSCS_MAX_BUFSIZ) {
+		conn_reserve(c, c->inlen - c->inpos + BSCS_MAX_BUFSIZ);
+	}
+	ssize_t n;
+	do {
+		n = recv(c->sd, c->in + c->inlen, c->insiz - c->inlen, 0);
+	} while ((n < 0) && (errno == EINTR));
+	if (n > 0) c->inlen += n;
+	return(n);
+}
+
+/*
+	check whether the next piece of work is available in the input buffer,
+	on success c->joblen is set and 1 is returned.
+ */
+static int conn_ready(CONN_T *c) {
+	size_t avail = c->inlen - c->inpos;
+	if (!c->flagMsg) {
+		if (avail < 8) {
+			conn_reserve(c, 8);
+			return(0);
+		}
+		memcpy(&c->msg, c->in + c->inpos, 8);
+		c->inpos += 8;
+		avail    -= 8;
+		c->LEN    = b_endian_u32(c->msg.LEN);
+		c->pos    = 0;
+		c->flagMsg = 1;
+		uint32_t cmd = c->msg.STATE & CMD_MASK;
+		c->flagChunked  = (cmd == BSCS_SEND_DAT) || (cmd == BSCS_PUT_FILE) || (c->LEN > BSCS_MAX_MSGLEN);
+		c->flagOverflow = !((cmd == BSCS_SEND_DAT) || (cmd == BSCS_PUT_FILE)) && (c->LEN > BSCS_MAX_MSGLEN);
+	}
+	size_t len = c->LEN - c->pos;
+	if (c->flagChunked) len = min(len, BSCS_CHUNK_SIZE);
+	if (avail < len) {
+		conn_reserve(c, len);
+		return(0);
+	}
+	c->joblen = len;
+	return(1);
+}
+
+/* close file of connection; returns error status */
+static int conn_close_file(CONN_T *c) {
+	int status = 0;
+	HDRTYPE *hdr = c->hdr;
+	conn_sendfile_done(c);
+	if (hdr != NULL) {
+		lock_library();
+		if ((c->STATUS == STATE_OPEN_WRITE) && (hdr->AS.bpb > 0)
+		 && (hdr->NRec != (nrec_t)(c->datalen/hdr->AS.bpb)))
+			hdr->NRec = -1; // this triggers sclose to compute the correct size
+		if (hdr->FILE.OPEN) sclose(hdr);
+		status = serror2(hdr);
+		destructHDR(hdr);
+		unlock_library();
+		c->hdr = NULL;
+	}
+	if (c->fd2 >= 0) {
+		close(c->fd2);
+		c->fd2 = -1;
+	}
+	if (c->f2 != NULL) {
+		unlink(c->f2);
+		free(c->f2);
+		c->f2 = NULL;
+	}
+	if (c->subfd >= 0) {
+		close(c->subfd);
+		c->subfd = -1;
+	}
+	c->layout.bpb = 0;
+	c->flagKey = 0;
+	c->STATUS = STATE_INIT;
+	return(status);
+}
+
+static void server_log(const char *fmt, const char *s) {
+	FILE *fid = fopen(LOGFILE,"a");
+	if (fid == NULL) return;
+	fprintf(fid, fmt, s);
+	fclose(fid);
+}
+
+/*
+	open file of connection for reading with header and event table
+	from the cache; entry: HeadLen (32 bit), length of event table (32 bit),
+	header, event table
+ */
+static HDRTYPE* conn_open_cached(CONN_T *c, const uint8_t *buf, size_t len) {
+	if (len < 8) return(NULL);
+	size_t HeadLen = leu32p(buf);
+	size_t evtlen  = leu32p(buf+4);
+	if (8 + HeadLen + evtlen != len) return(NULL);
+
+	lock_library();
+	HDRTYPE *hdr = constructHDR(0,0);
+	hdr->FLAG.ANONYMOUS = 1; 	// do not store name
+	hdr->TYPE      = GDF;
+	hdr->FileName  = strdup(c->fullfilename);
+	hdr->HeadLen   = HeadLen;
+	hdr->AS.Header = (uint8_t*)malloc(HeadLen);
+	memcpy(hdr->AS.Header, buf+8, HeadLen);
+	gdfbin2struct(hdr);
+	if (evtlen > 0) {
+		hdr->AS.rawEventData = (uint8_t*)malloc(evtlen);
+		memcpy(hdr->AS.rawEventData, buf+8+HeadLen, evtlen);
+		rawEVT2hdrEVT(hdr);
+	}
+	ifopen(hdr,"rb");
+	if (serror2(hdr) || (hdr->FILE.FID == NULL) || (hdr->NRec < 0)) {
+		destructHDR(hdr);
+		hdr = NULL;
+	}
+	else {
+		hdr->FILE.OPEN = 1;
+		hdr->FILE.size = c->key.size;
+		hdr->FILE.POS  = 0;
+		ifseek(hdr, hdr->HeadLen, SEEK_SET);
+	}
+	unlock_library();
+	return(hdr);
+}
+
+/* put header and event table of a file opened by sopen into the cache */
+static void conn_cache_header(CONN_T *c, HDRTYPE *hdr) {
+	if (!c->flagKey || (hdr->TYPE != GDF) || hdr->FILE.COMPRESSION
+	 || (hdr->HeadLen < 256) || (lei64p(hdr->AS.Header+236) != hdr->NRec))
+		return;
+	size_t evtlen = 0;
+	uint8_t *evt  = hdr->AS.rawEventData;
+	if (evt != NULL) {
+		size_t N = (hdr->VERSION < 1.94) ? leu32p(evt + 4) : evt[1] + (evt[2] + evt[3]*256)*256;
+		evtlen = 8 + N*((evt[0]>1) ? 12 : 6);
+	}
+	size_t len = 8 + hdr->HeadLen + evtlen;
+	uint8_t *buf = (uint8_t*)malloc(len);
+	leu32a(hdr->HeadLen, buf);
+	leu32a(evtlen, buf+4);
+	memcpy(buf+8, hdr->AS.Header, hdr->HeadLen);
+	if (evtlen > 0) memcpy(buf+8+hdr->HeadLen, evt, evtlen);
+	cache_put(&c->key, buf, len);
+	free(buf);
+}
+
+/*
+	data blocks start..start+length-1 assembled from chunks of the cache,
+	missing chunks are read from the file and added to the cache.
+	returns pointer to data, and the number of blocks in *length
+ */
+static uint8_t* conn_cached_data(CONN_T *c, size_t start, size_t *length) {
+	HDRTYPE *hdr = c->hdr;
+	const size_t bpb = hdr->AS.bpb;
+	const size_t R   = max(1, BSCS_CACHE_BLOCK / bpb);	// blocks per chunk
+	size_t end = min(start + *length, (size_t)hdr->NRec);
+	if (start >= end) {
+		*length = 0;
+		return(c->dbuf);
+	}
+	c->dbuf = (uint8_t*)realloc(c->dbuf, (end-start)*bpb);
+
+	CACHE_KEY_T key = c->key;
+	key.kind = BSCS_CACHE_DAT;
+	uint8_t *chunk = NULL;
+	size_t k;
+	for (k = start / R; k*R < end; k++) {
+		size_t first = k*R;
+		ssize_t n;
+		uint8_t *data;
+		key.index = k;
+		if ((n = cache_get(&key, &chunk)) >= 0) {
+			data = chunk;
+			n /= bpb;
+		}
+		else {
+			sread_raw(first, R, hdr, 0);
+			n = 0;
+			if ((first >= hdr->AS.first) && (first < hdr->AS.first + hdr->AS.length))
+				n = min(R, hdr->AS.first + hdr->AS.length - first);
+			data = hdr->AS.rawdata + (n ? (first - hdr->AS.first)*bpb : 0);
+			if ((n > 0) && ((size_t)n == min(R, (size_t)hdr->NRec - first)))
+				cache_put(&key, data, n*bpb);
+		}
+		size_t a = max(start, first);
+		size_t b = min(end, first + n);
+		if (a < b) memcpy(c->dbuf + (a-start)*bpb, data + (a-first)*bpb, (b-a)*bpb);
+		if (b < min(end, first + R)) {
+			end = b;	// incomplete chunk
+			break;
+		}
+	}
+	free(chunk);
+	*length = (end > start) ? end - start : 0;
+	return(c->dbuf);
+}
+
+/*
+	process payload load[0..len-1] of the current message (c->msg),
+	c->pos bytes of the payload have been processed before.
+ */
+static void bscs_process(CONN_T *c, uint8_t *load, size_t len)
+{
+	mesg_t msg = c->msg;
+	size_t LEN = c->LEN;
+	const char first = (c->pos == 0);
+	const char last  = (c->pos + len >= LEN);
+	HDRTYPE *hdr = c->hdr;
+
+	if (first && (VERBOSE_LEVEL>7))
+		fprintf(stdout,"STATUS=%08x MSG=%08x len=%i\n",c->STATUS,b_endian_u32(msg.STATE),(int)LEN);
+
+	if ((msg.STATE & VER_MASK) == BSCS_VERSION_02) {
+		/* version 0.2: the payload starts with the request id,
+		   otherwise the commands are the same as in version 0.1 */
+		if (LEN < BSCS_RID_LEN) {
+			c->rid = 0;
+			if (last) conn_reply(c, BSCS_VERSION_02 | (msg.STATE & CMD_MASK) | BSCS_REPLY | c->STATUS | BSCS_ERROR_INCORRECT_PACKET_LENGTH, NULL, 0);
+			return;
+		}
+		if (first) {
+			c->rid = leu32p(load);
+			load  += BSCS_RID_LEN;
+			len   -= BSCS_RID_LEN;
+		}
+		LEN -= BSCS_RID_LEN;
+		msg.STATE = (msg.STATE & ~VER_MASK) | BSCS_VERSION_01;
+	}
+
+	/* version 0.3: compressed data (SEND_DAT), or compressed reply is accepted (REQU_DAT) */
+	const char flagCompressed = (msg.STATE & BSCS_COMPRESSED) != 0;
+	msg.STATE &= ~BSCS_COMPRESSED;
+	if (flagCompressed && (c->layout.bpb == 0) && (hdr != NULL))
+		bscs_layout(&c->layout, hdr, 0);
+
+	if (c->flagOverflow) {
+		if (last) conn_reply(c, BSCS_VERSION_01 | (msg.STATE & CMD_MASK) | BSCS_REPLY | c->STATUS | BSCS_ERROR_MEMORY_OVERFLOW, NULL, 0);
+	}
+
+	else if ((msg.STATE & CMD_MASK) == BSCS_NOP)
+	{	// no operation
+		if (last) conn_reply(c, BSCS_VERSION_01 | BSCS_NOP | BSCS_REPLY | (msg.STATE & STATE_MASK) | BSCS_NO_ERROR, NULL, 0);
+	}
+
+	else if ((c->STATUS == STATE_INIT) &&
+	    	 ((msg.STATE & ~ERR_MASK) == (BSCS_VERSION_01 | BSCS_OPEN | STATE_INIT)))
+	{
 /****************************************************************************************
-	SEND HEADER
+	OPEN FILE with ID
  ****************************************************************************************/
- 
-				//case BSCS_SEND_HDR:  	// send header information
-				hdr->AS.Header = (uint8_t*)realloc(hdr->AS.Header,LEN); 
-				hdr->HeadLen = LEN; 
-				count = 0; 
-				while (count<LEN) {
-if (VERBOSE_LEVEL>8) fprintf(stdout,"SND HDR: c=%i,LEN=%i\n",count,LEN);				
-					count += recv(ns, hdr->AS.Header+count, LEN-count, 0);
+
+		if (LEN==0) 	// no ID, send back id, open(w)
+		{
+			c->ID = GetNewId();
+			conn_filename(c);
+			hdr = constructHDR(0,0);
+			hdr->FLAG.ANONYMOUS = 1; 	// do not store name
+			c->hdr = hdr;
+			c->STATUS = STATE_OPEN_WRITE_HDR;
+			uint64_t id = l_endian_u64(c->ID);
+			conn_reply(c, BSCS_VERSION_01 | BSCS_OPEN_W | BSCS_REPLY | STATE_OPEN_WRITE_HDR, &id, 8);
+			server_log("\t> %s", c->fullfilename+strlen(path));
+		}
+		else if (LEN == 8) 		// open(r)
+		{
+			c->ID = leu64p(load);
+			conn_filename(c);
+			c->flagKey = !cache_key(&c->key, c->fullfilename, BSCS_CACHE_HDR, 0);
+			hdr = NULL;
+			ssize_t clen;
+			if (c->flagKey && ((clen = cache_get(&c->key, &c->dbuf)) > 0))
+				hdr = conn_open_cached(c, c->dbuf, clen);
+			if (hdr == NULL) {
+				lock_library();
+				hdr = constructHDR(0,0);
+				hdr->FLAG.ANONYMOUS = 1; 	// do not store name
+				hdr = sopen(c->fullfilename,"r",hdr);
+				if ((hdr->FILE.OPEN==0) || serror2(hdr) || (hdr->NRec < 0)) {
+					destructHDR(hdr);
+					hdr = NULL;
 				}
-if (VERBOSE_LEVEL>8) fprintf(stdout,"SND HDR: c=%i,LEN=%i\n",count,LEN);				
-
-				hdr->TYPE = GDF; 
-				hdr->FLAG.ANONYMOUS = 1; 	// do not store name 
-				gdfbin2struct(hdr);
-
-				hdr->EVENT.N = 0; 
-				hdr->EVENT.POS = NULL; 
-				hdr->EVENT.TYP = NULL; 
-				hdr->EVENT.DUR = NULL; 
-				hdr->EVENT.CHN = NULL; 
-				
-				c64ta(ID, filename); 
-				hdr->FileName  = fullfilename;
-				hdr->FILE.COMPRESSION = 0; 
-				ifopen(hdr,"w"); 
-				hdr->FILE.OPEN = 2; 
-				count=ifwrite(hdr->AS.Header, 1, hdr->HeadLen, hdr);
-				datalen = 0;
-
-if (VERBOSE_LEVEL>8) fprintf(stdout,"SND HDR: count=%i\n",count);				
-	
-				if (errno) {	
-					// check for errors in gdfbin2struct, ifopen and ifwrite		
-					STATUS = STATE_OPEN_WRITE_HDR; 
-					msg.STATE = BSCS_VERSION_01 | BSCS_SEND_HDR | BSCS_REPLY | STATE_OPEN_WRITE_HDR | BSCS_ERROR_COULD_NOT_WRITE_HDR;
-				}	
-				else {
-					STATUS = STATE_OPEN_WRITE; 
-					msg.STATE = BSCS_VERSION_01 | BSCS_SEND_HDR | BSCS_REPLY | STATE_OPEN_WRITE;
-				}	
-				msg.LEN = b_endian_u32(0);
-if (VERBOSE_LEVEL>8) fprintf(stdout,"SND HDR RPLY: %08x\n",msg.STATE);				
-				s = send(ns, &msg, 8, 0);	
+				unlock_library();
+				if (hdr != NULL) conn_cache_header(c, hdr);
 			}
+			c->hdr = hdr;
+			if (hdr == NULL) {
+				c->STATUS = STATE_INIT;
+				conn_reply(c, BSCS_VERSION_01 | BSCS_OPEN_R | BSCS_REPLY | STATE_INIT | BSCS_ERROR_CANNOT_OPEN_FILE, NULL, 0);
+			} else 	{
+				c->STATUS = STATE_OPEN_READ;
+				conn_reply(c, BSCS_VERSION_01 | BSCS_OPEN_R | BSCS_REPLY | STATE_OPEN_READ, NULL, 0);
+			}
+			server_log("\t< %s", c->fullfilename+strlen(path));
+		}
+		else
+		{
+			c->STATUS = STATE_INIT;
+			conn_reply(c, BSCS_VERSION_01 | BSCS_OPEN_W | BSCS_REPLY | STATE_INIT | BSCS_ERROR_INCORRECT_PACKET_LENGTH, NULL, 0);
+		}
+	}
 
+	else if ((c->STATUS == (msg.STATE & STATE_MASK)) &&
+		 (LEN == 0) &&
+		 ((msg.STATE & (VER_MASK | CMD_MASK)) == (BSCS_VERSION_01 | BSCS_CLOSE)))
+	{	// close
+/****************************************************************************************
+	CLOSE FILE
+ ****************************************************************************************/
+		if (conn_close_file(c))
+			conn_reply(c, BSCS_VERSION_01 | BSCS_CLOSE | BSCS_REPLY | STATE_INIT | BSCS_ERROR_CLOSE_FILE, NULL, 0);
+		else
+			conn_reply(c, BSCS_VERSION_01 | BSCS_CLOSE | BSCS_REPLY | STATE_INIT, NULL, 0);
+	}
 
-			else if ((STATUS == STATE_OPEN_WRITE) && 
-				 ((msg.STATE & ~ERR_MASK) == (BSCS_VERSION_01 | BSCS_SEND_DAT | STATE_OPEN_WRITE))) 
-			{	
+	else if ((c->STATUS == STATE_OPEN_WRITE_HDR) &&
+		 ((msg.STATE & ~ERR_MASK) == (BSCS_VERSION_01 | BSCS_SEND_HDR | STATE_OPEN_WRITE_HDR)))
+	{
 /****************************************************************************************
-	SEND DATA
+	SEND HEADER
  ****************************************************************************************/
-				//case BSCS_SEND_DAT:   	// send data block 
-				// ToDo: check corrupt packet
-					count = 0; 
-					while (count<LEN) {
-						// ToDo: check if streams would be faster 
-						// fprintf(stdout,"SEND_DAT %li %li %li\n",datalen,count,LEN);
-					   	ssize_t c = recv(ns, inbuf, min(BSCS_MAX_BUFSIZ,LEN-count), 0);
-						datalen += ifwrite(inbuf, 1, c, hdr);
-					   	count += c;
-					}
-					//STATUS = STATE_OPEN_WRITE; 
+		hdr->AS.Header = (uint8_t*)realloc(hdr->AS.Header,LEN);
+		memcpy(hdr->AS.Header, load, LEN);
+		hdr->HeadLen = LEN;
+		hdr->TYPE = GDF;
+		hdr->FLAG.ANONYMOUS = 1; 	// do not store name
+
+		lock_library();
+		gdfbin2struct(hdr);
+		unlock_library();
+
+		hdr->EVENT.N = 0;
+		free(hdr->EVENT.POS); hdr->EVENT.POS = NULL;
+		free(hdr->EVENT.TYP); hdr->EVENT.TYP = NULL;
+		free(hdr->EVENT.DUR); hdr->EVENT.DUR = NULL;
+		free(hdr->EVENT.CHN); hdr->EVENT.CHN = NULL;
+
+		if (hdr->FileName) free(hdr->FileName);
+		hdr->FileName  = strdup(conn_filename(c));
+		hdr->FILE.COMPRESSION = 0;
+		ifopen(hdr,"w");
+		size_t count = 0;
+		if (hdr->FILE.FID != NULL) {
+			hdr->FILE.OPEN = 2;
+			count = ifwrite(hdr->AS.Header, 1, hdr->HeadLen, hdr);
+			ifflush(hdr);	// header is needed by subscribers
+		}
+		c->datalen = 0;
 
-				if (errno) {	
-					// check for errors in ifwrite		
-					msg.STATE = BSCS_VERSION_01 | BSCS_SEND_DAT | BSCS_REPLY | STATE_OPEN_WRITE | BSCS_ERROR_COULD_NOT_WRITE_DAT;
-				}	
-				else {
-					msg.STATE = BSCS_VERSION_01 | BSCS_SEND_DAT | BSCS_REPLY | STATE_OPEN_WRITE;
-				}	
-				msg.LEN = b_endian_u32(0);
-				s = send(ns, &msg, 8, 0);	
+		if (hdr->AS.B4C_ERRNUM || (hdr->FILE.FID == NULL) || (count != hdr->HeadLen)) {
+			// check for errors in gdfbin2struct, ifopen and ifwrite
+			c->STATUS = STATE_OPEN_WRITE_HDR;
+			conn_reply(c, BSCS_VERSION_01 | BSCS_SEND_HDR | BSCS_REPLY | STATE_OPEN_WRITE_HDR | BSCS_ERROR_COULD_NOT_WRITE_HDR, NULL, 0);
+		}
+		else {
+			c->STATUS = STATE_OPEN_WRITE;
+			conn_reply(c, BSCS_VERSION_01 | BSCS_SEND_HDR | BSCS_REPLY | STATE_OPEN_WRITE, NULL, 0);
+		}
+	}
+
+	else if ((c->STATUS == STATE_OPEN_WRITE) &&
+		 ((msg.STATE & ~ERR_MASK) == (BSCS_VERSION_01 | BSCS_SEND_DAT | STATE_OPEN_WRITE)))
+	{
+/****************************************************************************************
+	SEND DATA
+ ****************************************************************************************/
+		if (first) c->errcode = 0;
+		if (flagCompressed) {
+			/* compressed messages are not chunked */
+			size_t rawlen = (len >= 8) ? leu32p(load+4) : 0;
+			ssize_t n = -1;
+			if (rawlen <= BSCS_MAX_MSGLEN) {
+				c->zbuf = (uint8_t*)realloc(c->zbuf, rawlen);
+				n = bscs_decompress(&c->layout, load, len, c->zbuf, rawlen);
 			}
+			if (n < 0)
+				c->errcode = 1;
+			else {
+				size_t count = ifwrite(c->zbuf, 1, n, hdr);
+				c->datalen += count;
+				if (count < (size_t)n) c->errcode = 1;
+			}
+		}
+		else if (len > 0) {
+			size_t count = ifwrite(load, 1, len, hdr);
+			c->datalen += count;
+			if (count < len) c->errcode = 1;
+		}
+		if (last) {
+			ifflush(hdr);	// make data visible to subscribers
+			if (c->errcode)
+				conn_reply(c, BSCS_VERSION_01 | BSCS_SEND_DAT | BSCS_REPLY | STATE_OPEN_WRITE | BSCS_ERROR_COULD_NOT_WRITE_DAT, NULL, 0);
+			else
+				conn_reply(c, BSCS_VERSION_01 | BSCS_SEND_DAT | BSCS_REPLY | STATE_OPEN_WRITE, NULL, 0);
+		}
+	}
 
-			else if ((STATUS == STATE_OPEN_WRITE) && 
-				 ((msg.STATE & ~ERR_MASK) == (BSCS_VERSION_01 | BSCS_SEND_EVT | STATE_OPEN_WRITE))) 
-			{	
+	else if ((c->STATUS == STATE_OPEN_WRITE) &&
+		 ((msg.STATE & ~ERR_MASK) == (BSCS_VERSION_01 | BSCS_SEND_EVT | STATE_OPEN_WRITE)))
+	{
 /****************************************************************************************
 	SEND EVENTS
  ****************************************************************************************/
-				//case BSCS_SEND_EVT:  	// send event information 
-
-				
-		   		count = recv(ns, inbuf+8, min(8,LEN), 0);
-		   		if (count<8) continue; 
-
-				char  flag = inbuf[8];
-				int   N = inbuf[9] + (inbuf[10] + inbuf[11]*256)*256; 
-				//float Fs = lef32p(inbuf+12); 
-				
-				if (LEN != (8 + N * (flag==3 ? 12u : 6u)))
-				{
-					msg.STATE = BSCS_VERSION_01 | BSCS_SEND_EVT | BSCS_REPLY | STATE_OPEN_WRITE | BSCS_ERROR_INCORRECT_PACKET_LENGTH;
-				}
+		char flag = 0;
+		size_t N  = 0;
+		if (LEN >= 8) {
+			flag = load[0];
+			N    = load[1] + (load[2] + load[3]*256)*256;
+			//float Fs = lef32p(load+4);
+		}
 
-				else if (N>0) {
-					size_t n = hdr->EVENT.N;
-					hdr->EVENT.N += N;
-	 				hdr->EVENT.POS = (uint32_t*) realloc(hdr->EVENT.POS, hdr->EVENT.N*sizeof(*hdr->EVENT.POS) );
-					hdr->EVENT.TYP = (uint16_t*) realloc(hdr->EVENT.TYP, hdr->EVENT.N*sizeof(*hdr->EVENT.TYP) );
-					hdr->EVENT.DUR = (uint32_t*) realloc(hdr->EVENT.DUR, hdr->EVENT.N*sizeof(*hdr->EVENT.DUR) );
-					hdr->EVENT.CHN = (uint16_t*) realloc(hdr->EVENT.CHN, hdr->EVENT.N*sizeof(*hdr->EVENT.CHN) );
-	
-					// read EVENT.POS
-					count = 0; 
-					LEN = N*sizeof(*hdr->EVENT.POS);
-					while (count < LEN) {
-						count += recv(ns, (uint8_t*)(hdr->EVENT.POS+n)+count, LEN-count, 0);
-					}
-					// read EVENT.TYP
-					count = 0; 
-					LEN = N*sizeof(*hdr->EVENT.TYP);
-					while (count < LEN) {
-						count += recv(ns, (uint8_t*)(hdr->EVENT.TYP+n)+count, LEN-count, 0);
-					}
-					// read EVENT.DUR and EVENT.CHN
-					if (flag==3) {
-						count = 0; 
-						LEN = N*sizeof(*hdr->EVENT.POS);
-						while (count < LEN) {
-							count += recv(ns, (uint8_t*)(hdr->EVENT.DUR+n)+count, LEN-count, 0);
-						}
-						count = 0; 
-						LEN = N*sizeof(*hdr->EVENT.TYP);
-						while (count < LEN) {
-							count += recv(ns, (uint8_t*)(hdr->EVENT.CHN+n)+count, LEN-count, 0);
-						}
-					}	
-					else {
-						for (size_t k=n; k<hdr->EVENT.N; k++) {
-							hdr->EVENT.DUR[k] = 0; 
-							hdr->EVENT.CHN[k] = 0; 
-						}
-					}
-#if __BYTE_ORDER == __BIG_ENDIAN
-					// do byte swapping if needed 
-					for (size_t k=n; k<hdr->EVENT.N; k++) {
-						hdr->EVENT.POS[k] = l_endian_u32(hdr->EVENT.POS[k]); 
-						hdr->EVENT.TYP[k] = l_endian_u16(hdr->EVENT.TYP[k]); 
-					}
-					if (flag==3) {	
-						for (size_t k=n; k<hdr->EVENT.N; k++) {
-							hdr->EVENT.DUR[k] = l_endian_u32(hdr->EVENT.DUR[k]); 
-							hdr->EVENT.CHN[k] = l_endian_u16(hdr->EVENT.CHN[k]); 
-						}
-					} 
-#endif
-					msg.STATE = BSCS_VERSION_01 | BSCS_SEND_EVT | BSCS_REPLY | STATE_OPEN_WRITE;
-				}
-				msg.LEN = b_endian_u32(0);
-				s = send(ns, &msg, 8, 0);	
+		if ((LEN < 8) || (LEN != (8 + N * (flag==3 ? 12u : 6u))))
+		{
+			conn_reply(c, BSCS_VERSION_01 | BSCS_SEND_EVT | BSCS_REPLY | STATE_OPEN_WRITE | BSCS_ERROR_INCORRECT_PACKET_LENGTH, NULL, 0);
+		}
+		else {
+			size_t n = hdr->EVENT.N;
+			hdr->EVENT.N += N;
+ 			hdr->EVENT.POS = (uint32_t*) realloc(hdr->EVENT.POS, hdr->EVENT.N*sizeof(*hdr->EVENT.POS) );
+			hdr->EVENT.TYP = (uint16_t*) realloc(hdr->EVENT.TYP, hdr->EVENT.N*sizeof(*hdr->EVENT.TYP) );
+			hdr->EVENT.DUR = (uint32_t*) realloc(hdr->EVENT.DUR, hdr->EVENT.N*sizeof(*hdr->EVENT.DUR) );
+			hdr->EVENT.CHN = (uint16_t*) realloc(hdr->EVENT.CHN, hdr->EVENT.N*sizeof(*hdr->EVENT.CHN) );
+
+			uint8_t *pos = load + 8;
+			uint8_t *typ = pos + N*4;
+			uint8_t *dur = typ + N*2;
+			uint8_t *chn = dur + N*4;
+			for (size_t k = 0; k < N; k++) {
+				hdr->EVENT.POS[n+k] = leu32p(pos + 4*k);
+				hdr->EVENT.TYP[n+k] = leu16p(typ + 2*k);
+				hdr->EVENT.DUR[n+k] = (flag==3) ? leu32p(dur + 4*k) : 0;
+				hdr->EVENT.CHN[n+k] = (flag==3) ? leu16p(chn + 2*k) : 0;
 			}
+			conn_reply(c, BSCS_VERSION_01 | BSCS_SEND_EVT | BSCS_REPLY | STATE_OPEN_WRITE, NULL, 0);
+		}
+	}
 
-			else if ((msg.STATE & CMD_MASK) ==  BSCS_SEND_MSG ) 
-			{	// might become obsolet (?)
-				// ToDo: check corrupt packet
-				count = 0; 
-				ssize_t c=0;
-				while (count<LEN) {
-					int len = min(BSCS_MAX_BUFSIZ-1,LEN-count);	
-				   	c = recv(ns, inbuf, len, 0);
-			   		inbuf[c-1]=0;
-					fprintf(stdout,"got message <%s>\n",(char*)(inbuf));
-				   	count += c;
-				}
-				//system((char*)(inbuf));
-			// TODO: reply message
-			}
+	else if ((msg.STATE & CMD_MASK) ==  BSCS_SEND_MSG )
+	{	// might become obsolet (?)
+		if (VERBOSE_LEVEL>7) fprintf(stdout,"got message <%.*s>\n",(int)len,(char*)load);
+		if ((LEN == 6) && !memcmp(load, "status", 6)) {
+			// status query: statistics of the server
+			char buf[1024];
+			int n = cache_status(buf, sizeof(buf));
+			conn_reply(c, BSCS_VERSION_01 | BSCS_SEND_MSG | BSCS_REPLY | c->STATUS, buf, min(n, (int)sizeof(buf)-1));
+		}
+		// TODO: reply message
+	}
 
-			else if ((STATUS == STATE_OPEN_READ) && 
-				 ((msg.STATE & ~ERR_MASK) == (BSCS_VERSION_01 | BSCS_REQU_HDR | STATE_OPEN_READ))) 
-			{	
+	else if ((c->STATUS == STATE_OPEN_READ) &&
+		 ((msg.STATE & ~ERR_MASK) == (BSCS_VERSION_01 | BSCS_REQU_HDR | STATE_OPEN_READ)))
+	{
 /****************************************************************************************
 	REQUEST HEADER
  ****************************************************************************************/
-				msg.STATE = BSCS_VERSION_01 | BSCS_REQU_HDR | BSCS_REPLY | STATE_OPEN_READ;
-				msg.LEN = b_endian_u32(hdr->HeadLen);
-				s = send(ns, &msg, 8, 0);	
-				s = send(ns, hdr->AS.Header, hdr->HeadLen, 0);	
-
-			}
+		conn_reply(c, BSCS_VERSION_01 | BSCS_REQU_HDR | BSCS_REPLY | STATE_OPEN_READ, hdr->AS.Header, hdr->HeadLen);
+	}
 
-			else if ((STATUS == STATE_OPEN_READ) && 
-				 ((msg.STATE & ~ERR_MASK) == (BSCS_VERSION_01 | BSCS_REQU_DAT | STATE_OPEN_READ))) 
-			{	
+	else if ((c->STATUS == STATE_OPEN_READ) &&
+		 ((msg.STATE & ~ERR_MASK) == (BSCS_VERSION_01 | BSCS_REQU_DAT | STATE_OPEN_READ)))
+	{
 /****************************************************************************************
 	REQUEST DATA
  ****************************************************************************************/
-	   			count += recv(ns, inbuf, 8, 0);
-		   		size_t length = leu32p(inbuf);
-		   		size_t start = leu32p(inbuf+4);
-				sread_raw(start, length, hdr, 0);
+		size_t length = 0, start = 0;
+		if (LEN >= 8) {
+			length = leu32p(load);
+			start  = leu32p(load+4);
+		}
 
+#ifdef __linux__
+		/* uncompressed GDF: blocks are stored contiguously, and are sent directly from the file */
+		struct stat FileBuf;
+		if (!flagCompressed && (hdr->TYPE == GDF) && !hdr->FILE.COMPRESSION && (hdr->FILE.FID != NULL)
+		 && (hdr->NRec >= 0) && !hdr->AS.flag_collapsed_rawdata
+		 && !((start >= hdr->AS.first) && (start + length <= hdr->AS.first + hdr->AS.length))
+		 && !fstat(fileno(hdr->FILE.FID), &FileBuf))
+		{
+			length = (start >= (size_t)hdr->NRec) ? 0 : min(length, hdr->NRec - start);
+			off_t off  = hdr->HeadLen + (off_t)start * hdr->AS.bpb;
+			size_t len = length * hdr->AS.bpb;
+			if (off + (off_t)len <= FileBuf.st_size) {
+				conn_reply_head(c, BSCS_VERSION_01 | BSCS_REQU_DAT | BSCS_REPLY | STATE_OPEN_READ, len);
+				conn_sendfile(c, fileno(hdr->FILE.FID), off, len, 0);
+				return;
+			}
+		}
+#endif
+		uint8_t *data;
+		if (c->flagKey && (hdr->AS.bpb > 0) && !hdr->AS.flag_collapsed_rawdata)
+			data = conn_cached_data(c, start, &length);
+		else {
+			sread_raw(start, length, hdr, 0);
+
+			if (start >= hdr->AS.first + hdr->AS.length)
+				length = 0;
+			else
 				length = min(length, hdr->AS.first + hdr->AS.length - start);
-				msg.STATE = BSCS_VERSION_01 | BSCS_REQU_DAT | BSCS_REPLY | STATE_OPEN_READ;
-				msg.LEN = b_endian_u32(hdr->AS.bpb*length);
-				s = send(ns, &msg, 8, 0);	
-				s = send(ns, hdr->AS.rawdata + hdr->AS.bpb*(start-hdr->AS.first), hdr->AS.bpb*length, 0);	
-				//send(ns, hdr->AS.rawdata, (hdr->AS.length-hdr->AS.first)*hdr->AS.bpb,0);
+			data = hdr->AS.rawdata + hdr->AS.bpb*(start-hdr->AS.first);
+		}
+		size_t zlen = 0;
+		if (flagCompressed && (c->layout.bpb == hdr->AS.bpb))
+			zlen = bscs_compress(&c->layout, data, hdr->AS.bpb*length, &c->zbuf, BSCS_ZLEVEL);
+		if (zlen > 0)
+			conn_reply(c, BSCS_VERSION_01 | BSCS_REQU_DAT | BSCS_REPLY | BSCS_COMPRESSED | STATE_OPEN_READ, c->zbuf, zlen);
+		else
+			conn_reply(c, BSCS_VERSION_01 | BSCS_REQU_DAT | BSCS_REPLY | STATE_OPEN_READ,
+				data, hdr->AS.bpb*length);
+	}
+
+	else if ((c->STATUS == STATE_OPEN_READ) &&
+		 ((msg.STATE & ~ERR_MASK) == (BSCS_VERSION_01 | BSCS_REQU_EVT | STATE_OPEN_READ)))
+	{
+/****************************************************************************************
+	REQUEST EVENT TABLE
+ ****************************************************************************************/
+		size_t len = 0;
+		if ((hdr->TYPE == GDF) && (hdr->AS.rawEventData == NULL) && (hdr->NRec>=0)) {
+			// event table from GDF file
+			ifseek(hdr, hdr->HeadLen + hdr->AS.bpb*hdr->NRec, SEEK_SET);
+			// READ EVENTTABLE
+			hdr->AS.rawEventData = (uint8_t*)realloc(hdr->AS.rawEventData,8);
+			int c = ifread(hdr->AS.rawEventData, sizeof(uint8_t), 8, hdr);
+    			uint8_t *buf = hdr->AS.rawEventData;
+
+			if (c<8) {
+				hdr->EVENT.N = 0;
+			}
+			else if (hdr->VERSION < 1.94) {
+				hdr->EVENT.N = leu32p(buf + 4);
+			}
+			else {
+				hdr->EVENT.N = buf[1] + (buf[2] + buf[3]*256)*256;
+			}
+			int sze = (buf[0]>1) ? 12 : 6;
+			len = 8+hdr->EVENT.N*sze;
+			hdr->AS.rawEventData = (uint8_t*)realloc(hdr->AS.rawEventData,len);
+			ifread(hdr->AS.rawEventData+8, 1, len-8, hdr);
+			ifseek(hdr, hdr->HeadLen+hdr->AS.bpb*hdr->FILE.POS, SEEK_SET);
+			// note: no conversion to HDR.EVENT structure needed on server-side
+		}
+		else if ((hdr->TYPE != GDF) && (hdr->AS.rawEventData == NULL))
+			len = hdrEVT2rawEVT(hdr);
+
+		else if ((hdr->TYPE == GDF) && (hdr->AS.rawEventData != NULL)){
+			uint8_t *buf = hdr->AS.rawEventData;
+			if (hdr->VERSION < 1.94)
+				hdr->EVENT.N = leu32p(buf + 4);
+			else
+				hdr->EVENT.N = buf[1] + (buf[2] + buf[3]*256)*256;
+
+			int sze = (buf[0]>1) ? 12 : 6;
+
+			if (hdr->EVENT.N>0) {
+				len = 8+sze*hdr->EVENT.N;
 			}
+		}
+
+		if (len <= 8)
+			conn_reply(c, BSCS_VERSION_01 | BSCS_REQU_EVT | BSCS_REPLY | STATE_OPEN_READ, NULL, 0);
+		else
+			conn_reply(c, BSCS_VERSION_01 | BSCS_REQU_EVT | BSCS_REPLY | STATE_OPEN_READ, hdr->AS.rawEventData, len);
+	}
 
-			else if ((STATUS == STATE_OPEN_READ) && 
-				 ((msg.STATE & ~ERR_MASK) == (BSCS_VERSION_01 | BSCS_REQU_EVT | STATE_OPEN_READ))) 
-			{	
+	else if ((c->STATUS == STATE_OPEN_WRITE_HDR) &&
+		 ((msg.STATE & ~ERR_MASK) == (BSCS_VERSION_01 | BSCS_PUT_FILE | STATE_OPEN_WRITE_HDR)))
+	{
 /****************************************************************************************
-	REQUEST EVENT TABLE 
+	PUT FILE
  ****************************************************************************************/
-				size_t len = 0; 
-				if ((hdr->TYPE == GDF) && (hdr->AS.rawEventData == NULL) && (hdr->NRec>=0)) {
-					// event table from GDF file 
-					ifseek(hdr, hdr->HeadLen + hdr->AS.bpb*hdr->NRec, SEEK_SET);
-					// READ EVENTTABLE 
-					hdr->AS.rawEventData = (uint8_t*)realloc(hdr->AS.rawEventData,8);
-					int c = ifread(hdr->AS.rawEventData, sizeof(uint8_t), 8, hdr);
-	    				uint8_t *buf = hdr->AS.rawEventData;
-			
-					if (c<8) {
-						hdr->EVENT.N = 0;
-					}	
-					else if (hdr->VERSION < 1.94) {
-						hdr->EVENT.N = leu32p(buf + 4);
-					}	
-					else {
-						hdr->EVENT.N = buf[1] + (buf[2] + buf[3]*256)*256; 
-					}	
-					int sze = (buf[0]>1) ? 12 : 6;
-					len = 8+hdr->EVENT.N*sze;
-					hdr->AS.rawEventData = (uint8_t*)realloc(hdr->AS.rawEventData,len);
-					ifread(hdr->AS.rawEventData+8, 1, len-8, hdr);
-					ifseek(hdr, hdr->HeadLen+hdr->AS.bpb*hdr->FILE.POS, SEEK_SET); 
-					// note: no conversion to HDR.EVENT structure needed on server-side 
-				}
-				else if ((hdr->TYPE != GDF) && (hdr->AS.rawEventData == NULL))
-					len = hdrEVT2rawEVT(hdr); 
-
-				else if ((hdr->TYPE == GDF) && (hdr->AS.rawEventData != NULL)){
-					uint8_t *buf = hdr->AS.rawEventData; 
-					if (hdr->VERSION < 1.94) 
-						hdr->EVENT.N = leu32p(buf + 4);
-					else	
-						hdr->EVENT.N = buf[1] + (buf[2] + buf[3]*256)*256; 
-				
-					int sze = (buf[0]>1) ? 12 : 6;
-					
-					if (hdr->EVENT.N>0) {
-						len = 8+sze*hdr->EVENT.N;
-					}
+		if (first) {
+			c->errcode = 0;
+			conn_filename(c);
+			c->f2 = (char*)malloc(strlen(c->fullfilename)+5);
+			strcpy(c->f2, c->fullfilename);
+			strcat(c->f2, ".tmp");
+			c->fd2 = open(c->f2, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+			if (c->fd2 < 0) c->errcode = 1;
+		}
+
+		size_t count = 0;
+		while ((c->fd2 >= 0) && (count < len)) {
+			ssize_t n = write(c->fd2, load+count, len-count);
+			if (n <= 0) {
+				c->errcode = 1;
+				break;
+			}
+			count += n;
+		}
+
+		if (last) {
+			uint32_t errcode = c->errcode;
+			if (c->fd2 >= 0) close(c->fd2);
+			c->fd2 = -1;
+
+			/************ read temporary file, ... ************/
+			int status = 0;
+			HDRTYPE *hdr2 = NULL;
+			if (!errcode) {
+				lock_library();
+				hdr2 = constructHDR(0,0);
+#ifdef WITH_PDP
+				struct stat FileBuf;
+				stat(c->f2, &FileBuf);
+				hdr2->AS.Header = (uint8_t*) malloc(FileBuf.st_size+1);
+				FILE *fid = fopen(c->f2, "rb");
+				hdr2->HeadLen   = fread(hdr2->AS.Header, 1, FileBuf.st_size, fid);
+				hdr2->AS.Header[hdr2->HeadLen] = 0;
+				fclose(fid);
+				hdr2->FileName  = strdup(c->f2);
+				sopen_pdp_read(hdr2);
+				unlock_library();
+
+				sread(NULL,0,hdr2->NRec,hdr2);	// rawdata -> data.block
+				if ((status=serror2(hdr2)))
+					errcode = 2;
+#else
+				sopen(c->f2,"r",hdr2);
+				unlock_library();
+				if ((status=serror2(hdr2)))
+				        errcode = 11;
+				else {
+					sread(NULL,0,hdr2->NRec,hdr2);
+					if ((status=serror2(hdr2)))
+						errcode = 12;
+
+					lock_library();
+					sclose(hdr2);
+					unlock_library();
+					if ((status=serror2(hdr2)))
+						errcode = 13;
 				}
+#endif
+			}
 
-				msg.STATE = BSCS_VERSION_01 | BSCS_REQU_HDR | BSCS_REPLY | STATE_OPEN_READ;
-				if (len <= 8) {
-					msg.LEN = b_endian_u32(0);
-					s = send(ns, &msg, 8, 0);
+			if (VERBOSE_LEVEL>7) fprintf(stdout,"put file: errcode=%i\n",errcode);
+
+			/********* ... and convert to GDF file *************/
+			if (!errcode) {
+				hdr2->TYPE = GDF;
+				hdr2->VERSION = 2;
+				lock_library();
+				sopen(c->fullfilename,"w",hdr2);
+				unlock_library();
+				if ((status=serror2(hdr2))) {
+					errcode = 21;
 				} else {
-					msg.LEN = b_endian_u32(len);
-					s = send(ns, &msg, 8, 0);
-					s = send(ns, hdr->AS.rawEventData, len, 0);
+					ifwrite(hdr2->AS.rawdata,hdr2->AS.bpb,hdr2->NRec,hdr2);
+					if ((status=serror2(hdr2)))
+						errcode = 22;
+					lock_library();
+					sclose(hdr2);
+					unlock_library();
+					if ((status=serror2(hdr2)))
+						errcode = 23;
 				}
 			}
 
-			else if ((STATUS == STATE_OPEN_WRITE_HDR) && 
-				 ((msg.STATE & ~ERR_MASK) == (BSCS_VERSION_01 | BSCS_PUT_FILE | STATE_OPEN_WRITE_HDR))) 
-			{	
+			if (VERBOSE_LEVEL>7) fprintf(stdout,"put file: errcode=%i\n",errcode);
+
+			if (hdr2 != NULL) {
+				lock_library();
+				destructHDR(hdr2);
+				unlock_library();
+			}
+			conn_close_file(c);	// removes temporary file, releases header of BSCS_OPEN
+			conn_reply(c, BSCS_VERSION_01 | BSCS_PUT_FILE | BSCS_REPLY | STATE_INIT | b_endian_u32(errcode), NULL, 0);
+		}
+	}
+
+	else if ((c->STATUS == STATE_INIT) &&
+		 ((msg.STATE & ~ERR_MASK) == (BSCS_VERSION_01 | BSCS_SUBSCRIBE | STATE_INIT)))
+	{
 /****************************************************************************************
-	PUT FILE 
+	SUBSCRIBE
  ****************************************************************************************/
+		uint32_t start = BSCS_SUBSCRIBE_LIVE;
+		int fd = -1;
+		HDRTYPE *hdr2 = NULL;
+		if ((LEN == 8) || (LEN == 12)) {
+			c->ID = leu64p(load);
+			if (LEN == 12) start = leu32p(load+8);
+			fd = open(conn_filename(c), O_RDONLY);
+		}
 
- 
-				//case BSCS_PUT_FILE:  	// send header information
-				uint32_t errcode = 0; 
+		/* read GDF header */
+		uint8_t buf[256];
+		if ((fd >= 0) && (pread(fd, buf, 256, 0) == 256) && !memcmp(buf, "GDF", 3)) {
+			char tmp[6];
+			memcpy(tmp, buf+3, 5); tmp[5] = 0;
+			size_t HeadLen = (atof(tmp) > 1.90) ? (size_t)leu16p(buf+184)<<8 : (size_t)leu64p(buf+184);
+			if ((HeadLen >= 256) && (HeadLen <= BSCS_MAX_MSGLEN)) {
+				lock_library();
+				hdr2 = constructHDR(0,0);
+				unlock_library();
+				hdr2->AS.Header = (uint8_t*)realloc(hdr2->AS.Header, HeadLen);
+				hdr2->HeadLen   = HeadLen;
+				hdr2->TYPE      = GDF;
+				hdr2->FLAG.ANONYMOUS = 1; 	// do not store name
+				if (pread(fd, hdr2->AS.Header, HeadLen, 0) == (ssize_t)HeadLen) {
+					lock_library();
+					gdfbin2struct(hdr2);
+					unlock_library();
+				}
+				else
+					hdr2->AS.bpb = 0;
+			}
+		}
 
-				c64ta(ID, filename); 
-				char *f2 = (char*)malloc(strlen(fullfilename)+5); 
-				strcpy(f2,fullfilename); 
-				strcat(f2,".tmp"); 
+		if ((hdr2 == NULL) || (hdr2->AS.bpb <= 0) || hdr2->AS.B4C_ERRNUM) {
+			if (fd >= 0) close(fd);
+			conn_reply(c, BSCS_VERSION_01 | BSCS_SUBSCRIBE | BSCS_REPLY | STATE_INIT | BSCS_ERROR_CANNOT_OPEN_FILE, NULL, 0);
+		}
+		else {
+			c->subfd      = fd;
+			c->subHeadLen = hdr2->HeadLen;
+			c->subbpb     = hdr2->AS.bpb;
+			c->sublive    = (start == BSCS_SUBSCRIBE_LIVE);
+			c->subend     = 0;
+			c->subnext    = start;
+			struct stat FileBuf;
+			if (c->sublive)
+				c->subnext = (fstat(fd, &FileBuf) || (FileBuf.st_size < (off_t)c->subHeadLen)) ? 0 : (FileBuf.st_size - c->subHeadLen) / c->subbpb;
+			c->STATUS = STATE_SUBSCRIBED;
+			conn_reply(c, BSCS_VERSION_01 | BSCS_SUBSCRIBE | BSCS_REPLY | STATE_SUBSCRIBED, hdr2->AS.Header, hdr2->HeadLen);
+			server_log("\t~ %s", c->fullfilename+strlen(path));
+		}
+		if (hdr2 != NULL) {
+			lock_library();
+			destructHDR(hdr2);
+			unlock_library();
+		}
+	}
 
-				/*********** temporary file - not checked *********/
-				int sdo = open(f2,O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH); 
-				
-				HDRTYPE *hdr = constructHDR(0,0);
-				hdr->FileName = f2;
-#ifdef WITH_PDP 
-				hdr->AS.Header = (uint8_t*) malloc(LEN+1);
-#endif
+	else if ((
+		 (msg.STATE & ~ERR_MASK & ~STATE_MASK) == (BSCS_VERSION_01 | BSCS_GET_FILE)))
+	{
+/****************************************************************************************
+	GET FILE
+ ****************************************************************************************/
+		int sdi = -1;
+		if (LEN == 8) {
+			c->ID = leu64p(load);
+			sdi = open(conn_filename(c), O_RDONLY);
+		}
 
-				const int BUFLEN = 1024;
-				char buf[BUFLEN]; 
+		if (VERBOSE_LEVEL>7) fprintf(stdout,"get file: %s %i\n",c->fullfilename,sdi);
 
-				count  = 0; 
-				while (count<LEN) {
-					size_t len = recv(ns, buf, min(LEN-count, BUFLEN), 0);
-#ifdef WITH_PDP 
-					memcpy(hdr->AS.Header+count,buf,len);
+		struct stat FileBuf;
+		if ((sdi < 0) || fstat(sdi, &FileBuf)) {
+			conn_reply(c, BSCS_VERSION_01 | BSCS_GET_FILE | BSCS_REPLY | c->STATUS | BSCS_ERROR_CANNOT_OPEN_FILE, NULL, 0);
+		}
+		else {
+			conn_reply_head(c, BSCS_VERSION_01 | BSCS_GET_FILE | BSCS_REPLY | c->STATUS | BSCS_NO_ERROR, FileBuf.st_size);
+#ifdef __linux__
+			conn_sendfile(c, sdi, 0, FileBuf.st_size, 1);
+			sdi = -1;
+#else
+			conn_reply_file(c, sdi, 0, FileBuf.st_size);
 #endif
-					count += write(sdo, buf, len);
-					//fprintf(stdout,"\b\b\b\b%02i%% ",100.0*count/LEN);
-				}
-				close(sdo);
-				hdr->AS.Header[count]=0;
-				hdr->HeadLen = count;
+		}
+		if (sdi >= 0) close(sdi);
+	}
 
-				if (LEN-count) {
-					errcode = 1;
-//fprintf(stdout,"errcode=1 %i\n",LEN-count);
-				}
-				else {
-				/************ read temporary file, ... ************/
-				int status = 0;
-#ifdef WITH_PDP 
-				sopen_pdp_read(hdr);
-				
-				sread(NULL,0,hdr->NRec,hdr);	// rawdata -> data.block
-				status=serror2(hdr);
+	else if (msg.STATE & BSCS_REPLY)
+	{	// ignore reply messages
+		;
+	}
+	else if (last)
+	{
+		if (VERBOSE_LEVEL>7) fprintf(stdout,"unknown packet: state=%08x len=%i\n",b_endian_u32(msg.STATE),(int)LEN);
+		conn_reply(c, BSCS_VERSION_01 | BSCS_ERROR, NULL, 0);
+	}
+}
 
-				if (status) {
-					errcode = 2;
-#else
-        				{
-#endif
-					sopen(f2,"r",hdr);
-					if ((status=serror2(hdr))) 
-					        errcode = 11;
-					
-					else {
-						count = sread(NULL,0,hdr->NRec,hdr);
-						if ((status=serror2(hdr))) 
-							errcode = 12;
-						
-						sclose(hdr);
-						if ((status=serror2(hdr))) 
-							errcode = 13;
-						
-					}
-				}
+/* run the piece of work found by conn_ready() */
+static void conn_run(CONN_T *c) {
+	size_t len = c->joblen;
+	bscs_process(c, c->in + c->inpos, len);
+	c->inpos += len;
+	c->pos   += len;
+	if (c->pos >= c->LEN) c->flagMsg = 0;
+}
 
-				if (VERBOSE_LEVEL>7) fprintf(stdout,"put file: errcode=%i\n",errcode); 
-
-				/********* ... and convert to GDF file *************/
-				if (!status) {
-					hdr->FileName = fullfilename;
-					hdr->TYPE = GDF;
-					hdr->VERSION = 2; 
-					sopen(fullfilename,"w",hdr);
-					if ((status=serror2(hdr))) {
-						errcode = 21;
-					} else {
-						//count = swrite(hdr->data.block, hdr->NRec, hdr);
-						ifwrite(hdr->AS.rawdata,hdr->AS.bpb,hdr->NRec,hdr);
-						if ((status=serror2(hdr)))
-							errcode = 22;
-						sclose(hdr);
-						if ((status=serror2(hdr)))
-							errcode = 23;
-					}	
-				}
+/*
+	push new records of the subscribed file
+	returns 1 if output was generated
+ */
+static int conn_follow(CONN_T *c) {
+	if ((c->subfd < 0) || c->subend || c->sendlen) return(0);
+	size_t pending = conn_pending(c);
+	if (pending > BSCS_SUB_QUEUE/2) return(0);	// subscriber is slow, data stays in the file
+
+	struct stat FileBuf;
+	uint8_t buf[8];
+	if (fstat(c->subfd, &FileBuf) || (pread(c->subfd, buf, 8, 236) != 8)) return(0);
+	int64_t NRec = lei64p(buf);	// is set when the recording is closed
+	const size_t bpb = c->subbpb;
+	size_t avail = (FileBuf.st_size > (off_t)c->subHeadLen) ? (FileBuf.st_size - c->subHeadLen) / bpb : 0;
+	if (NRec >= 0) avail = min(avail, (size_t)NRec);
+
+	const size_t qrec = max(1, BSCS_SUB_QUEUE / bpb);
+	if (c->sublive && (avail > c->subnext + qrec))
+		c->subnext = avail - qrec;	// skip records
+
+	if (avail > c->subnext) {
+		size_t n = min(avail - c->subnext, max(1, (BSCS_SUB_QUEUE - pending) / bpb));
+		conn_reply_head(c, BSCS_VERSION_01 | BSCS_SUBSCRIBE | BSCS_REPLY | STATE_SUBSCRIBED, 4 + n*bpb);
+		leu32a(c->subnext, conn_outbuf(c, 4));
+		uint8_t *data = conn_outbuf(c, n*bpb);
+		ssize_t count = pread(c->subfd, data, n*bpb, c->subHeadLen + (off_t)c->subnext*bpb);
+		if (count < (ssize_t)(n*bpb)) memset(data + max(count, 0), 0, n*bpb - max(count, 0));
+		c->subnext += n;
+		return(1);
+	}
+	if ((NRec >= 0) && (c->subnext >= (size_t)NRec)) {
+		/* end of recording */
+		conn_reply_head(c, BSCS_VERSION_01 | BSCS_SUBSCRIBE | BSCS_REPLY | STATE_SUBSCRIBED, 4);
+		leu32a(c->subnext, conn_outbuf(c, 4));
+		c->subend = 1;
+		return(1);
+	}
+	return(0);
+}
 
-				if (VERBOSE_LEVEL>7) fprintf(stdout,"put file: errcode=%i\n",errcode); 
+static void conn_greeting(CONN_T *c) {
+	/*server identification */
+	const char *greeting="Hi there,\n this is your experimental BSCS server. \n It is useful for testing the BioSig client-server architecture.\n";
+	conn_reply(c, BSCS_VERSION_01 | BSCS_SEND_MSG | STATE_INIT | b_endian_u32(BSCS_MAX_VERSION), greeting, strlen(greeting));
+}
 
-				}
-				destructHDR(hdr);
-				free(f2);
+/*
+	fork server: serve one connection with blocking I/O
+ */
+void DoJob(int ns)
+{
+		/* Create a new SID for the child process */
+		pid_t sid = setsid();
+		if (sid < 0) {
+			exit(-1);
+		}
+
+		CONN_T *c = conn_new(ns);
+		conn_greeting(c);
 
-				STATUS = STATE_INIT;
-				msg.STATE = BSCS_VERSION_01 | BSCS_PUT_FILE | BSCS_REPLY | STATE_INIT | b_endian_u32(errcode);
-				msg.LEN = b_endian_u32(0);
-				s = send(ns, &msg, 8, 0);
+	    	while (1) // wait for command
+		{
+			while (!c->sendlen && conn_ready(c)) conn_run(c);
+
+			if (conn_flush(c) < 0) break;
+			if (conn_ready(c)) continue;	// requests held back by a file segment
+			if (conn_follow(c)) continue;	// new records of a subscription
+
+			if ((c->subfd >= 0) && !c->subend) {
+				/* wait for a request, or check the subscribed file again */
+				struct pollfd pfd;
+				pfd.fd     = c->sd;
+				pfd.events = POLLIN;
+				if (poll(&pfd, 1, BSCS_SUB_POLL) == 0) continue;
+			}
+
+	   		ssize_t count = conn_fill(c);
+	   		if (count <= 0) {
+				if (VERBOSE_LEVEL>7) fprintf(stdout,"connection lost! %i %i %s\n",(int)count,errno,strerror(errno));
+				break;
 			}
+		}
+		conn_close_file(c);
+		conn_free(c);
+}
+
 
-			else if (( 
-				 (msg.STATE & ~ERR_MASK & ~STATE_MASK) == (BSCS_VERSION_01 | BSCS_GET_FILE))) 
-			{	
+#if defined(__linux__) && defined(_PTHREAD_H)
 /****************************************************************************************
-	GET FILE 
+	EPOLL SERVER
+
+	One thread multiplexes all sockets with epoll, complete requests are
+	handed to a fixed pool of worker threads. A connection is processed by
+	at most one worker at a time, and its socket is not polled meanwhile;
+	the worker signals completion through an eventfd.
  ****************************************************************************************/
 
-	   			count = recv(ns, &msg.LOAD, 8, 0);
-				ID = leu64p((uint8_t*)&msg.LOAD);
-				c64ta(ID, filename); 
+static pthread_mutex_t mutexPool = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  condPool  = PTHREAD_COND_INITIALIZER;
+static CONN_T *JobHead = NULL, *JobTail = NULL;	// waiting for a worker
+static CONN_T *DoneList = NULL;			// processed, waiting for the event loop
+static int EpollFD = -1, EventFD = -1;
+static char tagListen, tagEvent;
+static CONN_T **Subscribers = NULL;		// connections with a subscription, used by the event loop only
+static size_t NSubscribers = 0, SizSubscribers = 0;
+
+static void *bscs_worker(void *arg) {
+	(void)arg;	// not used, jobs are taken from the queue
+	while (1) {
+		pthread_mutex_lock(&mutexPool);
+		while (JobHead == NULL)
+			pthread_cond_wait(&condPool, &mutexPool);
+		CONN_T *c = JobHead;
+		JobHead = c->next;
+		if (JobHead == NULL) JobTail = NULL;
+		pthread_mutex_unlock(&mutexPool);
+
+		if (c->closing)
+			conn_close_file(c);
+		else
+			conn_run(c);
+
+		pthread_mutex_lock(&mutexPool);
+		c->next  = DoneList;
+		DoneList = c;
+		pthread_mutex_unlock(&mutexPool);
+		uint64_t one = 1;
+		if (write(EventFD, &one, sizeof(one)) < 0)
+			perror("server: eventfd");
+	}
+	return(NULL);
+}
 
-				if (VERBOSE_LEVEL>7) fprintf(stdout,"get file: %s\n",filename); 
+static void pool_submit(CONN_T *c) {
+	c->busy = 1;
+	c->next = NULL;
+	pthread_mutex_lock(&mutexPool);
+	if (JobTail == NULL)
+		JobHead = c;
+	else
+		JobTail->next = c;
+	JobTail = c;
+	pthread_cond_signal(&condPool);
+	pthread_mutex_unlock(&mutexPool);
+}
 
-fprintf(stdout,"get file: %016lx\n",ID);
+/* register interest in the events that fit the state of the connection */
+static void conn_arm(CONN_T *c) {
+	uint32_t events = 0;
+	if (!c->busy && !c->closing) {
+		size_t pending = conn_pending(c);
+		if (pending <= BSCS_OUT_HIGHWATER) events |= EPOLLIN;
+		if (pending > 0) events |= EPOLLOUT;
+	}
+	if (events == c->events) return;
+	struct epoll_event ev;
+	ev.events   = events;
+	ev.data.ptr = c;
+	epoll_ctl(EpollFD, EPOLL_CTL_MOD, c->sd, &ev);
+	c->events = events;
+}
 
-				int sdi = open(fullfilename,O_RDONLY,S_IFREG);
+/*
+	peer has gone; returns 1 if c can be released immediately, otherwise the
+	file is closed by a worker, and c is released when the job is done
+ */
+static int conn_shutdown(CONN_T *c) {
+	if (!c->closing) {
+		c->closing = 1;
+		epoll_ctl(EpollFD, EPOLL_CTL_DEL, c->sd, NULL);
+		close(c->sd);
+		c->sd = -1;
+	}
+	if (c->busy) return(0);
+	if ((c->hdr != NULL) || (c->fd2 >= 0)) {
+		pool_submit(c);
+		return(0);
+	}
+	return(1);
+}
 
-fprintf(stdout,"get file: %016lx %i\n",ID,sdi);
+/* flush output, and start next job if available, or push records of a subscription */
+static int conn_step(CONN_T *c) {
+	if (c->closing) return(conn_shutdown(c));
+	if (!c->busy) {
+		if (conn_flush(c) < 0) return(conn_shutdown(c));
+		if (!c->sendlen && (conn_pending(c) <= BSCS_OUT_HIGHWATER) && conn_ready(c))
+			pool_submit(c);
+		else if (conn_follow(c) && (conn_flush(c) < 0))
+			return(conn_shutdown(c));
+	}
+	if ((c->subfd >= 0) && !c->sublisted) {
+		if (NSubscribers == SizSubscribers) {
+			SizSubscribers = max(16, 2*SizSubscribers);
+			Subscribers = (CONN_T**)realloc(Subscribers, SizSubscribers*sizeof(CONN_T*));
+		}
+		Subscribers[NSubscribers++] = c;
+		c->sublisted = 1;
+	}
+	conn_arm(c);
+	return(0);
+}
 
-				if (sdi<0) {
-					msg.STATE = BSCS_VERSION_01 | BSCS_GET_FILE | BSCS_REPLY | STATUS | BSCS_ERROR_CANNOT_OPEN_FILE;
-					msg.LEN = b_endian_u32(0);
-					s = send(ns, &msg, 8, 0);	
-				} 
-				else {		
-					struct stat FileBuf;
-					stat(fullfilename,&FileBuf);
-					uint32_t LEN = FileBuf.st_size;
+/* remove connections without subscription from Subscribers */
+static void subscribers_update(void) {
+	size_t n = 0;
+	for (size_t k = 0; k < NSubscribers; k++) {
+		CONN_T *c = Subscribers[k];
+		if ((c->subfd >= 0) && !c->closing)
+			Subscribers[n++] = c;
+		else
+			c->sublisted = 0;
+	}
+	NSubscribers = n;
+}
 
-					msg.STATE = BSCS_VERSION_01 | BSCS_GET_FILE | BSCS_REPLY | STATUS | BSCS_NO_ERROR;
-					msg.LEN = b_endian_u32(LEN);
-					s = send(ns, &msg, 8, 0);	
+static double monotonic_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec*1e3 + ts.tv_nsec*1e-6);
+}
 
-					const int BUFLEN = 1024;
-					char *buf[BUFLEN]; 
-					count = 0; 
-					while (count<LEN) {
-						size_t len = read(sdi, buf, min(LEN-count,BUFLEN));
-						count += send(ns, buf, len, 0); 
+static int epoll_server(int sd, int nworkers) {
+
+	EpollFD = epoll_create1(0);
+	EventFD = eventfd(0, EFD_NONBLOCK);
+	if ((EpollFD < 0) || (EventFD < 0)) {
+		perror("server: epoll");
+		return(-1);
+	}
+	fcntl(sd, F_SETFL, fcntl(sd, F_GETFL) | O_NONBLOCK);
+
+	struct epoll_event ev;
+	ev.events   = EPOLLIN;
+	ev.data.ptr = &tagListen;
+	epoll_ctl(EpollFD, EPOLL_CTL_ADD, sd, &ev);
+	ev.events   = EPOLLIN;
+	ev.data.ptr = &tagEvent;
+	epoll_ctl(EpollFD, EPOLL_CTL_ADD, EventFD, &ev);
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	for (int k = 0; k < nworkers; k++) {
+		pthread_t tid;
+		if (pthread_create(&tid, &attr, bscs_worker, NULL)) {
+			perror("server: pthread_create");
+			return(-1);
+		}
+	}
+	pthread_attr_destroy(&attr);
+
+	printf("server: waiting for connections (epoll, %i workers)...\n", nworkers);
+
+	const int MAXEVENTS = 256;
+	struct epoll_event events[MAXEVENTS];
+	CONN_T *zombies = NULL;		// released after each round, events might still refer to them
+	double tFollow = monotonic_ms();	// last check of subscribed files
+	while (1) {
+		char flagFollow = 0;		// data has been written, check subscribed files
+		int n = epoll_wait(EpollFD, events, MAXEVENTS, NSubscribers ? BSCS_SUB_POLL : -1);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			perror("server: epoll_wait");
+			return(-1);
+		}
+
+		for (int k = 0; k < n; k++) {
+			void *ptr = events[k].data.ptr;
+
+			if (ptr == &tagListen) {
+				/* accept all pending connections */
+				struct sockaddr_in sain;
+				socklen_t fromlen = sizeof(sain);
+				int ns;
+				while ((ns = accept4(sd, (struct sockaddr*)&sain, &fromlen, SOCK_NONBLOCK)) >= 0) {
+					int yes = 1;
+					setsockopt(ns, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+					if (VERBOSE_LEVEL>7) {
+						char dst[INET6_ADDRSTRLEN];
+						inet_ntop(AF_INET, &sain.sin_addr, dst, INET6_ADDRSTRLEN);
+						fprintf(stdout,"server: got connection from %s\n", dst);
 					}
-					//if (FileBuf.st_size-count); // TODO: error handling
-					close(sdi); 
+
+					CONN_T *c = conn_new(ns);
+					conn_greeting(c);
+					ev.events   = 0;
+					ev.data.ptr = c;
+					epoll_ctl(EpollFD, EPOLL_CTL_ADD, ns, &ev);
+					if (conn_step(c)) {
+						c->next = zombies;
+						zombies = c;
+					}
+					fromlen = sizeof(sain);
 				}
-				s = send(ns, &msg, 8, 0);	
+				if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+					perror("server: accept");
 			}
 
-			else if ((msg.STATE & CMD_MASK) == BSCS_NOP) 
-			{	
-/****************************************************************************************
-	NO OPERATION
- ****************************************************************************************/
-				;
+			else if (ptr == &tagEvent) {
+				/* collect finished jobs */
+				uint64_t cnt;
+				if (read(EventFD, &cnt, sizeof(cnt)) < 0) cnt = 0;
+				pthread_mutex_lock(&mutexPool);
+				CONN_T *c = DoneList;
+				DoneList = NULL;
+				pthread_mutex_unlock(&mutexPool);
+				while (c != NULL) {
+					CONN_T *next = c->next;
+					c->busy = 0;
+					if (c->STATUS == STATE_OPEN_WRITE) flagFollow = 1;
+					if (conn_step(c)) {
+						c->next = zombies;
+						zombies = c;
+					}
+					c = next;
+				}
 			}
 
+			else {
+				CONN_T *c = (CONN_T*)ptr;
+				if (c->closing) continue;
+				uint32_t e = events[k].events;
+				char flagClose = 0;
+				if (e & EPOLLIN) {
+					ssize_t count = conn_fill(c);
+					if ((count == 0) || ((count < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)))
+						flagClose = 1;
+				}
+				else if (e & (EPOLLERR | EPOLLHUP))
+					flagClose = 1;
+
+				if (flagClose ? conn_shutdown(c) : conn_step(c)) {
+					c->next = zombies;
+					zombies = c;
+				}
+			}
+		}
 
-			else if (msg.STATE & BSCS_REPLY) 
-			{	// ignore reply messages
-				;
-	   		} 
-			else 
-			{
-				fprintf(stdout,"unknown packet: state=%08x len=%i\n",b_endian_u32(msg.STATE),b_endian_i32(msg.LEN)); 
-				msg.STATE = BSCS_VERSION_01 | BSCS_ERROR;
-				msg.LEN = b_endian_u32(0);
-				s = send(ns, &msg, 8, 0);	
+		if (NSubscribers && (flagFollow || (monotonic_ms() - tFollow >= BSCS_SUB_POLL))) {
+			tFollow = monotonic_ms();
+			subscribers_update();
+			for (size_t k = 0; k < NSubscribers; k++) {
+				CONN_T *c = Subscribers[k];
+				if (!c->busy && conn_step(c)) {
+					c->next = zombies;
+					zombies = c;
+				}
 			}
 		}
+
+		if (zombies != NULL) subscribers_update();
+		while (zombies != NULL) {
+			CONN_T *c = zombies;
+			zombies = c->next;
+			conn_free(c);
+		}
+	}
+	return(0);
 }
+#endif
+
 
-//int main (int argc, char *argv[]) {
-int main () {
+int main (int argc, char *argv[]) {
 
-	int sd, ns; 		
+	int sd, ns;
 	socklen_t fromlen;
 	int addrlen;
 	struct sigaction sa;
-	time_t timer;	
-	pid_t sid; 
+	time_t timer;
+	char flagEpoll = 0;
+	int nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t cachesize = 128;		// [MB]
+
+	for (int k = 1; k < argc; k++) {
+		if (!strcmp(argv[k],"-e") || !strcmp(argv[k],"--epoll"))
+			flagEpoll = 1;
+		else if (!strncmp(argv[k],"-j",2))
+			nworkers = atoi(argv[k] + 2 + (argv[k][2]=='='));
+		else if (!strncmp(argv[k],"--workers=",10))
+			nworkers = atoi(argv[k]+10);
+		else if (!strncmp(argv[k],"-m",2))
+			cachesize = atol(argv[k] + 2 + (argv[k][2]=='='));
+		else if (!strncmp(argv[k],"--cache=",8))
+			cachesize = atol(argv[k]+8);
+#ifndef NDEBUG
+		else if (!strncmp(argv[k],"-V",2))
+			VERBOSE_LEVEL = atoi(argv[k]+2);
+#endif
+		else {
+			fprintf(stdout,"usage: biosig_server [OPTIONS]\n"
+				"  -e, --epoll\n"
+				"\tserve all connections from a single process with epoll and a pool\n"
+				"\tof worker threads; default: fork a process for each connection\n"
+				"  -j=#, --workers=#\n"
+				"\tnumber of worker threads of the epoll server [default: number of CPUs]\n"
+				"  -m=#, --cache=#\n"
+				"\tsize of the cache of headers and data blocks in MB, shared by all\n"
+				"\tconnections [default: 128], 0 disables the cache\n"
+				"  -V#\n\tverbosity level\n");
+			return(strcmp(argv[k],"-h") && strcmp(argv[k],"--help") ? -1 : 0);
+		}
+	}
+	if (nworkers < 1) nworkers = 1;
+
+	LoadIdTable(path);
 
-	fprintf(stdout,"01## errno=%i %s\n",errno,strerror(errno)); 
-	LoadIdTable(path); 
-	fprintf(stdout,"11## errno=%i %s\n",errno,strerror(errno)); 
+	if (cachesize && cache_init(cachesize<<20))
+		fprintf(stdout,"server: cache not available\n");
 
-	timer=time(NULL);	
+	timer=time(NULL);
 	char *t = asctime(localtime(&timer));
 	t[24]=0;
 
-	FILE *fid = fopen(LOGFILE,"a");
-	fprintf(fid,"\n%s\tserver started",t); 
-	fclose(fid); 
+	server_log("\n%s\tserver started", t);
 
+	/* many clients need many file descriptors */
+	struct rlimit rl;
+	if (!getrlimit(RLIMIT_NOFILE, &rl) && (rl.rlim_cur < rl.rlim_max)) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+	signal(SIGPIPE, SIG_IGN);	// errors are reported by send()
 
 #ifdef IPv6	// IPv4 and IPv6
 	int status;
@@ -835,7 +1972,7 @@ int main () {
 #else
 
     	struct sockaddr_in sain;
-    	fromlen = sizeof(sain); 
+    	fromlen = sizeof(sain);
 
     	/*
     	 * Get a socket to work with.  This socket will
@@ -847,6 +1984,9 @@ int main () {
         	exit(1);
     	}
 
+	int yes=1;
+	setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
+
    	/* bind server port */
     	sain.sin_family = AF_INET;
     	sain.sin_addr.s_addr = htonl(INADDR_ANY);
@@ -854,19 +1994,28 @@ int main () {
 
    	if(bind(sd, (struct sockaddr *) &sain, sizeof(sain))<0) {
       		perror("cannot bind port ");
-      		return(-1); 
+      		return(-1);
    	}
 
-#endif 
+#endif
 
     	/*
     	 * Listen on the socket.
     	 */
-    	if (listen(sd, 10) < 0) {
+    	if (listen(sd, SOMAXCONN) < 0) {
         	perror("server: listen");
         	exit(1);
     	}
 
+	if (flagEpoll) {
+#if defined(__linux__) && defined(_PTHREAD_H)
+		return(epoll_server(sd, nworkers));
+#else
+		fprintf(stderr,"server: epoll mode is not supported on this platform\n");
+		return(-1);
+#endif
+	}
+
  	sa.sa_handler = sigchld_handler; // reap all dead processes
 	sigemptyset(&sa.sa_mask);
 	sa.sa_flags = SA_RESTART;
@@ -883,45 +2032,46 @@ int main () {
 	    	 * will be connected to the client.  fsain will
     		 * contain the address of the client.
 	    	 */
-	    	fromlen = sizeof(sain); 	
+	    	fromlen = sizeof(sain);
 		if ((ns = accept(sd, (struct sockaddr*)&sain, &fromlen)) < 0) {
+			if (errno == EINTR) continue;
         		perror("server: accept");
 	        	exit(1);
     		}
+		setsockopt(ns, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
 #ifdef IPv6
 		inet_ntop(sain.ss_family, get_in_addr((struct sockaddr *)&sain),s, sizeof s);
 	        printf("server: got connection from %s\n", s);
-#else 
+#else
 		char hostname[100],service[100];
   		bzero(hostname,100);
   		bzero(service,100);
   		addrlen = sizeof(struct sockaddr);
 		if (getnameinfo((struct sockaddr *)&sain,addrlen,hostname,100,service,100,0) != 0)
      		{
-		fprintf(stdout,"--- errno=%i %s\n",errno,strerror(errno)); 
+		fprintf(stdout,"--- errno=%i %s\n",errno,strerror(errno));
 //    			perror("getnameinfo");
      		}
 
-		printf("Connection received from host (%s) on remote port (%s)\n",hostname,service);
+		if (VERBOSE_LEVEL>7) printf("Connection received from host (%s) on remote port (%s)\n",hostname,service);
 #endif
 
-#ifndef VERBOSE_LEVEL
-//VERBOSE_LEVEL = 8; 
-#endif 
-
-		// TODO: LOG FILE 
+		// TODO: LOG FILE
 
 		char dst[INET6_ADDRSTRLEN];
 		inet_ntop(AF_INET, &sain.sin_addr,dst, INET6_ADDRSTRLEN);
-		timer=time(NULL);	
+		timer=time(NULL);
 		char *t = asctime(localtime(&timer));
 		t[24]=0;
 
 
 		FILE *fid = fopen(LOGFILE,"a");
-		fprintf(fid,"\n%s\t%s\t%s",t,dst,hostname); 
-		fclose(fid); 
-		
+		if (fid != NULL) {
+			fprintf(fid,"\n%s\t%s\t%s",t,dst,hostname);
+			fclose(fid);
+		}
+
 	        if (!fork()) { // this is the child process
 			close(sd); // child doesn't need the listener
 
@@ -935,23 +2085,23 @@ int main () {
 				syslog( LOG_ERR, "unable to change directory to %s, code %d (%s)","/", errno, strerror(errno) );
 			        exit(-1);
 			}
-			    
+
 			/* Redirect standard files to /dev/null */
 
 			freopen( "/dev/null", "r", stdin);
 			freopen( "/dev/null", "w", stdout);
 			freopen( "/dev/null", "w", stderr);
-			
+
 			if (VERBOSE_LEVEL>7) fprintf(stdout,"server123 err=%i %s\n",errno,strerror(errno));
 
-			errno = 0; 
+			errno = 0;
 			DoJob(ns);
-	
+
 		    	close(ns);
         	    	exit(0);
 	        }
     		close(ns);
-	} 	
+	}
 
     	close(sd);
     	exit(0);
@@ -0,0 +1,502 @@
+/*
+
+    This file is part of the "BioSig for C/C++" repository
+    (biosig4c++) at http://biosig.sf.net/
+
+    BioSig is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+	Benchmark of biosig_server with many concurrent clients
+
+	The file is uploaded once with BSCS_PUT_FILE. Then, for each number of
+	clients, all clients connect at the same time, open the file, request
+	the header and NREQ data blocks, and close the file again.
+
+	With -w, a single client reads the whole file with bscs_requ_dat, for
+	each given number of outstanding requests (protocol version 0.2).
+
+	With -l, all connections go through a local proxy that delays the
+	traffic in each direction by half of the given round trip time.
+
+	usage: biosig_server_bench [-s host] [-c 1,100,1000] [-n NREQ] [-b BLOCKS] [-w 1,4,16] [-l RTT] file
+ */
+
+#include "biosig-network.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <netinet/tcp.h>
+
+static const char *hostname = "localhost";
+static struct sockaddr_in ServerAddr;
+static uint64_t ID;
+static size_t NRec, BPB;
+static size_t NREQ   = 100;	// number of data requests per client
+static size_t BLOCKS = 1;	// number of blocks per data request
+
+static pthread_barrier_t barrier;
+
+static double Delay = 0;	// one-way delay of proxy [s]
+static struct sockaddr_in ProxyAddr;
+
+typedef struct {
+	int	k;
+	double	tconnect;	// time for connect and greeting [s]
+	size_t	nreq;		// number of completed requests
+	size_t	nbytes;		// number of received bytes
+	int	err;
+} CLIENT_T;
+
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return(tv.tv_sec + tv.tv_usec*1e-6);
+}
+
+static int recvall(int sd, void *buf, size_t len) {
+	size_t count = 0;
+	while (count < len) {
+		ssize_t n = recv(sd, (uint8_t*)buf+count, len-count, 0);
+		if (n <= 0) {
+			if ((n < 0) && (errno == EINTR)) continue;
+			return(-1);
+		}
+		count += n;
+	}
+	return(0);
+}
+
+static int sendall(int sd, const void *buf, size_t len) {
+	size_t count = 0;
+	while (count < len) {
+		ssize_t n = send(sd, (const uint8_t*)buf+count, len-count, 0);
+		if (n <= 0) {
+			if ((n < 0) && (errno == EINTR)) continue;
+			return(-1);
+		}
+		count += n;
+	}
+	return(0);
+}
+
+/*
+	receive message, the payload is discarded into buf of size bufsiz
+	returns payload length, or -1 if (STATE & mask) is not as expected
+ */
+static ssize_t recv_mesg(int sd, uint32_t mask, uint32_t cmd, uint8_t *buf, size_t bufsiz) {
+	mesg_t msg;
+	if (recvall(sd, &msg, 8)) return(-1);
+	size_t len = b_endian_u32(msg.LEN);
+	size_t count = 0;
+	while (count < len) {
+		size_t n = min(len-count, bufsiz);
+		if (recvall(sd, buf, n)) return(-1);
+		count += n;
+	}
+	if ((msg.STATE & mask) != cmd) return(-1);
+	return(len);
+}
+
+static ssize_t recv_reply(int sd, uint32_t cmd, uint8_t *buf, size_t bufsiz) {
+	return(recv_mesg(sd, CMD_MASK | ERR_MASK, cmd, buf, bufsiz));
+}
+
+/****************************************************************************************
+	delaying proxy
+ ****************************************************************************************/
+typedef struct CHUNK_T {
+	double	t;		// time of arrival
+	size_t	len;
+	struct CHUNK_T *next;
+	uint8_t	data[1<<16];
+} CHUNK_T;
+
+typedef struct {
+	int	fd[2];		// client, server
+	int	refcnt;
+} LINK_T;
+
+typedef struct {
+	LINK_T	*link;
+	int	from, to;
+} PIPE_T;
+
+/* forward data from one socket to the other, each chunk is delayed by Delay */
+static void *delay_pipe(void *arg) {
+	PIPE_T *P = (PIPE_T*)arg;
+	CHUNK_T *head = NULL, *tail = NULL;
+	char flagEOF = 0;
+	while (!flagEOF || (head != NULL)) {
+		int timeout = -1;
+		if (head != NULL) {
+			double dt = head->t + Delay - now();
+			timeout = (dt > 0) ? (int)(dt*1e3) + 1 : 0;
+		}
+		if (!flagEOF) {
+			struct pollfd pfd;
+			pfd.fd = P->from;
+			pfd.events = POLLIN;
+			if (poll(&pfd, 1, timeout) > 0) {
+				CHUNK_T *c = (CHUNK_T*)malloc(sizeof(CHUNK_T));
+				ssize_t n = recv(P->from, c->data, sizeof(c->data), 0);
+				if (n <= 0) {
+					free(c);
+					flagEOF = 1;
+				}
+				else {
+					c->t = now();
+					c->len = n;
+					c->next = NULL;
+					if (tail == NULL) head = c;
+					else tail->next = c;
+					tail = c;
+				}
+			}
+		}
+		else if (timeout > 0)
+			usleep(timeout*1000);
+
+		while ((head != NULL) && (head->t + Delay <= now())) {
+			CHUNK_T *c = head;
+			sendall(P->to, c->data, c->len);
+			head = c->next;
+			if (head == NULL) tail = NULL;
+			free(c);
+		}
+	}
+	shutdown(P->to, SHUT_WR);
+	if (__sync_sub_and_fetch(&P->link->refcnt, 1) == 0) {
+		close(P->link->fd[0]);
+		close(P->link->fd[1]);
+		free(P->link);
+	}
+	free(P);
+	return(NULL);
+}
+
+static void *proxy(void *arg) {
+	int sd = *(int*)arg;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, 1<<16);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	while (1) {
+		int ns = accept(sd, NULL, NULL);
+		if (ns < 0) continue;
+		int ss = socket(AF_INET, SOCK_STREAM, 0);
+		if (connect(ss, (struct sockaddr*)&ServerAddr, sizeof(ServerAddr))) {
+			close(ns);
+			close(ss);
+			continue;
+		}
+		int yes = 1;
+		setsockopt(ns, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+		setsockopt(ss, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+		LINK_T *L = (LINK_T*)malloc(sizeof(LINK_T));
+		L->fd[0] = ns;
+		L->fd[1] = ss;
+		L->refcnt = 2;
+		for (int k = 0; k < 2; k++) {
+			PIPE_T *P = (PIPE_T*)malloc(sizeof(PIPE_T));
+			P->link = L;
+			P->from = L->fd[k];
+			P->to   = L->fd[1-k];
+			pthread_t tid;
+			pthread_create(&tid, &attr, delay_pipe, P);
+		}
+	}
+	return(NULL);
+}
+
+/* start proxy on a free local port */
+static int start_proxy() {
+	static int sd;
+	sd = socket(AF_INET, SOCK_STREAM, 0);
+	ProxyAddr.sin_family = AF_INET;
+	ProxyAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	ProxyAddr.sin_port = 0;
+	socklen_t len = sizeof(ProxyAddr);
+	if (bind(sd, (struct sockaddr*)&ProxyAddr, sizeof(ProxyAddr)) || listen(sd, SOMAXCONN)
+	 || getsockname(sd, (struct sockaddr*)&ProxyAddr, &len))
+		return(-1);
+	pthread_t tid;
+	return(pthread_create(&tid, NULL, proxy, &sd));
+}
+
+/****************************************************************************************
+	concurrent clients
+ ****************************************************************************************/
+static void *client(void *arg) {
+	CLIENT_T *C = (CLIENT_T*)arg;
+	size_t bufsiz = max(BPB*BLOCKS, BSCS_MAX_BUFSIZ);
+	uint8_t *buf = (uint8_t*)malloc(bufsiz);
+	mesg_t msg;
+	ssize_t len;
+
+	pthread_barrier_wait(&barrier);
+
+	double t0 = now();
+	int sd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in *addr = (Delay > 0) ? &ProxyAddr : &ServerAddr;
+	if ((sd < 0) || connect(sd, (struct sockaddr*)addr, sizeof(*addr))) {
+		C->err = 1;
+		if (sd >= 0) close(sd);
+		free(buf);
+		return(NULL);
+	}
+	int yes = 1;
+	setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+	/* greeting */
+	if (recv_mesg(sd, CMD_MASK, BSCS_SEND_MSG, buf, bufsiz) < 0) {
+		C->err = 2;
+		goto bench_close;
+	}
+	C->tconnect = now() - t0;
+
+	/* open */
+	msg.STATE = BSCS_VERSION_01 | BSCS_OPEN_R | STATE_INIT | BSCS_NO_ERROR;
+	msg.LEN   = b_endian_u32(8);
+	*(uint64_t*)msg.LOAD = l_endian_u64(ID);
+	if (sendall(sd, &msg, 16) || (recv_reply(sd, BSCS_OPEN_R | BSCS_REPLY, buf, bufsiz) < 0)) {
+		C->err = 3;
+		goto bench_close;
+	}
+
+	/* header */
+	msg.STATE = BSCS_VERSION_01 | BSCS_REQU_HDR | STATE_OPEN_READ | BSCS_NO_ERROR;
+	msg.LEN   = 0;
+	if (sendall(sd, &msg, 8) || ((len = recv_reply(sd, BSCS_REQU_HDR | BSCS_REPLY, buf, bufsiz)) < 0)) {
+		C->err = 4;
+		goto bench_close;
+	}
+	C->nbytes += len;
+
+	/* data */
+	for (size_t k = 0; k < NREQ; k++) {
+		size_t start = ((C->k + k)*BLOCKS) % max(NRec, 1);
+		msg.STATE = BSCS_VERSION_01 | BSCS_REQU_DAT | STATE_OPEN_READ | BSCS_NO_ERROR;
+		msg.LEN   = b_endian_u32(8);
+		*(uint32_t*)(msg.LOAD+0) = l_endian_u32(BLOCKS);
+		*(uint32_t*)(msg.LOAD+4) = l_endian_u32(start);
+		if (sendall(sd, &msg, 16) || ((len = recv_reply(sd, BSCS_REQU_DAT | BSCS_REPLY, buf, bufsiz)) < 0)) {
+			C->err = 5;
+			goto bench_close;
+		}
+		C->nbytes += len;
+		C->nreq++;
+	}
+
+	/* close */
+	msg.STATE = BSCS_VERSION_01 | BSCS_CLOSE | STATE_OPEN_READ | BSCS_NO_ERROR;
+	msg.LEN   = 0;
+	if (sendall(sd, &msg, 8) || (recv_reply(sd, BSCS_CLOSE | BSCS_REPLY, buf, bufsiz) < 0))
+		C->err = 6;
+
+bench_close:
+	close(sd);
+	free(buf);
+	return(NULL);
+}
+
+static int run(int nclients) {
+	CLIENT_T *C = (CLIENT_T*)calloc(nclients, sizeof(CLIENT_T));
+	pthread_t *tid = (pthread_t*)malloc(nclients*sizeof(pthread_t));
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, 1<<18);
+	pthread_barrier_init(&barrier, NULL, nclients+1);
+
+	int n = 0;
+	for (; n < nclients; n++) {
+		C[n].k = n;
+		if (pthread_create(tid+n, &attr, client, C+n)) {
+			fprintf(stderr,"could not start client %i\n",n);
+			exit(-1);
+		}
+	}
+	pthread_attr_destroy(&attr);
+
+	double t0 = now();
+	pthread_barrier_wait(&barrier);
+	for (int k = 0; k < nclients; k++)
+		pthread_join(tid[k], NULL);
+	double t = now() - t0;
+	pthread_barrier_destroy(&barrier);
+
+	size_t nreq = 0, nbytes = 0;
+	double tconnect = 0;
+	int nerr = 0;
+	for (int k = 0; k < nclients; k++) {
+		nreq     += C[k].nreq;
+		nbytes   += C[k].nbytes;
+		tconnect += C[k].tconnect;
+		nerr     += (C[k].err != 0);
+	}
+	fprintf(stdout,"%8i %10.3f %10.1f %10.0f %10.1f %10.2f %8i\n",
+		nclients, t, nclients/t, nreq/t, nbytes/t*1e-6, tconnect/nclients*1e3, nerr);
+
+	free(tid);
+	free(C);
+	return(nerr);
+}
+
+/****************************************************************************************
+	single client with several outstanding requests
+ ****************************************************************************************/
+static int run_window(const char *windows) {
+	char host[64];
+	if (Delay > 0)
+		sprintf(host, "127.0.0.1:%i", ntohs(ProxyAddr.sin_port));
+	else
+		strcpy(host, hostname);
+
+	int sd = bscs_connect(host);
+	HDRTYPE *hdr = constructHDR(0,0);
+	if ((sd < 0) || bscs_open(sd, &ID) || bscs_requ_hdr(sd, hdr)) {
+		fprintf(stderr,"could not open file %016lx\n",(unsigned long)ID);
+		return(-1);
+	}
+	fprintf(stdout,"# server protocol version %i\n", SERVER_VERSION);
+	fprintf(stdout,"#  window   time[s]     reqs/s       MB/s  checksum\n");
+
+	int nerr = 0;
+	const char *p = windows;
+	while (*p) {
+		int w = strtol(p, (char**)&p, 10);
+		if (*p) p++;
+		if (w <= 0) continue;
+
+		size_t nb = (BLOCKS > 1) ? BLOCKS : max(1, (1<<16)/BPB);
+		bscs_set_window(w, nb);
+		double t0 = now();
+		ssize_t s = bscs_requ_dat(sd, 0, NRec, hdr);
+		double t = now() - t0;
+
+		size_t len = hdr->AS.length * BPB;
+		uint64_t chk = 0;
+		for (size_t k = 0; k < len; k++)
+			chk = chk*31 + hdr->AS.rawdata[k];
+		if (s || (hdr->AS.length != NRec)) nerr++;
+		fprintf(stdout,"%8i %10.3f %10.0f %10.1f  %016lx\n",
+			w, t, ((NRec + nb - 1)/nb)/t, len/t*1e-6, (unsigned long)chk);
+	}
+	bscs_close(sd);
+	bscs_disconnect(sd);
+	destructHDR(hdr);
+	return(nerr);
+}
+
+int main(int argc, char *argv[]) {
+
+	const char *clients = "1,100,1000";
+	const char *windows = NULL;
+	char *filename = NULL;
+
+	for (int k = 1; k < argc; k++) {
+		if (!strcmp(argv[k],"-s") && (k+1 < argc))
+			hostname = argv[++k];
+		else if (!strcmp(argv[k],"-c") && (k+1 < argc))
+			clients = argv[++k];
+		else if (!strcmp(argv[k],"-n") && (k+1 < argc))
+			NREQ = atol(argv[++k]);
+		else if (!strcmp(argv[k],"-b") && (k+1 < argc))
+			BLOCKS = atol(argv[++k]);
+		else if (!strcmp(argv[k],"-w") && (k+1 < argc))
+			windows = argv[++k];
+		else if (!strcmp(argv[k],"-l") && (k+1 < argc))
+			Delay = atof(argv[++k])*1e-3/2;
+		else if (argv[k][0] != '-')
+			filename = argv[k];
+		else {
+			filename = NULL;
+			break;
+		}
+	}
+	if (filename == NULL) {
+		fprintf(stdout,"usage: biosig_server_bench [-s host] [-c 1,100,1000] [-n NREQ] [-b BLOCKS] [-w 1,4,16] [-l RTT] file\n"
+			"  -s host\n\tserver [default: localhost]\n"
+			"  -c N1,N2,...\n\tnumbers of concurrent clients [default: 1,100,1000]\n"
+			"  -n NREQ\n\tnumber of data requests per client [default: 100]\n"
+			"  -b BLOCKS\n\tnumber of blocks per data request [default: 1; with -w: about 64 kB]\n"
+			"  -w W1,W2,...\n\tread the whole file with a single client, and W outstanding requests\n"
+			"  -l RTT\n\tadd round trip time of RTT ms with a local proxy\n");
+		return(-1);
+	}
+
+	struct rlimit rl;
+	if (!getrlimit(RLIMIT_NOFILE, &rl) && (rl.rlim_cur < rl.rlim_max)) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+	/* upload file */
+	int sd = bscs_connect(hostname);
+	if (sd < 0) {
+		fprintf(stderr,"cannot connect to %s (%i)\n",hostname,sd);
+		return(-1);
+	}
+	ID = 0;
+	int s;
+	if ((s = bscs_open(sd, &ID)) || (s = bscs_put_file(sd, filename))) {
+		fprintf(stderr,"could not put file %s (%08x)\n",filename,s);
+		return(-1);
+	}
+
+	/* get size of data blocks */
+	HDRTYPE *hdr = constructHDR(0,0);
+	if (bscs_open(sd, &ID) || bscs_requ_hdr(sd, hdr)) {
+		fprintf(stderr,"could not open file %016lx\n",(unsigned long)ID);
+		return(-1);
+	}
+	NRec = hdr->NRec;
+	BPB  = hdr->AS.bpb;
+	bscs_close(sd);
+	bscs_disconnect(sd);
+	destructHDR(hdr);
+
+	struct hostent *h = gethostbyname(hostname);
+	ServerAddr.sin_family = h->h_addrtype;
+	memcpy(&ServerAddr.sin_addr.s_addr, h->h_addr_list[0], h->h_length);
+	ServerAddr.sin_port = htons(SERVER_PORT);
+
+	if ((Delay > 0) && start_proxy()) {
+		fprintf(stderr,"could not start proxy\n");
+		return(-1);
+	}
+	if (Delay > 0)
+		fprintf(stdout,"# round trip time: %g ms\n", Delay*2e3);
+
+	if (windows != NULL)
+		return(run_window(windows) > 0);
+
+	fprintf(stdout,"# %s: ID=%016lx NRec=%i bpb=%i, %i requests of %i blocks per client\n",
+		filename, (unsigned long)ID, (int)NRec, (int)BPB, (int)NREQ, (int)BLOCKS);
+	fprintf(stdout,"# clients   time[s]    conns/s     reqs/s       MB/s connect[ms]  errors\n");
+
+	int nerr = 0;
+	const char *p = clients;
+	while (*p) {
+		int n = strtol(p, (char**)&p, 10);
+		if (n > 0) nerr += run(n);
+		if (*p) p++;
+	}
+	return(nerr > 0);
+}
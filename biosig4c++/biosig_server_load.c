@@ -0,0 +1,556 @@
+/*
+
+    This file is part of the "BioSig for C/C++" repository
+    (biosig4c++) at http://biosig.sf.net/
+
+    BioSig is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+	Load generator for biosig_server
+
+	The file is uploaded once with BSCS_PUT_FILE. Then N clients run
+	for the given time, each with its own connection. A client without
+	an open file opens it (OPEN), otherwise the next command is drawn
+	from the weighted mix of
+		hdr	REQU_HDR
+		seq	REQU_DAT, sequential (continues where the last one ended)
+		rand	REQU_DAT, random start
+		evt	REQU_EVT
+		close	CLOSE, the next command is OPEN again
+		put	OPEN_W and PUT_FILE (after closing the open file);
+			each one leaves a new file on the server
+	For each command, the number, the rate and the latency (p50, p99,
+	max) are reported. If the server runs on the same machine, its
+	CPU time and resident memory (the sum over all processes named
+	biosig_server, or the process given with -p) is sampled from /proc;
+	shared pages, e.g. of the block cache, are counted for each process.
+
+	usage: biosig_server_load [-s host] [-c 10] [-t 10] [-b BLOCKS] [-m MIX] [-u upload] [-p pid] file
+ */
+
+#include "biosig-network.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <netinet/tcp.h>
+
+enum { CMD_OPEN, CMD_HDR, CMD_SEQ, CMD_RAND, CMD_EVT, CMD_CLOSE, CMD_PUT, NCMD };
+static const char *CmdName[NCMD] = { "open", "hdr", "seq", "rand", "evt", "close", "put" };
+static double Weight[NCMD] = { 0, 2, 40, 40, 2, 5, 0 };
+
+static const char *hostname = "localhost";
+static struct sockaddr_in ServerAddr;
+static uint64_t ID;
+static size_t NRec, BPB;
+static size_t BLOCKS = 16;	// number of blocks per data request
+static double Duration = 10;	// [s]
+static uint8_t *PutBuf = NULL;	// content of uploaded file
+static size_t PutLen = 0;
+
+static pthread_barrier_t barrier;
+static volatile int flagStop = 0;
+
+typedef struct {
+	double	*t;		// latencies [s]
+	size_t	n, size;
+	size_t	err;
+} LAT_T;
+
+typedef struct {
+	int	k;
+	LAT_T	lat[NCMD];
+	size_t	nbytes;		// number of received bytes
+	int	err;		// connection failed
+} CLIENT_T;
+
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return(tv.tv_sec + tv.tv_usec*1e-6);
+}
+
+static int recvall(int sd, void *buf, size_t len) {
+	size_t count = 0;
+	while (count < len) {
+		ssize_t n = recv(sd, (uint8_t*)buf+count, len-count, 0);
+		if (n <= 0) {
+			if ((n < 0) && (errno == EINTR)) continue;
+			return(-1);
+		}
+		count += n;
+	}
+	return(0);
+}
+
+static int sendall(int sd, const void *buf, size_t len) {
+	size_t count = 0;
+	while (count < len) {
+		ssize_t n = send(sd, (const uint8_t*)buf+count, len-count, 0);
+		if (n <= 0) {
+			if ((n < 0) && (errno == EINTR)) continue;
+			return(-1);
+		}
+		count += n;
+	}
+	return(0);
+}
+
+/*
+	receive reply, the payload is discarded into buf of size bufsiz
+	returns payload length, or -1 if the reply is not cmd without error
+ */
+static ssize_t recv_reply(int sd, uint32_t cmd, uint8_t *buf, size_t bufsiz) {
+	mesg_t msg;
+	if (recvall(sd, &msg, 8)) return(-1);
+	size_t len = b_endian_u32(msg.LEN);
+	size_t count = 0;
+	while (count < len) {
+		size_t n = min(len-count, bufsiz);
+		if (recvall(sd, buf, n)) return(-1);
+		count += n;
+	}
+	if ((msg.STATE & (CMD_MASK | ERR_MASK)) != cmd) return(-1);
+	return(len);
+}
+
+static void lat_add(LAT_T *L, double t) {
+	if (L->n >= L->size) {
+		L->size = max(1024, 2*L->size);
+		L->t = (double*)realloc(L->t, L->size*sizeof(double));
+	}
+	L->t[L->n++] = t;
+}
+
+static int cmp_double(const void *a, const void *b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return((x > y) - (x < y));
+}
+
+/****************************************************************************************
+	resource usage of server, from /proc
+ ****************************************************************************************/
+#define MAXPROC 4096
+static pid_t ServerPid = 0;	// 0: all processes named biosig_server
+static struct {
+	pid_t	pid;
+	double	t0, t;		// CPU time at first and last sample [s]
+} Proc[MAXPROC];
+static size_t NProc = 0;
+static double RSSmax = 0, RSSsum = 0;	// [MB]
+static size_t NSamples = 0;
+
+static int proc_sample_pid(pid_t pid, double *cpu, double *rss) {
+	char fn[64], buf[1024];
+	sprintf(fn, "/proc/%i/stat", (int)pid);
+	FILE *fid = fopen(fn, "r");
+	if (fid == NULL) return(-1);
+	size_t n = fread(buf, 1, sizeof(buf)-1, fid);
+	fclose(fid);
+	buf[n] = 0;
+
+	/* fields after the command name in parentheses: state is field 3, utime 14, stime 15, rss 24 */
+	char *p = strrchr(buf, ')');
+	if (p == NULL) return(-1);
+	unsigned long utime = 0, stime = 0;
+	long rsspages = 0;
+	if (sscanf(p+2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %*d %*d %*d %*d %*d %*d %*u %*u %ld",
+			&utime, &stime, &rsspages) != 3)
+		return(-1);
+	*cpu = (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+	*rss = (double)rsspages * sysconf(_SC_PAGESIZE) * 1e-6;
+	return(0);
+}
+
+static int is_server(pid_t pid) {
+	if (ServerPid) return(pid == ServerPid);
+	char fn[64], comm[64];
+	sprintf(fn, "/proc/%i/comm", (int)pid);
+	FILE *fid = fopen(fn, "r");
+	if (fid == NULL) return(0);
+	char *s = fgets(comm, sizeof(comm), fid);
+	fclose(fid);
+	return((s != NULL) && !strcmp(comm, "biosig_server\n"));
+}
+
+/* CPU time is summed over the samples of each process, RSS over all current processes */
+static void proc_sample() {
+	DIR *dir = opendir("/proc");
+	if (dir == NULL) return;
+	struct dirent *d;
+	double rss = 0;
+	while ((d = readdir(dir)) != NULL) {
+		if (!isdigit(d->d_name[0])) continue;
+		pid_t pid = atoi(d->d_name);
+		double c, r;
+		if (!is_server(pid) || proc_sample_pid(pid, &c, &r)) continue;
+		rss += r;
+		size_t k = 0;
+		while ((k < NProc) && (Proc[k].pid != pid)) k++;
+		if (k == NProc) {
+			if (NProc >= MAXPROC) continue;
+			Proc[k].pid = pid;
+			/* processes started during the run (forked children) count from 0 */
+			Proc[k].t0  = NSamples ? 0 : c;
+			NProc++;
+		}
+		Proc[k].t = c;
+	}
+	closedir(dir);
+	RSSmax = max(RSSmax, rss);
+	RSSsum += rss;
+	NSamples++;
+}
+
+static double proc_cpu() {
+	double t = 0;
+	for (size_t k = 0; k < NProc; k++)
+		t += Proc[k].t - Proc[k].t0;
+	return(t);
+}
+
+/****************************************************************************************
+	clients
+ ****************************************************************************************/
+static int draw_command(unsigned *seed) {
+	double sum = 0;
+	for (int k = 1; k < NCMD; k++) sum += Weight[k];
+	double r = rand_r(seed) * sum / ((double)RAND_MAX + 1);
+	int k = 1;
+	for (; k < NCMD-1; k++) {
+		if (r < Weight[k]) break;
+		r -= Weight[k];
+	}
+	return(k);
+}
+
+static void *client(void *arg) {
+	CLIENT_T *C = (CLIENT_T*)arg;
+	size_t bufsiz = max(BPB*BLOCKS, BSCS_MAX_BUFSIZ);
+	uint8_t *buf = (uint8_t*)malloc(bufsiz);
+	unsigned seed = C->k + 1;
+	size_t pos = (C->k * BLOCKS) % max(NRec, 1);	// position of sequential reading
+	char flagOpen = 0;
+	int next = CMD_OPEN;	// command after close
+	mesg_t msg;
+
+	pthread_barrier_wait(&barrier);
+
+	int sd = socket(AF_INET, SOCK_STREAM, 0);
+	if ((sd < 0) || connect(sd, (struct sockaddr*)&ServerAddr, sizeof(ServerAddr))) {
+		C->err = 1;
+		if (sd >= 0) close(sd);
+		free(buf);
+		return(NULL);
+	}
+	int yes = 1;
+	setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+	/* greeting */
+	if (recvall(sd, &msg, 8) || recvall(sd, buf, min(b_endian_u32(msg.LEN), bufsiz))) {
+		C->err = 2;
+		goto load_close;
+	}
+
+	while (!flagStop) {
+		int cmd = flagOpen ? draw_command(&seed) : next;
+		next = CMD_OPEN;
+		if ((cmd == CMD_PUT) && flagOpen) {
+			// PUT_FILE is only possible without open file
+			cmd  = CMD_CLOSE;
+			next = CMD_PUT;
+		}
+		ssize_t len = 0;
+		double t0 = now();
+
+		switch (cmd) {
+		case CMD_OPEN:
+			msg.STATE = BSCS_VERSION_01 | BSCS_OPEN_R | STATE_INIT | BSCS_NO_ERROR;
+			msg.LEN   = b_endian_u32(8);
+			*(uint64_t*)msg.LOAD = l_endian_u64(ID);
+			if (sendall(sd, &msg, 16) || ((len = recv_reply(sd, BSCS_OPEN_R | BSCS_REPLY, buf, bufsiz)) < 0))
+				break;
+			flagOpen = 1;
+			break;
+
+		case CMD_HDR:
+			msg.STATE = BSCS_VERSION_01 | BSCS_REQU_HDR | STATE_OPEN_READ | BSCS_NO_ERROR;
+			msg.LEN   = 0;
+			if (sendall(sd, &msg, 8)) len = -1;
+			else len = recv_reply(sd, BSCS_REQU_HDR | BSCS_REPLY, buf, bufsiz);
+			break;
+
+		case CMD_SEQ:
+		case CMD_RAND: {
+			size_t start;
+			if (cmd == CMD_SEQ) {
+				if (pos >= NRec) pos = 0;
+				start = pos;
+				pos  += BLOCKS;
+			}
+			else
+				start = (size_t)rand_r(&seed) % max(NRec, 1);
+			msg.STATE = BSCS_VERSION_01 | BSCS_REQU_DAT | STATE_OPEN_READ | BSCS_NO_ERROR;
+			msg.LEN   = b_endian_u32(8);
+			*(uint32_t*)(msg.LOAD+0) = l_endian_u32(BLOCKS);
+			*(uint32_t*)(msg.LOAD+4) = l_endian_u32(start);
+			if (sendall(sd, &msg, 16)) len = -1;
+			else len = recv_reply(sd, BSCS_REQU_DAT | BSCS_REPLY, buf, bufsiz);
+			break;
+		}
+
+		case CMD_EVT:
+			msg.STATE = BSCS_VERSION_01 | BSCS_REQU_EVT | STATE_OPEN_READ | BSCS_NO_ERROR;
+			msg.LEN   = 0;
+			if (sendall(sd, &msg, 8)) len = -1;
+			else len = recv_reply(sd, BSCS_REQU_EVT | BSCS_REPLY, buf, bufsiz);
+			break;
+
+		case CMD_CLOSE:
+			msg.STATE = BSCS_VERSION_01 | BSCS_CLOSE | STATE_OPEN_READ | BSCS_NO_ERROR;
+			msg.LEN   = 0;
+			if (sendall(sd, &msg, 8)) len = -1;
+			else len = recv_reply(sd, BSCS_CLOSE | BSCS_REPLY, buf, bufsiz);
+			flagOpen = 0;
+			break;
+
+		case CMD_PUT:
+			msg.STATE = BSCS_VERSION_01 | BSCS_OPEN_W | STATE_INIT | BSCS_NO_ERROR;
+			msg.LEN   = 0;
+			if (sendall(sd, &msg, 8) || (recv_reply(sd, BSCS_OPEN_W | BSCS_REPLY, buf, bufsiz) < 0)) {
+				len = -1;
+				break;
+			}
+			msg.STATE = BSCS_VERSION_01 | BSCS_PUT_FILE | STATE_OPEN_WRITE_HDR | BSCS_NO_ERROR;
+			msg.LEN   = b_endian_u32(PutLen);
+			if (sendall(sd, &msg, 8) || sendall(sd, PutBuf, PutLen)) len = -1;
+			else len = recv_reply(sd, BSCS_PUT_FILE | BSCS_REPLY, buf, bufsiz);
+			break;
+		}
+
+		if (len < 0) {
+			/* the connection is in an unknown state, errors end the client */
+			C->lat[cmd].err++;
+			break;
+		}
+		lat_add(C->lat + cmd, now() - t0);
+		C->nbytes += len;
+	}
+
+load_close:
+	close(sd);
+	free(buf);
+	return(NULL);
+}
+
+static int run(int nclients) {
+	CLIENT_T *C = (CLIENT_T*)calloc(nclients, sizeof(CLIENT_T));
+	pthread_t *tid = (pthread_t*)malloc(nclients*sizeof(pthread_t));
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, 1<<18);
+	pthread_barrier_init(&barrier, NULL, nclients+1);
+
+	for (int n = 0; n < nclients; n++) {
+		C[n].k = n;
+		if (pthread_create(tid+n, &attr, client, C+n)) {
+			fprintf(stderr,"could not start client %i\n",n);
+			exit(-1);
+		}
+	}
+	pthread_attr_destroy(&attr);
+
+	proc_sample();
+	double t0 = now();
+	pthread_barrier_wait(&barrier);
+	while (now() - t0 < Duration) {
+		usleep(100000);
+		proc_sample();
+	}
+	flagStop = 1;
+	for (int k = 0; k < nclients; k++)
+		pthread_join(tid[k], NULL);
+	double t = now() - t0;
+	pthread_barrier_destroy(&barrier);
+
+	/* merge latencies of all clients */
+	size_t nbytes = 0, nops = 0, nerr = 0;
+	int nfail = 0;
+	fprintf(stdout,"# command     count      ops/s    p50[ms]    p99[ms]    max[ms]  errors\n");
+	for (int m = 0; m < NCMD; m++) {
+		LAT_T L = {NULL, 0, 0, 0};
+		for (int k = 0; k < nclients; k++) {
+			L.t = (double*)realloc(L.t, (L.n + C[k].lat[m].n)*sizeof(double));
+			memcpy(L.t + L.n, C[k].lat[m].t, C[k].lat[m].n*sizeof(double));
+			L.n   += C[k].lat[m].n;
+			L.err += C[k].lat[m].err;
+			free(C[k].lat[m].t);
+		}
+		if (L.n + L.err == 0) continue;
+		qsort(L.t, L.n, sizeof(double), cmp_double);
+		double p50 = L.n ? L.t[(L.n-1)/2] : 0;
+		double p99 = L.n ? L.t[(size_t)((L.n-1)*0.99)] : 0;
+		double tmx = L.n ? L.t[L.n-1] : 0;
+		fprintf(stdout,"  %-8s %8i %10.1f %10.3f %10.3f %10.3f %7i\n",
+			CmdName[m], (int)L.n, L.n/t, p50*1e3, p99*1e3, tmx*1e3, (int)L.err);
+		nops += L.n;
+		nerr += L.err;
+		free(L.t);
+	}
+	for (int k = 0; k < nclients; k++) {
+		nbytes += C[k].nbytes;
+		nfail  += (C[k].err != 0);
+	}
+	fprintf(stdout,"# clients %i, time %.2f s, %.1f ops/s, %.1f MB/s received, %i errors, %i failed connections\n",
+		nclients, t, nops/t, nbytes/t*1e-6, (int)nerr, nfail);
+	if (NProc > 0)
+		fprintf(stdout,"# server: %i processes, CPU %.2f s (%.1f%%), RSS max %.1f MB, mean %.1f MB\n",
+			(int)NProc, proc_cpu(), proc_cpu()/t*100, RSSmax, RSSsum/NSamples);
+	else
+		fprintf(stdout,"# server: not found in /proc, no CPU and memory usage\n");
+
+	free(tid);
+	free(C);
+	return(nerr + nfail);
+}
+
+/* parse mix of commands, e.g. "hdr=1,seq=10,rand=10,evt=1,close=1,put=0" */
+static int parse_mix(const char *mix) {
+	for (int m = 1; m < NCMD; m++) Weight[m] = 0;
+	const char *p = mix;
+	while (*p) {
+		const char *e = strchr(p, '=');
+		if (e == NULL) return(-1);
+		int m = 1;
+		while ((m < NCMD) && ((strlen(CmdName[m]) != (size_t)(e-p)) || strncmp(CmdName[m], p, e-p))) m++;
+		if (m == NCMD) return(-1);
+		Weight[m] = strtod(e+1, (char**)&p);
+		if (*p == ',') p++;
+		else if (*p) return(-1);
+	}
+	double sum = 0;
+	for (int m = 1; m < NCMD; m++) sum += Weight[m];
+	return(sum > 0 ? 0 : -1);
+}
+
+int main(int argc, char *argv[]) {
+
+	int nclients = 10;
+	char *filename = NULL;
+	const char *upload = NULL;
+
+	for (int k = 1; k < argc; k++) {
+		if (!strcmp(argv[k],"-s") && (k+1 < argc))
+			hostname = argv[++k];
+		else if (!strcmp(argv[k],"-c") && (k+1 < argc))
+			nclients = atoi(argv[++k]);
+		else if (!strcmp(argv[k],"-t") && (k+1 < argc))
+			Duration = atof(argv[++k]);
+		else if (!strcmp(argv[k],"-b") && (k+1 < argc))
+			BLOCKS = atol(argv[++k]);
+		else if (!strcmp(argv[k],"-m") && (k+1 < argc)) {
+			if (parse_mix(argv[++k])) {
+				fprintf(stderr,"invalid mix %s\n",argv[k]);
+				return(-1);
+			}
+		}
+		else if (!strcmp(argv[k],"-u") && (k+1 < argc))
+			upload = argv[++k];
+		else if (!strcmp(argv[k],"-p") && (k+1 < argc))
+			ServerPid = atoi(argv[++k]);
+		else if (argv[k][0] != '-')
+			filename = argv[k];
+		else {
+			filename = NULL;
+			break;
+		}
+	}
+	if ((filename == NULL) || (nclients < 1) || (BLOCKS < 1)) {
+		fprintf(stdout,"usage: biosig_server_load [-s host] [-c N] [-t T] [-b BLOCKS] [-m MIX] [-u upload] [-p pid] file\n"
+			"  -s host\n\tserver [default: localhost]\n"
+			"  -c N\n\tnumber of concurrent clients [default: 10]\n"
+			"  -t T\n\tduration in seconds [default: 10]\n"
+			"  -b BLOCKS\n\tnumber of blocks per data request [default: 16]\n"
+			"  -m MIX\n\tweights of commands [default: hdr=2,seq=40,rand=40,evt=2,close=5,put=0]\n"
+			"\tput uploads a new file for each command, these files are not removed\n"
+			"  -u upload\n\tfile that is uploaded by put [default: file]\n"
+			"  -p pid\n\tprocess id of server [default: all processes named biosig_server]\n");
+		return(-1);
+	}
+
+	struct rlimit rl;
+	if (!getrlimit(RLIMIT_NOFILE, &rl) && (rl.rlim_cur < rl.rlim_max)) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+	if (Weight[CMD_PUT] > 0) {
+		if (upload == NULL) upload = filename;
+		FILE *fid = fopen(upload, "rb");
+		if (fid == NULL) {
+			fprintf(stderr,"cannot read %s\n",upload);
+			return(-1);
+		}
+		fseek(fid, 0, SEEK_END);
+		PutLen = ftell(fid);
+		fseek(fid, 0, SEEK_SET);
+		PutBuf = (uint8_t*)malloc(PutLen);
+		PutLen = fread(PutBuf, 1, PutLen, fid);
+		fclose(fid);
+	}
+
+	/* upload file */
+	int sd = bscs_connect(hostname);
+	if (sd < 0) {
+		fprintf(stderr,"cannot connect to %s (%i)\n",hostname,sd);
+		return(-1);
+	}
+	ID = 0;
+	int s;
+	if ((s = bscs_open(sd, &ID)) || (s = bscs_put_file(sd, filename))) {
+		fprintf(stderr,"could not put file %s (%08x)\n",filename,s);
+		return(-1);
+	}
+
+	/* get size of data blocks */
+	HDRTYPE *hdr = constructHDR(0,0);
+	if (bscs_open(sd, &ID) || bscs_requ_hdr(sd, hdr)) {
+		fprintf(stderr,"could not open file %016lx\n",(unsigned long)ID);
+		return(-1);
+	}
+	NRec = hdr->NRec;
+	BPB  = hdr->AS.bpb;
+	bscs_close(sd);
+	bscs_disconnect(sd);
+	destructHDR(hdr);
+
+	struct hostent *h = gethostbyname(hostname);
+	ServerAddr.sin_family = h->h_addrtype;
+	memcpy(&ServerAddr.sin_addr.s_addr, h->h_addr_list[0], h->h_length);
+	ServerAddr.sin_port = htons(SERVER_PORT);
+
+	fprintf(stdout,"# %s: ID=%016lx NRec=%i bpb=%i, %i blocks per data request\n# mix:",
+		filename, (unsigned long)ID, (int)NRec, (int)BPB, (int)BLOCKS);
+	for (int m = 1; m < NCMD; m++)
+		fprintf(stdout," %s=%g", CmdName[m], Weight[m]);
+	fprintf(stdout,"\n");
+
+	return(run(nclients) > 0);
+}
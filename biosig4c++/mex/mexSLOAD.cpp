@@ -15,6 +15,9 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef WITH_PTHREAD
+#include <pthread.h>
+#endif
 
 #include "../biosig.h"
 extern int VERBOSE_LEVEL; 	// used for debugging, variable is always defined
@@ -34,135 +37,175 @@ extern int VERBOSE_LEVEL; 	// used for debugging, variable is always defined
 #define TRUE (1)
 #endif
 
-#ifdef CHOLMOD_H
-//#include "cholmod/matlab/cholmod_matlab.h"
 /*
-The function sputil_get_sparse and its license was downloaded on Oct 16, 2009 from 
-http://www.cise.ufl.edu/research/sparse/cholmod/CHOLMOD/MATLAB/cholmod_matlab.c
-http://www.cise.ufl.edu/research/sparse/cholmod/CHOLMOD/MATLAB/License.txt
+	Re-referencing matrix (see RerefCHANNEL) from a Matlab sparse matrix
+	with one row for each selected channel and one column for each output
+	channel, i.e. the Matlab matrix is the transposed CSR matrix. The
+	elements are copied into R, the memory is released with mxFree.
 */
-/*
-CHOLMOD/MATLAB Module.
-Copyright (C) 2005-2006, Timothy A. Davis
-CHOLMOD is also available under other licenses; contact authors for details.
-MATLAB(tm) is a Registered Trademark of The MathWorks, Inc.
-http://www.cise.ufl.edu/research/sparse
-
-Note that this license is for the CHOLMOD/MATLAB module only.
-All CHOLMOD modules are licensed separately.
-
-
---------------------------------------------------------------------------------
-
-
-This Module is free software; you can redistribute it and/or
-modify it under the terms of the GNU General Public License
-as published by the Free Software Foundation; either version 2
-of the License, or (at your option) any later version.
-
-This Module is distributed in the hope that it will be useful,
-but WITHOUT ANY WARRANTY; without even the implied warranty of
-MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-GNU General Public License for more details.
+static REREF_TYPE* sload_get_sparse(const mxArray *A, REREF_TYPE *R) {
+	size_t k;
+	const mwIndex *Jc = mxGetJc(A);
+	const mwIndex *Ir = mxGetIr(A);
+
+	memset(R, 0, sizeof(REREF_TYPE));
+	R->nrow = mxGetN(A);
+	R->ncol = mxGetM(A);
+	size_t nnz = Jc[R->nrow];
+	R->p = (uint32_t*) mxMalloc((R->nrow+1)*sizeof(uint32_t));
+	R->i = (uint32_t*) mxMalloc((nnz ? nnz : 1)*sizeof(uint32_t));
+	R->x = (double*)   mxMalloc((nnz ? nnz : 1)*sizeof(double));
+	for (k = 0; k <= R->nrow; k++)
+		R->p[k] = Jc[k];
+	for (k = 0; k < nnz; k++) {
+		R->i[k] = Ir[k];
+		R->x[k] = mxIsLogical(A) ? (double)((mxLogical*)mxGetData(A))[k] : mxGetPr(A)[k];
+	}
+	return(R);
+}
 
-You should have received a copy of the GNU General Public License
-along with this Module; if not, write to the Free Software
-Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
-*/
+#ifdef WITH_PDP 
+void sopen_pdp_read(HDRTYPE *hdr);
+#endif
 
-/* ========================================================================== */
-/* === sputil_get_sparse ==================================================== */
-/* ========================================================================== */
+//#define VERBOSE_LEVEL  9 
+//extern int VERBOSE_LEVEL;
+//#define DEBUG
 
-/* Create a shallow CHOLMOD copy of a MATLAB sparse matrix.  No memory is
- * allocated.  The resulting matrix A must not be modified.
+#ifndef mexSOPEN
+/*
+	Reading a sample window [s0, s0+N) into an output matrix of class
+	double, single or integer. The blocks [b0, b1) are decoded in chunks
+	of about 1 MByte through hdr->data.block and converted directly into
+	the output matrix, so neither the whole recording nor a double copy of
+	the output is kept in memory. With 'THREADS:<n>', the block range
+	is split and each part is read with its own file handle.
  */
+typedef struct {
+	HDRTYPE		*hdr;		/* NULL: the thread opens its own handle like ref */
+	HDRTYPE		*ref;
+	const char	*FileName;
+	void		*out;		/* output matrix */
+	mxClassID	mxclass;
+	size_t		NS;		/* number of output channels */
+	size_t		N;		/* number of output samples */
+	size_t		s0;		/* first sample of the window */
+	size_t		b0, b1;		/* range of blocks read by this part */
+	char		ROW;		/* ROW_BASED_CHANNELS */
+	int		err;		/* error code, -1: could not open file */
+} SLOAD_PART;
+
+/* copy channel k1 of a chunk into the output matrix, integer types are saturated, NaN becomes MIN */
+#define SLOAD_COPY(T) { \
+		T *dst = (T*)p->out + (ROW ? k1 : k1*N); \
+		for (i = i0; i < i1; i++) \
+			dst[ROW ? (off+i)*NS : off+i] = ROW ? src[i*nch] : src[i]; \
+	}
+#define SLOAD_COPY_INT(T, MIN, MAX) { \
+		T *dst = (T*)p->out + (ROW ? k1 : k1*N); \
+		for (i = i0; i < i1; i++) { \
+			double v = ROW ? src[i*nch] : src[i]; \
+			dst[ROW ? (off+i)*NS : off+i] = \
+				(v != v || v <= MIN) ? MIN : (v >= MAX ? MAX : (T)lrint(v)); \
+		} \
+	}
 
-cholmod_sparse *sputil_get_sparse
-(
-    const mxArray *Amatlab, /* MATLAB version of the matrix */
-    cholmod_sparse *A,	    /* CHOLMOD version of the matrix */
-    double *dummy,	    /* a pointer to a valid scalar double */
-    mwSize stype		    /* -1: lower, 0: unsymmetric, 1: upper */
-)
-{
-    mwSize *Ap ;
-    A->nrow = mxGetM (Amatlab) ;
-    A->ncol = mxGetN (Amatlab) ;
-    A->p = (mwSize *) mxGetJc (Amatlab) ;
-    A->i = (mwSize *) mxGetIr (Amatlab) ;
-    Ap = (mwSize*)A->p ;
-    A->nzmax = Ap [A->ncol] ;
-    A->packed = TRUE ;
-    A->sorted = TRUE ;
-    A->nz = NULL ;
-    A->itype = CHOLMOD_LONG ;       /* was CHOLMOD_INT in v1.6 and earlier */
-    A->dtype = CHOLMOD_DOUBLE ;
-    A->stype = stype ;
-
-#ifndef MATLAB6p1_OR_EARLIER
-
-    if (mxIsLogical (Amatlab))
-    {
-	A->x = NULL ;
-	A->z = NULL ;
-	A->xtype = CHOLMOD_PATTERN ;
-    }
-    else if (mxIsEmpty (Amatlab))
-    {
-	/* this is not dereferenced, but the existence (non-NULL) of these
-	 * pointers is checked in CHOLMOD */
-	A->x = dummy ;
-	A->z = dummy ;
-	A->xtype = mxIsComplex (Amatlab) ? CHOLMOD_ZOMPLEX : CHOLMOD_REAL ;
-    }
-    else if (mxIsDouble (Amatlab))
-    {
-	A->x = mxGetPr (Amatlab) ;
-	A->z = mxGetPi (Amatlab) ;
-	A->xtype = mxIsComplex (Amatlab) ? CHOLMOD_ZOMPLEX : CHOLMOD_REAL ;
-    }
-    else
-    {
-	/* only logical and complex/real double matrices supported */
-	//sputil_error (ERROR_INVALID_TYPE, 0) ;        // modified by AS, Oct 2009 
-    }
-
-#else
-
-    if (mxIsEmpty (Amatlab))
-    {
-	/* this is not dereferenced, but the existence (non-NULL) of these
-	 * pointers is checked in CHOLMOD */
-	A->x = dummy ;
-	A->z = dummy ;
-	A->xtype = mxIsComplex (Amatlab) ? CHOLMOD_ZOMPLEX : CHOLMOD_REAL ;
-    }
-    else
-    {
-	/* in MATLAB 6.1, the matrix is sparse, so it must be double */
-	A->x = mxGetPr (Amatlab) ;
-	A->z = mxGetPi (Amatlab) ;
-	A->xtype = mxIsComplex (Amatlab) ? CHOLMOD_ZOMPLEX : CHOLMOD_REAL ;
-    }
+static void* sload_part(void *arg) {
+	SLOAD_PART *p = (SLOAD_PART*)arg;
+	HDRTYPE *hdr = p->hdr;
+	size_t k, k1, b, count;
+
+	if (hdr == NULL) {
+		hdr = constructHDR(0,0);
+		hdr->FLAG = p->ref->FLAG;
+		memcpy(hdr->AS.SegSel, p->ref->AS.SegSel, sizeof(hdr->AS.SegSel));
+		hdr = sopen(p->FileName, "r", hdr);
+		if (serror2(hdr) || hdr->NS != p->ref->NS || hdr->SPR != p->ref->SPR) {
+			destructHDR(hdr);
+			p->err = -1;
+			return NULL;
+		}
+		for (k = 0; k < hdr->NS; k++)
+			hdr->CHANNEL[k].OnOff = p->ref->CHANNEL[k].OnOff;
+		if ((p->ref->REREF != NULL) && RerefCHANNEL(hdr, p->ref->REREF, 3)) {
+			destructHDR(hdr);
+			p->err = -1;
+			return NULL;
+		}
+	}
 
-#endif 
+	const size_t SPR = hdr->SPR;
+	const size_t NS  = p->NS;
+	const size_t N   = p->N;
+	const char   ROW = p->ROW;
+	const size_t chunk = (1<<17) / (NS*SPR + 1) + 1;
+
+	for (b = p->b0; b < p->b1; b += count) {
+		count = sread(NULL, b, chunk < p->b1 - b ? chunk : p->b1 - b, hdr);
+		if ((p->err = hdr->AS.B4C_ERRNUM) || !count) break;
+
+		size_t n   = hdr->data.size[ROW ? 1 : 0];
+		size_t nch = hdr->data.size[ROW ? 0 : 1];
+		if (nch != NS) {
+			p->err = B4C_UNSPECIFIC_ERROR;
+			break;
+		}
+		/* sample i of this chunk is sample off+i of the output */
+		ssize_t off = (ssize_t)(b*SPR) - (ssize_t)p->s0;
+		size_t i0 = off < 0 ? -off : 0;
+		size_t i1 = (ssize_t)n + off > (ssize_t)N ? N - off : n;
+
+		for (k1 = 0; k1 < NS; k1++) {
+			const biosig_data_type *src = hdr->data.block + (ROW ? k1 : k1*n);
+			size_t i;
+			switch (p->mxclass) {
+			case mxDOUBLE_CLASS: SLOAD_COPY(double); break;
+			case mxSINGLE_CLASS: SLOAD_COPY(float);  break;
+			case mxINT8_CLASS:   SLOAD_COPY_INT(int8_t,   INT8_MIN,  INT8_MAX);   break;
+			case mxUINT8_CLASS:  SLOAD_COPY_INT(uint8_t,  0,         UINT8_MAX);  break;
+			case mxINT16_CLASS:  SLOAD_COPY_INT(int16_t,  INT16_MIN, INT16_MAX);  break;
+			case mxUINT16_CLASS: SLOAD_COPY_INT(uint16_t, 0,         UINT16_MAX); break;
+			case mxINT32_CLASS:  SLOAD_COPY_INT(int32_t,  INT32_MIN, INT32_MAX);  break;
+			case mxUINT32_CLASS: SLOAD_COPY_INT(uint32_t, 0,         UINT32_MAX); break;
+			default: break;
+			}
+		}
+	}
 
-    return (A) ;
+	if (p->hdr == NULL) {
+		sclose(hdr);
+		destructHDR(hdr);
+	}
+	return NULL;
 }
-/* ========================================================================== */
-/* === end of sputil_get_sparse ============================================= */
-/* ========================================================================== */
-#endif 
 
-#ifdef WITH_PDP 
-void sopen_pdp_read(HDRTYPE *hdr);
+/* output class of 'OUTPUT:NATIVE', i.e. of the raw data of the selected channels.
+   Re-referenced channels are linear combinations of the raw data, they do not
+   fit into the integer class of the file and are always returned as double. */
+static mxClassID sload_native_class(HDRTYPE *hdr) {
+	mxClassID c = mxUNKNOWN_CLASS, c1;
+	size_t k;
+	if (hdr->REREF != NULL) return mxDOUBLE_CLASS;
+	for (k = 0; k < hdr->NS; k++) {
+		if (!hdr->CHANNEL[k].OnOff) continue;
+		switch (hdr->CHANNEL[k].GDFTYP) {
+		case 1:  c1 = mxINT8_CLASS; break;
+		case 2:  c1 = mxUINT8_CLASS; break;
+		case 3:  c1 = mxINT16_CLASS; break;
+		case 4:  c1 = mxUINT16_CLASS; break;
+		case 5:  c1 = mxINT32_CLASS; break;
+		case 6:  c1 = mxUINT32_CLASS; break;
+		case 16: c1 = mxSINGLE_CLASS; break;
+		case 255+24: c1 = mxINT32_CLASS; break;
+		default: c1 = mxDOUBLE_CLASS;
+		}
+		if (c == mxUNKNOWN_CLASS) c = c1;
+		else if (c != c1) return mxDOUBLE_CLASS;	// mixed data types
+	}
+	return c == mxUNKNOWN_CLASS ? mxDOUBLE_CLASS : c;
+}
 #endif
 
-//#define VERBOSE_LEVEL  9 
-//extern int VERBOSE_LEVEL;
-//#define DEBUG
-
 void mexFunction(
     int           nlhs,           /* number of expected outputs */
     mxArray       *plhs[],        /* array of pointers to output arguments */
@@ -186,14 +229,13 @@ void mexFunction(
 	int		NS = -1;
 	char		FlagOverflowDetection = 1, FlagUCAL = 0;
 	int		argSweepSel = -1;
+	int		argWindow = -1;		// 'SAMPLES' or 'WINDOW'
+	char		FlagWindowSeconds = 0;
+	int		NumThreads = 1;
 	
-#ifdef CHOLMOD_H
-	cholmod_sparse RR,*rr=NULL;
-	double dummy;
-#endif 
+	REREF_TYPE	RR, *rr=NULL;
 
-// ToDO: output single data 
-//	mxClassId	FlagMXclass=mxDOUBLE_CLASS;
+	mxClassID	FlagMXclass = mxDOUBLE_CLASS;	// mxUNKNOWN_CLASS: native class of raw data
 	
 
 	if (nrhs<1) {
@@ -213,12 +255,20 @@ void mexFunction(
 		mexPrintf("\t[s,HDR]=mexSLOAD(f,chan,'UCAL:ON')\n");
 		mexPrintf("\t[s,HDR]=mexSLOAD(f,chan,'UCAL:OFF')\n");
 		mexPrintf("\t[s,HDR]=mexSLOAD(f,chan,'OUTPUT:SINGLE')\n");
+		mexPrintf("\t[s,HDR]=mexSLOAD(f,chan,'OUTPUT:NATIVE')\n");
+		mexPrintf("\t[s,HDR]=mexSLOAD(f,chan,'SAMPLES',[start, N])\n");
+		mexPrintf("\t[s,HDR]=mexSLOAD(f,chan,'WINDOW',[t0, dur])\n");
+		mexPrintf("\t[s,HDR]=mexSLOAD(f,chan,'THREADS:<n>')\n");
 		mexPrintf("\t[s,HDR]=mexSLOAD(f,chan,'TARGETSEGMENT:<N>')\n");
 		mexPrintf("\t[s,HDR]=mexSLOAD(f,chan,'SWEEP',[NE, NG, NS])\n");
 		mexPrintf("   Input:\n\tf\tfilename\n");
 		mexPrintf("\tchan\tlist of selected channels; 0=all channels [default]\n");
 		mexPrintf("\tUCAL\tON: do not calibrate data; default=OFF\n");
-//		mexPrintf("\tOUTPUT\tSINGLE: single precision; default='double'\n");
+		mexPrintf("\tOUTPUT\tSINGLE: single precision; default='double'\n");
+		mexPrintf("\t\tNATIVE: uncalibrated data in the integer class of the file (e.g. int16),\n\t\t\tuse double(s)*diag(HDR.Cal)+HDR.Off for scaling. Mixed data types give 'double',\n\t\t\tre-referenced data are calibrated 'double'.\n");
+		mexPrintf("\tSAMPLES\t[start, N] reads N samples starting at sample <start> (1-based)\n");
+		mexPrintf("\tWINDOW\t[t0, dur] reads <dur> seconds starting at <t0> seconds after the start of the recording\n");
+		mexPrintf("\tTHREADS:<n>\tdecode the data with n threads, each one with its own file handle, default=1\n");
 		mexPrintf("\tOVERFLOWDETECTION\tdefault = ON\n\t\tON: values outside dynamic range are not-a-number (NaN)\n");
 		mexPrintf("\tTARGETSEGMENT:<N>\n\t\tselect segment <N> in multisegment files (like Nihon-Khoden), default=1\n\t\tIt has no effect for other data formats.\n");
 		mexPrintf("\t[NE, NG, NS] are the number of the experiment, the series and the sweep, resp. for sweep selection in HEKA/PatchMaster files. (0 indicates all)\n");
@@ -252,11 +302,9 @@ void mexFunction(
 			mexPrintf("arg[%i] IsStruct\n",k);
 #endif
 		}
-#ifdef CHOLMOD_H
 		else if ((k==1) && mxIsSparse(arg)) {
-			rr = sputil_get_sparse(arg,&RR,&dummy,0);
+			rr = sload_get_sparse(arg,&RR);
 		}
-#endif 
 		else if ((k==1) && mxIsNumeric(arg)) {
 #ifdef DEBUG		
 			mexPrintf("arg[%i] IsNumeric\n",k);
@@ -280,8 +328,21 @@ void mexFunction(
 				FlagUCAL = 1;
 			else if (!strcmp(mxArrayToString(prhs[k]), "UCAL:OFF"))
 				FlagUCAL = 0;
-//			else if (!strcmp(mxArrayToString(prhs[k]),"OUTPUT:SINGLE"))
-//				FlagMXclass = mxSINGLE_CLASS;
+			else if (!strcmp(mxArrayToString(prhs[k]),"OUTPUT:SINGLE"))
+				FlagMXclass = mxSINGLE_CLASS;
+			else if (!strcmp(mxArrayToString(prhs[k]),"OUTPUT:DOUBLE"))
+				FlagMXclass = mxDOUBLE_CLASS;
+			else if (!strcmp(mxArrayToString(prhs[k]),"OUTPUT:NATIVE")) {
+				FlagMXclass = mxUNKNOWN_CLASS;
+				FlagUCAL = 1;
+			}
+			else if (!strncmp(mxArrayToString(prhs[k]),"THREADS:",8))
+				NumThreads = atoi(mxArrayToString(prhs[k])+8);
+			else if ((!strcasecmp(mxArrayToString(prhs[k]), "SAMPLES") || !strcasecmp(mxArrayToString(prhs[k]), "WINDOW"))
+				&& (k+1 < nrhs) && mxIsNumeric(prhs[k+1]) && mxGetNumberOfElements(prhs[k+1]) == 2) {
+				FlagWindowSeconds = !strcasecmp(mxArrayToString(prhs[k]), "WINDOW");
+				argWindow = ++k;
+			}
 			else if (!strncmp(mxArrayToString(prhs[k]),"TARGETSEGMENT:",14))
 				TARGETSEGMENT = atoi(mxArrayToString(prhs[k])+14);
 			else if (!strcasecmp(mxArrayToString(prhs[k]), "SWEEP") && (prhs[k+1] != NULL) && mxIsNumeric(prhs[k+1]))
@@ -298,6 +359,13 @@ void mexFunction(
 		}
 	}
 
+	/* re-referenced channels are linear combinations of the calibrated data,
+	   with 'OUTPUT:NATIVE' they are returned calibrated and as double */
+	if ((rr != NULL) && (FlagMXclass == mxUNKNOWN_CLASS)) {
+		FlagMXclass = mxDOUBLE_CLASS;
+		FlagUCAL = 0;
+	}
+
 	if (VERBOSE_LEVEL>7) 
 		mexPrintf("110: input arguments checked\n");
 
@@ -306,11 +374,7 @@ void mexFunction(
 #ifdef __LIBBIOSIG2_H__
 
 	unsigned flags = (!!FlagOverflowDetection)*BIOSIG_FLAG_OVERFLOWDETECTION + (!!FlagUCAL)*BIOSIG_FLAG_UCAL;
-#ifdef CHOLMOD_H
-	flags += (rr!=NULL)*BIOSIG_FLAG_ROW_BASED_CHANNELS;
-#else
 	biosig_reset_flag(hdr, BIOSIG_FLAG_ROW_BASED_CHANNELS);
-#endif
 	biosig_set_flag(hdr, flags);
 
 	biosig_set_targetsegment(hdr, TARGETSEGMENT);
@@ -330,11 +394,7 @@ void mexFunction(
 
 	hdr->FLAG.OVERFLOWDETECTION = FlagOverflowDetection; 
 	hdr->FLAG.UCAL = FlagUCAL;
-#ifdef CHOLMOD_H
-	hdr->FLAG.ROW_BASED_CHANNELS = (rr!=NULL); 
-#else 	
 	hdr->FLAG.ROW_BASED_CHANNELS = 0; 
-#endif 
 	hdr->FLAG.TARGETSEGMENT = TARGETSEGMENT;
 
 	// sweep selection for Heka format 
@@ -428,9 +488,16 @@ void mexFunction(
 		return; 
 	}
 
-#ifdef CHOLMOD_H
-	RerefCHANNEL(hdr,rr,2);
-#endif
+	if (rr != NULL) {
+		RerefCHANNEL(hdr,rr,3);
+		mxFree(RR.p);
+		mxFree(RR.i);
+		mxFree(RR.x);
+		if (hdr->AS.B4C_ERRNUM) {
+			destructHDR(hdr);
+			mexErrMsgTxt("mexSLOAD: size of ReRef-matrix does not fit the number of channels\n");
+		}
+	}
 
 	if (hdr->FLAG.OVERFLOWDETECTION != FlagOverflowDetection)
 		mexPrintf("Warning mexSLOAD: Overflowdetection not supported in file %s\n",hdr->FileName);
@@ -443,12 +510,10 @@ void mexFunction(
 
 //	convert2to4_eventtable(hdr); 
 		
-#ifdef CHOLMOD_H
-	if (hdr->Calib != NULL) {
-		NS = hdr->Calib->ncol;
+	if (hdr->REREF != NULL) {
+		NS = hdr->REREF->nrow;
 	}
 	else 
-#endif
 	if ((NS<0) || ((NS==1) && (ChanList[0] == 0.0))) { 	// all channels
 		for (k=0, NS=0; k<hdr->NS; ++k) {
 			if (hdr->CHANNEL[k].OnOff) NS++; 
@@ -470,24 +535,98 @@ void mexFunction(
 		fprintf(stderr,"[113] NS=%i %i\n",hdr->NS,NS);
 
 #ifndef mexSOPEN
-	if (hdr->FLAG.ROW_BASED_CHANNELS)
-		plhs[0] = mxCreateDoubleMatrix(NS, hdr->NRec*hdr->SPR, mxREAL);
-	else
-		plhs[0] = mxCreateDoubleMatrix(hdr->NRec*hdr->SPR, NS, mxREAL);
-
-	count = sread(mxGetPr(plhs[0]), 0, hdr->NRec, hdr);
-	hdr->NRec = count; 
+	if ((argWindow < 0) && (FlagMXclass == mxDOUBLE_CLASS) && (NumThreads < 2)) {
+		if (hdr->FLAG.ROW_BASED_CHANNELS)
+			plhs[0] = mxCreateDoubleMatrix(NS, hdr->NRec*hdr->SPR, mxREAL);
+		else
+			plhs[0] = mxCreateDoubleMatrix(hdr->NRec*hdr->SPR, NS, mxREAL);
+
+		count = sread(mxGetPr(plhs[0]), 0, hdr->NRec, hdr);
+		hdr->NRec = count; 
+	}
+	else {
+		// sample window [s0, s0+N)
+		double total = (double)hdr->NRec * hdr->SPR;
+		double s0 = 0, N = total;
+		if (argWindow > 0) {
+			double *W = (double*) mxGetData(prhs[argWindow]);
+			if (FlagWindowSeconds) {
+				s0 = round(W[0] * hdr->SampleRate);
+				N  = round(W[1] * hdr->SampleRate);
+			}
+			else {
+				s0 = W[0] - 1;
+				N  = W[1];
+			}
+			if (s0 < 0) { N += s0; s0 = 0; }
+			if (s0 > total) s0 = total;
+			if (N > total - s0) N = total - s0;
+			if (N < 0) N = 0;
+		}
+		if (FlagMXclass == mxUNKNOWN_CLASS)
+			FlagMXclass = sload_native_class(hdr);
+
+		if (hdr->FLAG.ROW_BASED_CHANNELS)
+			plhs[0] = mxCreateNumericMatrix(NS, (size_t)N, FlagMXclass, mxREAL);
+		else
+			plhs[0] = mxCreateNumericMatrix((size_t)N, NS, FlagMXclass, mxREAL);
+
+		size_t B0 = (size_t)s0 / hdr->SPR;
+		size_t B1 = N > 0 ? ((size_t)(s0 + N) + hdr->SPR - 1) / hdr->SPR : B0;
+		int nthr  = NumThreads;
+#ifndef WITH_PTHREAD
+		nthr = 1;
+#endif
+		if (nthr > (int)(B1 - B0)) nthr = B1 - B0;
+		if (nthr < 1) nthr = 1;
+
+		SLOAD_PART *part = (SLOAD_PART*) mxCalloc(nthr, sizeof(SLOAD_PART));
+		for (k = 0; k < (size_t)nthr; k++) {
+			part[k].hdr      = k ? NULL : hdr;
+			part[k].ref      = hdr;
+			part[k].FileName = FileName;
+			part[k].out      = mxGetData(plhs[0]);
+			part[k].mxclass  = FlagMXclass;
+			part[k].NS       = NS;
+			part[k].N        = (size_t)N;
+			part[k].s0       = (size_t)s0;
+			part[k].b0       = B0 + (B1 - B0) * k / nthr;
+			part[k].b1       = B0 + (B1 - B0) * (k+1) / nthr;
+			part[k].ROW      = hdr->FLAG.ROW_BASED_CHANNELS;
+		}
+#ifdef WITH_PTHREAD
+		pthread_t *tid = (pthread_t*) mxCalloc(nthr, sizeof(pthread_t));
+		for (k = 1; k < (size_t)nthr; k++)
+			if (pthread_create(tid+k, NULL, sload_part, part+k)) part[k].err = -2;
+#endif
+		sload_part(part);
+#ifdef WITH_PTHREAD
+		for (k = 1; k < (size_t)nthr; k++)
+			if (part[k].err != -2) pthread_join(tid[k], NULL);
+		mxFree(tid);
+#endif
+		// parts that could not be read in a thread of their own are read with hdr
+		for (k = 0; k < (size_t)nthr; k++) {
+			if (part[k].err < 0) {
+				part[k].hdr = hdr;
+				part[k].err = 0;
+				sload_part(part+k);
+			}
+			if (part[k].err != 0)
+				mexPrintf("Warning mexSLOAD: reading blocks %i to %i failed (error %i)\n", (int)part[k].b0, (int)part[k].b1, part[k].err);
+		}
+		mxFree(part);
+		count = B1 - B0;
+	}
 #endif
 	sclose(hdr);
-#ifdef CHOLMOD_H
-        if (hdr->Calib && hdr->rerefCHANNEL) {
-		hdr->NS = hdr->Calib->ncol; 
+        if (hdr->REREF && hdr->rerefCHANNEL) {
+		hdr->NS = hdr->REREF->nrow; 
                 free(hdr->CHANNEL);
                 hdr->CHANNEL = hdr->rerefCHANNEL;
                 hdr->rerefCHANNEL = NULL; 
-                hdr->Calib = NULL; 
+                RerefCHANNEL(hdr, NULL, 0);
         }                
-#endif 
 	if ((status=serror2(hdr))) return;  
 
 	if (VERBOSE_LEVEL>7) 
@@ -528,14 +667,6 @@ void mexFunction(
 		mxSetField(HDR,0,"tzmin",mxCreateDoubleScalar(hdr->tzmin));
 
 		/* Channel information */ 
-#ifdef CHOLMOD_H
-/*
-        	if (hdr->Calib == NULL) { // is refering to &RR, do not destroy
-		        mxArray *Calib = mxCreateDoubleMatrix(hdr->Calib->nrow, hdr->Calib->ncol, mxREAL);
-
-        	}
-*/
-#endif
 		mxArray *LeadIdCode  = mxCreateDoubleMatrix(1,NS, mxREAL);
 		mxArray *PhysDimCode = mxCreateDoubleMatrix(1,NS, mxREAL);
 		mxArray *GDFTYP      = mxCreateDoubleMatrix(1,NS, mxREAL);
@@ -829,9 +960,6 @@ void mexFunction(
 #endif
 
 	if (VERBOSE_LEVEL>7) fprintf(stdout,"[151] going for SCLOSE\n");
-#ifdef CHOLMOD_H
-	hdr->Calib = NULL; // is refering to &RR, do not destroy
-#endif
 	if (VERBOSE_LEVEL>7) fprintf(stdout,"[156] SCLOSE finished\n");
 	destructHDR(hdr);
 	hdr = NULL; 
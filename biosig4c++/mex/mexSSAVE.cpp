@@ -18,7 +18,7 @@
 #include <string.h>
 #include <time.h>
 
-#include "../biosig.h"
+#include "../biosig-dev.h"
 extern int VERBOSE_LEVEL; 	// used for debugging, variable is always defined
 
 #ifdef NDEBUG
@@ -71,97 +71,45 @@ double getDouble(const mxArray *pm, size_t idx) {
 	return(NAN);
 }
 
-void mexFunction(
-    int           nlhs,           /* number of expected outputs */
-    mxArray       *plhs[],        /* array of pointers to output arguments */
-    int           nrhs,           /* number of inputs */
-    const mxArray *prhs[]         /* array of pointers to input arguments */
-)
-
-{
-	int k;
-	const mxArray	*arg;
-	HDRTYPE		*hdr;
-	size_t 		count;
-	time_t 		T0;
-	char 		*FileName;  
-	char 		tmpstr[128];  
-	int 		status; 
-	int		CHAN = 0;
-	double		*ChanList=NULL;
-	int		NS = -1;
-	char		FlagOverflowDetection = 1, FlagUCAL = 0;
-	void 		*data = NULL;
-	mxArray *p = NULL, *p1 = NULL, *p2 = NULL;
-
-#ifdef CHOLMOD_H
-	cholmod_sparse RR,*rr=NULL;
-	double dummy;
-#endif 
-
-// ToDO: output single data 
-//	mxClassId	FlagMXclass=mxDOUBLE_CLASS;
-	
-
-	if (nrhs<1) {
-		mexPrintf("   Usage of mexSSAVE:\n");
-		mexPrintf("\tstatus=mexSSAVE(HDR,data)\n");
-		mexPrintf("   Input:\n\tHDR\tHeader structure \n");
-		mexPrintf("\tdata\tdata matrix, one channel per column\n");
-		mexPrintf("\tHDR\theader structure\n\n");
-		mexPrintf("\tstatus 0: file saves successfully\n\n");
-		mexPrintf("\tstatus <>0: file could not saved\n\n");
-		return; 
-	}
-
-/*
- 	improve checks for input arguments
-*/
-	/* process input arguments */
-	if (mxIsNumeric(prhs[1]) &&
-	    mxIsStruct( prhs[0])) {
-		data      = (void*) mxGetData(prhs[1]);
-		// get number of channels
-		size_t NS = mxGetN (prhs[1]);
-		// get number of events
-		size_t NEvt=0;
-		if ( (p = mxGetField(prhs[0], 0, "EVENT") ) != NULL ) {
-			if ( (p1 = mxGetField(p, 0, "POS") ) != NULL ) {
-				NEvt = mxGetNumberOfElements(p1);
-			}
-			if ( (p1 = mxGetField(p, 0, "TYP") ) != NULL ) {
-				size_t n = mxGetNumberOfElements(p1);
-				if (n>NEvt) NEvt = n; 
-			}
+/* number of events in HDR.EVENT */
+size_t mxNumberOfEvents(const mxArray *HDR) {
+	mxArray *p, *p1;
+	size_t NEvt = 0;
+	if ( (p = mxGetField(HDR, 0, "EVENT") ) != NULL ) {
+		if ( (p1 = mxGetField(p, 0, "POS") ) != NULL ) {
+			NEvt = mxGetNumberOfElements(p1);
+		}
+		if ( (p1 = mxGetField(p, 0, "TYP") ) != NULL ) {
+			size_t n = mxGetNumberOfElements(p1);
+			if (n>NEvt) NEvt = n; 
 		}
-		
-		// allocate memory for header structure
-		hdr       = constructHDR (NS, NEvt);
-		data      = (biosig_data_type*) mxGetData (prhs[1]);
-		hdr->NRec = mxGetM (prhs[1]);
-		hdr->SPR  = 1;
 	}
-	else {
-		mexErrMsgTxt("mexSSAVE(HDR,data) failed because HDR and data, are not a struct and numeric, resp.\n");	
-		return; 
-	}	
+	return(NEvt);
+}
 
+/*
+	options 'OVERFLOWDETECTION:ON|OFF' and 'UCAL:ON|OFF' in prhs[k0..nrhs-1]
+ */
+void mxOptions2hdr(HDRTYPE *hdr, int k0, int nrhs, const mxArray *prhs[]) {
+	int k;
 
-	for (k = 2; k < nrhs; k++) {	
-		arg = prhs[k];
+	hdr->FLAG.OVERFLOWDETECTION = 1;
+	hdr->FLAG.UCAL = 0;
+	for (k = k0; k < nrhs; k++) {	
+		const mxArray *arg = prhs[k];
 		
 		if (mxIsChar(arg)) {
 #ifdef DEBUG		
 			mexPrintf("arg[%i]=%s \n",k,mxArrayToString(prhs[k]));
 #endif
 			if (!strcmp(mxArrayToString(prhs[k]), "OVERFLOWDETECTION:ON"))
-				FlagOverflowDetection = 1;
+				hdr->FLAG.OVERFLOWDETECTION = 1;
 			else if (!strcmp(mxArrayToString(prhs[k]), "OVERFLOWDETECTION:OFF"))
-				FlagOverflowDetection = 0;
+				hdr->FLAG.OVERFLOWDETECTION = 0;
 			else if (!strcmp(mxArrayToString(prhs[k]), "UCAL:ON")) 
-				FlagUCAL = 1;
+				hdr->FLAG.UCAL = 1;
 			else if (!strcmp(mxArrayToString(prhs[k]), "UCAL:OFF"))
-				FlagUCAL = 0;
+				hdr->FLAG.UCAL = 0;
 		}
 		else {
 #ifndef mexSOPEN
@@ -173,44 +121,48 @@ void mexFunction(
 #endif
 		}
 	}
+}
 
-	/***** SET INPUT ARGUMENTS *****/
-	hdr->FLAG.OVERFLOWDETECTION = FlagOverflowDetection; 
-	hdr->FLAG.UCAL = FlagUCAL;
-#ifdef CHOLMOD_H
-	hdr->FLAG.ROW_BASED_CHANNELS = (rr!=NULL); 
-#else 	
-	hdr->FLAG.ROW_BASED_CHANNELS = 0; 
-#endif 
-
-
-	/***** CHECK INPUT HDR STUCTURE CONVERT TO libbiosig hdr *****/
-	if (VERBOSE_LEVEL>7) mexPrintf("110: input arguments checked\n");
+/*
+	converts the header structure HDR into hdr and returns the file name;
+	nrows is the number of rows of the data matrix, or -1 if the data
+	is appended in chunks and NRec is not known yet.
+ */
+char* mx2hdr(const mxArray *HDR, HDRTYPE *hdr, ssize_t nrows) {
+	int k;
+	char 		*FileName = NULL;
+	char 		tmpstr[128];
+	mxArray *p = NULL, *p1 = NULL, *p2 = NULL;
 
-	if ( (p = mxGetField(prhs[0], 0, "TYPE") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "TYPE") ) != NULL ) {
 		mxGetString(p,tmpstr,sizeof(tmpstr));
 		hdr->TYPE 	= GetFileTypeFromString(tmpstr);
 	}
-	if ( (p = mxGetField(prhs[0], 0, "VERSION") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "VERSION") ) != NULL ) {
 		mxGetString(p, tmpstr, sizeof(tmpstr));
 		hdr->VERSION 	= atof(tmpstr);
 	}
-	if ( (p = mxGetField(prhs[0], 0, "T0") ) != NULL ) 		hdr->T0 	= (gdf_time)getDouble(p, 0);
-	if ( (p = mxGetField(prhs[0], 0, "tzmin") ) != NULL )
+	if ( (p = mxGetField(HDR, 0, "T0") ) != NULL ) 		hdr->T0 	= (gdf_time)getDouble(p, 0);
+	if ( (p = mxGetField(HDR, 0, "tzmin") ) != NULL )
 		hdr->tzmin 	= (int16_t)getDouble(p, 0);
 	else
 		hdr->tzmin	= -timezone/60;
-	if ( (p = mxGetField(prhs[0], 0, "FileName") ) != NULL ) 	FileName 	= mxArrayToString(p);
-	if ( (p = mxGetField(prhs[0], 0, "SampleRate") ) != NULL ) 	hdr->SampleRate = getDouble(p, 0);
-	if ( (p = mxGetField(prhs[0], 0, "NS") ) != NULL )	 	hdr->NS         = getDouble(p, 0);
+	if ( (p = mxGetField(HDR, 0, "FileName") ) != NULL ) 	FileName 	= mxArrayToString(p);
+	if ( (p = mxGetField(HDR, 0, "SampleRate") ) != NULL ) 	hdr->SampleRate = getDouble(p, 0);
+	if ( (p = mxGetField(HDR, 0, "NS") ) != NULL )	 	hdr->NS         = getDouble(p, 0);
 
 #ifdef DEBUG		
 			mexPrintf("mexSSAVE [400] TYPE=<%s><%s> VERSION=%f\n",tmpstr,GetFileTypeString(hdr->TYPE),hdr->VERSION);
 #endif
 
-	p1 = mxGetField(prhs[0], 0, "SPR");
-	p2 = mxGetField(prhs[0], 0, "NRec");
-	if      ( p1 && p2) {
+	p1 = mxGetField(HDR, 0, "SPR");
+	p2 = mxGetField(HDR, 0, "NRec");
+	if (nrows < 0) {
+		/* chunked writing, NRec is determined in sclose */
+		hdr->SPR  = p1 ? (size_t)getDouble(p1, 0) : 1;
+		hdr->NRec = -1;
+	}
+	else if ( p1 && p2) {
 		hdr->SPR  = (size_t)getDouble(p1, 0);
 		hdr->NRec = (size_t)getDouble(p2, 0);
 	}
@@ -227,17 +179,17 @@ void mexFunction(
 		; /* use default values SPR=1, NREC = size(data,1) */
 	}
 
-	if (hdr->NRec * hdr->SPR != mxGetM (prhs[1]) )	
-		mexPrintf("mexSSAVE: warning HDR.NRec * HDR.SPR (%i*%i = %i) does not match number of rows (%i) in data.", hdr->NRec, hdr->SPR, hdr->NRec*hdr->SPR, mxGetM(prhs[1]) );	
+	if ((nrows >= 0) && (hdr->NRec * hdr->SPR != nrows))
+		mexPrintf("mexSSAVE: warning HDR.NRec * HDR.SPR (%i*%i = %i) does not match number of rows (%i) in data.", hdr->NRec, hdr->SPR, hdr->NRec*hdr->SPR, nrows );	
 
 
-	if ( (p = mxGetField(prhs[0], 0, "Label") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "Label") ) != NULL ) {
 		if ( mxIsCell(p) ) {
 			for (k = 0; k < hdr->NS; k++) 
 				mxGetString(mxGetCell(p,k), hdr->CHANNEL[k].Label, MAX_LENGTH_LABEL+1);
 		}
 	}
-	if ( (p = mxGetField(prhs[0], 0, "Transducer") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "Transducer") ) != NULL ) {
 		if ( mxIsCell(p) ) {
 			for (k = 0; k < hdr->NS; k++) 
 				mxGetString(mxGetCell(p,k), hdr->CHANNEL[k].Transducer, MAX_LENGTH_LABEL+1);
@@ -245,40 +197,40 @@ void mexFunction(
 	}
 
 
-	if ( (p = mxGetField(prhs[0], 0, "LowPass") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "LowPass") ) != NULL ) {
 		for (k = 0; k < hdr->NS; k++) 
 			hdr->CHANNEL[k].LowPass = (float)getDouble(p,k);
 	}
-	if ( (p = mxGetField(prhs[0], 0, "HighPass") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "HighPass") ) != NULL ) {
 		for (k = 0; k < hdr->NS; k++) 
 			hdr->CHANNEL[k].HighPass = (float)getDouble(p,k);
 	}
-	if ( (p = mxGetField(prhs[0], 0, "Notch") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "Notch") ) != NULL ) {
 		for (k = 0; k < hdr->NS; k++) 
 			hdr->CHANNEL[k].Notch = (float)getDouble(p,k);
 	}
-	if ( (p = mxGetField(prhs[0], 0, "PhysMax") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "PhysMax") ) != NULL ) {
 		for (k = 0; k < hdr->NS; k++) 
 			hdr->CHANNEL[k].PhysMax = (double)getDouble(p,k);
 	}
-	if ( (p = mxGetField(prhs[0], 0, "PhysMin") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "PhysMin") ) != NULL ) {
 		for (k = 0; k < hdr->NS; k++) 
 			hdr->CHANNEL[k].PhysMin = (double)getDouble(p,k);
 	}
-	if ( (p = mxGetField(prhs[0], 0, "DigMax") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "DigMax") ) != NULL ) {
 		for (k = 0; k < hdr->NS; k++) 
 			hdr->CHANNEL[k].DigMax = (double)getDouble(p,k);
 	}
-	if ( (p = mxGetField(prhs[0], 0, "DigMin") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "DigMin") ) != NULL ) {
 		for (k = 0; k < hdr->NS; k++) 
 			hdr->CHANNEL[k].DigMin = (double)getDouble(p,k);
 	}
 
-	if ( (p = mxGetField(prhs[0], 0, "PhysDimCode") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "PhysDimCode") ) != NULL ) {
 		for (k = 0; k < hdr->NS; k++) 
 			hdr->CHANNEL[k].PhysDimCode = (uint16_t)getDouble(p,k);
 	}
-	else if ( (p = mxGetField(prhs[0], 0, "PhysDim") ) != NULL ) {
+	else if ( (p = mxGetField(HDR, 0, "PhysDim") ) != NULL ) {
 		if ( mxIsCell(p) ) {
 			for (k = 0; k < hdr->NS; k++) 
 				mxGetString(mxGetCell(p,k), tmpstr, sizeof(tmpstr));
@@ -286,23 +238,23 @@ void mexFunction(
 		}
 	}
 
-	if ( (p = mxGetField(prhs[0], 0, "GDFTYP") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "GDFTYP") ) != NULL ) {
 		for (k = 0; k < hdr->NS; k++) 
 			hdr->CHANNEL[k].GDFTYP = (uint16_t)getDouble(p,k);
 	}
-	if ( (p = mxGetField(prhs[0], 0, "TOffset") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "TOffset") ) != NULL ) {
 		for (k = 0; k < hdr->NS; k++) 
 			hdr->CHANNEL[k].TOffset = (float)getDouble(p,k);
 	}
-	if ( (p = mxGetField(prhs[0], 0, "Impedance") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "Impedance") ) != NULL ) {
 		for (k = 0; k < hdr->NS; k++) 
 			hdr->CHANNEL[k].Impedance = (float)getDouble(p,k);
 	}
-	if ( (p = mxGetField(prhs[0], 0, "fZ") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "fZ") ) != NULL ) {
 		for (k = 0; k < hdr->NS; k++) 
 			hdr->CHANNEL[k].fZ = (float)getDouble(p,k);
 	}
-	if ( (p = mxGetField(prhs[0], 0, "AS") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "AS") ) != NULL ) {
 		if ( (p1 = mxGetField(p, 0, "SPR") ) != NULL ) {
 			// define channel-based samplingRate, HDR.SampleRate*HDR.AS.SPR(channel)/HDR.SPR; 
 			for (k = 0; k < hdr->NS; k++) 
@@ -310,7 +262,7 @@ void mexFunction(
 		}
 	}
 
-	if ( (p = mxGetField(prhs[0], 0, "Patient") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "Patient") ) != NULL ) {
 		if ( (p1 = mxGetField(p, 0, "Id") ) != NULL ) 
 			if (mxIsChar(p1)) mxGetString(p1, hdr->Patient.Id, MAX_LENGTH_PID+1);
 		if ( (p1 = mxGetField(p, 0, "Name") ) != NULL ) 
@@ -349,7 +301,7 @@ void mexFunction(
 			hdr->Patient.Birthday = (gdf_time)getDouble(p1,0);
 	}
 
-	if ( (p = mxGetField(prhs[0], 0, "ID") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "ID") ) != NULL ) {
 		if ( (p1 = mxGetField(p, 0, "Recording") ) != NULL ) 
 			if (mxIsChar(p1)) mxGetString(p1, hdr->ID.Recording, MAX_LENGTH_RID+1);
 		if ( (p1 = mxGetField(p, 0, "Technician") ) != NULL ) 
@@ -404,7 +356,7 @@ void mexFunction(
 		}
 	}
 
-	if ( (p = mxGetField(prhs[0], 0, "FLAG") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "FLAG") ) != NULL ) {
 		if ( (p1 = mxGetField(p, 0, "OVERFLOWDETECTION") ) != NULL ) 
 			hdr->FLAG.OVERFLOWDETECTION = (char)getDouble(p1,0);
 		if ( (p1 = mxGetField(p, 0, "UCAL") ) != NULL ) 
@@ -415,7 +367,7 @@ void mexFunction(
 			hdr->FLAG.ROW_BASED_CHANNELS = (char)getDouble(p1,0);
 	}
 
-	if ( (p = mxGetField(prhs[0], 0, "EVENT") ) != NULL ) {
+	if ( (p = mxGetField(HDR, 0, "EVENT") ) != NULL ) {
 		if ( (p1 = mxGetField(p, 0, "SampleRate") ) != NULL ) {
 			hdr->EVENT.SampleRate = (double)getDouble(p1,0);
 		}
@@ -471,6 +423,251 @@ void mexFunction(
 
 	}
 
+	return(FileName);
+}
+
+/*
+	chunked writing:
+		h = mexSSAVE('open', HDR [,'...'])
+		mexSSAVE('append', h, data [, EVENT])
+		status = mexSSAVE('close', h)
+
+	'open' writes the header, HDR.NRec is ignored. Each 'append' call
+	writes the blocks of data (HDR.SPR*n rows, one channel per column)
+	with swrite and appends the events in EVENT (fields POS, TYP and
+	optionally DUR, CHN, with the same conventions as HDR.EVENT); EDF
+	and BDF have no event table, EVENT is supported for GDF only.
+	'close' writes NRec and the event table into the file. Open files
+	are closed when the mex-file is cleared.
+ */
+static HDRTYPE **ssave_hdrlist = NULL;
+static size_t  *ssave_evtsize  = NULL;	// allocated size of the event table of each handle
+static size_t  ssave_hdrlen   = 0;
+
+static void ssave_atexit(void) {
+	size_t k;
+	for (k = 0; k < ssave_hdrlen; k++)
+		if (ssave_hdrlist[k] != NULL) destructHDR(ssave_hdrlist[k]);
+	free(ssave_hdrlist);
+	free(ssave_evtsize);
+	ssave_hdrlist = NULL;
+	ssave_evtsize = NULL;
+	ssave_hdrlen  = 0;
+}
+
+static size_t ssave_handle(const mxArray *h) {
+	double k = getDouble(h, 0);
+	if (!(k >= 1 && k <= ssave_hdrlen) || ssave_hdrlist[(size_t)k-1] == NULL)
+		mexErrMsgTxt("mexSSAVE: invalid handle\n");
+	return((size_t)k-1);
+}
+
+static void ssave_chunked(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]) {
+	char cmd[16];
+	HDRTYPE *hdr;
+	mxArray *p, *p1;
+	size_t k, h;
+
+	mxGetString(prhs[0], cmd, sizeof(cmd));
+	if (!strcasecmp(cmd, "open")) {
+		if ((nrhs < 2) || !mxIsStruct(prhs[1]) || ((p = mxGetField(prhs[1], 0, "NS")) == NULL))
+			mexErrMsgTxt("mexSSAVE('open',HDR): HDR must be a struct with field NS\n");
+
+		hdr = constructHDR((unsigned)getDouble(p, 0), mxNumberOfEvents(prhs[1]));
+		mxOptions2hdr(hdr, 2, nrhs, prhs);
+		hdr->FLAG.ROW_BASED_CHANNELS = 0;
+		char *FileName = mx2hdr(prhs[1], hdr, -1);
+		if ((hdr->TYPE != GDF) && (hdr->TYPE != EDF) && (hdr->TYPE != BDF)) {
+			destructHDR(hdr);
+			mexErrMsgTxt("mexSSAVE('open',HDR): chunked writing supports only GDF, EDF and BDF\n");
+		}
+		/* each column of data in 'append' has HDR.SPR samples per block */
+		for (k = 0; k < hdr->NS; k++) {
+			if (((p = mxGetField(prhs[1], 0, "AS")) == NULL) || (mxGetField(p, 0, "SPR") == NULL))
+				hdr->CHANNEL[k].SPR = hdr->SPR;
+			if (hdr->CHANNEL[k].SPR != hdr->SPR) {
+				destructHDR(hdr);
+				mexErrMsgTxt("mexSSAVE('open',HDR): chunked writing requires HDR.AS.SPR == HDR.SPR for all channels\n");
+			}
+		}
+		hdr = sopen(FileName, "w", hdr);
+		if (serror2(hdr)) {
+			destructHDR(hdr);
+			mexErrMsgTxt("mexSSAVE: sopen failed \n");
+		}
+
+		for (h = 0; h < ssave_hdrlen && ssave_hdrlist[h] != NULL; h++);
+		if (h == ssave_hdrlen) {
+			if (ssave_hdrlen == 0) mexAtExit(ssave_atexit);
+			ssave_hdrlen = 2*ssave_hdrlen + 4;
+			ssave_hdrlist = (HDRTYPE**)realloc(ssave_hdrlist, ssave_hdrlen*sizeof(HDRTYPE*));
+			ssave_evtsize = (size_t*)realloc(ssave_evtsize, ssave_hdrlen*sizeof(size_t));
+			for (k = h; k < ssave_hdrlen; k++) ssave_hdrlist[k] = NULL;
+		}
+		ssave_hdrlist[h] = hdr;
+		ssave_evtsize[h] = hdr->EVENT.N;
+		plhs[0] = mxCreateDoubleScalar(h+1);
+	}
+
+	else if (!strcasecmp(cmd, "append")) {
+		if ((nrhs < 3) || !mxIsNumeric(prhs[2]))
+			mexErrMsgTxt("mexSSAVE('append',h,data): data must be numeric\n");
+		h   = ssave_handle(prhs[1]);
+		hdr = ssave_hdrlist[h];
+
+		size_t rows = mxGetM(prhs[2]);
+		size_t cols = mxGetN(prhs[2]);
+		if ((cols != hdr->NS) || (rows % hdr->SPR))
+			mexErrMsgTxt("mexSSAVE('append',h,data): data must have HDR.NS columns and a multiple of HDR.SPR rows\n");
+		if ((nrhs > 3) && mxIsStruct(prhs[3]) && (hdr->TYPE != GDF))
+			mexErrMsgTxt("mexSSAVE('append',h,data,EVENT): events can be written to GDF files only\n");
+
+		// convert chunks of other numeric classes to double
+		biosig_data_type *data = (biosig_data_type*)mxGetData(prhs[2]);
+		if (mxGetClassID(prhs[2]) != mxDOUBLE_CLASS) {
+			data = (biosig_data_type*)malloc(rows*cols*sizeof(biosig_data_type));
+			for (k = 0; k < rows*cols; k++)
+				data[k] = getDouble(prhs[2], k);
+		}
+		hdr->data.size[0] = rows;
+		hdr->data.size[1] = cols;
+		swrite(data, rows / hdr->SPR, hdr);
+		if (data != (biosig_data_type*)mxGetData(prhs[2])) free(data);
+		if (serror2(hdr)) mexErrMsgTxt("mexSSAVE: swrite failed \n");
+
+		if ((nrhs > 3) && mxIsStruct(prhs[3])) {
+			const mxArray *EVT = prhs[3];
+			size_t N = 0, n;
+			if ( (p1 = mxGetField(EVT, 0, "POS") ) != NULL ) N = mxGetNumberOfElements(p1);
+			if ( (p1 = mxGetField(EVT, 0, "TYP") ) != NULL ) { n = mxGetNumberOfElements(p1); if (n > N) N = n; }
+			n = hdr->EVENT.N;
+			if (n + N > ssave_evtsize[h]) {
+				// grow geometrically, events are typically appended in many small chunks
+				ssave_evtsize[h] = reallocEventTable(hdr, max(n + N, 2*ssave_evtsize[h]));
+				if ((hdr->EVENT.POS == NULL) || (hdr->EVENT.TYP == NULL) || (hdr->EVENT.DUR == NULL) || (hdr->EVENT.CHN == NULL))
+					mexErrMsgTxt("mexSSAVE('append',h,data,EVENT): memory allocation failed\n");
+			}
+			hdr->EVENT.N = n + N;
+			p  = mxGetField(EVT, 0, "POS");
+			for (k = 0; k < N; k++) hdr->EVENT.POS[n+k] = p ? (uint32_t)getDouble(p,k) : 0;
+			p  = mxGetField(EVT, 0, "TYP");
+			for (k = 0; k < N; k++) hdr->EVENT.TYP[n+k] = p ? (uint16_t)getDouble(p,k) : 0;
+			if ( (p = mxGetField(EVT, 0, "DUR") ) != NULL )
+				for (k = 0; k < N; k++) hdr->EVENT.DUR[n+k] = (uint32_t)getDouble(p,k);
+			if ( (p = mxGetField(EVT, 0, "CHN") ) != NULL )
+				for (k = 0; k < N; k++) hdr->EVENT.CHN[n+k] = (uint16_t)getDouble(p,k);
+		}
+		if (nlhs > 0) plhs[0] = mxCreateDoubleScalar(0);
+	}
+
+	else if (!strcasecmp(cmd, "close")) {
+		if (nrhs < 2) mexErrMsgTxt("mexSSAVE('close',h): handle missing\n");
+		h   = ssave_handle(prhs[1]);
+		hdr = ssave_hdrlist[h];
+		ssave_hdrlist[h] = NULL;
+		sclose(hdr);
+		int status = serror2(hdr);
+		destructHDR(hdr);
+		if (nlhs > 0) plhs[0] = mxCreateDoubleScalar(status);
+		else if (status) mexErrMsgTxt("mexSSAVE: sclose failed \n");
+	}
+
+	else
+		mexErrMsgTxt("mexSSAVE: unknown command, use 'open', 'append' or 'close'\n");
+}
+
+void mexFunction(
+    int           nlhs,           /* number of expected outputs */
+    mxArray       *plhs[],        /* array of pointers to output arguments */
+    int           nrhs,           /* number of inputs */
+    const mxArray *prhs[]         /* array of pointers to input arguments */
+)
+
+{
+	int k;
+	const mxArray	*arg;
+	HDRTYPE		*hdr;
+	size_t 		count;
+	time_t 		T0;
+	char 		*FileName;  
+	char 		tmpstr[128];  
+	int 		status; 
+	int		CHAN = 0;
+	double		*ChanList=NULL;
+	int		NS = -1;
+	void 		*data = NULL;
+	mxArray *p = NULL, *p1 = NULL, *p2 = NULL;
+
+#ifdef CHOLMOD_H
+	cholmod_sparse RR,*rr=NULL;
+	double dummy;
+#endif 
+
+// ToDO: output single data 
+//	mxClassId	FlagMXclass=mxDOUBLE_CLASS;
+	
+
+	if (nrhs<1) {
+		mexPrintf("   Usage of mexSSAVE:\n");
+		mexPrintf("\tstatus=mexSSAVE(HDR,data)\n");
+		mexPrintf("   Input:\n\tHDR\tHeader structure \n");
+		mexPrintf("\tdata\tdata matrix, one channel per column\n");
+		mexPrintf("\tHDR\theader structure\n\n");
+		mexPrintf("\tstatus 0: file saves successfully\n\n");
+		mexPrintf("\tstatus <>0: file could not saved\n\n");
+		mexPrintf("   Chunked writing (GDF, EDF, BDF):\n");
+		mexPrintf("\th = mexSSAVE('open',HDR)\n");
+		mexPrintf("\tmexSSAVE('append',h,data [,EVENT])\n");
+		mexPrintf("\tstatus = mexSSAVE('close',h)\n");
+		mexPrintf("\tdata\tHDR.SPR*n rows, one channel per column\n");
+		mexPrintf("\tEVENT\tstruct with fields POS, TYP [, DUR, CHN] of events to be appended (GDF only)\n");
+		mexPrintf("\tNRec (and for GDF, the event table) are written when the file is closed.\n\n");
+		return; 
+	}
+
+	if (mxIsChar(prhs[0])) {
+		ssave_chunked(nlhs, plhs, nrhs, prhs);
+		return;
+	}
+
+/*
+ 	improve checks for input arguments
+*/
+	/* process input arguments */
+	if (mxIsNumeric(prhs[1]) &&
+	    mxIsStruct( prhs[0])) {
+		data      = (void*) mxGetData(prhs[1]);
+		// get number of channels
+		size_t NS = mxGetN (prhs[1]);
+		// get number of events
+		size_t NEvt = mxNumberOfEvents(prhs[0]);
+
+		// allocate memory for header structure
+		hdr       = constructHDR (NS, NEvt);
+		data      = (biosig_data_type*) mxGetData (prhs[1]);
+		hdr->NRec = mxGetM (prhs[1]);
+		hdr->SPR  = 1;
+	}
+	else {
+		mexErrMsgTxt("mexSSAVE(HDR,data) failed because HDR and data, are not a struct and numeric, resp.\n");	
+		return; 
+	}	
+
+
+	mxOptions2hdr(hdr, 2, nrhs, prhs);
+
+	/***** SET INPUT ARGUMENTS *****/
+#ifdef CHOLMOD_H
+	hdr->FLAG.ROW_BASED_CHANNELS = (rr!=NULL); 
+#else 	
+	hdr->FLAG.ROW_BASED_CHANNELS = 0; 
+#endif 
+
+
+	if (VERBOSE_LEVEL>7) mexPrintf("110: input arguments checked\n");
+
+	FileName = mx2hdr(prhs[0], hdr, mxGetM(prhs[1]));
+
 	hdr = sopen(FileName, "w", hdr);
 	if (serror2(hdr)) mexErrMsgTxt("mexSSAVE: sopen failed \n");	
 
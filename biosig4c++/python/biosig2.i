@@ -49,6 +49,11 @@ HDRTYPE* constructHDR(const unsigned NS, const unsigned N_EVENT);
 void 	 destructHDR(HDRTYPE* hdr);
 /* 	destroys the header *hdr and frees allocated memory
  --------------------------------------------------------------- */
+HDRTYPE* sopen(const char* FileName, const char* MODE, HDRTYPE* hdr);
+int 	sclose(HDRTYPE* hdr);
+/* 	opens and closes a file, data is read with sread (see sread_numpy.i)
+ --------------------------------------------------------------- */
+%include "sread_numpy.i"
 
 /* =============================================================
 	setter and getter functions for accessing fields of HDRTYPE
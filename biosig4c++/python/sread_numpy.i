@@ -0,0 +1,324 @@
+/*
+
+    Copyright (C) 2008-2013 Alois Schloegl <alois.schloegl@gmail.com>
+    This file is part of the "BioSig for C/C++" repository
+    (biosig4c++) at http://biosig.sf.net/
+
+
+    BioSig is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+// sread_numpy.i - NumPy interface of sread, included by swig.i and biosig2.i
+
+/*
+	data = sread(start, length, hdr [, out])
+
+	reads <length> blocks starting at block <start>. The result is a
+	2-dim array with one row per selected channel (OnOff), or per
+	re-referenced channel (RerefCHANNEL), and length*SPR columns (less
+	at the end of the file).
+
+	Without <out>, the data block allocated by sread is handed over
+	to the returned float64 array, no copy is made. hdr->data.block
+	is released from the header, so the array stays valid after
+	sclose/destructHDR.
+
+	<out> is a preallocated, C-contiguous and writeable array of
+	shape (number of selected channels, N) with N >= length*SPR.
+	Supported dtypes are
+		float64	calibrated data, decoded directly into <out>
+		float32	calibrated data
+		int16	uncalibrated (digital) values, saturated to
+			[-32768,32767]; NaN (e.g. overflow) becomes -32768.
+			Use CHANNEL[k].Cal and .Off for scaling.
+	float32 and int16 are converted in chunks of about 1 MByte,
+	so the memory overhead does not depend on <length>.
+	The returned array is a view of the filled part of <out>.
+
+	The GIL is released while sread decodes, so different files can be
+	read concurrently from Python threads. A single hdr must not be
+	used by more than one thread at a time.
+
+	nch, spr, nrec = sread_info(hdr)
+	number of selected channels, samples per block and number of blocks.
+ */
+
+%rename(sread) sread_numpy;
+PyObject* sread_numpy(size_t start, size_t length, HDRTYPE* hdr, PyObject *out = NULL);
+%rename(sread_info) sread_numpy_info;
+PyObject* sread_numpy_info(HDRTYPE* hdr);
+
+%{
+	static void sread_numpy_free(PyObject *capsule)
+	{
+		free(PyCapsule_GetPointer(capsule, NULL));
+	}
+
+	static PyObject* sread_numpy_error(HDRTYPE *hdr)
+	{
+		PyErr_SetString(PyExc_RuntimeError, hdr->AS.B4C_ERRMSG ? hdr->AS.B4C_ERRMSG : "sread failed");
+		return NULL;
+	}
+
+	/* view of the first <cols> columns of <out> */
+	static PyObject* sread_numpy_view(PyArrayObject *out, npy_intp cols)
+	{
+		npy_intp dims[2];
+		PyObject *view;
+
+		dims[0] = PyArray_DIM(out, 0);
+		dims[1] = cols;
+		Py_INCREF(PyArray_DESCR(out));
+		view = PyArray_NewFromDescr(&PyArray_Type, PyArray_DESCR(out), 2, dims,
+			PyArray_STRIDES(out), PyArray_DATA(out), NPY_ARRAY_CARRAY, NULL);
+		if (view == NULL) return NULL;
+		Py_INCREF(out);
+		if (PyArray_SetBaseObject((PyArrayObject*)view, (PyObject*)out) < 0) {
+			Py_DECREF(view);
+			return NULL;
+		}
+		return view;
+	}
+
+	PyObject* sread_numpy_info(HDRTYPE* hdr)
+	{
+		size_t k, NS;
+		for (k = 0, NS = 0; k < hdr->NS; ++k)
+			if (hdr->CHANNEL[k].OnOff) ++NS;
+		if (hdr->REREF != NULL) NS = hdr->REREF->nrow;
+		return Py_BuildValue("(nnL)", (Py_ssize_t)NS, (Py_ssize_t)hdr->SPR, (long long)hdr->NRec);
+	}
+
+	PyObject* sread_numpy(size_t start, size_t length, HDRTYPE* hdr, PyObject *out)
+	{
+		npy_intp dims[2];
+		PyArrayObject *arr;
+		PyObject *capsule;
+		size_t count, NS, SPR = hdr->SPR, k, k1;
+		biosig_data_type *data;
+
+		hdr->FLAG.ROW_BASED_CHANNELS = 0;
+
+		if (sizeof(biosig_data_type) != sizeof(double)) {
+			PyErr_SetString(PyExc_TypeError, "sread: biosig_data_type is not double");
+			return NULL;
+		}
+
+		for (k = 0, NS = 0; k < hdr->NS; ++k)
+			if (hdr->CHANNEL[k].OnOff) ++NS;
+		if (hdr->REREF != NULL) NS = hdr->REREF->nrow;	// re-referenced channels
+
+		if (start < (size_t)hdr->NRec && length > hdr->NRec - start)
+			length = hdr->NRec - start;
+
+		if (out == NULL || out == Py_None) {
+			/* hand over hdr->data.block to a new array */
+			Py_BEGIN_ALLOW_THREADS
+			count = sread(NULL, start, length, hdr);
+			Py_END_ALLOW_THREADS
+			if (hdr->AS.B4C_ERRNUM) return sread_numpy_error(hdr);
+			if (count == 0 || hdr->data.block == NULL) {
+				dims[0] = NS;
+				dims[1] = 0;
+				return PyArray_SimpleNew(2, dims, NPY_DOUBLE);
+			}
+			dims[0] = hdr->data.size[1];
+			dims[1] = hdr->data.size[0];
+			arr = (PyArrayObject*)PyArray_SimpleNewFromData(2, dims, NPY_DOUBLE, hdr->data.block);
+			if (arr == NULL) return NULL;
+			capsule = PyCapsule_New(hdr->data.block, NULL, NULL);
+			/* PyArray_SetBaseObject steals the reference to capsule, also on failure */
+			if (capsule == NULL || PyArray_SetBaseObject(arr, capsule) < 0) {
+				Py_DECREF(arr);
+				return NULL;
+			}
+			PyCapsule_SetDestructor(capsule, sread_numpy_free);
+			/* the block of data is now owned by the array, destructHDR should not destroy it */
+			hdr->data.block   = NULL;
+			hdr->data.size[0] = 0;
+			hdr->data.size[1] = 0;
+			return (PyObject*)arr;
+		}
+
+		if (!PyArray_Check(out)) {
+			PyErr_SetString(PyExc_TypeError, "sread: out must be a numpy.ndarray");
+			return NULL;
+		}
+		arr = (PyArrayObject*)out;
+		if (!PyArray_ISCARRAY(arr) || PyArray_NDIM(arr) != 2) {
+			PyErr_SetString(PyExc_ValueError, "sread: out must be a C-contiguous, writeable 2-dim array");
+			return NULL;
+		}
+		if ((size_t)PyArray_DIM(arr, 0) != NS || (size_t)PyArray_DIM(arr, 1) < length * SPR) {
+			PyErr_Format(PyExc_ValueError, "sread: out must have shape (%u, >=%u)", (unsigned)NS, (unsigned)(length * SPR));
+			return NULL;
+		}
+		size_t N = PyArray_DIM(arr, 1);
+		int type = PyArray_TYPE(arr);
+
+		if (type == NPY_DOUBLE) {
+			/* decode directly into out; sread uses count*SPR as row length */
+			data  = (biosig_data_type*)PyArray_DATA(arr);
+			Py_BEGIN_ALLOW_THREADS
+			count = sread(data, start, length, hdr);
+			if (count * SPR < N && !hdr->AS.B4C_ERRNUM)
+				for (k = NS; k-- > 1; )
+					memmove(data + k * N, data + k * count * SPR, count * SPR * sizeof(*data));
+			Py_END_ALLOW_THREADS
+			if (hdr->AS.B4C_ERRNUM) return sread_numpy_error(hdr);
+			return sread_numpy_view(arr, count * SPR);
+		}
+
+		if (type != NPY_FLOAT && type != NPY_SHORT) {
+			PyErr_SetString(PyExc_TypeError, "sread: dtype of out must be float64, float32 or int16");
+			return NULL;
+		}
+
+		/* convert in chunks through hdr->data.block */
+		char UCAL = hdr->FLAG.UCAL;
+		if (type == NPY_SHORT) hdr->FLAG.UCAL = 1;
+		size_t chunk = (1<<17) / (NS * SPR + 1) + 1;
+		size_t pos = 0;
+		for (k1 = 0; k1 < length; k1 += count) {
+			Py_BEGIN_ALLOW_THREADS
+			count = sread(NULL, start + k1, chunk < length - k1 ? chunk : length - k1, hdr);
+			Py_END_ALLOW_THREADS
+			if (hdr->AS.B4C_ERRNUM) {
+				hdr->FLAG.UCAL = UCAL;
+				return sread_numpy_error(hdr);
+			}
+			if (count == 0) break;
+			if ((size_t)hdr->data.size[1] != NS) {
+				hdr->FLAG.UCAL = UCAL;
+				PyErr_Format(PyExc_ValueError, "sread: out must have %u rows", (unsigned)hdr->data.size[1]);
+				return NULL;
+			}
+			size_t n = hdr->data.size[0];
+			data = hdr->data.block;
+			Py_BEGIN_ALLOW_THREADS
+			for (k = 0; k < NS; ++k) {
+				const biosig_data_type *src = data + k * n;
+				size_t i;
+				switch (type) {
+				case NPY_FLOAT: {
+					float *dst = (float*)PyArray_DATA(arr) + k * N + pos;
+					for (i = 0; i < n; i++) dst[i] = (float)src[i];
+					break;
+				}
+				case NPY_SHORT: {
+					int16_t *dst = (int16_t*)PyArray_DATA(arr) + k * N + pos;
+					for (i = 0; i < n; i++) {
+						double v = src[i];
+						if (v != v)             dst[i] = INT16_MIN;
+						else if (v <= INT16_MIN) dst[i] = INT16_MIN;
+						else if (v >= INT16_MAX) dst[i] = INT16_MAX;
+						else                     dst[i] = (int16_t)lrint(v);
+					}
+					break;
+				}
+				}
+			}
+			Py_END_ALLOW_THREADS
+			pos += n;
+		}
+		hdr->FLAG.UCAL = UCAL;
+		return sread_numpy_view(arr, pos);
+	}
+%}
+
+
+/*
+	for pos, data in iread(hdr, window [, step, start, stop, dtype, prefetch]):
+	for pos, data in iepochs(hdr, positions, pre, post [, dtype, prefetch]):
+
+	generators yielding windows of <window> samples every <step> samples
+	(iread), or epochs [p-pre, p+post) around sample positions p, e.g.
+	event positions (iepochs; epochs that do not fit into the recording
+	are skipped). <pos> is the first sample of <data>, data has shape
+	(number of selected channels, window).
+
+	The next <prefetch> windows are read by a background thread while
+	the caller works on the current one. The data is decoded into
+	prefetch+1 buffers that are allocated once and reused: <data> is
+	only valid until the next iteration, copy it to keep it. hdr must
+	not be used otherwise until the generator is exhausted or closed.
+ */
+%pythoncode %{
+def iread(hdr, window, step=None, start=0, stop=None, dtype='float64', prefetch=1):
+    nch, spr, nrec = sread_info(hdr)
+    if step is None:
+        step = window
+    if stop is None:
+        stop = nrec * spr
+    spans = range(start, stop - window + 1, step)
+    return _iread_spans(hdr, spans, window, dtype, prefetch)
+
+def iepochs(hdr, positions, pre, post, dtype='float64', prefetch=1):
+    spans = (int(p) - pre for p in positions)
+    return _iread_spans(hdr, spans, pre + post, dtype, prefetch)
+
+def _iread_spans(hdr, spans, n, dtype, prefetch):
+    import threading
+    import numpy
+    try:
+        import queue
+    except ImportError:
+        import Queue as queue
+
+    nch, spr, nrec = sread_info(hdr)
+    nblk = (n + 2 * spr - 2) // spr    # max. number of blocks covering n samples
+    free, ready = queue.Queue(), queue.Queue()
+    for k in range(prefetch + 1):
+        free.put(numpy.empty((nch, nblk * spr), dtype))
+    done = threading.Event()
+
+    def producer():
+        try:
+            for pos in spans:
+                if pos < 0 or pos + n > nrec * spr:
+                    continue
+                buf = free.get()
+                if done.is_set():
+                    return
+                b0 = pos // spr
+                b1 = (pos + n + spr - 1) // spr
+                x = sread(b0, b1 - b0, hdr, buf)
+                ready.put((pos, buf, x[:, pos - b0 * spr : pos - b0 * spr + n]))
+        except Exception as e:
+            ready.put((None, None, e))
+            return
+        ready.put(None)
+
+    t = threading.Thread(target=producer)
+    t.daemon = True
+    t.start()
+    buf = None
+    try:
+        while True:
+            if buf is not None:
+                free.put(buf)
+            item = ready.get()
+            if item is None:
+                break
+            pos, buf, x = item
+            if buf is None:
+                raise x
+            yield pos, x
+    finally:
+        done.set()
+        free.put(None)
+        t.join()
+%}
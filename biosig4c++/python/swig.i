@@ -265,7 +265,7 @@ HDRTYPE* constructHDR(const unsigned NS, const unsigned N_EVENT);
 void 	 destructHDR(HDRTYPE* hdr);
 HDRTYPE* sopen(const char* FileName, const char* MODE, HDRTYPE* hdr);
 int 	sclose(HDRTYPE* hdr);
-size_t	sread(biosig_data_type* data, size_t start, size_t length, HDRTYPE* hdr);
+// sread is provided by sread_numpy.i
 size_t  swrite(const biosig_data_type *data, size_t nelem, HDRTYPE* hdr);
 int	seof(HDRTYPE* hdr);
 void	srewind(HDRTYPE* hdr);
@@ -307,37 +307,7 @@ int sclose(HDRTYPE *hdr);
 %}
 */
 
-PyObject* sread(size_t start, size_t length, HDRTYPE* hdr);
-%{
-	PyObject* sread(size_t start, size_t length, HDRTYPE* hdr)
-	{
-		int i;
-		npy_intp dims[2];
-		PyArrayObject *_array;
-		size_t count;
-
-		dims[0] = 0;
-		dims[1] = length * hdr->SPR;
-		for(i = 0; i < hdr->NS; ++i)
-			if(hdr->CHANNEL[i].OnOff)
-				++dims[0];
-
-		hdr->FLAG.ROW_BASED_CHANNELS = 0;
-
-		if(sizeof(biosig_data_type) != sizeof(double))
-			return NULL;
-
-		/* create the NumPy array and copy the data into it */
-		_array = (PyArrayObject *)PyArray_SimpleNew(2, dims, PyArray_DOUBLE);
-		count = sread((double*)(_array->data), start, length, hdr);
-
-		/* the block of data is now owned by _array, destructHDR should not destroy it */
-		hdr->data.block = NULL;
-
-		/* if(count != length) {} */
-		return PyArray_Return(_array);
-        }
-%}
+%include "sread_numpy.i"
 
 void serror();
 %{
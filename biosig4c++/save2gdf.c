@@ -31,8 +31,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
 #include "biosig-dev.h"
 
+#ifdef WITH_PTHREAD
+#include <pthread.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif 
@@ -45,6 +53,653 @@ int savelink(const char* filename);
 void sopen_pdp_read(HDRTYPE *hdr);
 #endif
 
+#define DEFAULT_MEMORY_BUDGET	64	/* memory for one chunk of data in streaming mode [MiB] */
+
+/*
+	The header parsers and writers of libbiosig are not re-entrant (e.g. they
+	use strtok and gdf_time2tm_time), therefore SOPEN and SCLOSE are serialized
+	in batch mode. SREAD and SWRITE run concurrently on separate HDRs.
+*/
+#ifdef _PTHREAD_H
+static pthread_mutex_t mutexHeader = PTHREAD_MUTEX_INITIALIZER;
+#endif
+static void lock_header() {
+#ifdef _PTHREAD_H
+	pthread_mutex_lock(&mutexHeader);
+#endif
+}
+static void unlock_header() {
+#ifdef _PTHREAD_H
+	pthread_mutex_unlock(&mutexHeader);
+#endif
+}
+
+/*
+	--stats: report of the I/O and decoding counters of the source file,
+	written to stderr in order to keep the header dump on stdout unchanged.
+*/
+static void fprintf_stats(FILE *fid, const HDRTYPE *hdr) {
+	const HDRSTATS_TYPE *S = &hdr->STATS;
+	double t = S->t_header + S->t_events + S->t_io + S->t_decode;
+	fprintf(fid,"save2gdf stats: %s (%s)\n", hdr->FileName, GetFileTypeString(hdr->TYPE));
+	fprintf(fid,"  bytes read      %12llu\n", (unsigned long long)S->bytes_read);
+	fprintf(fid,"  read calls      %12llu\n", (unsigned long long)S->read_calls);
+	fprintf(fid,"  seek calls      %12llu\n", (unsigned long long)S->seek_calls);
+	fprintf(fid,"  cache hits      %12llu\n", (unsigned long long)S->cache_hits);
+	fprintf(fid,"  cache misses    %12llu\n", (unsigned long long)S->cache_misses);
+	fprintf(fid,"  records decoded %12llu\n", (unsigned long long)S->records_decoded);
+	fprintf(fid,"  t_header   %10.6f s\n", S->t_header);
+	fprintf(fid,"  t_events   %10.6f s\n", S->t_events);
+	fprintf(fid,"  t_io       %10.6f s\n", S->t_io);
+	fprintf(fid,"  t_decode   %10.6f s\n", S->t_decode);
+	fprintf(fid,"  total      %10.6f s (%.1f MB/s)\n", t, t>0 ? S->bytes_read*1e-6/t : 0.0);
+}
+
+/*
+	select the data type (and scaling) of a target channel, based on the range
+	[MinValue, MaxValue] of the data. Returns 0 if the conversion from
+	SOURCE_TYPE to TARGET_TYPE is not tested, and 1 otherwise.
+	SCP_ECG is handled by the caller, because it needs to rescale the data.
+*/
+static char set_target_datatype(CHANNEL_TYPE *hc, double MaxValue, double MinValue, char ucal, enum FileFormat SOURCE_TYPE, enum FileFormat TARGET_TYPE) {
+
+	double MaxValueF, MinValueF, MaxValueD, MinValueD;
+	if (!ucal) {
+		MaxValueF = MaxValue;
+		MinValueF = MinValue;
+		MaxValueD = (MaxValue - hc->Off) / hc->Cal;
+		MinValueD = (MinValue - hc->Off) / hc->Cal;
+	}
+	else {
+		MaxValueF = MaxValue * hc->Cal + hc->Off;
+		MinValueF = MinValue * hc->Cal + hc->Off;
+		MaxValueD = MaxValue;
+		MinValueD = MinValue;
+	}
+
+	if ((SOURCE_TYPE==alpha) && (hc->GDFTYP==(255+12)) && (TARGET_TYPE==GDF))
+		// 12 bit into 16 bit
+		; //hc->GDFTYP = 3;
+	else if ((SOURCE_TYPE==ETG4000) && (TARGET_TYPE==GDF)) {
+		hc->GDFTYP  = 16;
+		hc->PhysMax = MaxValueF;
+		hc->PhysMin = MinValueF;
+		hc->DigMax  = MaxValueD;
+		hc->DigMin  = MinValueD;
+	}
+/* TODO: check whether this is really needed - was probably just a workaround for another bug
+
+	else if ((SOURCE_TYPE==GDF) && (TARGET_TYPE==GDF))
+		;
+	else if (SOURCE_TYPE==HEKA)
+		;
+	else if (SOURCE_TYPE==ABF)
+		;
+*/
+	else if (TARGET_TYPE==EDF) {
+		hc->GDFTYP = 3;
+		hc->DigMax = ldexp(1.0,15)-1.0;
+		hc->DigMin = -hc->DigMax;
+		hc->PhysMax = MaxValueF;
+		hc->PhysMin = MinValueF;
+		hc->Cal = (hc->PhysMax - hc->PhysMin) / (hc->DigMax - hc->DigMin);
+		hc->Off = hc->PhysMin - hc->DigMin * hc->Cal;
+	}
+	else if ((hc->GDFTYP<10 ) && (TARGET_TYPE==GDF || TARGET_TYPE==CFWB)) {
+		/* heuristic to determine optimal data type */
+
+		if (VERBOSE_LEVEL > 7) fprintf(stdout,"%s (line %i): %i %f %f %f %f %f %f\n",__FILE__,__LINE__,(int)ucal,MinValue,MaxValue,MinValueF,MaxValueF,MinValueD,MaxValueD);
+
+		if ((MaxValueD <= 127) && (MinValueD >= -128))
+			hc->GDFTYP = 1;
+		else if ((MaxValueD <= 255.0) && (MinValueD >= 0.0))
+			hc->GDFTYP = 2;
+		else if ((MaxValueD <= ldexp(1.0,15)-1.0) && (MinValueD >= ldexp(-1.0,15)))
+			hc->GDFTYP = 3;
+		else if ((MaxValueD <= ldexp(1.0,16)-1.0) && (MinValueD >= 0.0))
+			hc->GDFTYP = 4;
+		else if ((MaxValueD <= ldexp(1.0,31)-1.0) && (MinValueD >= ldexp(-1.0,31)))
+			hc->GDFTYP = 5;
+		else if ((MaxValueD <= ldexp(1.0,32)-1.0) && (MinValueD >= 0.0))
+			hc->GDFTYP = 6;
+	}
+	else {
+		return 0;
+	}
+	return 1;
+}
+
+/*
+	make block size as small as possible, returns the factor
+	by which the number of records has been increased
+*/
+static uint32_t reduce_blocksize(HDRTYPE *hdr, enum FileFormat TARGET_TYPE) {
+	uint16_t k;
+	uint32_t asGCD=hdr->SPR;
+	for (k=0; k<hdr->NS; k++)
+		if (hdr->CHANNEL[k].OnOff && hdr->CHANNEL[k].SPR)
+			asGCD = gcd(asGCD, hdr->CHANNEL[k].SPR);
+	if (TARGET_TYPE==EDF) {
+		double d = asGCD / hdr->SampleRate;
+		if (d==ceil(d)) asGCD = d; 	// make block duration 1 second
+	}
+	hdr->SPR  /= asGCD;
+	hdr->NRec *= asGCD;
+	for (k=0; k<hdr->NS; k++)
+		hdr->CHANNEL[k].SPR /= asGCD;
+	return asGCD;
+}
+
+/*
+	returns a copy of HDR that is used for writing the target file, while
+	HDR remains open for reading the source file. CHANNEL is duplicated,
+	because the data types and block sizes of the target might change;
+	the event table and other referenced memory is shared with HDR and
+	must be released with free_target_hdr() before HDR is destructed.
+*/
+static HDRTYPE* clone_target_hdr(HDRTYPE *hdr) {
+	HDRTYPE *hdr2 = (HDRTYPE*)malloc(sizeof(HDRTYPE));
+	if (hdr2 == NULL) return NULL;
+	memcpy(hdr2, hdr, sizeof(HDRTYPE));
+
+	hdr2->CHANNEL = (CHANNEL_TYPE*)malloc(hdr->NS * sizeof(CHANNEL_TYPE));
+	if (hdr2->CHANNEL == NULL) {
+		free(hdr2);
+		return NULL;
+	}
+	memcpy(hdr2->CHANNEL, hdr->CHANNEL, hdr->NS * sizeof(CHANNEL_TYPE));
+
+	memset(&hdr2->FILE, 0, sizeof(hdr2->FILE));
+	hdr2->FileName        = NULL;
+	hdr2->AS.Header       = NULL;
+	hdr2->AS.rawEventData = NULL;
+	hdr2->AS.rawdata      = NULL;
+	hdr2->AS.first        = 0;
+	hdr2->AS.length       = 0;
+	hdr2->AS.auxBUF       = NULL;
+	hdr2->AS.bci2000      = NULL;
+	hdr2->data.block      = NULL;
+	hdr2->data.size[0]    = 0;
+	hdr2->data.size[1]    = 0;
+	hdr2->Calib           = NULL;
+	hdr2->rerefCHANNEL    = NULL;
+	hdr2->REREF           = NULL;
+	return hdr2;
+}
+
+static void free_target_hdr(HDRTYPE *hdr2) {
+	// these are owned by the source HDR
+	hdr2->data.block    = NULL;
+	hdr2->aECG          = NULL;
+	hdr2->ID.Technician = NULL;
+	hdr2->ID.Hospital   = NULL;
+	hdr2->EVENT.POS     = NULL;
+	hdr2->EVENT.TYP     = NULL;
+	hdr2->EVENT.DUR     = NULL;
+	hdr2->EVENT.CHN     = NULL;
+#if (BIOSIG_VERSION >= 10500)
+	hdr2->EVENT.TimeStamp = NULL;
+#endif
+	hdr2->EVENT.CodeDesc  = NULL;
+#if (BIOSIG_VERSION >= 10700)
+	hdr2->SCP.Section12.annotatedECG = NULL;
+#endif
+	destructHDR(hdr2);
+}
+
+/*
+	converts the records [t1, t1+t2) of the source file HDR into DEST.
+	The data is processed in chunks of at most MEMORY bytes (read -> write),
+	so that the memory requirement does not depend on the size of the file.
+	If the target data type depends on the range of the data, an additional
+	pass over the data is used to obtain the minimum and maximum values.
+*/
+static int stream_conversion(HDRTYPE *hdr, const char *dest, enum FileFormat TARGET_TYPE, int COMPRESSION_LEVEL, size_t t1, size_t t2, size_t memory) {
+
+	int status;
+	size_t pos, count, nrec;
+	uint16_t k, k2;
+	enum FileFormat SOURCE_TYPE = hdr->TYPE;
+
+	// number of source records per chunk
+	size_t NS = 0;
+	for (k=0; k<hdr->NS; k++)
+		if (hdr->CHANNEL[k].OnOff) NS++;
+	size_t chunk = memory / (max(NS,1) * hdr->SPR * sizeof(biosig_data_type));
+	if (chunk < 1) chunk = 1;
+
+	if (VERBOSE_LEVEL>7) fprintf(stdout,"%s (line %i): stream conversion [%i,%i] chunk=%i\n",__FILE__,__LINE__,(int)t1,(int)t2,(int)chunk);
+
+	HDRTYPE *hdr2 = clone_target_hdr(hdr);
+	if (hdr2 == NULL) {
+		biosigERROR(hdr, B4C_INSUFFICIENT_MEMORY, "save2gdf: memory allocation failed");
+		return serror2(hdr);
+	}
+	hdr2->TYPE = TARGET_TYPE;
+	if ((hdr2->TYPE==GDF) && (hdr2->VERSION<2)) hdr2->VERSION = 2.0;
+	hdr2->FILE.COMPRESSION = COMPRESSION_LEVEL;
+	hdr2->NRec = t2;
+	uint32_t asGCD = reduce_blocksize(hdr2, TARGET_TYPE);
+
+	//************ identify Max/Min **********
+	double *MaxValue = (double*)malloc(2 * hdr->NS * sizeof(double));
+	double *MinValue = MaxValue + hdr->NS;
+	for (k=0; k < hdr->NS; k++) {
+		MaxValue[k] = NAN;
+		MinValue[k] = NAN;
+	}
+	if ((TARGET_TYPE==EDF) || (TARGET_TYPE==GDF) || (TARGET_TYPE==CFWB)) {
+		for (pos = 0; pos < t2; pos += count) {
+			count = sread(NULL, t1 + pos, min(chunk, t2 - pos), hdr);
+			if (serror2(hdr) || (count==0)) break;
+			size_t N = hdr->data.size[0];
+			for (k=0, k2=0; k<hdr->NS; k++)
+			if (hdr->CHANNEL[k].OnOff && hdr->CHANNEL[k].SPR) {
+				const biosig_data_type *d = hdr->data.block + k2*N;
+				size_t k1;
+				if (pos==0) {
+					MaxValue[k] = d[0];
+					MinValue[k] = d[0];
+				}
+				for (k1=0; k1<N; k1++) {
+					if (MaxValue[k] < d[k1]) MaxValue[k] = d[k1];
+					if (MinValue[k] > d[k1]) MinValue[k] = d[k1];
+				}
+				k2++;
+			}
+		}
+	}
+
+	char FLAG_CONVERSION_TESTED = 1;
+	for (k=0; k<hdr2->NS; k++)
+	if (hdr2->CHANNEL[k].OnOff && hdr2->CHANNEL[k].SPR) {
+		if (!set_target_datatype(hdr2->CHANNEL+k, MaxValue[k], MinValue[k], hdr->FLAG.UCAL, SOURCE_TYPE, TARGET_TYPE))
+			FLAG_CONVERSION_TESTED = 0;
+		if (VERBOSE_LEVEL>7) fprintf(stdout,"#%3d %d [%g %g]\n",k,hdr2->CHANNEL[k].GDFTYP,MinValue[k],MaxValue[k]);
+	}
+	free(MaxValue);
+	if (!FLAG_CONVERSION_TESTED)
+		fprintf(stderr,"Warning SAVE2GDF: conversion from %s to %s not tested\n",GetFileTypeString(SOURCE_TYPE),GetFileTypeString(TARGET_TYPE));
+
+	hdr2->FLAG.ANONYMOUS = 1; 	// no personal names are processed
+
+	/* write file */
+	size_t destlen = strlen(dest);
+	char *tmp = (char*)malloc(destlen+4);
+	strcpy(tmp,dest);
+	if (hdr2->FILE.COMPRESSION)  // add .gz extension to filename
+		strcpy(tmp+destlen,".gz");
+	lock_header();
+	sopen(tmp, "wb", hdr2);
+	unlock_header();
+	free(tmp);
+	if ((status=serror2(hdr2))) {
+		free_target_hdr(hdr2);
+		return status;
+	}
+
+	for (nrec = 0, pos = 0; pos < t2; pos += count) {
+		count = sread(NULL, t1 + pos, min(chunk, t2 - pos), hdr);
+		if ((status=serror2(hdr)) || (count==0)) break;
+
+		hdr2->data.block   = hdr->data.block;
+		hdr2->data.size[0] = hdr->data.size[0];
+		hdr2->data.size[1] = hdr->data.size[1];
+		nrec += swrite(hdr->data.block, count*asGCD, hdr2);
+		if ((status=serror2(hdr2))) break;
+
+		if (VERBOSE_LEVEL>7) fprintf(stdout,"%s (line %i): %i of %i records written\n",__FILE__,__LINE__,(int)(pos+count),(int)t2);
+	}
+
+	if (nrec != (size_t)hdr2->NRec) {
+		fprintf(stderr,"Warning SAVE2GDF: only %i of %i records written\n",(int)nrec,(int)hdr2->NRec);
+		// let sclose fix the number of records in the header
+		if ((TARGET_TYPE==GDF) || (TARGET_TYPE==EDF) || (TARGET_TYPE==BDF))
+			hdr2->NRec = -1;
+	}
+
+	lock_header();
+	sclose(hdr2);
+	unlock_header();
+	if (!status) status = serror2(hdr2);
+	free_target_hdr(hdr2);
+	return status;
+}
+
+/*
+	batch mode: converts a list of files with a pool of worker threads.
+	Each worker uses its own HDR and converts one file at a time with
+	stream_conversion(), so that the memory requirement is bounded by
+	the number of workers times the memory budget.
+*/
+struct batch_t {
+	char		**list;		// source files
+	char		**dest;		// target files, NULL if the name is too long
+	size_t		*same;		// index of an earlier source with the same target, or N
+	size_t		N;		// number of source files
+	size_t		next;		// next file to be converted
+	size_t		nok, nfail;	// number of converted and failed files
+	size_t		ndup;		// number of sources skipped because of a duplicate target
+	double		bytes;		// size of successfully converted source files
+	const char	*pattern;	// output pattern
+	enum FileFormat	TARGET_TYPE;
+	int		COMPRESSION_LEVEL;
+	int		TARGETSEGMENT;
+	size_t		memory;
+#ifdef _PTHREAD_H
+	pthread_mutex_t	mutex;
+#endif
+};
+
+static double wallclock() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+static const char* target_extension(enum FileFormat TARGET_TYPE) {
+	switch (TARGET_TYPE) {
+	case BDF:	  return "bdf";
+	case BrainVision: return "vhdr";
+	case CFWB:	  return "cfwb";
+	case EDF:	  return "edf";
+	case MFER:	  return "mwf";
+	default:	  return "gdf";
+	}
+}
+
+/*
+	expands the output PATTERN for SOURCE into DEST (of size LEN):
+	%b is replaced by the basename of SOURCE without extension,
+	%d by the directory of SOURCE, %x by the extension of the target
+	format, and %% by %.
+	returns 0 on success, and -1 if DEST is too small.
+*/
+static int batch_filename(char *dest, size_t len, const char *pattern, const char *source, enum FileFormat TARGET_TYPE) {
+	const char *base = strrchr(source,'/');
+	size_t dirlen = base ? (size_t)(base - source) : 1;
+	const char *dir = base ? source : ".";
+	base = base ? base+1 : source;
+	const char *ext = strrchr(base,'.');
+	size_t baselen = ext ? (size_t)(ext - base) : strlen(base);
+
+	size_t k = 0;
+	for (; *pattern; pattern++) {
+		const char *s = pattern;
+		size_t n = 1;
+		if (pattern[0]=='%' && pattern[1]) {
+			switch (*(++pattern)) {
+			case 'b': s = base; n = baselen; break;
+			case 'd': s = dir;  n = dirlen;  break;
+			case 'x': s = target_extension(TARGET_TYPE); n = strlen(s); break;
+			case '%': s = pattern; n = 1;    break;
+			default : s = pattern-1; n = 2;
+			}
+		}
+		if (k+n >= len) return -1;
+		memcpy(dest+k, s, n);
+		k += n;
+	}
+	dest[k] = 0;
+	return 0;
+}
+
+static int batch_convert(struct batch_t *B, const char *source, const char *dest) {
+	int status;
+	struct stat s1, s2;
+
+	if (!stat(source, &s1) && !stat(dest, &s2) && (s1.st_dev==s2.st_dev) && (s1.st_ino==s2.st_ino)) {
+		fprintf(stderr,"Error SAVE2GDF: target %s would overwrite source file\n",dest);
+		return B4C_CANNOT_WRITE_FILE;
+	}
+
+	HDRTYPE *hdr = constructHDR(0,0);
+	hdr->FLAG.UCAL = 0;
+	hdr->FLAG.TARGETSEGMENT = B->TARGETSEGMENT;
+
+	lock_header();
+	hdr = sopen(source, "r", hdr);
+	unlock_header();
+
+	if (!hdr->AS.B4C_ERRNUM && (hdr->NRec <= 0))
+		biosigERROR(hdr, B4C_FORMAT_UNSUPPORTED, "number of records unknown - batch mode not supported");
+
+	if (!(status=serror2(hdr))) {
+		sort_eventtable(hdr);
+		hdr->FLAG.OVERFLOWDETECTION = 0;
+		status = stream_conversion(hdr, dest, B->TARGET_TYPE, B->COMPRESSION_LEVEL, 0, hdr->NRec, B->memory);
+	}
+
+	lock_header();
+	destructHDR(hdr);
+	unlock_header();
+	return status;
+}
+
+static void* batch_worker(void *arg) {
+	struct batch_t *B = (struct batch_t*)arg;
+	for (;;) {
+#ifdef _PTHREAD_H
+		pthread_mutex_lock(&B->mutex);
+#endif
+		size_t k = B->next++;
+#ifdef _PTHREAD_H
+		pthread_mutex_unlock(&B->mutex);
+#endif
+		if (k >= B->N) break;
+
+		const char *source = B->list[k];
+		const char *dest = B->dest[k] ? B->dest[k] : "";
+		struct stat st;
+		double bytes = stat(source, &st) ? 0.0 : st.st_size;
+		double t0 = wallclock();
+		int status;
+		if (B->dest[k] == NULL) {
+			fprintf(stderr,"Error SAVE2GDF: target file name too long for %s\n",source);
+			status = B4C_CANNOT_WRITE_FILE;
+		}
+		else if (B->same[k] < B->N) {
+			fprintf(stderr,"Error SAVE2GDF: target %s of %s is also the target of %s - skipped\n",dest,source,B->list[B->same[k]]);
+			status = B4C_CANNOT_WRITE_FILE;
+		}
+		else
+			status = batch_convert(B, source, dest);
+		double dt = wallclock() - t0;
+
+#ifdef _PTHREAD_H
+		pthread_mutex_lock(&B->mutex);
+#endif
+		if (status) {
+			B->nfail++;
+			bytes = 0.0;
+		}
+		else {
+			B->nok++;
+			B->bytes += bytes;
+		}
+		fprintf(stdout,"[%*i/%i] %-4s %s -> %s\t%.1f MB\t%.3f s\t%.1f MB/s\n", (int)(log10(B->N)+1), (int)(k+1), (int)B->N,
+			status ? "FAIL" : "OK", source, dest, bytes*1e-6, dt, dt>0 ? bytes*1e-6/dt : 0.0);
+		fflush(stdout);
+#ifdef _PTHREAD_H
+		pthread_mutex_unlock(&B->mutex);
+#endif
+	}
+	return NULL;
+}
+
+static int cmpstringp(const void *p1, const void *p2) {
+	return strcmp(*(char* const*)p1, *(char* const*)p2);
+}
+
+struct batch_target_t {
+	const char	*dest;
+	size_t		k;
+};
+
+static int cmptarget(const void *p1, const void *p2) {
+	const struct batch_target_t *t1 = (const struct batch_target_t*)p1;
+	const struct batch_target_t *t2 = (const struct batch_target_t*)p2;
+	int c = strcmp(t1->dest, t2->dest);
+	if (c) return c;
+	return (t1->k > t2->k) - (t1->k < t2->k);
+}
+
+/*
+	expands the target names of all sources before any file is written.
+	Sources with the same target name (e.g. a.edf and a.bdf with %b.%x)
+	would be written concurrently into the same file; only the first one
+	in the list is converted, the others are marked in B->same and
+	counted in B->ndup. Target names are compared as strings, different
+	spellings of the same path are not detected.
+	returns 0 on success, or -1 if memory allocation failed.
+*/
+static int batch_targets(struct batch_t *B) {
+	size_t k, k1, n = 0;
+	char dest[1024];
+	B->dest = (char**)calloc(B->N+1, sizeof(char*));
+	B->same = (size_t*)malloc((B->N+1)*sizeof(size_t));
+	struct batch_target_t *T = (struct batch_target_t*)malloc((B->N+1)*sizeof(struct batch_target_t));
+	if (B->dest==NULL || B->same==NULL || T==NULL) {
+		free(T);
+		return -1;
+	}
+	for (k = 0; k < B->N; k++) {
+		B->same[k] = B->N;
+		if (batch_filename(dest, sizeof(dest), B->pattern, B->list[k], B->TARGET_TYPE)) continue;
+		B->dest[k] = strdup(dest);
+		T[n].dest  = B->dest[k];
+		T[n].k     = k;
+		n++;
+	}
+	qsort(T, n, sizeof(*T), cmptarget);
+	for (k = 0; k < n; k = k1) {
+		for (k1 = k+1; (k1 < n) && !strcmp(T[k].dest, T[k1].dest); k1++) {
+			B->same[T[k1].k] = T[k].k;
+			B->ndup++;
+		}
+	}
+	free(T);
+	return 0;
+}
+
+/*
+	SRC is either a directory (all regular files are converted, hidden files
+	are skipped), or a text file containing one file name per line;
+	"-" reads the list from stdin. returns the number of files or -1 on error.
+*/
+static ssize_t batch_list(const char *src, char ***list) {
+	size_t N = 0, M = 16;
+	char **L = (char**)malloc(M*sizeof(char*));
+	struct stat st;
+
+	if (strcmp(src,"-") && !stat(src, &st) && S_ISDIR(st.st_mode)) {
+		DIR *dir = opendir(src);
+		if (dir==NULL) {
+			free(L);
+			return -1;
+		}
+		struct dirent *de;
+		while ((de = readdir(dir)) != NULL) {
+			if (de->d_name[0]=='.') continue;
+			char *fn = (char*)malloc(strlen(src)+strlen(de->d_name)+2);
+			sprintf(fn,"%s/%s",src,de->d_name);
+			if (stat(fn, &st) || !S_ISREG(st.st_mode)) {
+				free(fn);
+				continue;
+			}
+			if (N >= M) L = (char**)realloc(L, (M*=2)*sizeof(char*));
+			L[N++] = fn;
+		}
+		closedir(dir);
+		qsort(L, N, sizeof(char*), cmpstringp);
+	}
+	else {
+		FILE *fid = strcmp(src,"-") ? fopen(src,"r") : stdin;
+		if (fid==NULL) {
+			free(L);
+			return -1;
+		}
+		char line[1024];
+		while (fgets(line, sizeof(line), fid)) {
+			size_t len = strcspn(line,"\r\n");
+			line[len] = 0;
+			if (len==0 || line[0]=='#') continue;
+			if (N >= M) L = (char**)realloc(L, (M*=2)*sizeof(char*));
+			L[N++] = strdup(line);
+		}
+		if (fid != stdin) fclose(fid);
+	}
+	*list = L;
+	return N;
+}
+
+static void batch_free(struct batch_t *B) {
+	size_t k;
+	for (k = 0; k < B->N; k++) {
+		free(B->list[k]);
+		if (B->dest != NULL) free(B->dest[k]);
+	}
+	free(B->list);
+	free(B->dest);
+	free(B->same);
+}
+
+static int batch_conversion(const char *src, const char *pattern, int jobs, enum FileFormat TARGET_TYPE, int COMPRESSION_LEVEL, int TARGETSEGMENT, size_t memory) {
+	struct batch_t B;
+	memset(&B, 0, sizeof(B));
+	ssize_t N = batch_list(src, &B.list);
+	if (N < 0) {
+		fprintf(stderr,"Error SAVE2GDF: cannot read batch list %s\n",src);
+		return B4C_CANNOT_OPEN_FILE;
+	}
+	B.N       = N;
+	B.pattern = pattern;
+	B.TARGET_TYPE = TARGET_TYPE;
+	B.COMPRESSION_LEVEL = COMPRESSION_LEVEL;
+	B.TARGETSEGMENT = TARGETSEGMENT;
+	B.memory  = memory;
+
+	if (batch_targets(&B)) {
+		fprintf(stderr,"Error SAVE2GDF: memory allocation failed\n");
+		batch_free(&B);
+		return B4C_MEMORY_ALLOCATION_FAILED;
+	}
+	if (B.ndup)
+		fprintf(stderr,"Warning SAVE2GDF: %i source files have the same target name as another one and are skipped\n",(int)B.ndup);
+
+	if (jobs < 1) {
+#ifdef _SC_NPROCESSORS_ONLN
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		if (jobs < 1) jobs = 1;
+	}
+	if ((size_t)jobs > B.N) jobs = max(B.N,1);
+
+	double t0 = wallclock();
+#ifdef _PTHREAD_H
+	pthread_mutex_init(&B.mutex, NULL);
+	pthread_t *tid = (pthread_t*)malloc(jobs*sizeof(pthread_t));
+	int k, nt = 0;
+	for (k = 1; k < jobs; k++)
+		if (!pthread_create(tid+nt, NULL, batch_worker, &B)) nt++;
+	batch_worker(&B);
+	for (k = 0; k < nt; k++)
+		pthread_join(tid[k], NULL);
+	free(tid);
+	pthread_mutex_destroy(&B.mutex);
+#else
+	jobs = 1;
+	batch_worker(&B);
+#endif
+	double dt = wallclock() - t0;
+
+	fprintf(stdout,"save2gdf batch: %i files, %i converted, %i failed (%i duplicate targets), %.1f MB in %.3f s (%.1f MB/s, %i jobs)\n",
+		(int)B.N, (int)B.nok, (int)B.nfail, (int)B.ndup, B.bytes*1e-6, dt, dt>0 ? B.bytes*1e-6/dt : 0.0, jobs);
+
+	batch_free(&B);
+	return B.nfail ? B4C_UNSPECIFIC_ERROR : 0;
+}
+
 int main(int argc, char **argv){
     
     HDRTYPE 	*hdr; 
@@ -59,12 +714,15 @@ int main(int argc, char **argv){
     char	FLAG_CSV = 0;
     char	FLAG_JSON = 0; 
     char	FLAG_DYGRAPH = 0; 
+    char	FLAG_STATS = 0;
     char	*argsweep = NULL;
     double	t1=0.0, t2=1.0/0.0;
-#ifdef CHOLMOD_H
+    size_t	MEMORY = (size_t)DEFAULT_MEMORY_BUDGET<<20;
+    char	*BATCH = NULL;
+    const char	*OUTPUT = "%b.%x";
+    int		JOBS = 0;
     char *rrFile = NULL;
     int   refarg = 0;
-#endif 
 	
     for (k=1; k<argc; k++) {
     	if (!strcmp(argv[k],"-v") || !strcmp(argv[k],"--version") ) {
@@ -91,15 +749,21 @@ int main(int argc, char **argv){
 		fprintf(stdout,"   [t0,dt]\n\tstart time and duriation in seconds (do not use any spaces). \n");
 		fprintf(stdout,"\tTHIS FEATURE IS CURRENTLY EXPERIMENTAL !!!\n");
 #endif
-#ifdef CHOLMOD_H
 		fprintf(stdout,"   -r, --ref=MM  \n\trereference data with matrix file MM. \n\tMM must be a 'MatrixMarket matrix coordinate real general' file.\n");
-#endif
 		fprintf(stdout,"   -f=FMT  \n\tconverts data into format FMT\n");
 		fprintf(stdout,"\tFMT must represent a valid target file format\n");
 		fprintf(stdout,"\tCurrently are supported: HL7aECG, SCP_ECG (EN1064), GDF, EDF, BDF, CFWB, BIN, ASCII, ATF, BVA (BrainVision)\n\tas well as HEKA v2 -> ITX\n");
 		fprintf(stdout,"   -CSV  \n\texports data into CSV file\n");
 		fprintf(stdout,"   -DYGRAPH, -f=DYGRAPH  \n\tproduces JSON output for presentation with dygraphs\n");
 		fprintf(stdout,"   -JSON  \n\tshows header and events in JSON format\n");
+		fprintf(stdout,"   --stats\n\treports bytes read, number of read and seek calls, cache hits and misses,\n\trecords decoded, and time spent in header parsing, event table, I/O and decoding (on stderr)\n");
+		fprintf(stdout,"   --memory=#\n\tmemory in MiB used for one chunk of data [default: %i]\n",DEFAULT_MEMORY_BUDGET);
+		fprintf(stdout,"\tbinary target formats (GDF, EDF, BDF, CFWB, MFER, BVA) are converted chunk by chunk\n");
+		fprintf(stdout,"   --batch=SRC\n\tconverts many files; SRC is a directory, or a text file with one file name per line (- for stdin)\n");
+		fprintf(stdout,"\tthe target format must be one of GDF, EDF, BDF, CFWB, MFER, BVA; SOURCE and DEST are not used\n");
+		fprintf(stdout,"   --output=PATTERN\n\tname of the target files in batch mode [default: %%b.%%x]\n");
+		fprintf(stdout,"\t%%b basename of source file without extension, %%d directory of source file, %%x extension of target format\n");
+		fprintf(stdout,"   -j=#, --jobs=#\n\tnumber of files converted in parallel in batch mode [default: number of CPUs]\n");
 		fprintf(stdout,"   -z=#, -z#\n\t# indicates the compression level (#=0 no compression; #=9 best compression, default #=1)\n");
 		fprintf(stdout,"   -s=#\tselect target segment # (in the multisegment file format EEG1100)\n");
 		fprintf(stdout,"   -SWEEP=ne,ng,ns\n\tsweep selection of HEKA/PM files\n\tne,ng, and ns select the number of experiment, the number of group, and the sweep number, resp.\n");
@@ -134,6 +798,8 @@ int main(int argc, char **argv){
 	else if (!strcasecmp(argv[k],"-CSV"))
 		FLAG_CSV = 1;
 
+	else if (!strcmp(argv[k],"--stats"))
+		FLAG_STATS = 1;
 	else if (!strcasecmp(argv[k],"-JSON"))
 		FLAG_JSON = 1;
 
@@ -182,17 +848,35 @@ int main(int argc, char **argv){
 		}	
 	}
 
-#ifdef CHOLMOD_H
     	else if ( !strncmp(argv[k],"-r=",3) || !strncmp(argv[k],"--ref=",6) )	{
     	        // re-referencing matrix
 		refarg = k; 
 	}
-#endif
 
     	else if (!strncmp(argv[k],"-s=",3))  {
     		TARGETSEGMENT = atoi(argv[k]+3);
 	}
 
+    	else if (!strncmp(argv[k],"--memory=",9))  {
+		MEMORY = (size_t)atoi(argv[k]+9)<<20;
+		if (MEMORY==0) {
+			fprintf(stderr,"Error %s: invalid memory size %s\n",argv[0],argv[k]);
+			return(-1);
+		}
+	}
+
+    	else if (!strncmp(argv[k],"--batch=",8))  {
+		BATCH = argv[k]+8;
+	}
+
+    	else if (!strncmp(argv[k],"--output=",9))  {
+		OUTPUT = argv[k]+9;
+	}
+
+    	else if (!strncmp(argv[k],"-j=",3) || !strncmp(argv[k],"--jobs=",7))  {
+		JOBS = atoi(strchr(argv[k],'=')+1);
+	}
+
     	else if (argv[k][0]=='[' && argv[k][strlen(argv[k])-1]==']' && (tmpstr=strchr(argv[k],',')) )  	{
 		t1 = strtod(argv[k]+1,NULL);
 		t2 = strtod(tmpstr+1,NULL);
@@ -209,6 +893,17 @@ int main(int argc, char **argv){
     }
 
 
+	if (BATCH != NULL) {
+		if (!((TARGET_TYPE==GDF) || (TARGET_TYPE==GDF1) || (TARGET_TYPE==EDF) || (TARGET_TYPE==BDF)
+		   || (TARGET_TYPE==CFWB) || (TARGET_TYPE==MFER) || (TARGET_TYPE==BrainVision))
+		   || FLAG_CSV || FLAG_DYGRAPH) {
+			fprintf(stderr,"Error %s: target format not supported in batch mode\n",argv[0]);
+			exit(-1);
+		}
+		tzset();
+		exit(batch_conversion(BATCH, OUTPUT, JOBS, TARGET_TYPE, COMPRESSION_LEVEL, TARGETSEGMENT, MEMORY));
+	}
+
 	source = NULL;
 	dest = NULL;
 
@@ -269,13 +964,11 @@ int main(int argc, char **argv){
 	} 
 	}
 
-#ifdef CHOLMOD_H
 	if (refarg > 0) {
     	        rrFile = strchr(argv[refarg], '=') + 1;
 	        if (RerefCHANNEL(hdr, rrFile, 1))
 	                fprintf(stdout,"error: reading re-ref matrix %s \n",rrFile);
 	} 
-#endif
 
 	if (VERBOSE_LEVEL>7) fprintf(stdout,"%s (line %i): SOPEN-R finished (error %i)\n",__FILE__,__LINE__, hdr->AS.B4C_ERRNUM);
 
@@ -321,23 +1014,28 @@ int main(int argc, char **argv){
     		// hdr->CHANNEL[k].OnOff = 1;	// convert all channels
     	}	
 
-#ifdef CHOLMOD_H
-        int flagREREF = hdr->Calib != NULL && hdr->rerefCHANNEL != NULL;
-#else
-        int flagREREF = 0;
-#endif
+        int flagREREF = hdr->REREF != NULL && hdr->rerefCHANNEL != NULL;
 	hdr->FLAG.OVERFLOWDETECTION = 0;
 	hdr->FLAG.UCAL = hdr->FLAG.UCAL && !flagREREF;
-	hdr->FLAG.ROW_BASED_CHANNELS = flagREREF;
+	hdr->FLAG.ROW_BASED_CHANNELS = 0;
 	
-#ifdef CHOLMOD_H
 	if (VERBOSE_LEVEL>7) 
-		fprintf(stdout,"%s (line %i): %p %p Flag.ReRef=%i\n",__FILE__,__LINE__,hdr->Calib, hdr->rerefCHANNEL,flagREREF);
-#endif
+		fprintf(stdout,"%s (line %i): %p %p Flag.ReRef=%i\n",__FILE__,__LINE__,hdr->REREF, hdr->rerefCHANNEL,flagREREF);
 
 	if (VERBOSE_LEVEL>7) 
 		fprintf(stdout,"%s (line %i): SREAD [%f,%f].\n",__FILE__,__LINE__,t1,t2);
 
+	if ((dest != NULL) && !FLAG_CSV && !FLAG_DYGRAPH && !flagREREF && (hdr->NRec > 0) && strncmp(dest,"bscs://",7)
+	 && ((TARGET_TYPE==GDF) || (TARGET_TYPE==GDF1) || (TARGET_TYPE==EDF) || (TARGET_TYPE==BDF)
+	  || (TARGET_TYPE==CFWB) || (TARGET_TYPE==MFER) || (TARGET_TYPE==BrainVision)) ) {
+		// binary target formats are converted chunk by chunk, memory usage is bounded
+		if (t2+t1 > hdr->NRec) t2 = hdr->NRec - t1;
+		status = stream_conversion(hdr, dest, TARGET_TYPE, COMPRESSION_LEVEL, t1, t2, MEMORY);
+		if (FLAG_STATS) fprintf_stats(stderr, hdr);
+		destructHDR(hdr);
+		exit(status);
+	}
+
 	if (hdr->NRec <= 0) { 
 		// in case number of samples is not known
 		count = sread(NULL, t1, (size_t)-1, hdr);
@@ -358,6 +1056,8 @@ int main(int argc, char **argv){
 		exit(status);
 	};
 
+	if (FLAG_STATS) fprintf_stats(stderr, hdr);
+
 	if (VERBOSE_LEVEL>7) 
 		fprintf(stdout,"\n%s (line %i): SREAD on %s successful [%i,%i].\n",__FILE__,__LINE__,hdr->FileName,(int)hdr->data.size[0],(int)hdr->data.size[1]);
 
@@ -405,37 +1105,23 @@ int main(int argc, char **argv){
     *******************************************/
 
 	if (1) {
-		uint32_t asGCD=hdr->SPR;
-    		for (k=0; k<hdr->NS; k++)
-		    	if (hdr->CHANNEL[k].OnOff && hdr->CHANNEL[k].SPR) 
-				asGCD = gcd(asGCD, hdr->CHANNEL[k].SPR);
-		if (TARGET_TYPE==EDF) {
-			double d = asGCD / hdr->SampleRate;
-			if (d==ceil(d)) asGCD = d; 	// make block duration 1 second	
-		}
-    		hdr->SPR  /= asGCD;
-	    	hdr->NRec *= asGCD;
-	    	for (k=0; k<hdr->NS; k++)
-    			hdr->CHANNEL[k].SPR /= asGCD;
-#ifdef CHOLMOD_H
-		if (hdr->Calib) 
-		    	for (k=0; k<hdr->Calib->ncol; k++)
+		uint32_t asGCD = reduce_blocksize(hdr, TARGET_TYPE);
+		if (hdr->REREF && hdr->rerefCHANNEL)
+		    	for (k=0; k<hdr->REREF->nrow; k++)
 	    			hdr->rerefCHANNEL[k].SPR /= asGCD;
-#endif
     	}
 
    /********************************* 
    	re-referencing
     *********************************/
 
-#ifdef CHOLMOD_H
 	if (VERBOSE_LEVEL>7) fprintf(stdout,"%s (line %i): %p %p\n",__FILE__,__LINE__,hdr->CHANNEL,hdr->rerefCHANNEL);
 
-        if (hdr->Calib && hdr->rerefCHANNEL) {
+        if (hdr->REREF && hdr->rerefCHANNEL) {
 	        if (VERBOSE_LEVEL>6) 
         	        hdr2ascii(hdr,stdout,3);
 
-		hdr->NS = hdr->Calib->ncol; 
+		hdr->NS = hdr->REREF->nrow; 
 
                 free(hdr->CHANNEL);
                 hdr->CHANNEL = hdr->rerefCHANNEL;
@@ -443,15 +1129,13 @@ int main(int argc, char **argv){
 
 	if (VERBOSE_LEVEL>7) fprintf(stdout,"[200-]\n");
 
-        RerefCHANNEL(hdr, NULL, 0);	// clear HDR.Calib und HDR.rerefCHANNEL
+        RerefCHANNEL(hdr, NULL, 0);	// clear HDR.REREF und HDR.rerefCHANNEL
 
 	if (VERBOSE_LEVEL>7) fprintf(stdout,"[200+]\n");
-                hdr->Calib = NULL;
 
 	        if (VERBOSE_LEVEL>6) 
         	        hdr2ascii(hdr,stdout,3);
         } 
-#endif
 
    /********************************* 
    	Write data 
@@ -480,10 +1164,6 @@ int main(int argc, char **argv){
 	
 		double MaxValue;
 		double MinValue;
-		double MaxValueF;
-		double MinValueF;
-		double MaxValueD;
-		double MinValueD;
 		if (hdr->FLAG.ROW_BASED_CHANNELS) {
 			MaxValue = hdr->data.block[k2];
 			MinValue = hdr->data.block[k2];
@@ -506,40 +1186,15 @@ int main(int argc, char **argv){
 		if (!hdr->FLAG.UCAL) {
 			if (PhysMaxValue0 < val) PhysMaxValue0 = val;
 			if (PhysMinValue0 > val) PhysMinValue0 = val;
-			MaxValueF = MaxValue;
-			MinValueF = MinValue;
-			MaxValueD = (MaxValue - hdr->CHANNEL[k].Off) / hdr->CHANNEL[k].Cal;
-			MinValueD = (MinValue - hdr->CHANNEL[k].Off) / hdr->CHANNEL[k].Cal;
 		} 
 		else {
-			MaxValueF = MaxValue * hdr->CHANNEL[k].Cal + hdr->CHANNEL[k].Off;
+			double MaxValueF = MaxValue * hdr->CHANNEL[k].Cal + hdr->CHANNEL[k].Off;
 			if (PhysMaxValue0 < MaxValueF) PhysMaxValue0 = MaxValueF;
-			MinValueF = MinValue * hdr->CHANNEL[k].Cal + hdr->CHANNEL[k].Off;
+			double MinValueF = MinValue * hdr->CHANNEL[k].Cal + hdr->CHANNEL[k].Off;
 			if (PhysMinValue0 > MinValue) PhysMinValue0 = MinValueF;
-			MaxValueD = MaxValue;
-			MinValueD = MinValue;
 		}
 
-		if ((SOURCE_TYPE==alpha) && (hdr->CHANNEL[k].GDFTYP==(255+12)) && (TARGET_TYPE==GDF)) 
-			// 12 bit into 16 bit 
-			; //hdr->CHANNEL[k].GDFTYP = 3;
-		else if ((SOURCE_TYPE==ETG4000) && (TARGET_TYPE==GDF)) {
-			hdr->CHANNEL[k].GDFTYP  = 16;
-			hdr->CHANNEL[k].PhysMax = MaxValueF;
-			hdr->CHANNEL[k].PhysMin = MinValueF;
-			hdr->CHANNEL[k].DigMax  = MaxValueD;
-			hdr->CHANNEL[k].DigMin  = MinValueD;
-		}
-/* TODO: check whether this is really needed - was probably just a workaround for another bug
-		
-		else if ((SOURCE_TYPE==GDF) && (TARGET_TYPE==GDF)) 
-			;
-		else if (SOURCE_TYPE==HEKA)
-			;
-		else if (SOURCE_TYPE==ABF)
-			;
-*/
-		else if (TARGET_TYPE==SCP_ECG && !hdr->FLAG.UCAL) {
+		if (TARGET_TYPE==SCP_ECG && !hdr->FLAG.UCAL) {
 			double scale = PhysDimScale(hdr->CHANNEL[k].PhysDimCode) *1e9;
 			if (hdr->FLAG.ROW_BASED_CHANNELS) {
 				for (k1=0; k1<N; k1++)
@@ -557,34 +1212,7 @@ int main(int argc, char **argv){
 	    		hdr->CHANNEL[k].PhysMax = PhysMax;
 	    		hdr->CHANNEL[k].PhysMin = -PhysMax;
 		}
-		else if (TARGET_TYPE==EDF) {
-	    		hdr->CHANNEL[k].GDFTYP = 3;
-	    		hdr->CHANNEL[k].DigMax = ldexp(1.0,15)-1.0;
-	    		hdr->CHANNEL[k].DigMin = -hdr->CHANNEL[k].DigMax;
-			hdr->CHANNEL[k].PhysMax = MaxValueF;
-			hdr->CHANNEL[k].PhysMin = MinValueF;
-	    		hdr->CHANNEL[k].Cal = (hdr->CHANNEL[k].PhysMax - hdr->CHANNEL[k].PhysMin) / (hdr->CHANNEL[k].DigMax - hdr->CHANNEL[k].DigMin);
-	    		hdr->CHANNEL[k].Off = hdr->CHANNEL[k].PhysMin - hdr->CHANNEL[k].DigMin * hdr->CHANNEL[k].Cal;
-		}
-		else if ((hdr->CHANNEL[k].GDFTYP<10 ) && (TARGET_TYPE==GDF || TARGET_TYPE==CFWB)) {
-			/* heuristic to determine optimal data type */
-
-			if (VERBOSE_LEVEL > 7) fprintf(stdout,"%s (line %i): #%i %i %f %f %f %f %f %f\n",__FILE__,__LINE__,k+1,(int)hdr->FLAG.UCAL,MinValue,MaxValue,MinValueF,MaxValueF,MinValueD,MaxValueD);
-
-			if ((MaxValueD <= 127) && (MinValueD >= -128))
-		    		hdr->CHANNEL[k].GDFTYP = 1;
-			else if ((MaxValueD <= 255.0) && (MinValueD >= 0.0))
-			    	hdr->CHANNEL[k].GDFTYP = 2;
-			else if ((MaxValueD <= ldexp(1.0,15)-1.0) && (MinValueD >= ldexp(-1.0,15)))
-		    		hdr->CHANNEL[k].GDFTYP = 3;
-			else if ((MaxValueD <= ldexp(1.0,16)-1.0) && (MinValueD >= 0.0))
-			    	hdr->CHANNEL[k].GDFTYP = 4;
-			else if ((MaxValueD <= ldexp(1.0,31)-1.0) && (MinValueD >= ldexp(-1.0,31)))
-		    		hdr->CHANNEL[k].GDFTYP = 5;
-			else if ((MaxValueD <= ldexp(1.0,32)-1.0) && (MinValueD >= 0.0))
-		    		hdr->CHANNEL[k].GDFTYP = 6;
-		} 
-		else {
+		else if (!set_target_datatype(hdr->CHANNEL+k, MaxValue, MinValue, hdr->FLAG.UCAL, SOURCE_TYPE, TARGET_TYPE)) {
 			FLAG_CONVERSION_TESTED = 0;
 		}   		
 		
@@ -621,19 +1249,22 @@ int main(int argc, char **argv){
 				fprintf(fid,"\"%s [%s]\"", hc->Label, PhysDim3(hc->PhysDimCode) );
 			}
 		}
+		TEXTBUF_TYPE tb;
+		textbuf_init(&tb, fid, NULL);
 		for (k1 = 0; k1 < hdr->SPR*hdr->NRec; k1++) {
 			flag = 0;
 			for (k2 = 0; k2 < hdr->NS; k2++) {
 				CHANNEL_TYPE *hc = hdr->CHANNEL+k2;
 				if (hc->OnOff) {
-					fprintf(fid,"%c", flag ? SEP : '\n');
+					textbuf_putc(&tb, flag ? SEP : '\n');
 					flag = 1;
 					size_t p = hdr->FLAG.ROW_BASED_CHANNELS ? hdr->data.size[0] * k1 + k2 : hdr->data.size[0] * k2 + k1 ;
-					fprintf(fid,"%g", data[p]);
+					textbuf_double(&tb, data[p]);
 				}
 			}
 		}
-		fprintf(fid,"\n");
+		textbuf_putc(&tb, '\n');
+		textbuf_flush(&tb);
 		if (dest != NULL) fclose(fid);
 	}
 	else if (FLAG_DYGRAPH) {
@@ -644,16 +1275,18 @@ int main(int argc, char **argv){
 		fprintf(fid,",\n\"Data\": [ ");
 		ssize_t k1;
 		size_t k2;
+		TEXTBUF_TYPE tb;
+		textbuf_init(&tb, fid, NULL);
 		for (k1=0; k1 < hdr->SPR * hdr->NRec; k1++) {
-			if (k1>0) fprintf(fid,",\n\t");
-			fprintf(fid,"[");
+			textbuf_puts(&tb, k1>0 ? ",\n\t[" : "[");
 			for (k2=0; k2<hdr->NS; k2++) {
-				if (k2>0) fprintf(fid,", ");
+				if (k2>0) textbuf_puts(&tb, ", ");
 				size_t p = hdr->FLAG.ROW_BASED_CHANNELS ? hdr->data.size[0] * k1 + k2 : hdr->data.size[0] * k2 + k1 ;
-				fprintf(fid,"%g",data[p]);
+				textbuf_double(&tb, data[p]);
 			}
-			fprintf(fid,"]");
+			textbuf_putc(&tb, ']');
 		}
+		textbuf_flush(&tb);
 
 		fprintf(fid," ],\n\"labels\": [ ");
 		for (k2=0; k2<hdr->NS; k2++) {
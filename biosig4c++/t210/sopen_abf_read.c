@@ -51,38 +51,31 @@ EXTERN_C void sread_atf(HDRTYPE* hdr) {
 
 	ifseek(hdr, hdr->HeadLen, SEEK_SET);
 
-	size_t ll;
-	char *line = NULL;
+	LINEBUF_TYPE lb;
+	linebuf_init(&lb, hdr);
+	char *line;
 
 	if (VERBOSE_LEVEL>6) fprintf(stdout,"SREAD ATF\n");
 
 	size_t ln = 0;
-	while (~ifeof(hdr)) {
-		if (line!=NULL) { free(line); line=NULL; }  // allocate line buffer as needed
-		ssize_t nc = getline(&line, &ll, hdr->FILE.FID);
-		if (nc < 0) break;
-
+	while ((line = linebuf_next(&lb, NULL)) != NULL) {
 		if (VERBOSE_LEVEL>8) fprintf(stdout,"SREAD ATF 2 %i\t<%s>\n",(unsigned)ln,line );
 
-		if ((hdr->NRec * hdr->SPR) <= (ln+1) ) {
+		if (line[strspn(line," \t")] == 0) continue;	// skip empty lines
+
+		if ((size_t)(hdr->NRec * hdr->SPR) <= ln) {
 			hdr->NRec = max(1024, ln*2);
 			hdr->AS.rawdata = realloc(hdr->AS.rawdata, hdr->NRec * hdr->SPR * hdr->AS.bpb);
 		}
 
-		if (VERBOSE_LEVEL>8) fprintf(stdout,"SREAD ATF 4 %i\t<%s>\n",(unsigned)ln,line );
-
-		char *str = strtok(line,"\t");
+		char *str = line;
 		typeof(hdr->NS) k;
 		for (k = 0; k < hdr->NS; k++) {
-			*(double*)(hdr->AS.rawdata + ln*hdr->AS.bpb + hdr->CHANNEL[k].bi) = strtod(str, &str);
-			// extract next value
-			//str = strtok(NULL,"\t");
+			*(double*)(hdr->AS.rawdata + ln*hdr->AS.bpb + hdr->CHANNEL[k].bi) = str2double(str, &str);
 		}
-		if (VERBOSE_LEVEL>8) fprintf(stdout,"SREAD ATF 6 %i\t<%s>\n",(unsigned)ln,line );
-
 		ln++;
 	}
-	free(line);
+	linebuf_free(&lb);
 	ifclose(hdr);
 
 	hdr->NRec = ln;
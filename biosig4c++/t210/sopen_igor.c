@@ -723,9 +723,9 @@ void clear_sweepnames(struct sweepnames_t* list) {
 }
 
 void sopen_itx_read (HDRTYPE* hdr) {
-#define IGOR_MAXLENLINE 400
 
-		char line[IGOR_MAXLENLINE+1];
+		LINEBUF_TYPE lb;
+		char *line;
 		char flagData = 0;
 		char flagSupported = 1;
 
@@ -745,20 +745,11 @@ void sopen_itx_read (HDRTYPE* hdr) {
 		*/
 
 		ifseek(hdr,0,SEEK_SET);
-		int c = ifgetc(hdr);  //  read first character
-		while (!ifeof(hdr)) {
+		linebuf_init(&lb, hdr);
+		while ((line = linebuf_next(&lb, NULL)) != NULL) {
 
-	        if (VERBOSE_LEVEL>8)
-                        fprintf(stdout,"%s (line %i) start reading %s,v%4.2f format (%i)\n",__FILE__,__LINE__,GetFileTypeString(hdr->TYPE),hdr->VERSION,(int)iftell(hdr));
-
-			int i = 0;
-			while ( (c != -1) &&  (c != 10) &&  (c != 13) && (i < IGOR_MAXLENLINE) ) {
-				// terminate when any line break occurs
-				line[i++] = c;
-				c = ifgetc(hdr);
-			};
-			line[i] = 0;
-			while (isspace(c)) c = ifgetc(hdr); 	// keep first non-space character of next line in buffer
+			line += strspn(line," \t\f\v");	// skip leading white space and empty lines
+			if (line[0] == 0) continue;
 
 	        if (VERBOSE_LEVEL>8)
                         fprintf(stdout,"\t%s (line %i) <%s> (%i)\n",__FILE__,__LINE__,line,(int)iftell(hdr));
@@ -894,6 +885,8 @@ void sopen_itx_read (HDRTYPE* hdr) {
                 if (VERBOSE_LEVEL>7)
                         fprintf(stdout,"%s (line %i): scaning %s,v%4.2f format (supported: %i)\n",__FILE__,__LINE__,GetFileTypeString(hdr->TYPE),hdr->VERSION,flagSupported);
 
+		linebuf_free(&lb);
+
 		if (!flagSupported) {
 			clear_sweepnames(sweepname_list);
 			biosigERROR(hdr, hdr->AS.B4C_ERRNUM,
@@ -932,16 +925,11 @@ void sopen_itx_read (HDRTYPE* hdr) {
 		*/
 		spr = 0;SPR = 0;
 		ifseek(hdr, 0, SEEK_SET);
-		c = ifgetc(hdr);	// read first character
-		while (!ifeof(hdr)) {
-			int i = 0;
-			while ( (c != -1) &&  (c != 10) &&  (c != 13) && (i < IGOR_MAXLENLINE) ) {
-				// terminate when any line break occurs
-				line[i++] = c;
-				c = ifgetc(hdr);
-			};
-			line[i] = 0;
-			while (isspace(c)) c = ifgetc(hdr); 	// keep first non-space character of next line in buffer
+		linebuf_init(&lb, hdr);
+		while ((line = linebuf_next(&lb, NULL)) != NULL) {
+
+			line += strspn(line," \t\f\v");
+			if (line[0] == 0) continue;
 
 			if (!strncmp(line,"BEGIN",5)) {
 				flagData = 1;
@@ -978,11 +966,12 @@ void sopen_itx_read (HDRTYPE* hdr) {
 				}
 			}
 			else if (flagData) {
-				double val = atof(line);
+				double val = str2double(line, NULL);
 				data[hdr->NS*(SPR + spr) + chanNo] = val;
 				spr++;
 			}
 		}
+		linebuf_free(&lb);
 		clear_sweepnames(sweepname_list);
 		hdr->EVENT.N = sweepNo;
 
@@ -994,7 +983,6 @@ void sopen_itx_read (HDRTYPE* hdr) {
 		hdr->AS.first  = 0;
 		hdr->AS.length = hdr->NRec;
 		hdr->AS.bpb = sizeof(double)*hdr->NS;
-#undef IGOR_MAXLENLINE
 
 }
 
@@ -45,6 +45,7 @@
 %       demo7   simulations for MVAR estimates        
 %       scptest tests loading routine of SCP-ECG data
 % 	bench_biosig    benchmark test based on BioSig4OctMat
+% 	bench_covm      benchmark of the blocked and column-pair kernels of COVM_MEX
 % 
 %
 % T100: [Data Acquistion] 
@@ -0,0 +1,45 @@
+% Benchmark for COVM_MEX
+%  compares the cache-blocked kernel of covm_mex with the column-pair 
+%  loops (option 'untiled') on a 1000 x 1000 and a 10000 x 200 matrix, 
+%  with and without weights, and checks that both give the same result. 
+%  With flag_accuracy_level(0) the results are identical, otherwise the 
+%  blocked kernel uses double-double accumulation and differs only in 
+%  the last bits.
+%
+%  Requirements:
+%  covm_mex from the NaN-toolbox or BIOSIG/t400_Classification 
+
+%    	This is part of the BIOSIG-toolbox http://biosig.sf.net/
+
+% This library is free software; you can redistribute it and/or
+% modify it under the terms of the GNU Library General Public
+% License as published by the Free Software Foundation; either
+% Version 3 of the License, or (at your option) any later version.
+%
+% This library is distributed in the hope that it will be useful,
+% but WITHOUT ANY WARRANTY; without even the implied warranty of
+% MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+% Library General Public License for more details.
+
+SZ  = [1000,1000; 10000,200];
+REP = 3;
+
+fprintf(1,'%-12s %-5s %-4s %12s %12s %8s %10s\n','size','Y','W','untiled[s]','tiled[s]','speedup','max|diff|');
+for k = 1:size(SZ,1),
+	X = randn(SZ(k,:));
+	X(rand(size(X)) < 0.01) = NaN;
+	Y = randn(SZ(k,:));
+	for mode = 1:3, 
+		W = []; 
+		if mode == 2, W = rand(SZ(k,1),1); end;
+		if mode == 3, Yk = Y; else Yk = []; end; 
+		FLAG = logical(0);
+
+		tic; for r = 1:REP, [CC0,NN0] = covm_mex(X, Yk, FLAG, W, 'untiled'); end; t0 = toc/REP;
+		tic; for r = 1:REP, [CC1,NN1] = covm_mex(X, Yk, FLAG, W); end; t1 = toc/REP;
+
+		d = max([abs(CC0(:)-CC1(:)); abs(NN0(:)-NN1(:))]);
+		fprintf(1,'%5i x %-4i  %-5s %-4s %12.3f %12.3f %8.2f %10.3g\n', SZ(k,1), SZ(k,2), ...
+			char('X'*isempty(Yk)+'Y'*~isempty(Yk)), char('-'*isempty(W)+'W'*~isempty(W)), t0, t1, t0/t1, d);
+	end;
+end;
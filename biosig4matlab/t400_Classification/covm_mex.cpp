@@ -26,6 +26,8 @@
 // - Y: [optional], if empty, Y=X; 
 // - flag: if not empty, it is set to 1 if some NaN was observed
 // - W: weight vector to compute weighted correlation 
+// - 'untiled': [optional] use the column-pair loops instead of the cache-blocked kernel,
+//        for comparison and benchmarking 
 //
 // Output:
 // - CC = X' * sparse(diag(W)) * Y 	while NaN's are skipped
@@ -44,10 +46,276 @@
         #include <stdint.h>
 #endif
 #include <math.h>
+#include <string.h>
 #include "mex.h"
 
 /*#define NO_FLAG*/
 
+/*
+	cache-blocked (GEMM-style) kernel 
+
+	The rows of X are processed in panels of COVM_KC rows, and the columns 
+	of X in blocks of COVM_MC columns. Each block is packed so that COVM_MR 
+	neighbouring columns are interleaved (one SIMD vector per row), and 
+	is multiplied with COVM_NR columns of Y at a time; the panel of X and 
+	the COVM_NR columns of Y stay in L1/L2 cache while a tile of 
+	COVM_MR x COVM_NR elements of CC (and NN) is accumulated in registers. 
+	Every element of CC is still a sum over k in sequential order, with 
+	ACC_LEVEL==0 the results are identical to the column-pair loops. 
+	With ACC_LEVEL>0, double-double accumulation is used (TwoSum and 
+	TwoProduct [2]), which is more accurate than long double.  
+
+	[2] T. Ogita, S.M. Rump, S. Oishi, Accurate sum and dot product, 
+	SIAM J. Sci. Comput. 26(6):1955-1988, 2005. 
+*/
+#define COVM_MR	4	// columns of X per tile (SIMD lanes)
+#define COVM_NR	4	// columns of Y per tile
+#define COVM_KC	256	// rows per panel
+#define COVM_MC	128	// columns of X per packed block
+
+#define COVM_TWOSUM(a,b,s,e) { double _a = a, _b = b, _s = _a+_b, _z = _s-_a; \
+	e = (_a-(_s-_z))+(_b-_z); s = _s; }
+
+// rounding error of p=a*b 
+static inline double covm_prod_err(double a, double b, double p) {
+#ifdef __FMA__
+	return fma(a, b, -p);
+#else
+	// Dekker's algorithm, does not rely on FMA 
+	const double c = 134217729.0;	// 2^27+1
+	double t, ah, al, bh, bl;
+	t = c*a; ah = t-(t-a); al = a-ah;
+	t = c*b; bh = t-(t-b); bl = b-bh;
+	return (((ah*bh-p) + ah*bl) + al*bh) + al*bl;
+#endif
+}
+
+/* 
+	micro-kernel: xp points to kc packed rows of COVM_MR columns of X, 
+	y[] to COVM_NR columns of Y, w to kc weights or NULL. 
+	cc, nn, cce, nne are tiles of COVM_MR*COVM_NR elements (column j at j*COVM_MR). 
+	returns 1 if a NaN was skipped. 
+ */
+template <int ACC, int WEIGHTED, int COUNT>
+static char covm_kernel_portable(const double *xp, const double **y, const double *w, size_t kc, double *cc, double *nn, double *cce, double *nne) {
+	char flag = 0;
+	size_t k;
+	int i, j;
+	for (k = 0; k < kc; k++, xp += COVM_MR) 
+	for (j = 0; j < COVM_NR; j++) 
+	for (i = 0; i < COVM_MR; i++) {
+		int ij = i + j*COVM_MR;
+		double z = xp[i]*y[j][k];
+		if (isnan(z)) {
+			flag = 1;
+			continue;
+		}
+		if (!ACC) {
+			cc[ij] += WEIGHTED ? z*w[k] : z;
+			if (COUNT) nn[ij] += WEIGHTED ? w[k] : 1.0;
+		}
+		else {
+			double p = z, ep = covm_prod_err(xp[i], y[j][k], z), e;
+			if (WEIGHTED) {
+				p  = z*w[k];
+				ep = covm_prod_err(z, w[k], p) + ep*w[k];
+			}
+			COVM_TWOSUM(cc[ij], p, cc[ij], e);
+			cce[ij] += e + ep;
+			if (COUNT && WEIGHTED) {
+				COVM_TWOSUM(nn[ij], w[k], nn[ij], e);
+				nne[ij] += e;
+			}
+			else if (COUNT)
+				nn[ij] += 1.0;
+		}
+	}
+	return flag;
+}
+
+#if defined(__x86_64__) && (defined(__clang__) || (defined(__GNUC__) && (__GNUC__*100+__GNUC_MINOR__ >= 409)))
+#define WITH_COVM_AVX2
+#include <immintrin.h>
+
+#define COVM_TWOSUM4(a,b,s,e) { __m256d _a = a, _b = b, _s = _mm256_add_pd(_a,_b), _z = _mm256_sub_pd(_s,_a); \
+	e = _mm256_add_pd(_mm256_sub_pd(_a,_mm256_sub_pd(_s,_z)), _mm256_sub_pd(_b,_z)); s = _s; }
+
+/* 
+	AVX2 version of covm_kernel_portable, one vector holds the COVM_MR 
+	columns of X; skipped elements contribute exact zeros. 
+ */
+template <int ACC, int WEIGHTED, int COUNT>
+__attribute__((target("avx2,fma"))) 
+static char covm_kernel_avx2(const double *xp, const double **y, const double *w, size_t kc, double *cc, double *nn, double *cce, double *nne) {
+	__m256d c[COVM_NR], n[COVM_NR], ce[COVM_NR], ne[COVM_NR];
+	const __m256d one = _mm256_set1_pd(1.0);
+	__m256d allvalid  = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+	size_t k;
+	int j;
+	for (j = 0; j < COVM_NR; j++) {
+		c[j] = _mm256_loadu_pd(cc + j*COVM_MR);
+		if (COUNT) n[j] = _mm256_loadu_pd(nn + j*COVM_MR);
+		if (ACC) ce[j] = _mm256_loadu_pd(cce + j*COVM_MR);
+		if (ACC && COUNT && WEIGHTED) ne[j] = _mm256_loadu_pd(nne + j*COVM_MR);
+	}
+	for (k = 0; k < kc; k++, xp += COVM_MR) {
+		__m256d x = _mm256_loadu_pd(xp);
+		__m256d wk = WEIGHTED ? _mm256_broadcast_sd(w + k) : one;
+		for (j = 0; j < COVM_NR; j++) {
+			__m256d yk = _mm256_broadcast_sd(y[j] + k);
+			__m256d z  = _mm256_mul_pd(x, yk);
+			__m256d v  = _mm256_cmp_pd(z, z, _CMP_ORD_Q);
+			allvalid = _mm256_and_pd(allvalid, v);
+			if (!ACC) {
+				__m256d p = WEIGHTED ? _mm256_mul_pd(z, wk) : z;
+				c[j] = _mm256_add_pd(c[j], _mm256_and_pd(v, p));
+				if (COUNT) n[j] = _mm256_add_pd(n[j], _mm256_and_pd(v, wk));
+			}
+			else {
+				__m256d p = z, ep = _mm256_fmsub_pd(x, yk, z), e;
+				if (WEIGHTED) {
+					p  = _mm256_mul_pd(z, wk);
+					ep = _mm256_add_pd(_mm256_fmsub_pd(z, wk, p), _mm256_mul_pd(ep, wk));
+				}
+				COVM_TWOSUM4(c[j], _mm256_and_pd(v, p), c[j], e);
+				ce[j] = _mm256_add_pd(ce[j], _mm256_add_pd(e, _mm256_and_pd(v, ep)));
+				if (COUNT && WEIGHTED) {
+					COVM_TWOSUM4(n[j], _mm256_and_pd(v, wk), n[j], e);
+					ne[j] = _mm256_add_pd(ne[j], e);
+				}
+				else if (COUNT)
+					n[j] = _mm256_add_pd(n[j], _mm256_and_pd(v, one));
+			}
+		}
+	}
+	for (j = 0; j < COVM_NR; j++) {
+		_mm256_storeu_pd(cc + j*COVM_MR, c[j]);
+		if (COUNT) _mm256_storeu_pd(nn + j*COVM_MR, n[j]);
+		if (ACC) _mm256_storeu_pd(cce + j*COVM_MR, ce[j]);
+		if (ACC && COUNT && WEIGHTED) _mm256_storeu_pd(nne + j*COVM_MR, ne[j]);
+	}
+	return _mm256_movemask_pd(allvalid) != 0x0f;
+}
+#endif
+
+typedef char (*covm_kernel_t)(const double *xp, const double **y, const double *w, size_t kc, double *cc, double *nn, double *cce, double *nne);
+
+template <int ACC, int WEIGHTED, int COUNT>
+static covm_kernel_t covm_kernel_select() {
+#ifdef WITH_COVM_AVX2
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return covm_kernel_avx2<ACC,WEIGHTED,COUNT>;
+#endif
+	return covm_kernel_portable<ACC,WEIGHTED,COUNT>;
+}
+
+/* 
+	CC = X'*diag(W)*Y and NN (if not NULL), NaN's are skipped. 
+	CC and NN must be zero-initialized, if X==Y (and cX==cY) only the 
+	lower triangle is computed and copied to the upper triangle. 
+	returns 1 if a NaN was observed 
+ */
+static char covm_tiled(const double *X, size_t cX, const double *Y, size_t cY, size_t rX, const double *W, double *CC, double *NN, int ACC) {
+	covm_kernel_t kernel;
+	int sym = (X == Y) && (cX == cY);
+	char flag_isNaN = 0;
+	size_t k0, i0, k, i, j;
+
+	if (ACC) {
+		if (W) kernel = NN ? covm_kernel_select<1,1,1>() : covm_kernel_select<1,1,0>();
+		else   kernel = NN ? covm_kernel_select<1,0,1>() : covm_kernel_select<1,0,0>();
+	} else {
+		if (W) kernel = NN ? covm_kernel_select<0,1,1>() : covm_kernel_select<0,1,0>();
+		else   kernel = NN ? covm_kernel_select<0,0,1>() : covm_kernel_select<0,0,0>();
+	}
+
+	// compensation terms of CC and NN for double-double accumulation 
+	double *CCe = ACC ? (double*)mxCalloc(cX*cY, sizeof(double)) : NULL;
+	double *NNe = (ACC && W && NN) ? (double*)mxCalloc(cX*cY, sizeof(double)) : NULL;
+	double *Xp  = (double*)mxMalloc(COVM_KC*(COVM_MC+COVM_MR)*sizeof(double));
+
+	for (k0 = 0; k0 < rX; k0 += COVM_KC) {
+		size_t kc = (rX-k0 < COVM_KC) ? rX-k0 : COVM_KC;
+		for (i0 = 0; i0 < cX; i0 += COVM_MC) {
+			size_t mc = (cX-i0 < COVM_MC) ? cX-i0 : COVM_MC;
+			size_t nt = (mc + COVM_MR - 1) / COVM_MR;
+
+			// pack block of X, missing columns of the last tile are 0 
+			for (i = 0; i < nt*COVM_MR; i++) {
+				double *xp = Xp + (i/COVM_MR)*kc*COVM_MR + (i%COVM_MR);
+				if (i0+i < cX) {
+					const double *x = X + k0 + (i0+i)*rX;
+					for (k = 0; k < kc; k++) xp[k*COVM_MR] = x[k];
+				}
+				else 
+					for (k = 0; k < kc; k++) xp[k*COVM_MR] = 0.0;
+			}
+
+			long jt;
+			#pragma omp parallel for schedule(dynamic)
+			for (jt = 0; jt < (long)((cY + COVM_NR - 1) / COVM_NR); jt++) {
+				size_t j0 = jt*COVM_NR, t, ii, jj;
+				const double *y[COVM_NR];
+				double cc[COVM_MR*COVM_NR], nn[COVM_MR*COVM_NR], cce[COVM_MR*COVM_NR], nne[COVM_MR*COVM_NR];
+				char flag = 0;
+
+				if (sym && (j0 >= i0+mc)) continue;	// upper triangle 
+				// missing columns of the last tile use the last column of Y, their results are discarded 
+				for (jj = 0; jj < COVM_NR; jj++)
+					y[jj] = Y + k0 + ((j0+jj < cY) ? j0+jj : cY-1)*rX;
+
+				for (t = 0; t < nt; t++) {
+					size_t ib = i0 + t*COVM_MR;
+					if (sym && (ib+COVM_MR <= j0)) continue;	// upper triangle 
+
+					for (jj = 0; jj < COVM_NR; jj++)
+					for (ii = 0; ii < COVM_MR; ii++) {
+						size_t ij = ii + jj*COVM_MR, ix = (ib+ii) + (j0+jj)*cX;
+						int valid = (ib+ii < cX) && (j0+jj < cY);
+						cc[ij]  = valid ? CC[ix] : 0.0;
+						nn[ij]  = (valid && NN)  ? NN[ix]  : 0.0;
+						cce[ij] = (valid && CCe) ? CCe[ix] : 0.0;
+						nne[ij] = (valid && NNe) ? NNe[ix] : 0.0;
+					}
+
+					flag |= kernel(Xp + t*kc*COVM_MR, y, W ? W + k0 : NULL, kc, cc, nn, cce, nne);
+
+					for (jj = 0; jj < COVM_NR; jj++)
+					for (ii = 0; ii < COVM_MR; ii++) {
+						size_t ij = ii + jj*COVM_MR, ix = (ib+ii) + (j0+jj)*cX;
+						if ((ib+ii >= cX) || (j0+jj >= cY)) continue;
+						CC[ix] = cc[ij];
+						if (NN)  NN[ix]  = nn[ij];
+						if (CCe) CCe[ix] = cce[ij];
+						if (NNe) NNe[ix] = nne[ij];
+					}
+				}
+#ifndef NO_FLAG
+				if (flag) flag_isNaN = 1;
+#endif 
+			}
+		}
+	}
+	mxFree(Xp);
+
+	if (CCe) {
+		for (i = 0; i < cX*cY; i++) CC[i] += CCe[i];
+		mxFree(CCe);
+	}
+	if (NNe) {
+		for (i = 0; i < cX*cY; i++) NN[i] += NNe[i];
+		mxFree(NNe);
+	}
+	if (sym) {
+		for (j = 0; j < cY; j++)
+		for (i = j+1; i < cX; i++) {
+			CC[j + i*cX] = CC[i + j*cX];
+			if (NN) NN[j + i*cX] = NN[i + j*cX];
+		}
+	}
+	return flag_isNaN;
+}
+
 
 void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const mxArray *PInputs[]) 
 {
@@ -58,13 +326,14 @@ void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const m
     	size_t		rX,cX,rY,cY;
     	size_t    	i; 
 	char	 	flag_isNaN = 0;
-        int             ACC_LEVEL;
+        int             ACC_LEVEL = 0;
+	int		FLAG_UNTILED = 0;
 
 	/*********** check input arguments *****************/
 
 	// check for proper number of input and output arguments
 	if ((PInputCount <= 0) || (PInputCount > 5)) {
-	        mexPrintf("usage: [CC,NN] = covm_mex(X [,Y [,flag [,W [,'E']]]])\n\n");
+	        mexPrintf("usage: [CC,NN] = covm_mex(X [,Y [,flag [,W [,'untiled']]]])\n\n");
 	        mexPrintf("Do not use COVM_MEX directly, use COVM instead. \n");
 /*
 	        mexPrintf("\nCOVM_MEX computes the covariance matrix of real matrices and skips NaN's\n");
@@ -114,6 +383,13 @@ void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const m
 		else 	
 			mexErrMsgTxt("number of elements in W must match numbers of rows in X");
 	}
+
+	// 5th argument 'untiled' selects the column-pair loops instead of the cache-blocked kernel 
+       	if  ((PInputCount > 4) && mxIsChar(PInputs[4]))	{
+		char mode[16];
+		mxGetString(PInputs[4], mode, sizeof(mode));
+		FLAG_UNTILED = !strcmp(mode, "untiled");
+	}
         
 #ifdef __GNUC__
 	ACC_LEVEL = 0;
@@ -208,6 +484,10 @@ void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const m
 	
 #else
 
+   if (!FLAG_UNTILED) {
+	if (covm_tiled(X0, cX, Y0, cY, rX, W, CC, NN, ACC_LEVEL)) flag_isNaN = 1;
+   }
+   else {
    #pragma omp parallel 
    {
 #ifdef __GNUC__
@@ -495,7 +775,7 @@ void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const m
 			cc= t; 
 
 			// nn += W[k]; [1]
-			y = z*W[k]-rn;
+			y = W[k]-rn;
 			t = nn+y;
 			rn= (t-nn)-y;
 			nn= t; 
@@ -567,7 +847,7 @@ void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const m
 			cc= t; 
 
 			// nn += W[k];  [1]
-			y = z*W[k]-rn;
+			y = W[k]-rn;
 			t = nn+y;
 			rn= (t-nn)-y;
 			nn= t; 
@@ -658,7 +938,7 @@ void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const m
 			cc= t; 
 
 			// nn += W[k]; [1]
-			y = z*W[k]-rn;
+			y = W[k]-rn;
 			t = nn+y;
 			rn= (t-nn)-y;
 			nn= t; 
@@ -730,7 +1010,7 @@ void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const m
 			cc= t; 
 
 			// nn += W[k];  [1]
-			y = z*W[k]-rn;
+			y = W[k]-rn;
 			t = nn+y;
 			rn= (t-nn)-y;
 			nn= t; 
@@ -784,6 +1064,7 @@ void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const m
     }
 #endif
    } // end pragma omg parallel 
+   } // end FLAG_UNTILED
    
    
 #ifndef NO_FLAG
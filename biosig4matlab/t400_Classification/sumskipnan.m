@@ -111,8 +111,10 @@ elseif ~isempty(W) && (size(x,DIM)~=numel(W))
 	error('SUMSKIPNAN: size of weight vector does not match size(x,DIM)');
 end; 
 
-%% mex and oct files expect double
-x = double(x);
+%% mex and oct files expect double or single
+if ~isa(x,'single'),
+	x = double(x);
+end;
 
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 % use Matlab-MEX function when available  
@@ -25,9 +25,12 @@
 // 1) long double (80bit) instead of 64-bit double is used internally
 // 2) The Kahan Summation formula is used to reduce the error margin from N*eps to 2*eps 
 //        The latter is only implemented in case of stride=1 (column vectors only, summation along 1st dimension). 
+// Unless compiled with -DSUMSKIPNAN_LONG_DOUBLE, 1) is replaced by double-double 
+// accumulation [2], which is at least as accurate, vectorized (AVX2 if available) 
+// and also supports stride>1 and single precision input. 
 //
 // Input:
-// - x data array
+// - x data array (double or single)
 // - DIM (optional) dimension to sum
 // - flag (optional) is actually an output argument telling whether some NaN was observed
 // - W (optional) weight vector to compute weighted sum (default 1)
@@ -50,6 +53,7 @@
 
 #include <math.h>
 #include <stdint.h>
+#include <string.h>
 #include "mex.h"
 
 inline int __sumskipnan2w__(double *data, size_t Ni, double *s, double *No, char *flag_anyISNAN, double *W);
@@ -60,8 +64,11 @@ inline int __sumskipnan2we__(double *data, size_t Ni, double *s, double *No, cha
 inline int __sumskipnan3we__(double *data, size_t Ni, double *s, double *s2, double *No, char *flag_anyISNAN, double *W);
 inline int __sumskipnan2wer__(double *data, size_t Ni, double *s, double *No, char *flag_anyISNAN, double *W);
 inline int __sumskipnan3wer__(double *data, size_t Ni, double *s, double *s2, double *No, char *flag_anyISNAN, double *W);
+template <class T> inline int __sumskipnan_dd__(const T *data, size_t Ni, double *s, double *s2, double *No, char *flag_anyISNAN, const double *W);
+template <class T> inline int __sumskipnan_dd_stride__(const T *data, size_t D1, size_t D2, double *s, double *se, double *s2, double *s2e, double *No, double *Ne, char *flag_anyISNAN, const double *W);
 
 //#define NO_FLAG
+//#define SUMSKIPNAN_LONG_DOUBLE	// use long double instead of double-double accumulation 
 
 #ifdef tmwtypes_h
   #if (MX_API_VER<=0x07020000)
@@ -73,10 +80,11 @@ inline int __sumskipnan3wer__(double *data, size_t Ni, double *s, double *s2, do
 void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const mxArray *PInputs[]) 
 {
     	const mwSize	*SZ;	    
-    	double* 	LInput;
+    	double* 	LInput = NULL;
+    	float* 		FInput = NULL;	// single precision input
     	double* 	LOutputSum;
-    	double* 	LOutputCount;
-    	double* 	LOutputSum2;
+    	double* 	LOutputCount = NULL;
+    	double* 	LOutputSum2 = NULL;
     	long double* 	LongOutputSum = NULL;
     	long double* 	LongOutputCount = NULL;
     	long double* 	LongOutputSum2 = NULL;
@@ -86,7 +94,6 @@ void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const m
     	mwSize		DIM = 0; 
     	mwSize		D1, D2, D3; 	// NN; 	//  	
     	mwSize    	ND, ND2;	// number of dimensions: input, output
-    	mwSize		ix0, ix1, ix2;	// index to input and output
     	mwSize    	j, l;		// running indices 
     	mwSize 		*SZ2;		// size of output 	    
 	char	 	flag_isNaN = 0;
@@ -100,8 +107,10 @@ void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const m
 	// get 1st argument
 	if(mxIsDouble(PInputs[0]) && !mxIsComplex(PInputs[0]))
 		LInput  = mxGetPr(PInputs[0]);
+	else if(mxIsSingle(PInputs[0]) && !mxIsComplex(PInputs[0]))
+		FInput  = (float*)mxGetData(PInputs[0]);
 	else 	
-		mexErrMsgTxt("First argument must be REAL/DOUBLE.");
+		mexErrMsgTxt("First argument must be REAL/DOUBLE or REAL/SINGLE.");
 
     	// get 2nd argument
     	if  (PInputCount > 1) {
@@ -160,8 +169,10 @@ void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const m
 		int s = mexCallMATLAB(1, &LEVEL, 0, NULL, "flag_accuracy_level");
 		if (!s) {
 			ACC_LEVEL = (int) mxGetScalar(LEVEL);
+#ifdef SUMSKIPNAN_LONG_DOUBLE
 			if ((D1>1) && (ACC_LEVEL>2))
 				mexWarnMsgTxt("Warning: Kahan summation not supported with stride > 1 !");
+#endif
 		}	
 		mxDestroyArray(LEVEL);
 	}
@@ -172,23 +183,29 @@ void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const m
 
 	POutput[0] = mxCreateNumericArray(ND2, SZ2, TYP, mxREAL);
 	LOutputSum = mxGetPr(POutput[0]);
+#ifdef SUMSKIPNAN_LONG_DOUBLE
 	if (D1!=1 && D2>0) LongOutputSum = (long double*) mxCalloc(D1*D3,sizeof(long double));
+#endif
     	if (POutputCount >= 2) {
 		POutput[1] = mxCreateNumericArray(ND2, SZ2, TYP, mxREAL);
 		LOutputCount = mxGetPr(POutput[1]);
+#ifdef SUMSKIPNAN_LONG_DOUBLE
 		if (D1!=1 && D2>0) LongOutputCount = (long double*) mxCalloc(D1*D3,sizeof(long double));
+#endif
     	}
     	if (POutputCount >= 3) {
 		POutput[2] = mxCreateNumericArray(ND2, SZ2, TYP, mxREAL);
         	LOutputSum2  = mxGetPr(POutput[2]);
+#ifdef SUMSKIPNAN_LONG_DOUBLE
 		if (D1!=1 && D2>0) LongOutputSum2 = (long double*) mxCalloc(D1*D3,sizeof(long double));
+#endif
     	}
 	mxFree(SZ2);
 
 
 	if (D1*D2*D3<1) // zero size array
 		; 	// do nothing 
-	else if ((D1==1) && (ACC_LEVEL<1)) {
+	else if ((D1==1) && (ACC_LEVEL<1) && LInput) {
 		// double accuray, naive summation, error = N*2^-52 
 		switch (POutputCount) {
 		case 1: 
@@ -212,7 +229,8 @@ void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const m
 			break;
 		}
 	}
-	else if ((D1==1) && (ACC_LEVEL==1)) {
+#ifdef SUMSKIPNAN_LONG_DOUBLE
+	else if ((D1==1) && (ACC_LEVEL==1) && LInput) {
 		// extended accuray, naive summation, error = N*2^-64 
 		switch (POutputCount) {
 		case 1: 
@@ -236,7 +254,7 @@ void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const m
 			break;
 		}
 	}
-	else if ((D1==1) && (ACC_LEVEL==3)) {
+	else if ((D1==1) && (ACC_LEVEL==3) && LInput) {
 		// ACC_LEVEL==3: extended accuracy and Kahan Summation, error = 2^-64
 		switch (POutputCount) {
 		case 1: 
@@ -260,7 +278,8 @@ void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const m
 			break;
 		}
 	}
-	else if ((D1==1) && (ACC_LEVEL==2)) {
+#endif
+	else if ((D1==1) && (ACC_LEVEL==2) && LInput) {
 		// ACC_LEVEL==2: double accuracy and Kahan Summation, error = 2^-52
 		switch (POutputCount) {
 		case 1: 
@@ -284,11 +303,25 @@ void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const m
 			break;
 		}
 	}
-	else if (POutputCount <= 1) {
+	else if (D1==1) {
+		// double-double accumulation, error = 2^-104 (ACC_LEVEL 1 and 3, and single precision data)
+		#pragma omp parallel for schedule(dynamic)
+		for (l = 0; l<D3; l++) {
+			double count; 
+			double *s2 = (POutputCount >= 3) ? LOutputSum2+l : NULL;
+			double *No = (POutputCount >= 2) ? LOutputCount+l : &count;
+			if (LInput) 
+				__sumskipnan_dd__(LInput+l*D2, D2, LOutputSum+l, s2, No, &flag_isNaN, W);
+			else 
+				__sumskipnan_dd__(FInput+l*D2, D2, LOutputSum+l, s2, No, &flag_isNaN, W);
+		}
+	}
+#ifdef SUMSKIPNAN_LONG_DOUBLE
+	else if ((POutputCount <= 1) && LInput) {
+		mwSize ix0, ix2;	// index to output
 		// OUTER LOOP: along dimensions > DIM
  		for (l = 0; l<D3; l++) {
 			ix0 = l*D1; 	// index for output
-			ix1 = ix0*D2;	// index for input 
 			for (j=0; j<D2; j++) {
 				// minimize cache misses 
 				ix2 =   ix0;	// index for output 
@@ -326,11 +359,11 @@ void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const m
                	}		
 	}
 
-	else if (POutputCount == 2) {
+	else if ((POutputCount == 2) && LInput) {
+		mwSize ix0, ix2;	// index to output
 		// OUTER LOOP: along dimensions > DIM
 		for (l = 0; l<D3; l++) {
 			ix0 = l*D1; 
-			ix1 = ix0*D2;	// index for input 
 			for (j=0; j<D2; j++) {
 				// minimize cache misses 
 				ix2 =   ix0;	// index for output 
@@ -371,11 +404,11 @@ void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const m
                	}		
 	}
 
-	else if (POutputCount == 3) {
+	else if ((POutputCount == 3) && LInput) {
+		mwSize ix0, ix2;	// index to output
 		// OUTER LOOP: along dimensions > DIM
 		for (l = 0; l<D3; l++) {
 			ix0 = l*D1; 
-			ix1 = ix0*D2;	// index for input 
 			for (j=0; j<D2; j++) {
 				// minimize cache misses 
 				ix2 =   ix0;	// index for output 
@@ -419,6 +452,23 @@ void mexFunction(int POutputCount,  mxArray* POutput[], int PInputCount, const m
 			}
                	}		
 	}
+#endif
+	else {
+		// stride > 1: double-double accumulation, the LOutput* arrays keep the high parts
+		double *tmp = (double*) mxCalloc(5*D1*D3, sizeof(double));
+		double *Se = tmp, *N = tmp + D1*D3, *Ne = tmp + 2*D1*D3, *S2e = tmp + 3*D1*D3;
+		#pragma omp parallel for schedule(dynamic)
+		for (l = 0; l<D3; l++) {
+			mwSize i0 = l*D1;
+			double *s2 = (POutputCount >= 3) ? LOutputSum2+i0 : NULL;
+			double *No = (POutputCount >= 2) ? LOutputCount+i0 : N+i0;
+			if (LInput) 
+				__sumskipnan_dd_stride__(LInput+i0*D2, D1, D2, LOutputSum+i0, Se+i0, s2, S2e+i0, No, Ne+i0, &flag_isNaN, W);
+			else 
+				__sumskipnan_dd_stride__(FInput+i0*D2, D1, D2, LOutputSum+i0, Se+i0, s2, S2e+i0, No, Ne+i0, &flag_isNaN, W);
+		}
+		mxFree(tmp);
+	}
 
 	if (LongOutputSum) mxFree(LongOutputSum);
 	if (LongOutputCount) mxFree(LongOutputCount);
@@ -519,7 +569,7 @@ inline int __sumskipnan2w__(double *data, size_t Ni, double *s, double *No, char
 	if (flag && (flag_anyISNAN != NULL)) *flag_anyISNAN = 1; 
 #endif
 	*s  = sum;
-
+	return 0;
 }
 
 
@@ -576,6 +626,7 @@ inline int __sumskipnan3w__(double *data, size_t Ni, double *s, double *s2, doub
 #endif
 	*s  = sum;
 	*s2 = msq; 
+	return 0;
 }
 
 inline int __sumskipnan2wr__(double *data, size_t Ni, double *s, double *No, char *flag_anyISNAN, double *W)
@@ -629,7 +680,7 @@ inline int __sumskipnan2wr__(double *data, size_t Ni, double *s, double *No, cha
 	if (flag && (flag_anyISNAN != NULL)) *flag_anyISNAN = 1; 
 #endif
 	*s  = sum;
-
+	return 0;
 }
 
 
@@ -686,6 +737,7 @@ inline int __sumskipnan3wr__(double *data, size_t Ni, double *s, double *s2, dou
 #endif
 	*s  = sum;
 	*s2 = msq; 
+	return 0;
 }
 
 
@@ -768,7 +820,7 @@ inline int __sumskipnan2we__(double *data, size_t Ni, double *s, double *No, cha
 	if (flag && (flag_anyISNAN != NULL)) *flag_anyISNAN = 1; 
 #endif
 	*s  = sum;
-
+	return 0;
 }
 
 
@@ -852,6 +904,7 @@ inline int __sumskipnan3we__(double *data, size_t Ni, double *s, double *s2, dou
 #endif
 	*s  = sum;
 	*s2 = msq; 
+	return 0;
 }
 
 inline int __sumskipnan2wer__(double *data, size_t Ni, double *s, double *No, char *flag_anyISNAN, double *W)
@@ -922,7 +975,7 @@ inline int __sumskipnan2wer__(double *data, size_t Ni, double *s, double *No, ch
 	if (flag && (flag_anyISNAN != NULL)) *flag_anyISNAN = 1; 
 #endif
 	*s  = sum;
-
+	return 0;
 }
 
 
@@ -1006,5 +1059,243 @@ inline int __sumskipnan3wer__(double *data, size_t Ni, double *s, double *s2, do
 #endif
 	*s  = sum;
 	*s2 = msq; 
+	return 0;
+}
+
+
+/***************************************
+	double-double accumulation [2]
+
+	Each sum is kept as an unevaluated pair hi+lo: hi is updated with 
+	the rounded sum and the exact rounding error of every addition 
+	(TwoSum) and of every product (TwoProduct) is accumulated in lo. 
+	The result is as accurate as if computed with twice the precision
+	of double, which is better than the 64-bit mantissa of long double. 
+	In contrast to long double, this vectorizes: the data is split into 
+	SSN_LANES interleaved lanes (element k goes into lane k%SSN_LANES), 
+	NaN's are masked instead of branched, and the lanes are combined at 
+	the end in a fixed order. The AVX2 kernel and the portable kernel 
+	do exactly the same operations, their results are bit-identical. 
+	Single precision data is converted to double, which is exact. 
+
+	[2] T. Ogita, S.M. Rump, S. Oishi, Accurate sum and dot product, 
+	SIAM J. Sci. Comput. 26(6):1955-1988, 2005. 
+ ****************************************/
+
+#define SSN_LANES 4
+
+typedef struct {
+	double s[SSN_LANES], se[SSN_LANES];	// sum 
+	double q[SSN_LANES], qe[SSN_LANES];	// sum of squares
+	double n[SSN_LANES], ne[SSN_LANES];	// count 
+	char   flag;
+} SSN_ACC;
+
+// s+e = a+b exactly 
+#define SSN_TWOSUM(a,b,s,e) { double _a = a, _b = b, _s = _a+_b, _z = _s-_a; \
+	e = (_a-(_s-_z))+(_b-_z); s = _s; }
+
+// rounding error of p=a*b 
+static inline double ssn_prod_err(double a, double b, double p) {
+#ifdef __FMA__
+	return fma(a, b, -p);
+#else
+	// Dekker's algorithm, does not rely on FMA 
+	const double c = 134217729.0;	// 2^27+1
+	double t, ah, al, bh, bl;
+	t = c*a; ah = t-(t-a); al = a-ah;
+	t = c*b; bh = t-(t-b); bl = b-bh;
+	return (((ah*bh-p) + ah*bl) + al*bh) + al*bl;
+#endif
+}
+
+static void ssn_acc_init(SSN_ACC *acc) {
+	memset(acc, 0, sizeof(SSN_ACC));
+}
+
+// combine lanes and the compensation terms
+static double ssn_acc_reduce(const double *hi, const double *lo) {
+	double s = hi[0], e = lo[0], t;
+	for (int l = 1; l < SSN_LANES; l++) {
+		SSN_TWOSUM(s, hi[l], s, t);
+		e += t + lo[l];
+	}
+	return s + e;
+}
+
+template <class T> 
+static void ssn_acc_portable(const T *data, size_t k, size_t Ni, const double *W, SSN_ACC *acc, int SSQ) {
+	for (; k < Ni; k++) {
+		int l = k % SSN_LANES;
+		double x = data[k], p, ep, e;
+		if (isnan(x)) {
+			acc->flag = 1;
+			continue;
+		}
+		if (W) {
+			double w = W[k];
+			SSN_TWOSUM(acc->n[l], w, acc->n[l], e);
+			acc->ne[l] += e;
+			p  = w*x;
+			ep = ssn_prod_err(w, x, p);
+		} else {
+			acc->n[l] += 1.0;
+			p  = x;
+			ep = 0.0;
+		}
+		SSN_TWOSUM(acc->s[l], p, acc->s[l], e);
+		acc->se[l] += e + ep;
+		if (SSQ) {
+			double q = p*x;
+			double eq = ssn_prod_err(p, x, q) + ep*x;
+			SSN_TWOSUM(acc->q[l], q, acc->q[l], e);
+			acc->qe[l] += e + eq;
+		}
+	}
+}
+
+#if defined(__x86_64__) && (defined(__clang__) || (defined(__GNUC__) && (__GNUC__*100+__GNUC_MINOR__ >= 409)))
+#define WITH_SSN_AVX2
+#include <immintrin.h>
+
+__attribute__((target("avx2,fma"))) 
+static inline __m256d ssn_load4(const double *p, __m256i m) { return _mm256_maskload_pd(p, m); }
+
+__attribute__((target("avx2,fma"))) 
+static inline __m256d ssn_load4(const float *p, __m256i m) { 
+	// 64-bit lane mask to 32-bit lane mask 
+	m = _mm256_permutevar8x32_epi32(m, _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0));
+	return _mm256_cvtps_pd(_mm_maskload_ps(p, _mm256_castsi256_si128(m)));
+}
+
+#define SSN_TWOSUM4(a,b,s,e) { __m256d _a = a, _b = b, _s = _mm256_add_pd(_a,_b), _z = _mm256_sub_pd(_s,_a); \
+	e = _mm256_add_pd(_mm256_sub_pd(_a,_mm256_sub_pd(_s,_z)), _mm256_sub_pd(_b,_z)); s = _s; }
+
+/* 
+	AVX2 version of ssn_acc_portable: SSN_LANES elements per step, 
+	the last step is partial. NaN's and elements beyond Ni are masked, 
+	they contribute exact zeros to all sums. 
+ */
+template <class T> 
+__attribute__((target("avx2,fma"))) 
+static void ssn_acc_avx2(const T *data, size_t Ni, const double *W, SSN_ACC *acc, int SSQ) {
+	__m256d s  = _mm256_loadu_pd(acc->s),  se = _mm256_loadu_pd(acc->se);
+	__m256d q  = _mm256_loadu_pd(acc->q),  qe = _mm256_loadu_pd(acc->qe);
+	__m256d n  = _mm256_loadu_pd(acc->n),  ne = _mm256_loadu_pd(acc->ne);
+	__m256d one = _mm256_set1_pd(1.0);
+	__m256i nanmask = _mm256_setzero_si256();
+	const __m256i lane = _mm256_setr_epi64x(0, 1, 2, 3);
+	size_t k;
+
+	for (k = 0; k < Ni; k += SSN_LANES) {
+		// all lanes are valid except in the last, partial step 
+		__m256i m = _mm256_cmpgt_epi64(_mm256_set1_epi64x((long long)(Ni-k)), lane);
+		__m256d x = ssn_load4(data + k, m);
+		__m256d valid = _mm256_and_pd(_mm256_castsi256_pd(m), _mm256_cmp_pd(x, x, _CMP_ORD_Q));
+		__m256d p, ep, e;
+		nanmask = _mm256_or_si256(nanmask, _mm256_andnot_si256(_mm256_castpd_si256(valid), m));
+		if (W) {
+			__m256d w = _mm256_and_pd(valid, _mm256_maskload_pd(W + k, m));
+			SSN_TWOSUM4(n, w, n, e);
+			ne = _mm256_add_pd(ne, e);
+			p  = _mm256_mul_pd(w, x);
+			ep = _mm256_and_pd(valid, _mm256_fmsub_pd(w, x, p));
+			p  = _mm256_and_pd(valid, p);
+		} else {
+			n  = _mm256_add_pd(n, _mm256_and_pd(valid, one));
+			p  = _mm256_and_pd(valid, x);
+			ep = _mm256_setzero_pd();
+		}
+		SSN_TWOSUM4(s, p, s, e);
+		se = _mm256_add_pd(se, _mm256_add_pd(e, ep));
+		if (SSQ) {
+			__m256d xs = _mm256_and_pd(valid, x);
+			__m256d qq = _mm256_mul_pd(p, xs);
+			__m256d eq = _mm256_add_pd(_mm256_fmsub_pd(p, xs, qq), _mm256_mul_pd(ep, xs));
+			SSN_TWOSUM4(q, qq, q, e);
+			qe = _mm256_add_pd(qe, _mm256_add_pd(e, eq));
+		}
+	}
+	_mm256_storeu_pd(acc->s, s);  _mm256_storeu_pd(acc->se, se);
+	_mm256_storeu_pd(acc->q, q);  _mm256_storeu_pd(acc->qe, qe);
+	_mm256_storeu_pd(acc->n, n);  _mm256_storeu_pd(acc->ne, ne);
+	if (!_mm256_testz_si256(nanmask, nanmask)) acc->flag = 1;
+}
+#endif
+
+/* 
+	sum, count and (optionally) sum of squares of a column with stride 1
+ */
+template <class T> 
+inline int __sumskipnan_dd__(const T *data, size_t Ni, double *s, double *s2, double *No, char *flag_anyISNAN, const double *W)
+{
+	SSN_ACC acc;
+	ssn_acc_init(&acc);
+
+#ifdef WITH_SSN_AVX2
+	static int HAVE_AVX2 = -1;
+	if (HAVE_AVX2 < 0) HAVE_AVX2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	if (HAVE_AVX2)
+		ssn_acc_avx2(data, Ni, W, &acc, s2 != NULL);
+	else
+#endif
+		ssn_acc_portable(data, 0, Ni, W, &acc, s2 != NULL);
+
+#ifndef NO_FLAG
+	if (acc.flag && (flag_anyISNAN != NULL)) *flag_anyISNAN = 1;
+#endif
+	*s  = ssn_acc_reduce(acc.s, acc.se);
+	if (s2) *s2 = ssn_acc_reduce(acc.q, acc.qe);
+	*No = ssn_acc_reduce(acc.n, acc.ne);
+	return 0;
+}
+
+/* 
+	sum along a dimension with stride D1>1: the D1 sums of each block 
+	are independent, the inner loop over them is vectorized by the compiler. 
+	s, se, No (and s2, s2e, Ne if needed) point to D1 zero-initialized elements, 
+	the compensation terms se, s2e and Ne are added at the end. 
+ */
+template <class T> 
+inline int __sumskipnan_dd_stride__(const T *data, size_t D1, size_t D2, double *s, double *se, double *s2, double *s2e, double *No, double *Ne, char *flag_anyISNAN, const double *W)
+{
+	size_t j, k;
+	char flag = 0;
+	for (j = 0; j < D2; j++, data += D1) {
+		double w = W ? W[j] : 1.0;
+		for (k = 0; k < D1; k++) {
+			double x = data[k];
+			int valid = !isnan(x);
+			double wv = valid ? w : 0.0;
+			double p, ep, e;
+			flag |= !valid;
+			x  = valid ? x : 0.0;
+			if (W) {
+				SSN_TWOSUM(No[k], wv, No[k], e);
+				Ne[k] += e;
+			} 
+			else 
+				No[k] += valid;
+			p  = wv*x;
+			ep = W ? ssn_prod_err(wv, x, p) : 0.0;
+			SSN_TWOSUM(s[k], p, s[k], e);
+			se[k] += e + ep;
+			if (s2) {
+				double q = p*x;
+				double eq = ssn_prod_err(p, x, q) + ep*x;
+				SSN_TWOSUM(s2[k], q, s2[k], e);
+				s2e[k] += e + eq;
+			}
+		}
+	}
+#ifndef NO_FLAG
+	if (flag && (flag_anyISNAN != NULL)) *flag_anyISNAN = 1;
+#endif
+	for (k = 0; k < D1; k++) {
+		s[k] += se[k];
+		if (s2) s2[k] += s2e[k];
+		if (W)  No[k] += Ne[k];
+	}
+	return 0;
 }
 
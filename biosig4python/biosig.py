@@ -824,27 +824,28 @@ def sclose(HDR):
 	###########
 	#  SREAD  #
 	###########
-def sread(HDR, length = -1, start = 0):
-	"""input: HDR_TYPE HDR, int length, int start
+def sread(HDR, length = -1, start = 0, dtype = float64, out = None):
+	"""input: HDR_TYPE HDR, int length, int start, [dtype], [out]
 	output: array
 	Reads and returns data according to length and start.
 	length is the number of blocks to read. Use -1 to read all blocks until the end.
 	start is the block to begin reading with.
-	Use HDR.CHANNEL[k].OnOff to exclude single channels from reading."""
+	Use HDR.CHANNEL[k].OnOff to exclude single channels from reading.
+	dtype selects the output type: float64 (default) and float32 return
+	calibrated values, int16 returns the uncalibrated digital values
+	(saturated to the int16 range, use CHANNEL[k].Cal and .Off for scaling).
+	out is an optional preallocated array of at least (HDR.SPR*length, ns)
+	elements; its dtype takes precedence over dtype and no new data
+	block is allocated. The returned array is a view of out."""
 	
-	raw = ''			# const input string
 	channel = []			# const channels to read
 	ns = 0				# const number of signals to read
+	offset = []			# byte offset of each channel within a block
 	
-	i = 0				# index for writing in output matrix
-	bstart = 0			# start index (in bytes) of next value on the input string
-	bend = 0			# length (in bytes) of the next value on the input string and next bstart
-	row = 0				# row in output matrix
-	column = 0			# column in output matrix
-	ch = 0				# actual channel
-	value = 0			# actual value to insert into output matrix
-	
+	bstart = 0
 	for ch in range(HDR.NS):
+		offset.append(bstart)
+		bstart += HDR.CHANNEL[ch].bpr
 		if HDR.CHANNEL[ch].OnOff != 0:
 			channel.append(ch)
 	ns = len(channel)
@@ -857,75 +858,56 @@ def sread(HDR, length = -1, start = 0):
 		if length == -1:
 			length = HDR.NRec	# read all blocks
 		length = max(min(length, HDR.NRec - HDR.FILE.POS),0)		# number of blocks to read
-		HDR.data.block = numpy.ones((HDR.SPR * length,ns), float64) * NaN	# right sized output matrix filled with NaN's
-		raw = HDR.FILE.FID.read(HDR.AS.bpb * length)			# read input string from file
 		
-		for i in range(numpy.size(HDR.data.block)):
-			row = i / (ns * HDR.SPR) * HDR.SPR + i % HDR.SPR
-			column = (i / HDR.SPR) % ns
+		if out is None:
+			out = numpy.empty((HDR.SPR * length, ns), dtype)
+		elif out.shape[0] < HDR.SPR * length or out.shape[1] != ns:
+			raise __FATALERROR('Error SREAD: out must have at least %i rows and exactly %i columns' % (HDR.SPR * length, ns))
+		dtype = out.dtype
+		ucal = (HDR.FLAG.UCAL != 0) or (dtype == int16)
+		
+		# raw data as a (blocks x bytes per block) matrix, each channel is a column slice of it
+		raw = numpy.fromstring(HDR.FILE.FID.read(HDR.AS.bpb * length), uint8)
+		length = len(raw) / HDR.AS.bpb
+		raw = raw[:length * HDR.AS.bpb].reshape(length, HDR.AS.bpb)
+		
+		for column in range(ns):
 			ch = channel[column]
+			CH = HDR.CHANNEL[ch]
+			if CH.SPR == 0:
+				out[:HDR.SPR * length, column] = 0
+				continue
+			r = raw[:, offset[ch]:offset[ch] + CH.bpr]
 			
-			# OnOff calculations
-			# not all channels are being read and it's the first row in a block
-			if (ns != HDR.NS) and (row % HDR.SPR == 0):
-				# first channel is missing
-				if (column == 0) and (channel[0] != 0):
-					# first block -> take only the leading missing channels in account
-					# other blocks -> take trailing and leading missing channels in account
-					if i != 0:
-						# for all channels being left out between channel[-1] (last wanted channel) and HDR.NS (last possible channel)
-						for leftout in range(channel[-1] + 1, HDR.NS):
-							bstart += HDR.CHANNEL[leftout].bpr
-					# for all channels being left out between 0 and channel[column]
-					for leftout in range(ch):
-						bstart += HDR.CHANNEL[leftout].bpr
-				
-				# channels in between are missing
-				elif ch != channel[column - 1] + 1:
-					# for all channels being left out between channel[column - 1] and channel[column]
-					for leftout in range(channel[column - 1] + 1, ch):
-						bstart += HDR.CHANNEL[leftout].bpr
-			
-			
-			# reading from input string, calculating right value and inserting in output matrix
-			if (row * HDR.CHANNEL[ch].SPR) % HDR.SPR == 0:
-				# reading and calculating of value
-				# BDF
-				if HDR.CHANNEL[ch].GDFTYP == 255 + 24:
-					bend = bstart + 3
-					value = numpy.fromstring(raw[bstart:bend], uint8).tolist()
-					if value[2] >= 128:	# minus
-						value = value[0] + value[1] * 2**8 + (value[2] - 256) * 2**16
-					else:			# plus
-						value = value[0] + value[1] * 2**8 + value[2] * 2**16
-				# EDF, GDF
-				elif HDR.CHANNEL[ch].GDFTYP < 18:
-					bend = bstart + __GDFTYP_BYTE[HDR.CHANNEL[ch].GDFTYP]
-					value = numpy.fromstring(raw[bstart:bend], __GDFTYP_NAME[HDR.CHANNEL[ch].GDFTYP]).tolist()[0]
-					
-				else:
-					raise __FATALERROR('Error SREAD: datatype ' + HDR.CHANNEL[ch].GDFTYP + ' not supported!')
-					
-				# calculating new input string position
-				bstart = bend
-				
-				# overflow and saturation detection
-				if (HDR.FLAG.OVERFLOWDETECTION != 0) and ((value <= HDR.CHANNEL[ch].DigMin) or (value >= HDR.CHANNEL[ch].DigMax)):
-					value = NaN
-					
-				# calibration
-				elif HDR.FLAG.UCAL == 0:
-					value = value * HDR.CHANNEL[ch].Cal + HDR.CHANNEL[ch].Off
-
-				# inserting in output matrix
-				HDR.data.block[row, column] = value
+			# BDF
+			if CH.GDFTYP == 255 + 24:
+				r = r.reshape(length * CH.SPR, 3).astype(int32)
+				value = r[:,0] + (r[:,1] << 8) + (r[:,2] << 16)
+				value -= (value >= 2**23) * 2**24
+			# EDF, GDF
+			elif CH.GDFTYP < 18 and __GDFTYP_NAME[CH.GDFTYP] is not None:
+				value = numpy.ascontiguousarray(r).view(numpy.dtype(__GDFTYP_NAME[CH.GDFTYP]).newbyteorder('<')).ravel()
+			else:
+				raise __FATALERROR('Error SREAD: datatype ' + str(CH.GDFTYP) + ' not supported!')
 			
+			# samples of channels with a lower sampling rate are repeated
+			if CH.SPR != HDR.SPR:
+				value = value.repeat(HDR.SPR / CH.SPR)
 			
-			# inserting same value multiply times (HDR.CHANNEL[].SPR != HDR.SPR)
+			if dtype == int16:
+				x = value.clip(-2**15, 2**15 - 1).astype(int16)
 			else:
-				HDR.data.block[row, column] = value
-		
+				x = value.astype(dtype)
+				# calibration, computed in the output type
+				if not ucal:
+					x *= dtype.type(CH.Cal)
+					x += dtype.type(CH.Off)
+				# overflow and saturation detection
+				if HDR.FLAG.OVERFLOWDETECTION != 0:
+					x[(value <= CH.DigMin) | (value >= CH.DigMax)] = NaN
+			out[:HDR.SPR * length, column] = x
 		
+		HDR.data.block = out[:HDR.SPR * length]
 		HDR.data.size = HDR.data.block.shape
 		HDR.FILE.POS = HDR.FILE.POS + length
 	